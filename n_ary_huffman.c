@@ -176,16 +176,24 @@ http://cbloomrants.blogspot.com/2015/09/library-writing-realizations.html
 
 
 Currently this implementation
-never uses dynamic allocation.
-Or C99-style "variable-length arrays".
-(Except we do use "length, table[length]" in the parameter list of some functions).
+uses dynamic allocation in exactly one place:
+each compressor gets one "struct block_scratch",
+allocated once with calloc()
+(which ensures the new memory block is initialized)
+and then reused, block after block.
+Everything the Huffman path needs for one block --
+the node list, the sorted index, the length, encode and decode tables,
+and the input, compressed and decompressed text buffers --
+lives in that one arena,
+rather than in a few hundred KB of C99-style "variable-length arrays"
+on the stack of each call.
+(We do still use "length, table[length]" in the parameter list of some functions).
 So we never have to worry about
 garbage collection / memory fragmentation
 memory leakage / etc.
-If you do use dynamic allocation in the future,
+If you add more dynamic allocation in the future,
 consider continuing to avoid malloc()
-and instead using things like calloc()
-which ensure the new memory block is initialized.
+and instead using things like calloc().
 
 Currently
 * this implementation never uses "typedef"
@@ -301,11 +309,14 @@ on non-comment lines contain the compressed data.
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h> // for strtol(), calloc(), free(), qsort()
 #include <stdbool.h> // for bool, true, false
 #include <iso646.h> // for bitand, bitor, not, xor, etc.
 #include <assert.h> // for assert()
 #include <ctype.h> // for isprint()
 #include <limits.h> // for INT_MAX
+#include <stdint.h> // for uint32_t, uint64_t
+#include <time.h> // for clock(), timespec_get()
 
 #define COMPILE_TIME_ASSERT(pred) switch(0){case 0:case pred:;}
 /*
@@ -363,6 +374,61 @@ imin( int a, int b){
     return ((a<b)? a : b);
 }
 
+/*
+inspired by
+zbyszek
+https://stackoverflow.com/questions/994593/how-to-do-an-integer-log2-in-c/22418446#22418446
+*/
+static inline int
+log2i(int x) {
+    assert(x > 0);
+    // "...clz()" is for "int"
+    // "...clzl()" is for "long int".
+    return sizeof(int) * 8 - __builtin_clz(x) - 1;
+}
+
+/*
+Fixed sizes for the canonical Huffman decoder.
+convert_lengths_to_encode_table() already refuses
+codes of 16 or more digits.
+*/
+#define MAX_CODE_LENGTH (16)
+#define MAX_DECODE_SYMBOLS (4096)
+#define MAX_LOOKUP_ENTRIES (4096)
+// the interleaved "\nQ" layout (see compress_with_streams())
+#define HUFFMAN_STREAMS (4)
+
+/*
+Fixed sizes for the per-block scratch arena.
+FIXME: support arbitrary number of symbols.
+Each block must fit in a netstring of at most 2^15 bytes,
+even when it falls back to pass-through raw data,
+so BLOCK_SIZE leaves room for the netstring headers.
+*/
+#define MAX_LEAF_VALUE (258)
+/*
+The LZ77 front end (see compress_lz77())
+codes literals and match lengths in one alphabet,
+laid out as in DEFLATE
+(0..255 literals, 256 end-of-block, 257..285 match lengths),
+and match distances in a second alphabet.
+*/
+#define LZ_MAX_SYMBOL_VALUE (285)
+#define LZ_DISTANCE_SYMBOLS (30)
+/*
+The word-token mode (see compress_words())
+codes single bytes as 0..255,
+leaves 256..MAX_LEAF_VALUE unused as in the byte alphabet,
+and codes the words of its per-block dictionary after that.
+*/
+#define WORD_FIRST_SYMBOL (MAX_LEAF_VALUE + 1)
+#define WORD_DICTIONARY_SIZE (3800)
+#define WORD_MAX_SYMBOL_VALUE (WORD_FIRST_SYMBOL + WORD_DICTIONARY_SIZE - 1)
+// room for every leaf and every internal node of the largest alphabet
+#define HUFFMAN_LIST_LENGTH (2*(WORD_MAX_SYMBOL_VALUE+1))
+#define BLOCK_SIZE (32000)
+#define COMPRESSED_BLOCK_SIZE (BLOCK_SIZE + 100)
+
 
 /* base64url (RFC 4648) */
 /* used for binary Huffman
@@ -460,7 +526,8 @@ digit2int(char input_digit){
 // than 256 'char'.
 void
 histogram(
-    const char * text,
+    const int length,
+    const char text[length],
     const int max_symbol_value,
     int h[max_symbol_value+1] // output-only
 ){
@@ -474,19 +541,16 @@ histogram(
     for(int i=0; i<(max_symbol_value+1); i++){
         h[i] = 0;
     };
-    const unsigned char * c = (const unsigned char *) text;
     /*
-    Currently assumes there is no '\0' chars
-    in the text block.
+    Every byte is a normal symbol,
+    including '\0',
+    so the length comes from the caller
+    rather than from a terminating zero.
     */
-    while( *c ){
-        assert( 0 < *c );
-        assert( *c <= max_symbol_value );
-        if( 126 < *c ){
-            printf("# value above 126 near %s\n", c - 20);
-        };
-        h[*c]++;
-        c++;
+    const unsigned char * c = (const unsigned char *) text;
+    for(int i=0; i<length; i++){
+        assert( c[i] <= max_symbol_value );
+        h[c[i]]++;
     };
     // return h;
     assert( 0 == h[258] );
@@ -506,7 +570,6 @@ struct node{
     // only if leaf=true, i.e., this node is a leaf:
     int leaf_value;
     // FUTURE: make this a union?
-    // FIXME: int depth; // only used for length-limited Huffman
     int parent_index; // for trinary, decimal, etc. trees ?
     // The true parent index should never be 0,
     // since index 0 should always be a *literal* leaf,
@@ -528,15 +591,39 @@ struct node{
     // so the 1st node volume = sum( count( each leaf ) )
     // for general interior node:
     // volume = sum( count(each child) ) + sum( volume(each child) ).
+    // height of the subtree under this node:
+    // 0 for a leaf, 1 + the deepest child for an internal node.
+    // Breaks ties in count; see sorts_after().
+    int depth;
+};
+
+/*
+Which of two nodes with equal counts sorts first
+(and so is merged first).
+Only benchmark_tie_breaking() uses anything but SHALLOWER_FIRST.
+*/
+enum tie_break{
+    SHALLOWER_FIRST, // minimum-depth tree (see sorts_after())
+    OLDEST_FIRST, // whichever was made first
+    DEEPER_FIRST // maximum-depth tree
 };
 
+/*
+huffman() and its helpers narrate every step,
+which helps when following one tree by hand
+but swamps the time of anything that builds one;
+the benchmarks turn it off around their timed regions.
+*/
+static bool huffman_debug_output = true;
+#define DEBUG_PRINTF(...) do{ if( huffman_debug_output ){ printf( __VA_ARGS__ ); }; }while(0)
+
 void
 debug_print_node(struct node n, int index){
     char c = n.leaf_value;
     if(!isprint(c)){
         c = 0;
     };
-    printf("# %i { %i, count:%i, ... '%c', parent:%i }\n",
+    DEBUG_PRINTF("# %i { %i, count:%i, ... '%c', parent:%i }\n",
         index, n.leaf, n.count, c, n.parent_index
         );
 }
@@ -546,7 +633,7 @@ debug_print_node_list(
     const int list_length,
     const struct node list[list_length]
 ){
-    printf("# list_length: %i\n", list_length);
+    DEBUG_PRINTF("# list_length: %i\n", list_length);
     for(int i=0; i<list_length; i++){
         bool nonzero = (0 != list[i].count);
         bool nonleaf = !(list[i].leaf);
@@ -591,16 +678,22 @@ at both ends,
 and inserting the new "merged" node
 at the "best" end --
 the end that requires the least shuffling of other nodes.
-* FIXME: when merging,
-make sure
-(if there is an option -- sometimes there is no option)
+* When merging,
+if there is an option -- sometimes there is no option --
 we always
-pick the N that *minimizes*
-the longest Huffman code.
+pick the N that *minimize*
+the longest Huffman code:
+among nodes with equal counts,
+the shallower node sorts first
+(leaves before internal nodes,
+then internal nodes by the height of their subtree,
+then in the order the nodes were made,
+so the tree is the same on every machine).
+This is the "minimum variance" Huffman code.
 For example, if we have frequencies of
 1, 1, 2, 2,
 and if we have N=2 (binary Huffman),
-prefer to make the tree
+this makes the tree
             6
          /     \
         2       4
@@ -620,17 +713,12 @@ rather than
 *Both* of these trees
 can be converted to (different) canonical Huffman codes.
 Both of these trees give exactly the same
-total compressed bitlength compressed payload.
-I suspect (?) that
-the minimum-depth tree
-will make decompressing a little faster
-and
-perhaps (?)
-the minimum-depth tree
-will make the header
-(representing the canonical Huffman tree)
-at the beginning of the compressed block
-a little shorter.
+total compressed bitlength compressed payload,
+but the minimum-depth tree
+puts more of the symbols
+within reach of a single table lookup
+in the decoder
+(see benchmark_tie_breaking()).
 * Rather than a linear list, perhaps a priority heap?
 https://en.wikipedia.org/wiki/Partial_sorting
 * FUTURE: some faster sorted queue implementation?
@@ -646,28 +734,67 @@ print_counts(
 ){
     for(int i=min_active_node; i<(max_node+1); i++){
         int count_one = list[ sorted_index[ i ] ].count;
-        printf("# %i\n", count_one);
+        DEBUG_PRINTF("# %i\n", count_one);
     };
 }
+/*
+Does list[one] belong after list[two] in sorted order?
+Smaller counts first;
+equal counts: by depth.
+(Equal depths too: no, so the sort is stable.)
+*/
 static
 bool
-swap_if_necessary(
+sorts_after(
+    const struct node list[], // input-only
+    const enum tie_break ties,
+    const int one,
+    const int two
+){
+    int count_one = list[ one ].count;
+    int count_two = list[ two ].count;
+    const int depth_one = list[ one ].depth;
+    const int depth_two = list[ two ].depth;
+    const bool tie_swap = (count_two == count_one) and (
+        ((SHALLOWER_FIRST == ties) and (depth_two < depth_one)) or
+        ((DEEPER_FIRST == ties) and (depth_one < depth_two)) );
+    return (count_two < count_one) or tie_swap;
+}
+/*
+Move the node at sorted_index[max_node]
+into place among the already-sorted nodes
+min_active_node .. max_node-1:
+just in front of the first of them that sorts after it.
+Since they are sorted, a binary search finds that spot,
+and the nodes from there on shift back by one.
+generate_huffman_tree() uses this directly
+for each new internal node,
+so a merge costs a handful of comparisons rather than a full sort.
+*/
+static
+void
+insert_last_node(
     const int list_length,
     int sorted_index[list_length], // modified
     struct node list[list_length], // input-only
-    const int left,
-    const int right
+    const enum tie_break ties,
+    const int min_active_node,
+    const int max_node
 ){
-    int count_one = list[ sorted_index[ left  ] ].count;
-    int count_two = list[ sorted_index[ right ] ].count;
-    if( count_two < count_one ){
-        int c = sorted_index[ left ];
-        int d = sorted_index[ right ];
-        sorted_index[ left ] = d;
-        sorted_index[ right ] = c;
-        return true;
+    const int last = sorted_index[ max_node ];
+    int low = min_active_node;
+    int high = max_node;
+    while( low < high ){
+        const int middle = low + (high - low)/2;
+        if( sorts_after( list, ties, sorted_index[ middle ], last ) ){
+            high = middle;
+        }else{
+            low = middle + 1;
+        };
     };
-    return false;
+    memmove( &sorted_index[ low+1 ], &sorted_index[ low ],
+        (max_node - low) * sizeof( sorted_index[0] ) );
+    sorted_index[ low ] = last;
 }
 static
 void
@@ -675,6 +802,7 @@ partial_sort(
     const int list_length,
     int sorted_index[list_length], // modified
     struct node list[list_length], // input-only
+    const enum tie_break ties,
     const int min_active_node,
     const int max_node
 ){
@@ -696,38 +824,33 @@ partial_sort(
         max_node
     );
     */
-    printf("# sorting %i items...\n", max_node - min_active_node + 1);
+    DEBUG_PRINTF("# sorting %i items...\n", max_node - min_active_node + 1);
     assert( min_active_node < list_length );
     assert( min_active_node < max_node );
-    int total_swapped = 0;
-    do{
-        total_swapped = 0;
-        for(int i=(max_node-1); i>=(min_active_node); i--){
-            bool swapped = swap_if_necessary(
-                list_length,
-                sorted_index,
-                list,
-                i,
-                i+1
-            );
-            total_swapped += swapped;
-        };
-        /*
-        if(total_swapped){
-            printf("# found %i out-of-order; rescanning...",
-                total_swapped
-            );
-        };
-        */
-    }while(total_swapped);
-    print_counts(
-        list_length,
-        sorted_index,
-        list,
-        min_active_node,
-        max_node
-    );
-    printf("# ... sorted.\n");
+    // Insertion sort: the same stable order
+    // repeated bubble passes reach, in a fraction of the comparisons.
+    for(int i=(min_active_node+1); i<=max_node; i++){
+        insert_last_node(
+            list_length,
+            sorted_index,
+            list,
+            ties,
+            min_active_node,
+            i
+        );
+    };
+    // a dump of the thousands of word-token symbols swamps the rest,
+    // so only dump the counts of the byte-sized alphabets.
+    if( list_length <= 2*(LZ_MAX_SYMBOL_VALUE+1) ){
+        print_counts(
+            list_length,
+            sorted_index,
+            list,
+            min_active_node,
+            max_node
+        );
+    };
+    DEBUG_PRINTF("# ... sorted.\n");
 }
 
 /*
@@ -778,12 +901,15 @@ setup_nodes(
     const int max_leaf_value,
     const int symbol_frequencies[max_leaf_value+1]
 ){
-    printf("# starting setup_nodes.\n");
-    printf("# list_length:%i\n", list_length);
-    printf("# max_leaf_value:%i\n", max_leaf_value );
+    DEBUG_PRINTF("# starting setup_nodes.\n");
+    DEBUG_PRINTF("# list_length:%i\n", list_length);
+    DEBUG_PRINTF("# max_leaf_value:%i\n", max_leaf_value );
     // initialize the leaf nodes
     // (typically including the 256 possible literal byte values)
-    assert( 0 == symbol_frequencies[258] );
+    const bool byte_alphabet = (MAX_LEAF_VALUE == max_leaf_value);
+    if( byte_alphabet ){
+        assert( 0 == symbol_frequencies[258] );
+    };
     assert( (max_leaf_value+1) < list_length );
     for( int i=0; i<(max_leaf_value+1); i++){
         list[i].leaf = true;
@@ -796,6 +922,7 @@ setup_nodes(
         // zero out stuff that only applies to non-leaves
         list[i].left_index = 0;
         list[i].right_index = 0;
+        list[i].depth = 0;
     };
     for( int i=max_leaf_value+1; i<list_length; i++){
         list[i].leaf = false;
@@ -804,16 +931,19 @@ setup_nodes(
         list[i].right_index = 0; // will be filled in later
         list[i].parent_index = 0; // will be filled in later
         list[i].count = 0; // will be filled in later by the algorithm
+        list[i].depth = 0; // will be filled in later by the algorithm
         // zero out stuff that only applies to leaves
         list[i].leaf_value = 0;
     };
-    printf("# Done setup_nodes.\n");
+    DEBUG_PRINTF("# Done setup_nodes.\n");
     assert( true == list[max_leaf_value].leaf );
     assert( false == list[max_leaf_value+1].leaf );
-    assert(0 == list[259].count );
     debug_print_node_list(list_length, list);
-    assert( 0 == list[258].count );
-    assert( 0 == list[300].count );
+    if( byte_alphabet ){
+        assert(0 == list[259].count );
+        assert( 0 == list[258].count );
+        assert( 0 == list[300].count );
+    };
 }
 
 /*
@@ -870,12 +1000,18 @@ generate_huffman_tree(
     // const int text_symbols,
     const int list_length,
     struct node list[list_length], // in-out: updated
+    int sorted_index[list_length], // scratch
     const int compressed_symbols, // 3 for trinary
-    const int max_leaf_value
+    const int max_leaf_value,
+    const enum tie_break ties
 ){
-    assert( 0 == list[0].count ); // FIXME: can't handle NULL bytes yet.
-    assert( 0 == list[258].count );
-    assert(0 == list[259].count );
+    // the byte alphabet never uses symbol 258
+    // (the LZ77 alphabet does).
+    const bool byte_alphabet = (MAX_LEAF_VALUE == max_leaf_value);
+    if( byte_alphabet ){
+        assert( 0 == list[258].count );
+        assert(0 == list[259].count );
+    };
     // count out zero-frequency symbols
     int nonzero_text_symbols = 0;
     for( int i=0; i<(max_leaf_value+1); i++ ){
@@ -884,69 +1020,110 @@ generate_huffman_tree(
             nonzero_text_symbols++ ;
         };
     };
-    printf("# found %i unique symbols actually used.\n", nonzero_text_symbols);
-    // FIXME: squeeze out zero-frequency symbols?
-
-    // setup internal sorted_index
-    int sorted_index[list_length];
+    DEBUG_PRINTF("# found %i unique symbols actually used.\n", nonzero_text_symbols);
+
+    // setup internal sorted_index,
+    // with the zero-frequency symbols squeezed out to the front
+    // (in order, so the sort below still sees the same order
+    // a stable sort would have given them).
+    // Sorting them out of the way one at a time
+    // is quadratic in the alphabet size,
+    // and most of the word-token alphabet is unused in any one block.
     assert( max_leaf_value < list_length );
+    int zero_text_symbols = 0;
+    int next_nonzero = (max_leaf_value+1) - nonzero_text_symbols;
     for( int i=0; i<(max_leaf_value+1); i++){
-        sorted_index[i] = i;
+        if( 0 == list[ i ].count ){
+            sorted_index[zero_text_symbols++] = i;
+        }else{
+            sorted_index[next_nonzero++] = i;
+        };
     };
+    assert( next_nonzero == (max_leaf_value+1) );
     for( int i=(max_leaf_value+1); i<list_length; i++){
         sorted_index[i] = i;
     };
 
+    if( 0 == nonzero_text_symbols ){
+        // empty block: no tree at all,
+        // every length stays zero.
+        DEBUG_PRINTF("# no symbols, no tree.\n");
+        return;
+    };
+
+    // The modulo at the end
+    // keeps this at 0 (rather than compressed_symbols - 1)
+    // when no dummy nodes are needed.
     int dummy_nodes =
-        (compressed_symbols - 1) -
+        ((compressed_symbols - 1) -
         ((nonzero_text_symbols - 1) %
-        (compressed_symbols - 1));
-    
-    printf("# %d : compressed symbols\n", compressed_symbols );
+        (compressed_symbols - 1))) %
+        (compressed_symbols - 1);
+    if( 1 == nonzero_text_symbols ){
+        // Special case:
+        // a block that repeats one symbol over and over
+        // still needs a 1-digit code for that symbol,
+        // so the root gets that one real child
+        // and (compressed_symbols - 1) dummy children.
+        dummy_nodes = compressed_symbols - 1;
+    };
+
+    DEBUG_PRINTF("# %d : compressed symbols\n", compressed_symbols );
     if( 2 == compressed_symbols ){
         //binary
-        assert( 0 == dummy_nodes );
+        assert( (0 == dummy_nodes) or (1 == nonzero_text_symbols) );
     };
-    if( 3 == compressed_symbols ){
+    if( (3 == compressed_symbols) and (1 < nonzero_text_symbols) ){
         //trinary
         const int expected_dummy = 1 - (nonzero_text_symbols & 1);
-        printf("nonzero_text_symbols: %i\n", nonzero_text_symbols);
-        printf("compressed_symbols: %i\n", compressed_symbols);
-        printf("dummy_nodes: %i\n", dummy_nodes);
+        DEBUG_PRINTF("nonzero_text_symbols: %i\n", nonzero_text_symbols);
+        DEBUG_PRINTF("compressed_symbols: %i\n", compressed_symbols);
+        DEBUG_PRINTF("dummy_nodes: %i\n", dummy_nodes);
         assert( expected_dummy == dummy_nodes );
     };
-    assert( dummy_nodes < (compressed_symbols - 1) );
-    printf("# using %i dummy nodes.\n", dummy_nodes);
-    printf("# max_leaf_value: %i\n", max_leaf_value);
-    for(int i=(max_leaf_value+1); i<(max_leaf_value + 1 + dummy_nodes); i++){
-        sorted_index[i] = i;
-        list[i].count = 1; // minimum count for dummy nodes.
-        // FUTURE: perhaps
-        // force dummy nodes have a nonzero count
-        // far *less* than any real node,
-        // perhaps by scaling all the real node counts
-        // by 2 or 3 or 10 or so.
-    };
-    assert(1 == list[259].count ); // dummy node
-    assert( 1 == ((nonzero_text_symbols + dummy_nodes) % (compressed_symbols - 1)) );
-    // ZQ
+    assert( (dummy_nodes < (compressed_symbols - 1)) or (1 == nonzero_text_symbols) );
+    DEBUG_PRINTF("# using %i dummy nodes.\n", dummy_nodes);
+    DEBUG_PRINTF("# max_leaf_value: %i\n", max_leaf_value);
+    /*
+    Rather than adding dummy leaves with some made-up count
+    (which may tie with, and sort after, real leaves,
+    leaving a dummy *shallower* than some real leaf),
+    the dummy nodes are simply missing children
+    of the very first internal node we build.
+    That first node always merges the least-frequent symbols,
+    so the unused codewords end up among the longest codes,
+    exactly where convert_lengths_to_encode_table() expects them.
+    */
+    assert( 0 == ((nonzero_text_symbols + dummy_nodes - 1) % (compressed_symbols - 1)) );
 
     int min_active_node = 0;
     // when leaves are "merged" together to some internal node,
     // list[n] will be that internal node.
-    int max_active_node = max_leaf_value + dummy_nodes;
-    assert( 0 == list[258].count );
+    int max_active_node = max_leaf_value;
+    if( 1 == nonzero_text_symbols ){
+        // find the only symbol used, give it a parent, done.
+        const int n = max_active_node+1;
+        for(int i=0; i<(max_leaf_value+1); i++){
+            if( 0 != list[i].count ){
+                list[i].parent_index = n;
+                list[n].count = list[i].count;
+                list[n].left_index = i;
+            };
+        };
+        DEBUG_PRINTF("# finished single-symbol tree.\n");
+        return;
+    };
     /*
     debug_print_node_list(list_length, list);
     */
     // squeeze out zero values
     do{
-        printf("# squeezing out zero counts.\n");
+        DEBUG_PRINTF("# squeezing out zero counts.\n");
         while( 0 == list[sorted_index[min_active_node]].count ){
             min_active_node++;
         };
         partial_sort(
-            list_length, sorted_index, list,
+            list_length, sorted_index, list, ties,
             min_active_node,
             max_active_node
         );
@@ -955,20 +1132,23 @@ generate_huffman_tree(
     for(int i=min_active_node; i<(max_active_node+1); i++){
         assert( 0 != list[sorted_index[i]].count );
     };
-    printf("# No more zero counts.\n");
+    DEBUG_PRINTF("# No more zero counts.\n");
     /*
     debug_print_node_list(list_length, list);
     */
+    // only the first merge is short of children
+    int children = compressed_symbols - dummy_nodes;
     while( min_active_node < max_active_node ){
         const int n = max_active_node+1;
-        printf("# n=%i\n", n);
+        DEBUG_PRINTF("# n=%i\n", n);
         assert(0 == list[n].count);
         assert( n < list_length );
         // find the lowest-frequency (other than 0) nodes,
         // merge together to produce a non-leaf internal node.
         // Repeat until only one node.
-        partial_sort(
-            list_length, sorted_index, list,
+        // Everything but the last merge's node is still in order.
+        insert_last_node(
+            list_length, sorted_index, list, ties,
             min_active_node,
             max_active_node
         );
@@ -979,28 +1159,32 @@ generate_huffman_tree(
             list[n].right_index = sorted_index[min_active_node+1];
         };
         int parent_count = 0;
-        for(int i=0; i<compressed_symbols; i++){
+        int parent_depth = 0;
+        for(int i=0; i<children; i++){
             int child_i = sorted_index[min_active_node];
             if( 0 == list[child_i].count ){
                 /*
                 debug_print_node_list(list_length, list);
                 */
                 for(int j=min_active_node; j<=max_active_node; j++){
-                    printf("# odd: %i, %i\n", list[sorted_index[j]].count, sorted_index[j]);
+                    DEBUG_PRINTF("# odd: %i, %i\n", list[sorted_index[j]].count, sorted_index[j]);
                 };
             };
             assert( 0 != list[child_i].count );
             list[child_i].parent_index = n;
             parent_count += list[child_i].count;
+            parent_depth = imax( parent_depth, list[child_i].depth + 1 );
             min_active_node++;
         };
         list[n].count = parent_count;
+        list[n].depth = parent_depth;
         assert(0 != list[n].count);
         assert( n == sorted_index[n]);
         max_active_node++;
         assert( n == max_active_node );
+        children = compressed_symbols;
     };
-    printf("# finished tree.\n");
+    DEBUG_PRINTF("# finished tree.\n");
     assert( min_active_node == max_active_node );
 }
 
@@ -1053,7 +1237,7 @@ summarize_tree_with_lengths(
     // should immediately follow.
     // There may be a few dummy unused nodes (0 == list[x].count)
     // at the end of the list[].
-    printf( "# leaves: %i\n", leaves);
+    DEBUG_PRINTF( "# leaves: %i\n", leaves);
     assert( list_length > leaves );
     assert( false == list[leaves].leaf );
     for( int i=0; i<leaves; i++){
@@ -1089,7 +1273,7 @@ summarize_tree_with_lengths(
         assert( leaf_value <= max_leaf_value );
         lengths[leaf_value] = sum;
     };
-    printf("# finished summary.\n");
+    DEBUG_PRINTF("# finished summary.\n");
 }
 
 void
@@ -1117,9 +1301,9 @@ void test_summarize_tree_with_lengths(void){
 #define text_symbols_doubled (6)
     const int text_symbols = (text_symbols_doubled) / 2;
     struct node list_a[text_symbols_doubled] = {
-        { true, 9, 0, 0, 'a', 2, 0 },
-        { true, 9, 0, 0, 'b', 2, 0 },
-        { false, 4, 0, 1, 0, 0, 0 }
+        { true, 9, 0, 0, 'a', 2, 0, 0 },
+        { true, 9, 0, 0, 'b', 2, 0, 0 },
+        { false, 4, 0, 1, 0, 0, 0, 1 }
     };
     int leaves = 2;
     int max_leaf_value = 'z';
@@ -1134,11 +1318,11 @@ void test_summarize_tree_with_lengths(void){
 
 #define list_b_length (5)
     struct node list_b[list_b_length] = {
-        { true, 9, 0, 0, 'a', 4, 0 },
-        { true, 9, 0, 0, 'b', 3, 0 },
-        { true, 8, 0, 0, 'c', 3, 0 },
-        { false, 17, 1, 2, 0, 4, 0 },
-        { false, 26, 0, 3, 0, 0, 0 }
+        { true, 9, 0, 0, 'a', 4, 0, 0 },
+        { true, 9, 0, 0, 'b', 3, 0, 0 },
+        { true, 8, 0, 0, 'c', 3, 0, 0 },
+        { false, 17, 1, 2, 0, 4, 0, 1 },
+        { false, 26, 0, 3, 0, 0, 0, 2 }
     };
     leaves = 3;
     max_leaf_value = 'z';
@@ -1153,6 +1337,19 @@ void test_summarize_tree_with_lengths(void){
     printf("# Done with list_b test.\n");
 }
 
+/*
+The tree that huffman() builds and then throws away,
+kept in one place so it can be reused
+block after block.
+*/
+struct huffman_scratch{
+    // list of both leaf and internal nodes
+    struct node list[HUFFMAN_LIST_LENGTH];
+    int sorted_index[HUFFMAN_LIST_LENGTH];
+    // SHALLOWER_FIRST (0), except in benchmark_tie_breaking().
+    enum tie_break ties;
+};
+
 /*
 Given a histogram of symbol frequencies,
 generate the optimal length for each symbol
@@ -1160,23 +1357,26 @@ using the Huffman algorithm.
 */
 void
 huffman(
+    struct huffman_scratch * scratch,
     const int max_leaf_value,
     const int symbol_frequencies[max_leaf_value+1],
     const int compressed_symbols,
     int lengths[max_leaf_value+1]
 ){
-    const int list_length = (2*max_leaf_value);
+    // every leaf, plus at most one fewer internal nodes.
+    const int list_length = (2*(max_leaf_value+1));
     assert(1 < compressed_symbols);
+    assert( list_length <= HUFFMAN_LIST_LENGTH );
     /*
     I wish
     node list[text_symbols] = {0}; // list of both leaf and internal nodes
-    int sorted_index[2*text_symbols] = {0};
     zeroed out the array,
     but instead the compiler tells me
     "error: variable-sized object may not be initialized".
+    So setup_nodes() initializes every node we use,
+    and the scratch arena can be reused without clearing it.
     */
-    struct node list[list_length];
-    // int sorted_index[max_leaf_value_doubled];
+    struct node * list = scratch->list;
 
     setup_nodes(
         list_length, list,
@@ -1184,27 +1384,26 @@ huffman(
         max_leaf_value,
         symbol_frequencies
     );
-    assert(0 == list[259].count );
     /*
-    printf("# after initial setup_nodes: \n");
+    DEBUG_PRINTF("# after initial setup_nodes: \n");
     debug_print_node_list(
         list_length, list
     );
     */
 
-    assert( 0 == list[258].count );
     generate_huffman_tree(
         list_length,
         list,
-        // sorted_index,
+        scratch->sorted_index,
         compressed_symbols,
-        max_leaf_value
+        max_leaf_value,
+        scratch->ties
     );
 
-    printf("# summarizing tree...\n");
-    printf("# max_leaf_value: %i\n", max_leaf_value);
+    DEBUG_PRINTF("# summarizing tree...\n");
+    DEBUG_PRINTF("# max_leaf_value: %i\n", max_leaf_value);
     summarize_tree_with_lengths( list_length, list, max_leaf_value, lengths, max_leaf_value+1 );
-    printf("# discarding tree, keeping only lengths.\n");
+    DEBUG_PRINTF("# discarding tree, keeping only lengths.\n");
 }
 
 /*
@@ -1269,9 +1468,6 @@ load_more_text(FILE * in, const size_t bufsize, char * buffer){
         // read all bufsize characters successfully;
         // there's probably more characters later.
         printf("# successful full-buffer read\n");
-        // Append a zero
-        // to convert this to a valid C string.
-        buffer[ret_code] = '\0';
         return ret_code;
     };
 
@@ -1279,9 +1475,6 @@ load_more_text(FILE * in, const size_t bufsize, char * buffer){
     if( feof(in) ){
         // hit end of file.
         printf("# successful part-buffer read (end-of-file)\n");
-        // Append a zero
-        // to convert this to a valid C string.
-        buffer[ret_code] = '\0';
         return ret_code;
 
     }else if( ferror(in) ){
@@ -1378,6 +1571,34 @@ int array_min(
     return min_canonical_length;
 }
 
+/*
+huffman(), but no code longer than max_length digits:
+halve the frequencies (never below 1)
+until the tree is shallow enough.
+Not optimal, but only large, very skewed blocks ever need it.
+The frequencies are scaled in place.
+*/
+void
+limited_huffman(
+    struct huffman_scratch * scratch,
+    const int max_leaf_value,
+    int symbol_frequencies[max_leaf_value+1], // in-out
+    const int compressed_symbols,
+    const int max_length,
+    int lengths[max_leaf_value+1] // output
+){
+    for(;;){
+        huffman( scratch, max_leaf_value, symbol_frequencies,
+            compressed_symbols, lengths );
+        if( array_max( max_leaf_value+1, lengths ) <= max_length ){
+            return;
+        };
+        for( int i=0; i<=max_leaf_value; i++ ){
+            symbol_frequencies[i] = (symbol_frequencies[i] + 1) / 2;
+        };
+    };
+}
+
 
 void
 convert_lengths_to_encode_table(
@@ -1398,7 +1619,7 @@ convert_lengths_to_encode_table(
     // or etc.
     const int debug = 1;
     if(debug){
-        printf(
+        DEBUG_PRINTF(
             "compressed_symbols: i = %i; max_symbol_value = %i \n",
             compressed_symbols,
             max_symbol_value
@@ -1407,18 +1628,17 @@ convert_lengths_to_encode_table(
 
     assert(max_symbol_value);
     assert(compressed_symbols);
-    const int max_canonical_length = array_max( max_symbol_value, canonical_lengths );
-    const int min_canonical_length = array_min( max_symbol_value, canonical_lengths );
+    // (array_max() takes the number of items, not the largest index.)
+    const int max_canonical_length = array_max( max_symbol_value+1, canonical_lengths );
+    const int min_canonical_length = array_min( max_symbol_value+1, canonical_lengths );
     // FUTURE: need to allow longer lengths
     // if we have huge Huffman tables.
     assert(max_canonical_length < 16);
     assert(0 < min_canonical_length);
     assert( min_canonical_length <= max_canonical_length );
-    // FIXME: perhaps we shouldn't assume the NULL character never occurs.
-    assert(0 == canonical_lengths[0]);
 
     // clear the symbol tables
-    for(int i=0; i<max_symbol_value; i++){
+    for(int i=0; i<=max_symbol_value; i++){
         encode_length_table[i] = 0;
         encode_value_table[i] = 0;
     };
@@ -1542,7 +1762,7 @@ convert_lengths_to_encode_table(
     for( int current_length = min_canonical_length; current_length <= max_canonical_length; current_length++){
         const int debug = 1;
         if(debug){
-            printf("current_length = %i.\n", current_length);
+            DEBUG_PRINTF("current_length = %i.\n", current_length);
         };
         for(int i=0; i<=max_symbol_value; i++){
             // only look at symbols
@@ -1556,7 +1776,7 @@ convert_lengths_to_encode_table(
                 encode_length_table[i] = current_length;
                 encode_value_table[i] = current_code;
                 if(debug){
-                    printf("Assigning i=%i to code 0x%x == %i.\n", i, current_code, current_code);
+                    DEBUG_PRINTF("Assigning i=%i to code 0x%x == %i.\n", i, current_code, current_code);
                 };
                 current_code += 1; // increment code.
             };
@@ -1582,16 +1802,19 @@ convert_lengths_to_encode_table(
     // (or the all-max-digit max-length code)
     const int max_possible_code = power(compressed_symbols, max_canonical_length) - 1;
     const int dummy_symbols = max_possible_code - max_actual_code;
-    if( debug && ( 2 == compressed_symbols )){
+    // a lone symbol gets a 1-digit code
+    // and (compressed_symbols - 1) dummy siblings.
+    const int nonzero_symbols = count_nonzero_items( max_symbol_value+1, canonical_lengths );
+    const bool lone_symbol = (1 == nonzero_symbols);
+    if( debug && ( 2 == compressed_symbols ) && !lone_symbol ){
         assert( ((1<<max_canonical_length) - 1) == current_code );
         assert( 0 == dummy_symbols );
     };
-    if( debug && ( 3 == compressed_symbols )){
-        int nonzero_symbols = count_nonzero_items( max_symbol_value, canonical_lengths );
-        printf( "nonzero symbols: %i\n", nonzero_symbols );
-        printf( "max_canonical_length: %i\n", max_canonical_length );
-        printf( "max_possible_code: %i\n", max_possible_code );
-        printf( "max_actual_code: %i\n", max_actual_code );
+    if( debug && ( 3 == compressed_symbols ) && !lone_symbol ){
+        DEBUG_PRINTF( "nonzero symbols: %i\n", nonzero_symbols );
+        DEBUG_PRINTF( "max_canonical_length: %i\n", max_canonical_length );
+        DEBUG_PRINTF( "max_possible_code: %i\n", max_possible_code );
+        DEBUG_PRINTF( "max_actual_code: %i\n", max_actual_code );
         bool odd = (nonzero_symbols & 1);
         bool even = !odd;
         if(odd){
@@ -1602,237 +1825,3911 @@ convert_lengths_to_encode_table(
         };
     };
     if(debug){
-        printf( " compressed_symbols = %i, max_canonical_length = %i \n", compressed_symbols, max_canonical_length);
-        printf( " compressed_symbols ** max_canonical_length - 1 = %i \n",  max_possible_code);
-        printf( " max_actual_code = %i \n",  max_actual_code);
-        printf( " dummy_symbols = %i \n",  dummy_symbols );
+        DEBUG_PRINTF( " compressed_symbols = %i, max_canonical_length = %i \n", compressed_symbols, max_canonical_length);
+        DEBUG_PRINTF( " compressed_symbols ** max_canonical_length - 1 = %i \n",  max_possible_code);
+        DEBUG_PRINTF( " max_actual_code = %i \n",  max_actual_code);
+        DEBUG_PRINTF( " dummy_symbols = %i \n",  dummy_symbols );
     }
     assert( 0 <= dummy_symbols );
-    assert( dummy_symbols < (compressed_symbols - 1) );
+    assert( (dummy_symbols < (compressed_symbols - 1)) or lone_symbol );
+}
+
+
+/*
+Compressed digits are stored in one of two ways:
+* printable: one character per digit,
+'0'..'9' and then 'a'..'z'
+(so up to 36-ary Huffman),
+used by the human-readable "\nZ" blocks.
+* packed: as many digits per byte as will fit,
+most-significant digit first,
+used by the "\nY" blocks:
+8 bits per byte for binary,
+5 trits per byte for trinary (243 of the 256 byte values),
+2 digits per byte for base-9 (81 values) or base-10 (100 values).
+The last packed byte is padded with zero digits.
+*/
+static const char printable_digits[] =
+    "0123456789"
+    "abcdefghijklmnopqrstuvwxyz";
+
+static int
+digits_per_packed_byte( const int compressed_symbols ){
+    assert( 2 <= compressed_symbols );
+    assert( compressed_symbols <= 256 );
+    int digits = 0;
+    int values = 1;
+    while( values * compressed_symbols <= 256 ){
+        values *= compressed_symbols;
+        digits++;
+    };
+    return digits;
 }
 
+/*
+The total number of output digits (not bytes)
+needed to represent the text with the given code lengths.
+*/
+int
+count_code_digits(
+    const int max_symbol_value,
+    const int encode_length_table[max_symbol_value+1],
+    const int original_length,
+    const char original_text[original_length]
+){
+    int digits = 0;
+    for(int i=0; i<original_length; i++){
+        const unsigned char item = original_text[i];
+        assert( item <= max_symbol_value );
+        digits += encode_length_table[item];
+    };
+    return digits;
+}
 
 /*
 starts writing into compressed_text
 at byte compressed_text[start],
-last byte written is
-at byte compressed_text[start + retval -1]. (???)
+returns the number of bytes written.
+Each code is written most-significant digit first,
+so a decoder reading one digit at a time
+can walk down the canonical code ranges.
 */
 int
 represent_items_with_codes(
             const int max_symbol_value,
-            int canonical_lengths[max_symbol_value+1],
+            const int encode_length_table[max_symbol_value+1],
+            const unsigned int encode_value_table[max_symbol_value+1],
             const int compressed_symbols, // 2 for binary, 3 for trinary, etc.
-            const int bufsize, // const size_t bufsize,
+            const bool packed_digits,
             const int original_length,
-            char original_text[bufsize+1],
-            int start, // index to start writing in compressed_text
-            char compressed_text[bufsize+1] // output
+            const char original_text[original_length],
+            const int start, // index to start writing in compressed_text
+            const int compressed_size,
+            char compressed_text[compressed_size] // output
     ){
-
-    unsigned int encode_value_table[max_symbol_value + 1];
-    int encode_length_table[max_symbol_value + 1];
-    assert(sizeof(encode_value_table) >= 16);
-    // the convert_lengths_to_encode_table
-    // has some endian-sensitive stuff
-    // in the encode_value_table
-    convert_lengths_to_encode_table(
-        max_symbol_value,
-        canonical_lengths,
-        compressed_symbols, // 2 for binary, 3 for trinary, etc.
-        encode_length_table,
-        encode_value_table
-        );
-    // FUTURE: handle various other output formats
-    // Currently using base64url.
-    const int bits_per_output_symbol = 6; // base64url
-    int bit_offset = 0;
+    assert( 0 <= start );
+    const int digits_per_byte =
+        packed_digits ? digits_per_packed_byte( compressed_symbols ) : 1;
+    if( !packed_digits ){
+        assert( compressed_symbols < (int)NUM_ELEM( printable_digits ) );
+    };
     int char_offset = start;
+    int packed_value = 0;
+    int packed_count = 0;
     for(int i=0; i<original_length; i++){
-        // FUTURE: consider re-ordering
-        // to make more byte-aligned.
-        // For now, completely bit-oriented.
-        int item = original_text[i];
-        int encoded_value = encode_value_table[item];
-        int encoded_length = encode_length_table[item];
+        const unsigned char item = original_text[i];
+        const int encoded_length = encode_length_table[item];
+        unsigned int encoded_value = encode_value_table[item];
         assert(encoded_length > 0);
-        assert(encoded_value < (1<<encoded_length));
+        assert(encoded_length <= MAX_CODE_LENGTH);
+        // peel off the digits least-significant first ...
+        int digits[MAX_CODE_LENGTH];
+        for(int j=encoded_length-1; j>=0; j--){
+            digits[j] = encoded_value % compressed_symbols;
+            encoded_value /= compressed_symbols;
+        };
+        assert( 0 == encoded_value );
+        // ... and emit them most-significant first.
+        for(int j=0; j<encoded_length; j++){
+            if( packed_digits ){
+                packed_value = packed_value * compressed_symbols + digits[j];
+                packed_count++;
+                if( digits_per_byte == packed_count ){
+                    assert( char_offset < compressed_size );
+                    compressed_text[char_offset++] = (unsigned char)packed_value;
+                    packed_value = 0;
+                    packed_count = 0;
+                };
+            }else{
+                assert( char_offset < compressed_size );
+                compressed_text[char_offset++] = printable_digits[ digits[j] ];
+            };
+        };
+    };
+    if( packed_count ){
+        // pad the last byte with zero digits.
+        while( packed_count < digits_per_byte ){
+            packed_value *= compressed_symbols;
+            packed_count++;
+        };
+        assert( char_offset < compressed_size );
+        compressed_text[char_offset++] = (unsigned char)packed_value;
+    };
+    return char_offset - start;
+}
 
-        assert(0);
+/*
+Canonical Huffman decoding in any radix.
+
+convert_lengths_to_encode_table()
+assigns codes by counting up within each length,
+then appending a zero digit
+(multiplying by compressed_symbols)
+before moving on to the next length.
+So, for each length L,
+the codes of length L are the consecutive numbers
+    first_code[L] ... first_code[L] + count[L] - 1
+and every longer code
+starts with some L-digit prefix
+that is at least first_code[L] + count[L].
+The decoder only needs those two short arrays
+(plus the symbols sorted by length)
+to recognize a code one digit at a time.
+
+To go faster,
+we also build a lookup table indexed by
+the next lookup_digits digits
+(read as one base-compressed_symbols number).
+Any code no longer than lookup_digits
+is decoded with a single table lookup;
+longer codes fall back to the digit-at-a-time loop,
+picking up where the table left off.
+With at most 4096 table entries,
+that's 12 bits at a time for binary,
+7 trits at a time for trinary,
+and 3 digits at a time for base-9 and base-10.
+*/
+struct canonical_decoder{
+    int compressed_symbols; // 2 for binary, 3 for trinary, etc.
+    int max_length;
+    int first_code[MAX_CODE_LENGTH+1];
+    int count[MAX_CODE_LENGTH+1];
+    int first_index[MAX_CODE_LENGTH+1]; // index into sorted_symbols[]
+    int sorted_symbols[MAX_DECODE_SYMBOLS];
+    int lookup_digits;
+    int lookup_entries; // compressed_symbols ** lookup_digits
+    int digit_power[MAX_CODE_LENGTH+1]; // compressed_symbols ** i, up to lookup_digits
+    // the symbol, or -1 when every code starting with these digits
+    // is longer than lookup_digits.
+    short lookup_symbol[MAX_LOOKUP_ENTRIES];
+    unsigned char lookup_length[MAX_LOOKUP_ENTRIES];
+    // the digits of the window after that code:
+    // entry % compressed_symbols ** (lookup_digits - lookup_length[entry])
+    unsigned short lookup_rest[MAX_LOOKUP_ENTRIES];
+};
 
-        bit_offset += encoded_length;
-        while( bit_offset >= bits_per_output_symbol ){
-            assert(bit_offset > 0);
-            assert(0);
-            assert(2 == compressed_symbols);
-            const char letter = int2digit(encoded_value);
-            assert(0);
-            compressed_text[char_offset] = letter;
-            char_offset++;
-            bit_offset =- bits_per_output_symbol;
+/*
+(Re)build the lookup table of a decoder
+to look at exactly lookup_digits digits at a time.
+convert_lengths_to_decode_table() never looks further than the longest code,
+but several decoders sharing one digit_reader
+need to agree on the width of the window.
+*/
+static void
+build_lookup_table( struct canonical_decoder * decoder, const int lookup_digits ){
+    const int compressed_symbols = decoder->compressed_symbols;
+    int lookup_entries = 1;
+    decoder->digit_power[0] = 1;
+    for(int i=1; i<=lookup_digits; i++){
+        lookup_entries *= compressed_symbols;
+        decoder->digit_power[i] = lookup_entries;
+    };
+    assert( lookup_entries <= MAX_LOOKUP_ENTRIES );
+    decoder->lookup_digits = lookup_digits;
+    decoder->lookup_entries = lookup_entries;
+    for(int i=0; i<lookup_entries; i++){
+        decoder->lookup_symbol[i] = -1;
+        decoder->lookup_length[i] = 0;
+        decoder->lookup_rest[i] = 0;
+    };
+    // each code no longer than lookup_digits
+    // fills every table entry that starts with that code.
+    for(int length=1; length<=lookup_digits; length++){
+        const int spread = decoder->digit_power[ lookup_digits - length ];
+        for(int j=0; j<decoder->count[length]; j++){
+            const int code = decoder->first_code[length] + j;
+            const int symbol = decoder->sorted_symbols[ decoder->first_index[length] + j ];
+            for(int k=0; k<spread; k++){
+                const int entry = code * spread + k;
+                assert( entry < lookup_entries );
+                decoder->lookup_symbol[entry] = symbol;
+                decoder->lookup_length[entry] = length;
+                decoder->lookup_rest[entry] = k;
+            };
         };
+    };
+}
 
+void
+convert_lengths_to_decode_table(
+        /* inputs */
+        const int max_symbol_value, // input-only
+        const int canonical_lengths[max_symbol_value+1], // input-only
+        const int compressed_symbols, // input-only: 2 for binary, 3 for trinary, etc.
+        /* outputs */
+        struct canonical_decoder * decoder // output-only
+    ){
+    assert( 2 <= compressed_symbols );
+    assert( max_symbol_value < MAX_DECODE_SYMBOLS );
+    decoder->compressed_symbols = compressed_symbols;
+    for(int length=0; length<=MAX_CODE_LENGTH; length++){
+        decoder->count[length] = 0;
+        decoder->first_code[length] = 0;
+        decoder->first_index[length] = 0;
+    };
+    int max_length = 0;
+    for(int i=0; i<=max_symbol_value; i++){
+        const int length = canonical_lengths[i];
+        assert( 0 <= length );
+        assert( length < MAX_CODE_LENGTH );
+        decoder->count[length]++;
+        max_length = imax( max_length, length );
+    };
+    decoder->count[0] = 0; // length 0 means "never used", not a real code.
+    decoder->max_length = max_length;
+
+    // the same counting-up rule as convert_lengths_to_encode_table()
+    int code = 0;
+    int index = 0;
+    for(int length=1; length<=max_length; length++){
+        decoder->first_code[length] = code;
+        decoder->first_index[length] = index;
+        code += decoder->count[length];
+        index += decoder->count[length];
+        assert( code <= (INT_MAX / compressed_symbols) );
+        code *= compressed_symbols;
+    };
+    // sort the symbols by length,
+    // and by symbol value within each length.
+    int next_index[MAX_CODE_LENGTH+1];
+    for(int length=0; length<=MAX_CODE_LENGTH; length++){
+        next_index[length] = decoder->first_index[length];
+    };
+    for(int i=0; i<=max_symbol_value; i++){
+        const int length = canonical_lengths[i];
+        if( length ){
+            decoder->sorted_symbols[ next_index[length]++ ] = i;
+        };
     };
 
-    return 32767;
+    // pick the widest lookup table that fits.
+    int lookup_digits = 0;
+    int lookup_entries = 1;
+    while( (lookup_digits < max_length) and
+        ((lookup_entries * compressed_symbols) <= MAX_LOOKUP_ENTRIES)
+    ){
+        lookup_digits++;
+        lookup_entries *= compressed_symbols;
+    };
+    build_lookup_table( decoder, lookup_digits );
 }
 
+
 /*
-Given a list of lengths
-(one length for each symbol)
-and a block of uncompressed text,
-generate a block of compressed text
-(starting with a compact representation
-of the canonical list of lengths).
+The digit reader hands out packed digits one at a time, for read_digit(),
+or a whole code's worth in one step, for the lookup table,
+straight from the current byte,
+with a table of the leading digits of each byte
+so that neither path divides.
 */
-static void
-compress(
-    const int max_symbol_value,
-    int canonical_lengths[max_symbol_value+1],
-    const int compressed_symbols, // 2 for binary, 3 for trinary, etc.
-    const int bufsize, // const size_t bufsize,
-    const int original_length,
-    char original_text[bufsize+1],
-    char compressed_text[bufsize+1] // output
+struct digit_reader{
+    const unsigned char * data;
+    int digit_count; // digits actually stored
+    int compressed_symbols;
+    int digits_per_byte; // 0 for printable digits
+    int bytes; // packed bytes actually stored
+    int next_byte;
+    int byte; // the current packed byte
+    int pending_digits; // digits of the current byte not yet used
+    int digits_read; // may run past digit_count (zero padding)
+    int position; // digits used up by decoded symbols
+    int window; // the next lookup_digits digits, for the lookup table
+    int power[9]; // compressed_symbols ** i, up to digits_per_byte
+    signed char digit_value[256]; // printable character -> digit
+    unsigned char unpacked[256][8]; // packed byte -> its digits
+    unsigned char leading[256][9]; // packed byte -> its first i digits
+};
+
+void
+start_digit_reader(
+    struct digit_reader * reader,
+    const int compressed_symbols,
+    const bool packed_digits,
+    const int digit_count,
+    const unsigned char data[]
 ){
-    assert( original_length <= bufsize );
-    if(max_symbol_value > 1000){
-        assert(0);
-    };
-    if( compressed_symbols < 2 ){
-        assert(0); 
+    reader->data = data;
+    reader->digit_count = digit_count;
+    reader->compressed_symbols = compressed_symbols;
+    reader->next_byte = 0;
+    reader->byte = 0;
+    reader->pending_digits = 0;
+    reader->digits_read = 0;
+    reader->position = 0;
+    reader->window = 0;
+    if( packed_digits ){
+        const int digits_per_byte = digits_per_packed_byte( compressed_symbols );
+        reader->digits_per_byte = digits_per_byte;
+        reader->bytes = (digit_count + digits_per_byte - 1) / digits_per_byte;
+        reader->power[0] = 1;
+        for(int i=1; i<=digits_per_byte; i++){
+            reader->power[i] = reader->power[i-1] * compressed_symbols;
+        };
+        for(int byte=0; byte<256; byte++){
+            for(int i=0; i<=digits_per_byte; i++){
+                reader->leading[byte][i] = byte / reader->power[ digits_per_byte - i ];
+            };
+            for(int j=0; j<digits_per_byte; j++){
+                reader->unpacked[byte][j] = reader->leading[byte][j+1] -
+                    reader->leading[byte][j] * compressed_symbols;
+            };
+        };
+    }else{
+        reader->digits_per_byte = 0;
+        reader->bytes = 0;
+        assert( compressed_symbols < (int)NUM_ELEM( printable_digits ) );
+        for(int c=0; c<256; c++){
+            reader->digit_value[c] = -1;
+        };
+        for(int d=0; d<compressed_symbols; d++){
+            const unsigned char c = printable_digits[d];
+            reader->digit_value[c] = d;
+        };
     };
-    if( compressed_symbols > 2 ){
-        printf("# %d : compressed_symbols.\n", compressed_symbols );
-        // FIXME:
-        printf("# header ....\n");
-        // FIXME: perhaps make d a simple integer index *into* the compressed_text[] array
-        char * d = compressed_text;
-        char * type = "\nX"; // Huffman table type 1 (human-readable)
-        // FUTURE: there's probably a better way
-        // of encoding max_symbol_value and compressed_symbols.
-        int s_length = 0;
-        if(max_symbol_value < 10){
-            s_length = 1;
-        }else if(max_symbol_value < 100){
-            s_length = 2;
-        }else if(max_symbol_value < 1000){
-            s_length = 3;
-        };
-        assert(0 != s_length); // FUTURE: handle more than 1000 symbols.
-        const int netstring_length =
-            strlen(type) + s_length + 1 + max_symbol_value + 1;
-        printf("# netstring_length: %d\n", netstring_length);
-        d +=
-        sprintf(d, "%d:", // start of netstring
-            netstring_length
-            );
-        int start_of_header_index = d - compressed_text;
-        d +=
-        sprintf(d, "%s%d:",
-            type, max_symbol_value
-            );
-        printf("# %s", compressed_text );
-        for( int i=0; i<=max_symbol_value; i++ ){
-            d +=
-            sprintf(d, "%d",
-                canonical_lengths[i]
-                );
+}
+
+static inline void
+load_next_byte( struct digit_reader * reader ){
+    // past the end: act as if padded with zero digits.
+    reader->byte = (reader->next_byte < reader->bytes) ?
+        reader->data[ reader->next_byte ] : 0;
+    reader->next_byte++;
+    reader->pending_digits = reader->digits_per_byte;
+}
+
+static inline int
+read_digit( struct digit_reader * reader ){
+    const int i = reader->digits_read++;
+    if( reader->digits_per_byte ){
+        if( !reader->pending_digits ){
+            load_next_byte( reader );
         };
-        int end_of_header_index = d - compressed_text;
-        d +=
-        sprintf(d, ","); // end of netstring
-        const int actual_header_size = end_of_header_index - start_of_header_index;
-        printf("# actual header size: %d\n", actual_header_size);
-        assert( actual_header_size == netstring_length );
-        printf("# data ....\n");
-        // FIXME: quick hack:
-        // reserve 5 digits for length;
-        // later overwrite with correct value.
-        const int data_length_initial = 32767; // initial guess
-        int data_length_index = d - compressed_text;
-        d +=
-        sprintf(d, "%d:", // start of netstring
-            data_length_initial
-            );
+        const int used = reader->digits_per_byte - reader->pending_digits--;
+        return reader->unpacked[ reader->byte ][ used ];
+    };
+    if( i >= reader->digit_count ){
+        // past the end: act as if padded with zero digits.
+        return 0;
+    };
+    const int digit = reader->digit_value[ reader->data[i] ];
+    assert( 0 <= digit ); // not one of our printable digits?
+    return digit;
+}
 
-        d +=
-        represent_items_with_codes(
-            max_symbol_value,
-            canonical_lengths,
-            compressed_symbols, // 2 for binary, 3 for trinary, etc.
-            bufsize, // const size_t bufsize,
-            original_length,
-            original_text,
-            (d - compressed_text),
-            compressed_text
-            );
-        const int actual_data_length = d - compressed_text;
-        if(data_length_initial == actual_data_length){
-            printf("# guessed correct length, nothing to do.\n");
-        }else{
-            // Quick hack:
-            // reserve 5 digits for length;
-            // later overwrite with correct value.
-            // if it's 9999 or less,
-            // left-pad with spaces.
-            // FIXME: somehow get rid of that padding.
-            printf("# %d: actual data length", actual_data_length);
-            assert(actual_data_length <= 32767);
-            sprintf(d+data_length_index, "% 5d:", // start of netstring
-                actual_data_length
-                );
+/*
+Take the next few digits
+as one base-n number.
+*/
+static inline int
+take_reader_digits( struct digit_reader * reader, const int digits ){
+    if( !reader->digits_per_byte ){
+        // one digit per printable character: nothing to gain.
+        int value = 0;
+        for(int i=0; i<digits; i++){
+            value = value * reader->compressed_symbols + read_digit( reader );
         };
-        assert(0);
-        /*
-        sprintf(d, "%d:%s%.*s,",
-            netstring_length, type, original_length, original_text
-            );
-        */
-        sprintf(d, ","); // end of netstring
-        printf("# compressed.\n");
+        return value;
     };
-    if(1){
-        // currently only handles ASCII text.
-        // FUTURE: handle arbitrary binary.
-        // FUTURE: handle more than 257 source symbols.
-        assert(0 == canonical_lengths[0]);
-    };
-    int huffman_data_size = original_length; // FIXME
-    int huffman_header_size = 256; // FIXME
-    // if it doesn't save any space to Huffman compress --
-    // such as when all canonical lengths are the same --
-    // fall back to simple pass-thru raw data.
-    if( huffman_data_size + huffman_header_size >= original_length ){
-        printf("# pass-through raw data.\n");
-        char * d = compressed_text;
-        char * type = "\n\n"; // pass-through type
-        int netstring_length = original_length + strlen(type);
-        sprintf(d, "%d:%s%.*s,",
-            netstring_length, type, original_length, original_text
-            );
+    const int digits_per_byte = reader->digits_per_byte;
+    int value = 0;
+    int needed = digits;
+    while( needed ){
+        if( !reader->pending_digits ){
+            load_next_byte( reader );
+        };
+        const int used = digits_per_byte - reader->pending_digits;
+        const int k = imin( needed, reader->pending_digits );
+        const unsigned char * leading = reader->leading[ reader->byte ];
+        value = value * reader->power[k] +
+            leading[ used + k ] - leading[used] * reader->power[k];
+        reader->pending_digits -= k;
+        needed -= k;
     };
+    reader->digits_read += digits;
+    return value;
+}
+
+static inline bool
+is_complete_code(
+    const struct canonical_decoder * decoder,
+    const int code,
+    const int length
+){
+    // the unsigned compare also rejects code < first_code[length].
+    return (
+        (unsigned)(code - decoder->first_code[length]) <
+        (unsigned)(decoder->count[length])
+    );
+}
+
+static inline int
+code_to_symbol(
+    const struct canonical_decoder * decoder,
+    const int code,
+    const int length
+){
+    return decoder->sorted_symbols[
+        decoder->first_index[length] + code - decoder->first_code[length]
+    ];
 }
 
 static int
-get_compressed_block_length( const char * s ){
-    // Later this will be restricted more,
-    // but currently "%i"
-    // supports base-16 if blocks begin with "0x" or "0X",
-    // base-8 if it begins with 0,
-    // and base 10 otherwise.
+decode_symbol_one_digit_at_a_time(
+    const struct canonical_decoder * decoder,
+    struct digit_reader * reader
+){
+    int code = 0;
     int length = 0;
-    sscanf( s, "%i", &length );
-    assert( length <=  32768 );
-    assert( length <= 0x8000 );
-    assert( 0 <= length );
-    return length;
+    do{
+        code = code * decoder->compressed_symbols + read_digit( reader );
+        length++;
+        assert( length <= decoder->max_length ); // corrupt data?
+    }while( !is_complete_code( decoder, code, length ) );
+    reader->position += length;
+    return code_to_symbol( decoder, code, length );
 }
 
-/*
-Given a block of compressed text
-(starting with a compact representation
-of the canonical list of lengths),
+static void
+fill_lookahead_window(
+    const struct canonical_decoder * decoder,
+    struct digit_reader * reader
+){
+    reader->window = take_reader_digits( reader, decoder->lookup_digits );
+}
+
+static inline int
+decode_symbol_with_lookup_table(
+    const struct canonical_decoder * decoder,
+    struct digit_reader * reader
+){
+    const int window = reader->window;
+    const int symbol = decoder->lookup_symbol[ window ];
+    if( 0 <= symbol ){
+        // common case: one lookup,
+        // then slide the window along by the length of that code,
+        // taking all of its digits in one step.
+        const int length = decoder->lookup_length[ window ];
+        reader->window = decoder->lookup_rest[ window ] * decoder->digit_power[length] +
+            take_reader_digits( reader, length );
+        reader->position += length;
+        return symbol;
+    };
+    // a code longer than the table:
+    // continue one digit at a time from where the table left off.
+    int code = window;
+    int length = decoder->lookup_digits;
+    do{
+        code = code * decoder->compressed_symbols + read_digit( reader );
+        length++;
+        assert( length <= decoder->max_length ); // corrupt data?
+    }while( !is_complete_code( decoder, code, length ) );
+    reader->position += length;
+    fill_lookahead_window( decoder, reader );
+    return code_to_symbol( decoder, code, length );
+}
+
+/*
+Decode exactly digit_count digits
+(packed or printable)
+into text;
+returns the number of bytes of decoded text.
+*/
+int
+decode_digits_to_text(
+    const struct canonical_decoder * decoder,
+    const bool use_lookup_table,
+    const bool packed_digits,
+    const int digit_count,
+    const unsigned char digits[],
+    const int max_decompressed_size,
+    char decompressed_text[max_decompressed_size] // output
+){
+    struct digit_reader reader;
+    start_digit_reader( &reader,
+        decoder->compressed_symbols, packed_digits, digit_count, digits );
+    int decompressed_length = 0;
+    if( use_lookup_table ){
+        fill_lookahead_window( decoder, &reader );
+        while( reader.position < digit_count ){
+            const int symbol = decode_symbol_with_lookup_table( decoder, &reader );
+            assert( symbol < 256 );
+            assert( decompressed_length < max_decompressed_size );
+            decompressed_text[ decompressed_length++ ] = symbol;
+        };
+    }else{
+        while( reader.position < digit_count ){
+            const int symbol = decode_symbol_one_digit_at_a_time( decoder, &reader );
+            assert( symbol < 256 );
+            assert( decompressed_length < max_decompressed_size );
+            decompressed_text[ decompressed_length++ ] = symbol;
+        };
+    };
+    // the last code should end exactly on the last digit.
+    assert( reader.position == digit_count );
+    return decompressed_length;
+}
+
+// compressed_symbols ** i, for as many digits as a stream_reader ever holds
+#define STREAM_POWERS (MAX_CODE_LENGTH + 8 + 1)
+
+/*
+A digit reader for one of the interleaved streams
+(packed digits only).
+Rather than picking digits out of one byte at a time, like the digit_reader,
+it keeps the packed bytes it has read but not yet used
+as one base-n number,
+and takes as many digits as a code needs in one step,
+so decoding a symbol is a handful of arithmetic operations
+with no loop over its digits.
+*/
+struct stream_reader{
+    const unsigned char * data;
+    int bytes; // packed bytes actually stored
+    int next_byte;
+    unsigned long long pending; // digits read but not yet used, as a base-n number
+    int pending_digits;
+    int position; // digits used up by decoded symbols
+    int window; // the next lookup_digits digits, for the lookup table
+};
+
+static inline int
+take_digits(
+    struct stream_reader * reader,
+    const unsigned long long power[STREAM_POWERS],
+    const int digits_per_byte,
+    const int digits
+){
+    while( reader->pending_digits < digits ){
+        // past the end: act as if padded with zero digits.
+        const unsigned char byte = (reader->next_byte < reader->bytes) ?
+            reader->data[ reader->next_byte ] : 0;
+        reader->next_byte++;
+        reader->pending = reader->pending * power[digits_per_byte] + byte;
+        reader->pending_digits += digits_per_byte;
+    };
+    reader->pending_digits -= digits;
+    const unsigned long long scale = power[ reader->pending_digits ];
+    const int value = reader->pending / scale;
+    reader->pending -= value * scale;
+    return value;
+}
+
+static inline int
+decode_symbol_from_stream(
+    const struct canonical_decoder * decoder,
+    struct stream_reader * reader,
+    const unsigned long long power[STREAM_POWERS],
+    const int digits_per_byte
+){
+    const int window = reader->window;
+    const int symbol = decoder->lookup_symbol[ window ];
+    const int lookup_digits = decoder->lookup_digits;
+    if( 0 <= symbol ){
+        const int length = decoder->lookup_length[ window ];
+        reader->window = decoder->lookup_rest[ window ] * (int)power[length] +
+            take_digits( reader, power, digits_per_byte, length );
+        reader->position += length;
+        return symbol;
+    };
+    // a code longer than the table:
+    // continue one digit at a time from where the table left off.
+    int code = window;
+    int length = lookup_digits;
+    do{
+        code = code * decoder->compressed_symbols +
+            take_digits( reader, power, digits_per_byte, 1 );
+        length++;
+        assert( length <= decoder->max_length ); // corrupt data?
+    }while( !is_complete_code( decoder, code, length ) );
+    reader->position += length;
+    reader->window = take_digits( reader, power, digits_per_byte, lookup_digits );
+    return code_to_symbol( decoder, code, length );
+}
+
+/*
+Decode symbol_count symbols
+from 1 .. HUFFMAN_STREAMS interleaved streams of packed digits
+(symbol i is in stream i % streams; see compress_with_streams()).
+Each stream has its own reader,
+so the lookups of each round
+don't wait on each other's digit positions.
+Returns the number of bytes of decoded text.
+*/
+int
+decode_interleaved_digits(
+    const struct canonical_decoder * decoder,
+    const int streams,
+    const int symbol_count,
+    const int digit_counts[streams],
+    const unsigned char * const data[streams],
+    const int max_decompressed_size,
+    char decompressed_text[max_decompressed_size] // output
+){
+    assert( (1 <= streams) and (streams <= HUFFMAN_STREAMS) );
+    assert( symbol_count <= max_decompressed_size );
+    const int n = decoder->compressed_symbols;
+    const int digits_per_byte = digits_per_packed_byte( n );
+    unsigned long long power[STREAM_POWERS];
+    power[0] = 1;
+    for( int i=1; i<STREAM_POWERS; i++ ){
+        power[i] = power[i-1] * n;
+    };
+    struct stream_reader readers[HUFFMAN_STREAMS];
+    for( int k=0; k<streams; k++ ){
+        struct stream_reader * reader = &readers[k];
+        reader->data = data[k];
+        reader->bytes = (digit_counts[k] + digits_per_byte - 1) / digits_per_byte;
+        reader->next_byte = 0;
+        reader->pending = 0;
+        reader->pending_digits = 0;
+        reader->position = 0;
+        reader->window =
+            take_digits( reader, power, digits_per_byte, decoder->lookup_digits );
+    };
+    int i = 0;
+    if( HUFFMAN_STREAMS == streams ){
+        for( ; i + HUFFMAN_STREAMS <= symbol_count; i += HUFFMAN_STREAMS ){
+            // independent of each other: the CPU can overlap them.
+            const int a = decode_symbol_from_stream( decoder, &readers[0], power, digits_per_byte );
+            const int b = decode_symbol_from_stream( decoder, &readers[1], power, digits_per_byte );
+            const int c = decode_symbol_from_stream( decoder, &readers[2], power, digits_per_byte );
+            const int d = decode_symbol_from_stream( decoder, &readers[3], power, digits_per_byte );
+            decompressed_text[i] = a;
+            decompressed_text[i + 1] = b;
+            decompressed_text[i + 2] = c;
+            decompressed_text[i + 3] = d;
+        };
+    };
+    for( ; i<symbol_count; i++ ){
+        decompressed_text[i] = decode_symbol_from_stream(
+            decoder, &readers[ i % streams ], power, digits_per_byte );
+    };
+    // every stream should end exactly on its last digit.
+    for( int k=0; k<streams; k++ ){
+        assert( readers[k].position == digit_counts[k] );
+    };
+    return symbol_count;
+}
+
+/*
+Adaptive (one-pass) n-ary Huffman,
+in the style of FGK (Faller, Gallager, Knuth),
+generalized to any compressed_symbols >= 2.
+Both sides start with a tree holding only the
+"not yet transmitted" (NYT) escape leaf,
+and update the tree identically after every symbol,
+so there's no table header,
+and (unlike next_block(), which needs one pass for the histogram
+and another to encode)
+each symbol's code can be written as soon as that symbol is read.
+
+Nodes live in slots numbered from the root (slot 0) downward,
+with weights non-increasing by slot number,
+and all children of a node in consecutive slots
+(Gallager's "sibling property", for n-ary trees).
+After coding a symbol,
+each node on the path from its leaf up to the root
+is first swapped (with its whole subtree) into
+the lowest-numbered slot of the same weight,
+then incremented,
+which keeps the sibling property.
+
+Two differences from textbook binary FGK:
+* Each new internal node gets children
+  one at a time, up to compressed_symbols of them:
+  a new symbol becomes another child of
+  the last (partly-filled) sibling group,
+  and only when that group is full
+  does the NYT leaf split into a new group [NYT, new symbol].
+  Only the last sibling group is ever partly filled,
+  which plays the role of the dummy nodes in the static code.
+* The NYT leaf has a constant weight of 1 rather than 0,
+  so every parent is strictly heavier than each of its children,
+  and the slot we swap with can never be an ancestor.
+  (This also acts like a small escape probability).
+A new symbol is sent as the NYT code
+followed by the byte in raw_digits fixed-width digits.
+FUTURE: halve all the weights now and then,
+to adapt to changing statistics and avoid overflow in long streams.
+*/
+#define ADAPTIVE_MAX_NODES (2*257+2)
+#define ADAPTIVE_NYT (-1) // the "symbol" of the NYT leaf
+
+struct adaptive_huffman{
+    int compressed_symbols; // 2 for binary, 3 for trinary, etc.
+    int raw_digits; // digits to send a new byte literally
+    int nodes; // slots in use
+    int nyt; // slot of the NYT leaf
+    int last_group; // first slot of the last sibling group
+    int weight[ADAPTIVE_MAX_NODES];
+    int parent[ADAPTIVE_MAX_NODES]; // -1 for the root
+    int first_child[ADAPTIVE_MAX_NODES]; // -1 for leaves
+    int child_count[ADAPTIVE_MAX_NODES];
+    int symbol[ADAPTIVE_MAX_NODES]; // leaves only
+    int leaf_slot[256]; // -1 until the symbol is first seen
+};
+
+/*
+Built-in static Huffman tables.
+Small blocks of typical text
+pay for a full huffman() run plus a 259-digit "\nX" header,
+even though (as the test vectors in this file show)
+text of one kind produces very stable length tables.
+So a block may instead say "\nS" table_id ':' compressed_symbols,
+meaning "use built-in static table #table_id".
+
+Since the canonical lengths depend on compressed_symbols,
+each static table has a length table for each of a few common radixes
+(see static_code_lengths[] below);
+with any other radix the static tables are simply not used.
+Each table also keeps the short typical sample it was built from,
+for the tests and benchmarks.
+*/
+struct static_huffman_table{
+    const char * name;
+    const char * sample_text;
+};
+
+static const struct static_huffman_table static_huffman_tables[] = {
+    { "English prose",
+"It was the best of times, it was the worst of times. "
+"The committee met on Tuesday afternoon to discuss the new library, "
+"and after a long and sometimes heated debate they agreed that the "
+"old building would be kept, repaired, and opened again in the spring. "
+"Most of the people who spoke were in favor of the plan; a few were not. "
+"\"We have waited long enough,\" said one of the older members, "
+"who had lived in the town for more than forty years. "
+"Others asked how much it would cost, and where the money would come from, "
+"but nobody could give them a clear answer that evening. "
+"When the meeting ended, the rain had stopped and the streets were quiet.\n"
+"She walked home slowly, thinking about what her grandmother used to say: "
+"that a town is only as good as the books its children can read. "
+"In the morning she wrote a letter to the newspaper.\n"
+    },
+    { "source code",
+"#include <stdio.h>\n"
+"#include <string.h>\n"
+"\n"
+"int\n"
+"count_words( const char * text, int length ){\n"
+"    int words = 0;\n"
+"    bool in_word = false;\n"
+"    for( int i=0; i<length; i++ ){\n"
+"        if( isspace( text[i] ) ){\n"
+"            in_word = false;\n"
+"        }else if( !in_word ){\n"
+"            in_word = true;\n"
+"            words++;\n"
+"        };\n"
+"    };\n"
+"    return words; // FIXME: handle '\\0'\n"
+"}\n"
+"\n"
+"static void\n"
+"print_table( const int n, const int table[n] ){\n"
+"    for( int i=0; i<n; i++ ){\n"
+"        printf(\"# %i: %i\\n\", i, table[i]);\n"
+"        assert( 0 <= table[i] );\n"
+"    };\n"
+"}\n"
+"/* list[i].count = symbol_frequencies[i]; */\n"
+"    struct node * list = scratch->list;\n"
+"    if( (0 < n) and (n < max_size) ){ x = y[n] + z[n-1]; };\n"
+    },
+    { "JSON",
+"{\"id\": 1042, \"name\": \"widget\", \"tags\": [\"blue\", \"small\"], "
+"\"price\": 12.50, \"in_stock\": true, \"dimensions\": {\"width\": 3, \"height\": 7}},\n"
+"{\"id\": 1043, \"name\": \"gadget\", \"tags\": [], "
+"\"price\": 99.99, \"in_stock\": false, \"dimensions\": {\"width\": 10, \"height\": 2}},\n"
+"{\"id\": 1044, \"name\": \"sprocket\", \"tags\": [\"red\"], "
+"\"price\": 0.75, \"in_stock\": true, \"dimensions\": null},\n"
+"{\"user\": {\"login\": \"alice\", \"email\": \"alice@example.com\", \"admin\": false}, "
+"\"created_at\": \"2021-10-25T14:03:59Z\", \"items\": [1042, 1044], \"total\": 13.25},\n"
+"{\"user\": {\"login\": \"bob\", \"email\": \"bob@example.org\", \"admin\": true}, "
+"\"created_at\": \"2021-11-02T08:41:07Z\", \"items\": [1043], \"total\": 99.99},\n"
+"{\"status\": \"ok\", \"count\": 5, \"next\": \"/api/v1/orders?page=2&limit=50\"}\n"
+    },
+    { "logs",
+"2021-11-02 08:41:07,113 INFO  [main] server.Listener - listening on 0.0.0.0:8080\n"
+"2021-11-02 08:41:07,356 DEBUG [worker-3] db.Pool - opened connection 7 of 16\n"
+"2021-11-02 08:41:09,002 INFO  [worker-1] http.Access - 192.168.1.23 GET /index.html 200 5123 12ms\n"
+"2021-11-02 08:41:09,417 WARN  [worker-2] http.Access - 10.0.0.5 GET /favicon.ico 404 0 1ms\n"
+"2021-11-02 08:41:10,851 INFO  [worker-4] http.Access - 192.168.1.23 POST /api/login 302 0 48ms\n"
+"2021-11-02 08:41:12,090 ERROR [worker-3] db.Pool - timeout after 30000 ms waiting for connection\n"
+"2021-11-02 08:41:12,091 INFO  [worker-3] db.Pool - retrying (attempt 2 of 5)\n"
+"Nov  2 08:41:13 host1 sshd[2211]: Accepted publickey for deploy from 10.0.0.9 port 52114\n"
+"Nov  2 08:41:15 host1 kernel: [12345.678901] eth0: link up, 1000 Mbps, full duplex\n"
+"Nov  2 08:41:16 host1 CRON[2290]: (root) CMD (run-parts /etc/cron.hourly)\n"
+    },
+};
+#define STATIC_TABLE_COUNT ((int)NUM_ELEM( static_huffman_tables ))
+
+/*
+The canonical code lengths of each built-in table,
+one hex digit per byte value 0..255,
+for each radix in static_table_radixes[].
+They were built once by huffman() from the sample text above,
+with one fake sample for every byte 0..255
+(the same trick as the "fake samples to give each symbol a nonzero probability"
+discussed below)
+so every byte has some (long) code.
+They are literal constants,
+so that "\nS" blocks keep their meaning
+whatever later changes are made to huffman(), such as its tie-breaking;
+test_static_tables() pins them.
+*/
+static const int static_table_radixes[] = {2, 3, 4, 9, 10};
+#define STATIC_TABLE_RADIXES ((int)NUM_ELEM( static_table_radixes ))
+static const char static_code_lengths[STATIC_TABLE_COUNT][STATIC_TABLE_RADIXES][256+1] = {
+    { // English prose
+        // n=2
+        "aaaaaaaaaa8aaaaaaaaaaaaaaaaaaaaa3a8aaaaaaaaa7a7aaaaaaaaaaa99aaaa"
+        "aaaaaaaaa8aaa9a9aaa98aa8aaaaaaaaa577536655a7665469554686a7aaaaaa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        // n=3
+        "7777777777677777777777776666666626666666666646566666666666666666"
+        "6666666666666666666666666666666663443244336544334633345464666666"
+        "6666666666666666666666666666666666666666666666666666666666666666"
+        "6666666666666666666666666666666666666666666666666666666666666666",
+        // n=4
+        "5555555555455555555555555555555525455555555535355555555555445555"
+        "5555555554555454555445545555555552333233235433223432234353555555"
+        "5555555555555555555555555555555555555555555555555555555555555555"
+        "5555555555555555555555555555555555555555555555555555555555555555",
+        // n=9
+        "3333333333333333333333333333333313333333333323233333333333333333"
+        "3333333333333333333333333333333332222122223322212322123232333333"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+        // n=10
+        "4444333333333333333333333333333313333333333323233333333333333333"
+        "3333333333333333333333333333333331222122223322112322123232333333"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+    },
+    { // source code
+        // n=2
+        "aaaaaaaaaa5aaaaaaaaaaaaaaaaaaaaa2998a8a86687888879aaaaaaaa86778a"
+        "aaaaa99aa9aaa9aaaaaaaaaa9aa787a7a676657875aa6855895557978887a7aa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa9",
+        // n=3
+        "7766666666366666666666666666666626556565445455554666666666544456"
+        "6666666666666666666666666664546464444345436645345633346455546466"
+        "6666666666666666666666666666666666666666666666666666666666666666"
+        "6666666666666666666666666666666666666666666666666666666666666666",
+        // n=4
+        "5555555555355555555555555555555515445454334444444555555555434345"
+        "5555555555555555555555555554445453433334425534234533235344445455"
+        "5555555555555555555555555555555555555555555555555555555555555555"
+        "5555555555555555555555555555555555555555555555555555555555555555",
+        // n=9
+        "3333333333233333333333333333333313333333223233322333333333322233"
+        "3333333333333333333333333332323232222223213323223322123223323233"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+        // n=10
+        "3333333333233333333333333333333313323333222223222333333333322223"
+        "3333333333333333333333333332323232222222213322122322123222223233"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+    },
+    { // JSON
+        // n=2
+        "aaaaaaaaaa7aaaaaaaaaaaaaaaaaaaaa4a3aaa9aaaaa5878666777a8974aa8a9"
+        "8aaaaaaaaaaaaaaaaaaa8aaaaa87a7a7a576658675a766667a6557988aa6a6aa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa99",
+        // n=3
+        "7766666666566666666666666666666636266666666635454445446564366666"
+        "5666666666666666666656666655656563544354536544444643346556646466"
+        "6666666666666666666666666666666666666666666666666666666666666666"
+        "6666666666666666666666666666666666666666666666666666666666666666",
+        // n=4
+        "5555555555455555555555555555555525255555555524343334335453255454"
+        "4555555555555555555545555544545453433243425433333533334445535355"
+        "5555555555555555555555555555555555555555555555555555555555555555"
+        "5555555555555555555555555555555555555555555555555555555555555555",
+        // n=9
+        "3333333333233333333333333333333313133333333322222222223232233333"
+        "3333333333333333333333333332323232222232223222222322223223323233"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+        // n=10
+        "3333333333233333333333333333333313133333333322222222223232133333"
+        "3333333333333333333333333332323232222122223222222322223223323233"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+    },
+    { // logs
+        // n=2
+        "aaaaaaaaaa7aaaaaaaaaaaaaaaaaaaaa3aaaaaaa88aa756844576788676aaaaa"
+        "a8999888a8aa99778a8989a9aaa7a7aaa786757876a767656a56578798aaaaaa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        // n=3
+        "7777777777477777777777777777777727777777557743453334455544477776"
+        "6566655565666645565656666664646665544355446444434634355565666666"
+        "6666666666666666666666666666666666666666666666666666666666666666"
+        "6666666666666666666666666666666666666666666666666666666666666666",
+        // n=4
+        "5555555555355555555555555555555525555555445533342223344433355555"
+        "5455444454555434454545555553535554433344335333323533344444555555"
+        "5555555555555555555555555555555555555555555555555555555555555555"
+        "5555555555555555555555555555555555555555555555555555555555555555",
+        // n=9
+        "3333333333233333333333333333333313333333333322222122222322233333"
+        "3333333333333322332333333332323332222223223222222322222233333333"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+        // n=10
+        "3333333333233333333333333333333313333333323322221122222222233333"
+        "3233322232333322232323333332323332222222223222222322222232333333"
+        "3333333333333333333333333333333333333333333333333333333333333333"
+        "3333333333333333333333333333333333333333333333333333333333333333",
+    },
+};
+// compress() with this table id builds a fresh "\nX" table instead.
+#define NO_STATIC_TABLE (-1)
+
+/*
+One LZ77 token:
+a literal byte (length 0),
+or a copy of length bytes starting distance bytes back.
+*/
+struct lz_token{
+    unsigned short length; // 0 for a literal
+    unsigned short value; // the literal byte, or the match distance
+};
+#define LZ_MIN_MATCH (3)
+#define LZ_MAX_MATCH (258)
+#define LZ_HASH_BITS (15)
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+// see compress_contexts()
+#define CONTEXT_CLASSES (32)
+#define MAX_CONTEXT_TABLES (CONTEXT_CLASSES)
+
+/*
+The word-token mode (see compress_words()):
+each distinct token of a block,
+found again by hashing its bytes.
+*/
+struct word_entry{
+    int start; // where it first appears in the block
+    int length;
+    int count;
+    int symbol; // WORD_FIRST_SYMBOL and up when it's in the dictionary, else -1
+};
+struct word_key{
+    const unsigned char * text;
+    int length;
+    int saving; // bytes no longer spelled out, if it's in the dictionary
+    int entry;
+};
+#define WORD_MAX_LENGTH (32)
+#define WORD_MIN_SAVING (4)
+#define WORD_HASH_BITS (16)
+#define WORD_HASH_SIZE (1 << WORD_HASH_BITS)
+// see compress_tans()
+#define TANS_MIN_TABLE_LOG (5)
+#define TANS_MAX_TABLE_LOG (12)
+#define TANS_DEFAULT_TABLE_LOG (11)
+#define TANS_MAX_TABLE_SIZE (1 << TANS_MAX_TABLE_LOG)
+
+/*
+Per-compressor scratch arena:
+everything one block in the Huffman path needs,
+allocated once with new_block_scratch()
+and reset (not reallocated) between blocks,
+so the steady state does no allocation
+and keeps hitting the same (cache-warm) memory.
+Each thread compressing its own stream
+should use its own block_scratch.
+*/
+struct block_scratch{
+    struct huffman_scratch tree;
+    int symbol_frequencies[MAX_LEAF_VALUE+1];
+    int canonical_lengths[MAX_LEAF_VALUE+1];
+    int encode_length_table[MAX_LEAF_VALUE+1];
+    unsigned int encode_value_table[MAX_LEAF_VALUE+1];
+    // the decompressor's copy of the most-recent table
+    int decode_lengths[MAX_DECODE_SYMBOLS];
+    struct canonical_decoder decoder;
+    char original_text[BLOCK_SIZE+1];
+    char compressed_text[COMPRESSED_BLOCK_SIZE];
+    char decompressed_text[BLOCK_SIZE+1];
+    // built-in static tables, built for one radix at a time
+    int static_tables_radix; // 0 until prepare_static_tables()
+    bool static_table_usable[STATIC_TABLE_COUNT];
+    int static_lengths[STATIC_TABLE_COUNT][MAX_LEAF_VALUE+1];
+    struct adaptive_huffman adaptive;
+    // the LZ77 front end: hash chains, tokens, and both alphabets
+    int lz_head[LZ_HASH_SIZE]; // most recent position with each hash, or -1
+    int lz_previous[BLOCK_SIZE]; // the position before that with the same hash
+    struct lz_token lz_tokens[BLOCK_SIZE];
+    // optimal parsing: the cheapest way (in digits) to reach each position,
+    // and the token that gets there
+    int lz_cost[BLOCK_SIZE+1];
+    struct lz_token lz_step[BLOCK_SIZE+1];
+    int lz_frequencies[LZ_MAX_SYMBOL_VALUE+1];
+    int lz_lengths[LZ_MAX_SYMBOL_VALUE+1];
+    int lz_encode_lengths[LZ_MAX_SYMBOL_VALUE+1];
+    unsigned int lz_encode_values[LZ_MAX_SYMBOL_VALUE+1];
+    int lz_distance_frequencies[LZ_DISTANCE_SYMBOLS];
+    int lz_distance_lengths[LZ_DISTANCE_SYMBOLS];
+    int lz_distance_encode_lengths[LZ_DISTANCE_SYMBOLS];
+    unsigned int lz_distance_encode_values[LZ_DISTANCE_SYMBOLS];
+    struct canonical_decoder lz_distance_decoder;
+    // context-selected tables, one per class of the previous byte
+    int context_frequencies[MAX_CONTEXT_TABLES][256];
+    int context_lengths[MAX_CONTEXT_TABLES][256];
+    int context_encode_lengths[MAX_CONTEXT_TABLES][256];
+    unsigned int context_encode_values[MAX_CONTEXT_TABLES][256];
+    char context_tables[MAX_CONTEXT_TABLES][LZ_MAX_SYMBOL_VALUE+16]; // compact length tables
+    int context_table_lengths[MAX_CONTEXT_TABLES];
+    struct canonical_decoder context_decoders[MAX_CONTEXT_TABLES];
+    // word tokens: the hash table, the tokens, and the dictionary
+    int word_slot[WORD_HASH_SIZE]; // entry index, or -1
+    struct word_entry word_entries[BLOCK_SIZE];
+    int word_tokens[BLOCK_SIZE]; // entry index of each token, in order
+    struct word_key word_keys[BLOCK_SIZE];
+    int word_frequencies[WORD_MAX_SYMBOL_VALUE+1];
+    int word_lengths[WORD_MAX_SYMBOL_VALUE+1];
+    int word_encode_lengths[WORD_MAX_SYMBOL_VALUE+1];
+    unsigned int word_encode_values[WORD_MAX_SYMBOL_VALUE+1];
+    char word_table[WORD_MAX_SYMBOL_VALUE+16]; // compact length table
+    unsigned char word_dictionary[WORD_DICTIONARY_SIZE * (2 + WORD_MAX_LENGTH)];
+    // the decompressor's copy of the dictionary
+    unsigned char dictionary_text[WORD_DICTIONARY_SIZE][WORD_MAX_LENGTH];
+    int dictionary_length[WORD_DICTIONARY_SIZE];
+    // tANS: the normalized counts, and tables for both directions
+    int tans_counts[256];
+    int tans_cumulative[256];
+    int tans_max_bits[256];
+    int tans_threshold[256];
+    unsigned char tans_spread[TANS_MAX_TABLE_SIZE];
+    unsigned char tans_symbol[TANS_MAX_TABLE_SIZE];
+    unsigned char tans_bits[TANS_MAX_TABLE_SIZE];
+    unsigned short tans_base[TANS_MAX_TABLE_SIZE];
+    unsigned short tans_encode_state[TANS_MAX_TABLE_SIZE];
+    // the bits of each encoding step, written out in reverse
+    unsigned short tans_step_value[BLOCK_SIZE];
+    unsigned char tans_step_bits[BLOCK_SIZE];
+};
+
+struct block_scratch *
+new_block_scratch(void){
+    struct block_scratch * scratch = calloc( 1, sizeof( *scratch ) );
+    assert( scratch );
+    return scratch;
+}
+
+/*
+Only the tables that are accumulated into
+need to be cleared between blocks;
+everything else is completely overwritten
+before it is read.
+*/
+void
+reset_block_scratch( struct block_scratch * scratch ){
+    for( int i=0; i<(MAX_LEAF_VALUE+1); i++){
+        scratch->symbol_frequencies[i] = 0;
+        scratch->canonical_lengths[i] = 0;
+    };
+}
+
+void
+free_block_scratch( struct block_scratch * scratch ){
+    free( scratch );
+}
+
+/*
+Unpack the length table of every built-in static table
+for this radix,
+unless they're already unpacked.
+With a radix that has no length tables,
+every static table is marked unusable.
+*/
+void
+prepare_static_tables( struct block_scratch * scratch, const int compressed_symbols ){
+    if( compressed_symbols == scratch->static_tables_radix ){
+        return;
+    };
+    int radix = -1;
+    for( int r=0; r<STATIC_TABLE_RADIXES; r++ ){
+        if( compressed_symbols == static_table_radixes[r] ){
+            radix = r;
+        };
+    };
+    for( int k=0; k<STATIC_TABLE_COUNT; k++ ){
+        int * lengths = scratch->static_lengths[k];
+        for( int i=0; i<(MAX_LEAF_VALUE+1); i++ ){
+            lengths[i] = 0;
+        };
+        scratch->static_table_usable[k] = (0 <= radix);
+        if( radix < 0 ){
+            continue;
+        };
+        const char * hex_lengths = static_code_lengths[k][radix];
+        assert( 256 == strlen( hex_lengths ) );
+        for( int i=0; i<256; i++ ){
+            const char * hex = strchr( "0123456789abcdef", hex_lengths[i] );
+            assert( hex and *hex );
+            lengths[i] = hex - "0123456789abcdef";
+            assert( 0 < lengths[i] );
+        };
+    };
+    scratch->static_tables_radix = compressed_symbols;
+}
+
+void
+start_adaptive_huffman( struct adaptive_huffman * tree, const int compressed_symbols ){
+    assert( 2 <= compressed_symbols );
+    tree->compressed_symbols = compressed_symbols;
+    tree->raw_digits = 0;
+    for( int values = 1; values < 256; values *= compressed_symbols ){
+        tree->raw_digits++;
+    };
+    for( int i=0; i<256; i++ ){
+        tree->leaf_slot[i] = -1;
+    };
+    // the root starts out as the NYT leaf.
+    tree->nodes = 1;
+    tree->nyt = 0;
+    tree->last_group = 0;
+    tree->weight[0] = 1;
+    tree->parent[0] = -1;
+    tree->first_child[0] = -1;
+    tree->child_count[0] = 0;
+    tree->symbol[0] = ADAPTIVE_NYT;
+}
+
+/*
+Exchange the contents (and so the whole subtrees)
+of two slots with equal weights.
+The slots themselves, and so their parents, stay put.
+*/
+static void
+swap_adaptive_slots( struct adaptive_huffman * tree, const int a, const int b ){
+    assert( tree->weight[a] == tree->weight[b] );
+    const int first_child = tree->first_child[a];
+    const int child_count = tree->child_count[a];
+    const int symbol = tree->symbol[a];
+    tree->first_child[a] = tree->first_child[b];
+    tree->child_count[a] = tree->child_count[b];
+    tree->symbol[a] = tree->symbol[b];
+    tree->first_child[b] = first_child;
+    tree->child_count[b] = child_count;
+    tree->symbol[b] = symbol;
+    const int slots[2] = {a, b};
+    for( int i=0; i<2; i++ ){
+        const int slot = slots[i];
+        if( tree->first_child[slot] < 0 ){
+            if( ADAPTIVE_NYT == tree->symbol[slot] ){
+                tree->nyt = slot;
+            }else{
+                tree->leaf_slot[ tree->symbol[slot] ] = slot;
+            };
+        }else{
+            for( int c=0; c<tree->child_count[slot]; c++ ){
+                tree->parent[ tree->first_child[slot] + c ] = slot;
+            };
+        };
+    };
+}
+
+static int
+new_adaptive_slot(
+    struct adaptive_huffman * tree, const int parent, const int weight, const int symbol
+){
+    const int slot = tree->nodes++;
+    assert( slot < ADAPTIVE_MAX_NODES );
+    tree->weight[slot] = weight;
+    tree->parent[slot] = parent;
+    tree->first_child[slot] = -1;
+    tree->child_count[slot] = 0;
+    tree->symbol[slot] = symbol;
+    if( ADAPTIVE_NYT == symbol ){
+        tree->nyt = slot;
+    }else{
+        tree->leaf_slot[symbol] = slot;
+    };
+    tree->child_count[parent]++;
+    return slot;
+}
+
+/*
+Add a (weight 0) leaf for a symbol
+that has just been sent after the NYT code.
+*/
+static int
+add_adaptive_symbol( struct adaptive_huffman * tree, const unsigned char symbol ){
+    assert( tree->leaf_slot[symbol] < 0 );
+    const int n = tree->compressed_symbols;
+    const int last_parent = tree->parent[ tree->last_group ];
+    if( (0 <= last_parent) and (tree->child_count[last_parent] < n) ){
+        // room for one more sibling in the last group.
+        return new_adaptive_slot( tree, last_parent, 0, symbol );
+    };
+    // split the NYT leaf into a new group [NYT, symbol].
+    const int old_nyt = tree->nyt;
+    const int group = tree->nodes;
+    tree->first_child[old_nyt] = group;
+    tree->child_count[old_nyt] = 0;
+    new_adaptive_slot( tree, old_nyt, 1, ADAPTIVE_NYT );
+    tree->last_group = group;
+    return new_adaptive_slot( tree, old_nyt, 0, symbol );
+}
+
+static void
+update_adaptive_huffman( struct adaptive_huffman * tree, int slot ){
+    while( 0 <= slot ){
+        // the lowest-numbered slot with the same weight
+        int leader = slot;
+        while( (0 < leader) and (tree->weight[leader-1] == tree->weight[slot]) ){
+            leader--;
+        };
+        if( leader != slot ){
+            swap_adaptive_slots( tree, leader, slot );
+            slot = leader;
+        };
+        tree->weight[slot]++;
+        slot = tree->parent[slot];
+    };
+}
+
+struct digit_writer{
+    int compressed_symbols;
+    bool packed_digits;
+    int digits_per_byte;
+    int packed_value;
+    int packed_count;
+    int digit_count;
+    int size;
+    int length;
+    char * out;
+};
+
+static void
+start_digit_writer(
+    struct digit_writer * writer,
+    const int compressed_symbols,
+    const bool packed_digits,
+    const int size,
+    char out[size]
+){
+    writer->compressed_symbols = compressed_symbols;
+    writer->packed_digits = packed_digits;
+    writer->digits_per_byte =
+        packed_digits ? digits_per_packed_byte( compressed_symbols ) : 1;
+    writer->packed_value = 0;
+    writer->packed_count = 0;
+    writer->digit_count = 0;
+    writer->size = size;
+    writer->length = 0;
+    writer->out = out;
+}
+
+static inline void
+write_digit( struct digit_writer * writer, const int digit ){
+    assert( (0 <= digit) and (digit < writer->compressed_symbols) );
+    writer->digit_count++;
+    if( !writer->packed_digits ){
+        assert( writer->length < writer->size );
+        writer->out[ writer->length++ ] = printable_digits[digit];
+        return;
+    };
+    writer->packed_value = writer->packed_value * writer->compressed_symbols + digit;
+    writer->packed_count++;
+    if( writer->digits_per_byte == writer->packed_count ){
+        assert( writer->length < writer->size );
+        writer->out[ writer->length++ ] = (unsigned char)writer->packed_value;
+        writer->packed_value = 0;
+        writer->packed_count = 0;
+    };
+}
+
+// pad the last byte with zero digits.
+static void
+finish_digit_writer( struct digit_writer * writer ){
+    const int digit_count = writer->digit_count;
+    while( 0 != writer->packed_count ){
+        write_digit( writer, 0 );
+    };
+    writer->digit_count = digit_count;
+}
+
+/*
+Write the code for one symbol,
+then update the tree.
+*/
+void
+encode_adaptive_symbol(
+    struct adaptive_huffman * tree,
+    struct digit_writer * writer,
+    const unsigned char symbol
+){
+    const int n = tree->compressed_symbols;
+    const bool known = (0 <= tree->leaf_slot[symbol]);
+    // collect the path from the leaf up to the root ...
+    int digits[ADAPTIVE_MAX_NODES];
+    int length = 0;
+    for( int slot = known ? tree->leaf_slot[symbol] : tree->nyt;
+        0 <= tree->parent[slot]; slot = tree->parent[slot]
+    ){
+        digits[length++] = slot - tree->first_child[ tree->parent[slot] ];
+    };
+    // ... and write it root first.
+    while( length ){
+        write_digit( writer, digits[--length] );
+    };
+    int slot = tree->leaf_slot[symbol];
+    if( !known ){
+        int value = symbol;
+        for( int j=tree->raw_digits-1; j>=0; j-- ){
+            digits[j] = value % n;
+            value /= n;
+        };
+        for( int j=0; j<tree->raw_digits; j++ ){
+            write_digit( writer, digits[j] );
+        };
+        slot = add_adaptive_symbol( tree, symbol );
+    };
+    update_adaptive_huffman( tree, slot );
+}
+
+int
+decode_adaptive_symbol(
+    struct adaptive_huffman * tree,
+    struct digit_reader * reader
+){
+    const int n = tree->compressed_symbols;
+    int slot = 0;
+    while( 0 <= tree->first_child[slot] ){
+        const int digit = read_digit( reader );
+        assert( digit < tree->child_count[slot] );
+        slot = tree->first_child[slot] + digit;
+    };
+    int symbol = tree->symbol[slot];
+    if( ADAPTIVE_NYT == symbol ){
+        symbol = 0;
+        for( int j=0; j<tree->raw_digits; j++ ){
+            symbol = symbol * n + read_digit( reader );
+        };
+        assert( symbol < 256 );
+        slot = add_adaptive_symbol( tree, symbol );
+    };
+    update_adaptive_huffman( tree, slot );
+    reader->position = reader->digits_read;
+    return symbol;
+}
+
+/*
+Compact encodings of a canonical length table,
+for the "\nW" table block:
+    "\nW" compressed_symbols ':' max_symbol_value ':' method
+followed by the table in one of these methods:
+'N': nybbles, two lengths per byte, high nybble first.
+'R': the same nybbles,
+    except a 0 nybble is followed by a nybble holding
+    (the number of zero lengths in this run) - 1,
+    so a run of up to 16 unused symbols costs one byte.
+'H': DEFLATE-style Huffman-coded lengths:
+    digit_count ':' followed by packed bits:
+    19 3-bit lengths of a (binary, canonical) code
+    for the code-length alphabet
+        0..15: a length,
+        16: repeat the previous length 3-6 times (2 extra bits),
+        17: 3-10 zero lengths (3 extra bits),
+        18: 11-138 zero lengths (7 extra bits),
+    then the code-length symbols, each followed by its extra bits.
+    (Unlike DEFLATE, the 19 lengths are sent in plain order,
+    and all 19 are always sent).
+The 'H' lengths are decoded by the same
+first-code / count tables as the data.
+*/
+#define CODE_LENGTH_SYMBOLS (19)
+#define MAX_CODE_LENGTH_CODE (7)
+#define LENGTH_TABLE_METHODS "NRH"
+
+static void
+put_nybble( char out[], const int nybble_index, const int value ){
+    assert( (0 <= value) and (value < 16) );
+    if( 0 == (nybble_index & 1) ){
+        out[ nybble_index / 2 ] = value << 4;
+    }else{
+        out[ nybble_index / 2 ] |= value;
+    };
+}
+
+static int
+get_nybble( const char in[], const int nybble_index ){
+    const unsigned char byte = in[ nybble_index / 2 ];
+    return (nybble_index & 1) ? (byte & 0x0f) : (byte >> 4);
+}
+
+// write value as exactly digits n-ary digits, most-significant first.
+static void
+write_digits( struct digit_writer * writer, int value, const int digits ){
+    assert( digits <= MAX_CODE_LENGTH );
+    int d[MAX_CODE_LENGTH];
+    for( int j=digits-1; j>=0; j-- ){
+        d[j] = value % writer->compressed_symbols;
+        value /= writer->compressed_symbols;
+    };
+    assert( 0 == value );
+    if( !writer->packed_digits ){
+        for( int j=0; j<digits; j++ ){
+            write_digit( writer, d[j] );
+        };
+        return;
+    };
+    // the same packing as write_digit(),
+    // without a call per digit
+    // (as in represent_items_with_codes()).
+    int packed_value = writer->packed_value;
+    int packed_count = writer->packed_count;
+    for( int j=0; j<digits; j++ ){
+        packed_value = packed_value * writer->compressed_symbols + d[j];
+        packed_count++;
+        if( writer->digits_per_byte == packed_count ){
+            assert( writer->length < writer->size );
+            writer->out[ writer->length++ ] = (unsigned char)packed_value;
+            packed_value = 0;
+            packed_count = 0;
+        };
+    };
+    writer->packed_value = packed_value;
+    writer->packed_count = packed_count;
+    writer->digit_count += digits;
+}
+
+static void
+write_bits( struct digit_writer * writer, const int value, const int bits ){
+    for( int b=bits-1; b>=0; b-- ){
+        write_digit( writer, (value >> b) & 1 );
+    };
+}
+
+static int
+read_bits( struct digit_reader * reader, const int bits ){
+    int value = 0;
+    for( int b=0; b<bits; b++ ){
+        value = (value << 1) | read_digit( reader );
+    };
+    reader->position += bits;
+    return value;
+}
+
+/*
+The 'H' method in two steps:
+the code-length symbols of the table and the code for them,
+then the bits.
+A caller that writes the same table many times
+builds the code only once.
+*/
+struct length_table_code{
+    int count;
+    int symbols[WORD_MAX_SYMBOL_VALUE+1];
+    int extra[WORD_MAX_SYMBOL_VALUE+1];
+    int code_lengths[CODE_LENGTH_SYMBOLS];
+    int encode_lengths[CODE_LENGTH_SYMBOLS];
+    unsigned int encode_values[CODE_LENGTH_SYMBOLS];
+};
+
+void
+build_length_table_code(
+    struct block_scratch * scratch,
+    const int max_symbol_value,
+    const int lengths[max_symbol_value+1],
+    struct length_table_code * code // output
+){
+    assert( max_symbol_value <= WORD_MAX_SYMBOL_VALUE );
+    // turn the lengths into code-length symbols and extra bits.
+    int * symbols = code->symbols;
+    int * extra = code->extra;
+    int count = 0;
+    for( int i=0; i<=max_symbol_value; ){
+        const int length = lengths[i];
+        int run = 1;
+        while( (i + run <= max_symbol_value) and (length == lengths[i + run]) ){
+            run++;
+        };
+        if( (0 == length) and (11 <= run) ){
+            run = imin( run, 138 );
+            symbols[count] = 18; extra[count++] = run - 11;
+        }else if( (0 == length) and (3 <= run) ){
+            run = imin( run, 10 );
+            symbols[count] = 17; extra[count++] = run - 3;
+        }else{
+            symbols[count] = length; extra[count++] = 0;
+            run = 1;
+            int repeats = 0;
+            while( (0 != length) and (i + 1 + repeats <= max_symbol_value) and
+                (length == lengths[i + 1 + repeats])
+            ){
+                repeats++;
+            };
+            while( 3 <= repeats ){
+                const int r = imin( repeats, 6 );
+                symbols[count] = 16; extra[count++] = r - 3;
+                run += r;
+                repeats -= r;
+            };
+        };
+        i += run;
+    };
+    code->count = count;
+    // a length-limited binary Huffman code for the code-length symbols:
+    // halve the frequencies until no code is longer than 7 bits.
+    int frequencies[CODE_LENGTH_SYMBOLS];
+    for( int i=0; i<CODE_LENGTH_SYMBOLS; i++ ){
+        frequencies[i] = 0;
+    };
+    for( int i=0; i<count; i++ ){
+        frequencies[ symbols[i] ]++;
+    };
+    limited_huffman( &scratch->tree, CODE_LENGTH_SYMBOLS-1, frequencies, 2,
+        MAX_CODE_LENGTH_CODE, code->code_lengths );
+    convert_lengths_to_encode_table( CODE_LENGTH_SYMBOLS-1, code->code_lengths, 2,
+        code->encode_lengths, code->encode_values );
+}
+
+// returns the number of bytes written.
+int
+write_length_table_code(
+    const struct length_table_code * code,
+    const int size,
+    char out[size] // output
+){
+    const int extra_bits[CODE_LENGTH_SYMBOLS] = {
+        0,0,0,0, 0,0,0,0, 0,0,0,0, 0,0,0,0, 2, 3, 7 };
+    // the bits go just past the longest possible digit_count header,
+    // and are moved down once we know the header.
+    const int reserved = 8;
+    struct digit_writer writer;
+    start_digit_writer( &writer, 2, true, size - reserved, &out[reserved] );
+    for( int c=0; c<CODE_LENGTH_SYMBOLS; c++ ){
+        write_bits( &writer, code->code_lengths[c], 3 );
+    };
+    for( int i=0; i<code->count; i++ ){
+        const int c = code->symbols[i];
+        write_bits( &writer, code->encode_values[c], code->encode_lengths[c] );
+        write_bits( &writer, code->extra[i], extra_bits[c] );
+    };
+    finish_digit_writer( &writer );
+    char header[reserved];
+    const int header_length = snprintf( header, reserved, "%d:", writer.digit_count );
+    assert( header_length < reserved );
+    memmove( &out[header_length], &out[reserved], writer.length );
+    memcpy( out, header, header_length );
+    return header_length + writer.length;
+}
+
+/*
+Write the table (everything after the method character)
+into out[];
+returns the number of bytes written.
+*/
+int
+encode_length_table(
+    struct block_scratch * scratch,
+    const char method,
+    const int max_symbol_value,
+    const int lengths[max_symbol_value+1],
+    const int size,
+    char out[size] // output
+){
+    if( ('N' == method) or ('R' == method) ){
+        int nybbles = 0;
+        for( int i=0; i<=max_symbol_value; i++ ){
+            assert( (0 <= lengths[i]) and (lengths[i] < 16) );
+            assert( (nybbles + 3) / 2 <= size );
+            put_nybble( out, nybbles++, lengths[i] );
+            if( ('R' == method) and (0 == lengths[i]) ){
+                int run = 1;
+                while( (run < 16) and (i + run <= max_symbol_value) and
+                    (0 == lengths[i + run])
+                ){
+                    run++;
+                };
+                put_nybble( out, nybbles++, run - 1 );
+                i += run - 1;
+            };
+        };
+        return (nybbles + 1) / 2;
+    };
+    assert( 'H' == method );
+    struct length_table_code code;
+    build_length_table_code( scratch, max_symbol_value, lengths, &code );
+    return write_length_table_code( &code, size, out );
+}
+
+/*
+The inverse of encode_length_table().
+Builds its 'H' decoder in scratch->decoder,
+so call this *before* building the decoder for the data.
+*/
+void
+decode_length_table(
+    struct block_scratch * scratch,
+    const char method,
+    const int length,
+    const char data[length],
+    const int max_symbol_value,
+    int lengths[max_symbol_value+1] // output
+){
+    if( ('N' == method) or ('R' == method) ){
+        int nybbles = 0;
+        for( int i=0; i<=max_symbol_value; ){
+            assert( nybbles / 2 < length );
+            const int value = get_nybble( data, nybbles++ );
+            if( ('R' == method) and (0 == value) ){
+                const int run = get_nybble( data, nybbles++ ) + 1;
+                assert( i + run <= max_symbol_value + 1 );
+                for( int r=0; r<run; r++ ){
+                    lengths[i++] = 0;
+                };
+            }else{
+                lengths[i++] = value;
+            };
+        };
+        return;
+    };
+    assert( 'H' == method );
+    char * end = NULL;
+    const int digit_count = strtol( data, &end, 10 );
+    assert( ':' == *end );
+    assert( (digit_count + 7) / 8 == (data + length) - (end + 1) );
+    struct digit_reader reader;
+    start_digit_reader( &reader, 2, true, digit_count,
+        (const unsigned char *)(end + 1) );
+    int code_lengths[CODE_LENGTH_SYMBOLS];
+    for( int c=0; c<CODE_LENGTH_SYMBOLS; c++ ){
+        code_lengths[c] = read_bits( &reader, 3 );
+    };
+    struct canonical_decoder * decoder = &scratch->decoder;
+    convert_lengths_to_decode_table( CODE_LENGTH_SYMBOLS-1, code_lengths, 2, decoder );
+    int i = 0;
+    while( i <= max_symbol_value ){
+        const int symbol = decode_symbol_one_digit_at_a_time( decoder, &reader );
+        assert( (0 <= symbol) and (symbol < CODE_LENGTH_SYMBOLS) );
+        int run = 1;
+        int value = symbol;
+        if( 16 == symbol ){
+            assert( 0 < i );
+            value = lengths[i-1];
+            run = 3 + read_bits( &reader, 2 );
+        }else if( 17 == symbol ){
+            value = 0;
+            run = 3 + read_bits( &reader, 3 );
+        }else if( 18 == symbol ){
+            value = 0;
+            run = 11 + read_bits( &reader, 7 );
+        };
+        assert( i + run <= max_symbol_value + 1 );
+        for( int r=0; r<run; r++ ){
+            lengths[i++] = value;
+        };
+    };
+    assert( reader.position == digit_count );
+}
+
+/*
+Try every method, and leave the smallest in out[].
+Returns the number of bytes written, including the method character.
+*/
+int
+encode_smallest_length_table(
+    struct block_scratch * scratch,
+    const int max_symbol_value,
+    const int lengths[max_symbol_value+1],
+    const int size,
+    char out[size] // output
+){
+    const char * methods = LENGTH_TABLE_METHODS;
+    char candidate[WORD_MAX_SYMBOL_VALUE+16];
+    int best_length = INT_MAX;
+    for( int m=0; methods[m]; m++ ){
+        const int length = encode_length_table( scratch, methods[m],
+            max_symbol_value, lengths, sizeof( candidate ), candidate );
+        if( length + 1 < best_length ){
+            best_length = length + 1;
+            assert( best_length <= size );
+            out[0] = methods[m];
+            memcpy( &out[1], candidate, length );
+        };
+    };
+    return best_length;
+}
+
+/*
+Compress one block with a fresh adaptive tree,
+as a single netstring
+    "\nA" compressed_symbols ':' digit_count ':' packed digits.
+The coder itself is one-pass:
+each symbol's digits are written as soon as it's read.
+Only the netstring framing needs the length up front,
+so the digits are written just past the longest possible header
+and the header is filled in afterwards.
+Returns the number of bytes written.
+*/
+int
+compress_adaptive(
+    struct block_scratch * scratch,
+    const int compressed_symbols,
+    const int original_length,
+    const char original_text[original_length],
+    const int compressed_size,
+    char compressed_text[compressed_size] // output
+){
+    const int reserved = 32;
+    assert( reserved < compressed_size );
+    struct adaptive_huffman * tree = &scratch->adaptive;
+    start_adaptive_huffman( tree, compressed_symbols );
+    struct digit_writer writer;
+    start_digit_writer( &writer, compressed_symbols, true,
+        compressed_size - reserved - 2, &compressed_text[reserved] );
+    for( int i=0; i<original_length; i++ ){
+        encode_adaptive_symbol( tree, &writer, original_text[i] );
+    };
+    finish_digit_writer( &writer );
+    const int payload_length = 2 +
+        snprintf( NULL, 0, "%d:%d:", compressed_symbols, writer.digit_count ) +
+        writer.length;
+    assert( payload_length <= 0x8000 );
+    char header[reserved];
+    const int header_length = snprintf( header, reserved, "%d:\nA%d:%d:",
+        payload_length, compressed_symbols, writer.digit_count );
+    assert( header_length < reserved );
+    memmove( &compressed_text[header_length], &compressed_text[reserved], writer.length );
+    memcpy( compressed_text, header, header_length );
+    char * d = &compressed_text[ header_length + writer.length ];
+    d += sprintf( d, ",\n" ); // end of netstring
+    return d - compressed_text;
+}
+
+/*
+The size of a block stored as pass-through raw data
+("\n\n" and the original text, as one netstring),
+which every compressed form of the block has to beat.
+*/
+static int
+raw_block_size( const int original_length ){
+    const int raw_payload_length = 2 + original_length;
+    return snprintf( NULL, 0, "%d:", raw_payload_length ) + raw_payload_length + 2;
+}
+
+/*
+Given a list of lengths
+(one length for each symbol)
+and a block of uncompressed text,
+generate a block of compressed text
+(starting with a compact representation
+of the canonical list of lengths).
+Returns the number of bytes written into compressed_text[].
+
+A Huffman-compressed block is written as 2 netstrings:
+first the Huffman table
+    "\nX" compressed_symbols ':' max_symbol_value ':'
+    then one hex digit for the length of each symbol
+    (0 for symbols that never occur in this block),
+or (for packed digits) the same table in the smallest compact form
+    "\nW" compressed_symbols ':' max_symbol_value ':' method ...
+    (see encode_length_table()),
+or (when static_table is one of the built-in tables)
+    "\nS" static_table ':' compressed_symbols,
+then the data, either
+    "\nZ" followed by printable digits, one per output digit,
+or
+    "\nY" digit_count ':' followed by packed digits,
+or (packed, when streams is HUFFMAN_STREAMS)
+    "\nQ" symbol_count ':' then the digit_count of each stream, each followed by ':',
+    then each stream's packed digits, one stream after another.
+Symbol i goes in stream (i % HUFFMAN_STREAMS),
+so the decoder can keep one digit_reader per stream in flight
+and decode HUFFMAN_STREAMS symbols at a time
+that don't depend on each other;
+the digit counts double as a jump table to the start of each stream.
+The human-readable "\nZ" form is always larger than the original text
+(each printable digit carries at most log2(36) bits),
+so we always emit it when asked to;
+we only fall back to pass-through raw data
+when the packed form doesn't save any space.
+*/
+static int
+compress_with_streams(
+    struct block_scratch * scratch,
+    const int static_table, // NO_STATIC_TABLE, or canonical_lengths came from this table
+    const int max_symbol_value,
+    int canonical_lengths[max_symbol_value+1],
+    const int compressed_symbols, // 2 for binary, 3 for trinary, etc.
+    const bool packed_digits,
+    const int streams, // 1, or HUFFMAN_STREAMS (packed digits only)
+    const int original_length,
+    const char original_text[original_length],
+    const int compressed_size,
+    char compressed_text[compressed_size] // output
+){
+    assert( (1 == streams) or ((HUFFMAN_STREAMS == streams) and packed_digits) );
+    if(max_symbol_value > MAX_LEAF_VALUE){
+        assert(0);
+    };
+    if( compressed_symbols < 2 ){
+        assert(0); 
+    };
+    // FUTURE: handle more than 257 source symbols.
+    const int raw_size = raw_block_size( original_length );
+    const int used_symbols =
+        count_nonzero_items( max_symbol_value+1, canonical_lengths );
+    if( (0 < original_length) and (0 < used_symbols) ){
+        DEBUG_PRINTF("# %d : compressed_symbols.\n", compressed_symbols );
+        int * encode_length_table = scratch->encode_length_table;
+        unsigned int * encode_value_table = scratch->encode_value_table;
+        convert_lengths_to_encode_table(
+            max_symbol_value,
+            canonical_lengths,
+            compressed_symbols, // 2 for binary, 3 for trinary, etc.
+            encode_length_table,
+            encode_value_table
+            );
+        const int digit_count = count_code_digits(
+            max_symbol_value, encode_length_table,
+            original_length, original_text
+            );
+        const int digits_per_byte =
+            packed_digits ? digits_per_packed_byte( compressed_symbols ) : 1;
+        int data_bytes = (digit_count + digits_per_byte - 1) / digits_per_byte;
+        int stream_digits[HUFFMAN_STREAMS] = {0};
+        int stream_header_length = 0;
+        if( 1 < streams ){
+            const unsigned char * t = (const unsigned char *)original_text;
+            for( int i=0; i<original_length; i++ ){
+                stream_digits[ i % streams ] += encode_length_table[ t[i] ];
+            };
+            data_bytes = 0;
+            stream_header_length = snprintf( NULL, 0, "%d:", original_length );
+            for( int k=0; k<streams; k++ ){
+                data_bytes += (stream_digits[k] + digits_per_byte - 1) / digits_per_byte;
+                stream_header_length += snprintf( NULL, 0, "%d:", stream_digits[k] );
+            };
+        };
+        // The human-readable form gets the human-readable "\nX" table;
+        // packed data gets the smallest compact "\nW" table.
+        const bool compact_table = packed_digits and (NO_STATIC_TABLE == static_table);
+        char compact[MAX_LEAF_VALUE+16];
+        const int compact_length = compact_table ?
+            encode_smallest_length_table( scratch,
+                max_symbol_value, canonical_lengths, sizeof( compact ), compact ) :
+            0;
+        // FUTURE: there's probably a better way
+        // of encoding max_symbol_value and compressed_symbols.
+        const int table_payload_length =
+            (NO_STATIC_TABLE != static_table) ?
+            2 + snprintf( NULL, 0, "%d:%d", static_table, compressed_symbols ) :
+            2 + snprintf( NULL, 0, "%d:%d:", compressed_symbols, max_symbol_value ) +
+            (compact_table ? compact_length : max_symbol_value + 1);
+        const int data_payload_length = (1 < streams) ?
+            2 + stream_header_length + data_bytes :
+            2 + (packed_digits ? snprintf( NULL, 0, "%d:", digit_count ) : 0) +
+            data_bytes;
+        const int huffman_size =
+            snprintf( NULL, 0, "%d:", table_payload_length ) + table_payload_length + 2 +
+            snprintf( NULL, 0, "%d:", data_payload_length ) + data_payload_length + 2;
+        DEBUG_PRINTF("# huffman header + data: %d bytes; raw: %d bytes.\n",
+            huffman_size, raw_size );
+        // if it doesn't save any space to Huffman compress --
+        // such as when all canonical lengths are the same --
+        // fall back to simple pass-thru raw data.
+        const bool worth_it = (!packed_digits) or (huffman_size < raw_size);
+        const bool fits =
+            (huffman_size < compressed_size) and
+            (data_payload_length <= 0x8000);
+        if( worth_it and fits ){
+            printf("# header ....\n");
+            char * d = compressed_text;
+            if( compact_table ){
+                d += sprintf( d, "%d:\nW%d:%d:", // start of netstring
+                    table_payload_length, compressed_symbols, max_symbol_value );
+                memcpy( d, compact, compact_length );
+                d += compact_length;
+            }else if( NO_STATIC_TABLE == static_table ){
+                d += sprintf( d, "%d:\nX%d:%d:", // start of netstring
+                    table_payload_length, compressed_symbols, max_symbol_value );
+                for( int i=0; i<=max_symbol_value; i++ ){
+                    assert( canonical_lengths[i] < 16 );
+                    *d++ = "0123456789abcdef"[ canonical_lengths[i] ];
+                };
+            }else{
+                // just refer to the built-in table.
+                assert( 0 <= static_table );
+                assert( static_table < STATIC_TABLE_COUNT );
+                d += sprintf( d, "%d:\nS%d:%d", // start of netstring
+                    table_payload_length, static_table, compressed_symbols );
+            };
+            d += sprintf( d, ",\n" ); // end of netstring
+            printf("# data ....\n");
+            if( 1 < streams ){
+                d += sprintf( d, "%d:\nQ%d:", // start of netstring
+                    data_payload_length, original_length );
+                for( int k=0; k<streams; k++ ){
+                    d += sprintf( d, "%d:", stream_digits[k] );
+                };
+                const unsigned char * t = (const unsigned char *)original_text;
+                for( int k=0; k<streams; k++ ){
+                    const int bytes =
+                        (stream_digits[k] + digits_per_byte - 1) / digits_per_byte;
+                    struct digit_writer writer;
+                    start_digit_writer( &writer, compressed_symbols, true, bytes, d );
+                    for( int i=k; i<original_length; i+=streams ){
+                        write_digits( &writer,
+                            encode_value_table[ t[i] ], encode_length_table[ t[i] ] );
+                    };
+                    finish_digit_writer( &writer );
+                    assert( stream_digits[k] == writer.digit_count );
+                    assert( bytes == writer.length );
+                    d += bytes;
+                };
+            }else{
+                d += sprintf( d, "%d:\n%c", // start of netstring
+                    data_payload_length, (packed_digits ? 'Y' : 'Z') );
+                if( packed_digits ){
+                    d += sprintf( d, "%d:", digit_count );
+                };
+                d += represent_items_with_codes(
+                    max_symbol_value,
+                    encode_length_table,
+                    encode_value_table,
+                    compressed_symbols, // 2 for binary, 3 for trinary, etc.
+                    packed_digits,
+                    original_length,
+                    original_text,
+                    (d - compressed_text),
+                    compressed_size,
+                    compressed_text
+                    );
+            };
+            d += sprintf( d, ",\n" ); // end of netstring
+            assert( huffman_size == (d - compressed_text) );
+            printf("# compressed.\n");
+            return huffman_size;
+        };
+    };
+    DEBUG_PRINTF("# pass-through raw data.\n");
+    assert( raw_size < compressed_size );
+    char * d = compressed_text;
+    d += sprintf( d, "%d:\n\n", 2 + original_length ); // pass-through type
+    memcpy( d, original_text, original_length );
+    d += original_length;
+    d += sprintf( d, ",\n" ); // end of netstring
+    assert( raw_size == (d - compressed_text) );
+    return raw_size;
+}
+
+// the usual single-stream layout.
+static int
+compress(
+    struct block_scratch * scratch,
+    const int static_table, // NO_STATIC_TABLE, or canonical_lengths came from this table
+    const int max_symbol_value,
+    int canonical_lengths[max_symbol_value+1],
+    const int compressed_symbols, // 2 for binary, 3 for trinary, etc.
+    const bool packed_digits,
+    const int original_length,
+    const char original_text[original_length],
+    const int compressed_size,
+    char compressed_text[compressed_size] // output
+){
+    return compress_with_streams( scratch, static_table,
+        max_symbol_value, canonical_lengths, compressed_symbols,
+        packed_digits, 1,
+        original_length, original_text,
+        compressed_size, compressed_text );
+}
+
+/*
+LZ77 front end.
+A hash-chain match finder
+(as in zlib: a chain of earlier positions for each 3-byte hash)
+turns the block into literal and (length, distance) tokens,
+and huffman() codes them with two DEFLATE-style alphabets:
+literals and match lengths in one,
+match distances in the other.
+Each length or distance symbol covers a range of values,
+picked out by a few extra digits
+(DEFLATE's extra *bits*, rounded up to whole n-ary digits).
+Matches never reach back before the start of the block,
+so every block still decompresses on its own.
+
+The block is a single netstring:
+    "\nL" compressed_symbols ':' digit_count ':'
+    literal_table_bytes ':' literal/length table
+    distance_table_bytes ':' distance table
+    packed digits,
+where each table is a compact length table,
+method character and all
+(see encode_smallest_length_table()).
+The end-of-block symbol 256 is never used:
+digit_count already says where the block ends.
+*/
+static const unsigned short lz_length_base[LZ_MAX_SYMBOL_VALUE - 256] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lz_length_extra[LZ_MAX_SYMBOL_VALUE - 256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short lz_distance_base[LZ_DISTANCE_SYMBOLS] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const unsigned char lz_distance_extra[LZ_DISTANCE_SYMBOLS] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+#define LZ_MAX_EXTRA_BITS (13)
+
+/*
+Effort levels, roughly as in zlib:
+how many earlier positions to try at each position,
+and a match long enough to stop looking.
+Level 0 never looks, so it's order-0 Huffman of the literals.
+Levels 1..9 parse greedily;
+the top levels use the much slower optimal parse
+(see find_lz77_optimal_parse()),
+for cold data where ratio matters more than speed.
+*/
+struct lz_level{
+    int max_chain;
+    int nice_length;
+    bool optimal;
+};
+static const struct lz_level lz_levels[] = {
+    {0, 0, false}, {4, 8, false}, {8, 16, false}, {16, 32, false},
+    {32, 64, false}, {64, 128, false}, {128, 258, false},
+    {256, 258, false}, {1024, 258, false}, {4096, 258, false},
+    {64, 258, true}, {1024, 258, true} };
+#define LZ_LEVELS ((int)NUM_ELEM( lz_levels ))
+#define LZ_DEFAULT_LEVEL (6)
+// the most times the optimal parse re-prices and re-parses a block
+#define LZ_OPTIMAL_PASSES (4)
+
+static int
+lz_length_symbol( const int length ){
+    assert( (LZ_MIN_MATCH <= length) and (length <= LZ_MAX_MATCH) );
+    int c = NUM_ELEM( lz_length_base ) - 1;
+    while( length < lz_length_base[c] ){
+        c--;
+    };
+    return 257 + c;
+}
+
+static int
+lz_distance_symbol( const int distance ){
+    assert( (1 <= distance) and (distance <= BLOCK_SIZE) );
+    int c = LZ_DISTANCE_SYMBOLS - 1;
+    while( distance < lz_distance_base[c] ){
+        c--;
+    };
+    return c;
+}
+
+static inline int
+lz_hash( const unsigned char * p ){
+    const unsigned long v = ((unsigned long)p[0] << 16) | (p[1] << 8) | p[2];
+    return ((v * 2654435761u) & 0xffffffffu) >> (32 - LZ_HASH_BITS);
+}
+
+/*
+Greedy parse of the whole block into scratch->lz_tokens[]:
+at each position take the longest match the hash chain offers,
+or a literal if there's no match of at least LZ_MIN_MATCH bytes.
+Returns the number of tokens.
+*/
+int
+find_lz77_matches(
+    struct block_scratch * scratch,
+    const int level,
+    const int length,
+    const char text[length]
+){
+    assert( (0 <= level) and (level < LZ_LEVELS) );
+    assert( length <= BLOCK_SIZE );
+    const int max_chain = lz_levels[level].max_chain;
+    const int nice_length = lz_levels[level].nice_length;
+    const unsigned char * t = (const unsigned char *)text;
+    int * head = scratch->lz_head;
+    int * previous = scratch->lz_previous;
+    for( int h=0; h<LZ_HASH_SIZE; h++ ){
+        head[h] = -1;
+    };
+    struct lz_token * tokens = scratch->lz_tokens;
+    int count = 0;
+    int i = 0;
+    while( i < length ){
+        int best_length = 0;
+        int best_distance = 0;
+        if( i + LZ_MIN_MATCH <= length ){
+            const int max_length = imin( LZ_MAX_MATCH, length - i );
+            int candidate = head[ lz_hash( &t[i] ) ];
+            for( int chain=0; (chain < max_chain) and (0 <= candidate); chain++ ){
+                // a longer match must also match one byte further on.
+                if( t[candidate + best_length] == t[i + best_length] ){
+                    int match = 0;
+                    while( (match < max_length) and (t[candidate + match] == t[i + match]) ){
+                        match++;
+                    };
+                    if( best_length < match ){
+                        best_length = match;
+                        best_distance = i - candidate;
+                        if( (nice_length <= match) or (max_length == match) ){
+                            break;
+                        };
+                    };
+                };
+                candidate = previous[candidate];
+            };
+        };
+        if( LZ_MIN_MATCH <= best_length ){
+            tokens[count].length = best_length;
+            tokens[count].value = best_distance;
+        }else{
+            best_length = 1;
+            tokens[count].length = 0;
+            tokens[count].value = t[i];
+        };
+        count++;
+        // every position we step over goes into the hash chains.
+        for( int j=i; (j < i + best_length) and (j + LZ_MIN_MATCH <= length); j++ ){
+            const int h = lz_hash( &t[j] );
+            previous[j] = head[h];
+            head[h] = j;
+        };
+        i += best_length;
+    };
+    return count;
+}
+
+/*
+The number of n-ary digits
+needed to hold any value of the given number of bits.
+*/
+static int
+digits_for_bits( const int compressed_symbols, const int bits ){
+    int digits = 0;
+    for( long values = 1; values < (1L << bits); values *= compressed_symbols ){
+        digits++;
+    };
+    return digits;
+}
+
+static int
+read_digits( struct digit_reader * reader, const int digits ){
+    int value = 0;
+    for( int j=0; j<digits; j++ ){
+        value = value * reader->compressed_symbols + read_digit( reader );
+    };
+    reader->position += digits;
+    return value;
+}
+
+// histogram of the tokens, in both alphabets.
+static void
+count_lz77_symbols( struct block_scratch * scratch, const int token_count ){
+    for( int i=0; i<=LZ_MAX_SYMBOL_VALUE; i++ ){
+        scratch->lz_frequencies[i] = 0;
+    };
+    for( int i=0; i<LZ_DISTANCE_SYMBOLS; i++ ){
+        scratch->lz_distance_frequencies[i] = 0;
+    };
+    for( int k=0; k<token_count; k++ ){
+        const struct lz_token token = scratch->lz_tokens[k];
+        if( 0 == token.length ){
+            scratch->lz_frequencies[ token.value ]++;
+        }else{
+            scratch->lz_frequencies[ lz_length_symbol( token.length ) ]++;
+            scratch->lz_distance_frequencies[ lz_distance_symbol( token.value ) ]++;
+        };
+    };
+}
+
+/*
+Optimal (price-based) parse of the whole block into scratch->lz_tokens[].
+Start from the greedy parse at the same effort,
+then repeatedly
+(a) build this block's Huffman tables from the current tokens,
+taking each code's length (in digits, plus any extra digits)
+as the price of that literal, length, or distance, and
+(b) find the cheapest parse under those prices
+with a forward dynamic program:
+lz_cost[i] is the cheapest way to code the first i bytes,
+and every literal or match starting at i
+may lower the cost of the position it reaches.
+Each hash-chain candidate only adds the lengths
+longer than every closer candidate could reach,
+since a closer match of the same length is never dearer
+(its distance symbol is never larger).
+Stop after LZ_OPTIMAL_PASSES, or sooner once the cost stops falling.
+Returns the number of tokens.
+*/
+int
+find_lz77_optimal_parse(
+    struct block_scratch * scratch,
+    const int level,
+    const int compressed_symbols,
+    const int length,
+    const char text[length]
+){
+    const int max_chain = lz_levels[level].max_chain;
+    const int nice_length = lz_levels[level].nice_length;
+    const unsigned char * t = (const unsigned char *)text;
+    int * head = scratch->lz_head;
+    int * previous = scratch->lz_previous;
+    int * cost = scratch->lz_cost;
+    struct lz_token * step = scratch->lz_step;
+    struct lz_token * tokens = scratch->lz_tokens;
+    int token_count = find_lz77_matches( scratch, level, length, text );
+    int extra_digits[LZ_MAX_EXTRA_BITS+1];
+    for( int bits=0; bits<=LZ_MAX_EXTRA_BITS; bits++ ){
+        extra_digits[bits] = digits_for_bits( compressed_symbols, bits );
+    };
+    int best_cost = INT_MAX;
+    for( int pass=0; pass<LZ_OPTIMAL_PASSES; pass++ ){
+        // (a) prices from the current tokens.
+        count_lz77_symbols( scratch, token_count );
+        limited_huffman( &scratch->tree, LZ_MAX_SYMBOL_VALUE,
+            scratch->lz_frequencies, compressed_symbols, MAX_CODE_LENGTH-1,
+            scratch->lz_lengths );
+        limited_huffman( &scratch->tree, LZ_DISTANCE_SYMBOLS-1,
+            scratch->lz_distance_frequencies, compressed_symbols, MAX_CODE_LENGTH-1,
+            scratch->lz_distance_lengths );
+        // a symbol the current tokens never use
+        // would get some code at least as long as the longest one.
+        const int unused_price = 1 + imax(
+            array_max( LZ_MAX_SYMBOL_VALUE+1, scratch->lz_lengths ),
+            array_max( LZ_DISTANCE_SYMBOLS, scratch->lz_distance_lengths ) );
+        int symbol_price[LZ_MAX_SYMBOL_VALUE+1];
+        for( int i=0; i<=LZ_MAX_SYMBOL_VALUE; i++ ){
+            symbol_price[i] = scratch->lz_lengths[i] ? scratch->lz_lengths[i] : unused_price;
+        };
+        int length_price[LZ_MAX_MATCH+1];
+        for( int l=LZ_MIN_MATCH; l<=LZ_MAX_MATCH; l++ ){
+            const int symbol = lz_length_symbol( l );
+            length_price[l] = symbol_price[symbol] +
+                extra_digits[ lz_length_extra[symbol - 257] ];
+        };
+        int distance_price[LZ_DISTANCE_SYMBOLS];
+        for( int d=0; d<LZ_DISTANCE_SYMBOLS; d++ ){
+            const int price = scratch->lz_distance_lengths[d];
+            distance_price[d] = (price ? price : unused_price) +
+                extra_digits[ lz_distance_extra[d] ];
+        };
+
+        // (b) the cheapest parse under those prices.
+        for( int h=0; h<LZ_HASH_SIZE; h++ ){
+            head[h] = -1;
+        };
+        cost[0] = 0;
+        for( int i=1; i<=length; i++ ){
+            cost[i] = INT_MAX;
+        };
+        for( int i=0; i<length; i++ ){
+            const int literal_cost = cost[i] + symbol_price[ t[i] ];
+            if( literal_cost < cost[i+1] ){
+                cost[i+1] = literal_cost;
+                step[i+1].length = 0;
+                step[i+1].value = t[i];
+            };
+            if( i + LZ_MIN_MATCH > length ){
+                continue;
+            };
+            const int h = lz_hash( &t[i] );
+            const int max_length = imin( LZ_MAX_MATCH, length - i );
+            int longest = LZ_MIN_MATCH - 1;
+            int candidate = head[h];
+            for( int chain=0; (chain < max_chain) and (0 <= candidate); chain++ ){
+                if( t[candidate + longest] == t[i + longest] ){
+                    int match = 0;
+                    while( (match < max_length) and (t[candidate + match] == t[i + match]) ){
+                        match++;
+                    };
+                    if( longest < match ){
+                        const int distance = i - candidate;
+                        const int match_cost =
+                            cost[i] + distance_price[ lz_distance_symbol( distance ) ];
+                        for( int l=longest+1; l<=match; l++ ){
+                            const int c = match_cost + length_price[l];
+                            if( c < cost[i+l] ){
+                                cost[i+l] = c;
+                                step[i+l].length = l;
+                                step[i+l].value = distance;
+                            };
+                        };
+                        longest = match;
+                        if( (nice_length <= longest) or (max_length == longest) ){
+                            break;
+                        };
+                    };
+                };
+                candidate = previous[candidate];
+            };
+            previous[i] = head[h];
+            head[h] = i;
+        };
+        DEBUG_PRINTF("# optimal parse pass %d: %d digits.\n", pass, cost[length]);
+        if( best_cost <= cost[length] ){
+            break; // converged: keep the tokens we have.
+        };
+        best_cost = cost[length];
+        // walk back from the end to count the tokens,
+        // then again to store them in order.
+        token_count = 0;
+        for( int i=length; 0<i; i -= imax( 1, step[i].length ) ){
+            token_count++;
+        };
+        int k = token_count;
+        for( int i=length; 0<i; i -= imax( 1, step[i].length ) ){
+            tokens[--k] = step[i];
+        };
+        assert( 0 == k );
+    };
+    return token_count;
+}
+
+/*
+Write the codes (and extra digits) of every token,
+or, with no writer, just count the digits they need.
+*/
+static int
+emit_lz77_tokens(
+    const struct block_scratch * scratch,
+    const int token_count,
+    const int extra_digits[LZ_MAX_EXTRA_BITS+1],
+    struct digit_writer * writer // NULL: count only
+){
+    const int * lengths = scratch->lz_encode_lengths;
+    const unsigned int * values = scratch->lz_encode_values;
+    const int * distance_lengths = scratch->lz_distance_encode_lengths;
+    const unsigned int * distance_values = scratch->lz_distance_encode_values;
+    int digits = 0;
+    for( int k=0; k<token_count; k++ ){
+        const struct lz_token token = scratch->lz_tokens[k];
+        if( 0 == token.length ){
+            const int symbol = token.value;
+            digits += lengths[symbol];
+            if( writer ){
+                write_digits( writer, values[symbol], lengths[symbol] );
+            };
+            continue;
+        };
+        const int symbol = lz_length_symbol( token.length );
+        const int c = symbol - 257;
+        const int length_digits = extra_digits[ lz_length_extra[c] ];
+        const int d = lz_distance_symbol( token.value );
+        const int distance_digits = extra_digits[ lz_distance_extra[d] ];
+        digits += lengths[symbol] + length_digits + distance_lengths[d] + distance_digits;
+        if( writer ){
+            write_digits( writer, values[symbol], lengths[symbol] );
+            write_digits( writer, token.length - lz_length_base[c], length_digits );
+            write_digits( writer, distance_values[d], distance_lengths[d] );
+            write_digits( writer, token.value - lz_distance_base[d], distance_digits );
+        };
+    };
+    return digits;
+}
+
+/*
+Compress one block through the LZ77 front end
+at the given effort level (0 .. LZ_LEVELS-1, greedy or optimal parse),
+as a single "\nL" netstring,
+or as pass-through raw data if that's no smaller.
+Returns the number of bytes written.
+*/
+int
+compress_lz77(
+    struct block_scratch * scratch,
+    const int level,
+    const int compressed_symbols,
+    const int original_length,
+    const char original_text[original_length],
+    const int compressed_size,
+    char compressed_text[compressed_size] // output
+){
+    const int n = compressed_symbols;
+    const int token_count = lz_levels[level].optimal ?
+        find_lz77_optimal_parse( scratch, level, n, original_length, original_text ) :
+        find_lz77_matches( scratch, level, original_length, original_text );
+    count_lz77_symbols( scratch, token_count );
+    // every length must fit in one nybble of the compact tables.
+    limited_huffman( &scratch->tree, LZ_MAX_SYMBOL_VALUE,
+        scratch->lz_frequencies, n, MAX_CODE_LENGTH-1, scratch->lz_lengths );
+    limited_huffman( &scratch->tree, LZ_DISTANCE_SYMBOLS-1,
+        scratch->lz_distance_frequencies, n, MAX_CODE_LENGTH-1,
+        scratch->lz_distance_lengths );
+    const bool has_tokens =
+        (0 < count_nonzero_items( LZ_MAX_SYMBOL_VALUE+1, scratch->lz_lengths ));
+    const bool has_matches =
+        (0 < count_nonzero_items( LZ_DISTANCE_SYMBOLS, scratch->lz_distance_lengths ));
+    const int raw_size = raw_block_size( original_length );
+    if( has_tokens ){
+        convert_lengths_to_encode_table( LZ_MAX_SYMBOL_VALUE, scratch->lz_lengths, n,
+            scratch->lz_encode_lengths, scratch->lz_encode_values );
+        if( has_matches ){
+            convert_lengths_to_encode_table( LZ_DISTANCE_SYMBOLS-1,
+                scratch->lz_distance_lengths, n,
+                scratch->lz_distance_encode_lengths,
+                scratch->lz_distance_encode_values );
+        };
+        int extra_digits[LZ_MAX_EXTRA_BITS+1];
+        for( int bits=0; bits<=LZ_MAX_EXTRA_BITS; bits++ ){
+            extra_digits[bits] = digits_for_bits( n, bits );
+        };
+        const int digit_count = emit_lz77_tokens( scratch, token_count, extra_digits, NULL );
+        const int digits_per_byte = digits_per_packed_byte( n );
+        const int data_bytes = (digit_count + digits_per_byte - 1) / digits_per_byte;
+        char literal_table[LZ_MAX_SYMBOL_VALUE+16];
+        const int literal_table_length = encode_smallest_length_table( scratch,
+            LZ_MAX_SYMBOL_VALUE, scratch->lz_lengths,
+            sizeof( literal_table ), literal_table );
+        char distance_table[LZ_DISTANCE_SYMBOLS+16];
+        const int distance_table_length = encode_smallest_length_table( scratch,
+            LZ_DISTANCE_SYMBOLS-1, scratch->lz_distance_lengths,
+            sizeof( distance_table ), distance_table );
+        const int payload_length = 2 +
+            snprintf( NULL, 0, "%d:%d:%d:", n, digit_count, literal_table_length ) +
+            literal_table_length +
+            snprintf( NULL, 0, "%d:", distance_table_length ) +
+            distance_table_length + data_bytes;
+        const int lz_size =
+            snprintf( NULL, 0, "%d:", payload_length ) + payload_length + 2;
+        DEBUG_PRINTF("# LZ77 level %d: %d tokens, %d bytes; raw: %d bytes.\n",
+            level, token_count, lz_size, raw_size );
+        if( (lz_size < raw_size) and (lz_size < compressed_size) and
+            (payload_length <= 0x8000)
+        ){
+            char * d = compressed_text;
+            d += sprintf( d, "%d:\nL%d:%d:%d:", // start of netstring
+                payload_length, n, digit_count, literal_table_length );
+            memcpy( d, literal_table, literal_table_length );
+            d += literal_table_length;
+            d += sprintf( d, "%d:", distance_table_length );
+            memcpy( d, distance_table, distance_table_length );
+            d += distance_table_length;
+            struct digit_writer writer;
+            start_digit_writer( &writer, n, true, data_bytes, d );
+            emit_lz77_tokens( scratch, token_count, extra_digits, &writer );
+            finish_digit_writer( &writer );
+            assert( digit_count == writer.digit_count );
+            assert( data_bytes == writer.length );
+            d += data_bytes;
+            d += sprintf( d, ",\n" ); // end of netstring
+            assert( lz_size == (d - compressed_text) );
+            return lz_size;
+        };
+    };
+    // not worth it (or an empty block):
+    // all-zero lengths make compress() pass the data through raw.
+    reset_block_scratch( scratch );
+    return compress( scratch, NO_STATIC_TABLE,
+        MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+        true, // packed digits
+        original_length, original_text,
+        compressed_size, compressed_text );
+}
+
+/*
+Decode digit_count digits of "\nL" tokens
+with the tables already in scratch->decoder
+and scratch->lz_distance_decoder,
+copying each match from earlier in this block's own output.
+Returns the number of bytes written.
+*/
+static int
+decode_lz77_digits(
+    struct block_scratch * scratch,
+    const int compressed_symbols,
+    const int digit_count,
+    const unsigned char digits[],
+    const int max_decompressed_size,
+    char decompressed_text[max_decompressed_size] // output
+){
+    const struct canonical_decoder * literals = &scratch->decoder;
+    const struct canonical_decoder * distances = &scratch->lz_distance_decoder;
+    int extra_digits[LZ_MAX_EXTRA_BITS+1];
+    for( int bits=0; bits<=LZ_MAX_EXTRA_BITS; bits++ ){
+        extra_digits[bits] = digits_for_bits( compressed_symbols, bits );
+    };
+    struct digit_reader reader;
+    start_digit_reader( &reader, compressed_symbols, true, digit_count, digits );
+    int length = 0;
+    while( reader.position < digit_count ){
+        const int symbol = decode_symbol_one_digit_at_a_time( literals, &reader );
+        if( symbol < 256 ){
+            assert( length < max_decompressed_size );
+            decompressed_text[length++] = symbol;
+            continue;
+        };
+        assert( 257 <= symbol ); // end-of-block is never written.
+        const int c = symbol - 257;
+        const int match_length =
+            lz_length_base[c] + read_digits( &reader, extra_digits[ lz_length_extra[c] ] );
+        const int d = decode_symbol_one_digit_at_a_time( distances, &reader );
+        const int distance =
+            lz_distance_base[d] + read_digits( &reader, extra_digits[ lz_distance_extra[d] ] );
+        assert( distance <= length ); // corrupt data?
+        assert( length + match_length <= max_decompressed_size );
+        // one byte at a time: a match may overlap its own output.
+        for( int k=0; k<match_length; k++ ){
+            decompressed_text[length] = decompressed_text[length - distance];
+            length++;
+        };
+    };
+    assert( reader.position == digit_count );
+    return length;
+}
+
+/*
+Context-selected tables.
+small_compression.c and nybble_compression.c
+pick a dictionary by the class of the previous byte
+(byte_to_context()),
+because the previous byte says a lot about the next one:
+after 'q' comes 'u', after '.' comes ' ' or '\n', and so on.
+This is the same idea for plain Huffman:
+one histogram (and one table) per context,
+where the context is the class of the previous byte,
+so each table only has to cover
+the bytes that tend to follow that class.
+
+Every byte gets one of CONTEXT_CLASSES fine classes,
+ordered so that neighbouring classes are alike,
+and a block with K tables (2 <= K <= MAX_CONTEXT_TABLES)
+merges runs of neighbours:
+with K=2 it's letters vs. everything else,
+with K=4 it's whitespace and digits, other punctuation,
+the vowels (with t, h, and s), and the rest of the letters,
+and so on up to all 32 classes.
+K doesn't have to be a power of 2.
+The first byte of each block is coded
+as if it followed CONTEXT_START_BYTE,
+so every block still decompresses on its own.
+
+The block is a single netstring:
+    "\nK" K ':' compressed_symbols ':' digit_count ':'
+    K times: table_bytes ':' compact length table
+    packed digits.
+FUTURE: let neighbouring contexts share a table
+when one table would cost less than two.
+*/
+#define CONTEXT_START_BYTE ('\n')
+
+/*
+The class of each byte,
+filled in at compile time:
+0: control characters,
+1: newline and carriage return, 2: tab, 3: space, 4: digits,
+5: '.', 6: ',', 7: ';' ':', 8: '!' '?',
+9: the quotes and '`', 10: opening brackets (including '<'),
+11: closing brackets (including '>'), 12: '-' '_',
+13: '+' '*' '/' '=' '%' '^' '|' '&' '~' and backslash, 14: '#' '$' '@',
+15: bytes 128..255 (UTF-8, binary);
+16..31: letters, either case:
+a, e, i, o u, y, t, h, s,
+r, l, n, m, c d, g p b, f w v k, j x q z.
+*/
+static const unsigned char context_classes[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  1,  0,  0,  1,  0,  0, // 0x00
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x10
+     3,  8,  9, 14, 14, 13, 13,  9, 10, 11, 13, 13,  6, 12,  5, 13, // 0x20
+     4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  7,  7, 10, 13, 11,  8, // 0x30
+    14, 16, 29, 28, 28, 17, 30, 29, 22, 18, 31, 30, 25, 27, 26, 19, // 0x40
+    29, 31, 24, 23, 21, 19, 30, 30, 31, 20, 31, 10, 13, 11, 13, 12, // 0x50
+     9, 16, 29, 28, 28, 17, 30, 29, 22, 18, 31, 30, 25, 27, 26, 19, // 0x60
+    29, 31, 24, 23, 21, 19, 30, 30, 31, 20, 31, 10, 13, 11, 13,  0, // 0x70
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0x80
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0x90
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0xA0
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0xB0
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0xC0
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0xD0
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0xE0
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, // 0xF0
+};
+
+static int
+context_class( const unsigned char byte ){
+    return context_classes[byte];
+}
+
+static inline int
+huffman_context( const unsigned char previous_byte, const int contexts ){
+    return context_class( previous_byte ) * contexts / CONTEXT_CLASSES;
+}
+
+/*
+Compress one block with K context-selected tables
+as a single "\nK" netstring,
+or as pass-through raw data if that's no smaller.
+All K histograms are built in one pass over the block.
+Returns the number of bytes written.
+*/
+int
+compress_contexts(
+    struct block_scratch * scratch,
+    const int contexts,
+    const int compressed_symbols,
+    const int original_length,
+    const char original_text[original_length],
+    const int compressed_size,
+    char compressed_text[compressed_size] // output
+){
+    assert( 2 <= contexts );
+    assert( contexts <= MAX_CONTEXT_TABLES );
+    const int n = compressed_symbols;
+    const unsigned char * t = (const unsigned char *)original_text;
+    for( int k=0; k<contexts; k++ ){
+        for( int i=0; i<256; i++ ){
+            scratch->context_frequencies[k][i] = 0;
+        };
+    };
+    int context = huffman_context( CONTEXT_START_BYTE, contexts );
+    for( int i=0; i<original_length; i++ ){
+        scratch->context_frequencies[context][ t[i] ]++;
+        context = huffman_context( t[i], contexts );
+    };
+    const int raw_size = raw_block_size( original_length );
+    // every length must fit in one nybble of the compact tables.
+    int tables_length = 0;
+    for( int k=0; k<contexts; k++ ){
+        int * lengths = scratch->context_lengths[k];
+        limited_huffman( &scratch->tree, 255,
+            scratch->context_frequencies[k], n, MAX_CODE_LENGTH-1, lengths );
+        if( count_nonzero_items( 256, lengths ) ){
+            convert_lengths_to_encode_table( 255, lengths, n,
+                scratch->context_encode_lengths[k],
+                scratch->context_encode_values[k] );
+        };
+        const int table_length = encode_smallest_length_table( scratch,
+            255, lengths,
+            sizeof( scratch->context_tables[k] ), scratch->context_tables[k] );
+        scratch->context_table_lengths[k] = table_length;
+        tables_length += snprintf( NULL, 0, "%d:", table_length ) + table_length;
+    };
+    int digit_count = 0;
+    context = huffman_context( CONTEXT_START_BYTE, contexts );
+    for( int i=0; i<original_length; i++ ){
+        digit_count += scratch->context_encode_lengths[context][ t[i] ];
+        context = huffman_context( t[i], contexts );
+    };
+    const int digits_per_byte = digits_per_packed_byte( n );
+    const int data_bytes = (digit_count + digits_per_byte - 1) / digits_per_byte;
+    const int payload_length = 2 +
+        snprintf( NULL, 0, "%d:%d:%d:", contexts, n, digit_count ) +
+        tables_length + data_bytes;
+    const int context_size =
+        snprintf( NULL, 0, "%d:", payload_length ) + payload_length + 2;
+    printf("# %d context tables: %d bytes of tables, %d bytes; raw: %d bytes.\n",
+        contexts, tables_length, context_size, raw_size );
+    if( (0 < original_length) and
+        (context_size < raw_size) and (context_size < compressed_size) and
+        (payload_length <= 0x8000)
+    ){
+        char * d = compressed_text;
+        d += sprintf( d, "%d:\nK%d:%d:%d:", // start of netstring
+            payload_length, contexts, n, digit_count );
+        for( int k=0; k<contexts; k++ ){
+            d += sprintf( d, "%d:", scratch->context_table_lengths[k] );
+            memcpy( d, scratch->context_tables[k], scratch->context_table_lengths[k] );
+            d += scratch->context_table_lengths[k];
+        };
+        struct digit_writer writer;
+        start_digit_writer( &writer, n, true, data_bytes, d );
+        context = huffman_context( CONTEXT_START_BYTE, contexts );
+        for( int i=0; i<original_length; i++ ){
+            write_digits( &writer,
+                scratch->context_encode_values[context][ t[i] ],
+                scratch->context_encode_lengths[context][ t[i] ] );
+            context = huffman_context( t[i], contexts );
+        };
+        finish_digit_writer( &writer );
+        assert( digit_count == writer.digit_count );
+        assert( data_bytes == writer.length );
+        d += data_bytes;
+        d += sprintf( d, ",\n" ); // end of netstring
+        assert( context_size == (d - compressed_text) );
+        return context_size;
+    };
+    // not worth it (or an empty block):
+    // all-zero lengths make compress() pass the data through raw.
+    reset_block_scratch( scratch );
+    return compress( scratch, NO_STATIC_TABLE,
+        MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+        true, // packed digits
+        original_length, original_text,
+        compressed_size, compressed_text );
+}
+
+/*
+Decode digit_count digits of "\nK" data
+with the tables already in scratch->context_decoders[],
+picking the table for each symbol from the byte before it.
+All the decoders share one digit_reader,
+so they all get lookup tables of the same width.
+Returns the number of bytes written.
+*/
+static int
+decode_context_digits(
+    struct block_scratch * scratch,
+    const int contexts,
+    const int compressed_symbols,
+    const int digit_count,
+    const unsigned char digits[],
+    const int max_decompressed_size,
+    char decompressed_text[max_decompressed_size] // output
+){
+    struct canonical_decoder * decoders = scratch->context_decoders;
+    int lookup_digits = 0;
+    for( int k=0; k<contexts; k++ ){
+        lookup_digits = imax( lookup_digits, decoders[k].lookup_digits );
+    };
+    for( int k=0; k<contexts; k++ ){
+        if( lookup_digits != decoders[k].lookup_digits ){
+            build_lookup_table( &decoders[k], lookup_digits );
+        };
+    };
+    struct digit_reader reader;
+    start_digit_reader( &reader, compressed_symbols, true, digit_count, digits );
+    int context = huffman_context( CONTEXT_START_BYTE, contexts );
+    fill_lookahead_window( &decoders[context], &reader );
+    int length = 0;
+    while( reader.position < digit_count ){
+        const int symbol = decode_symbol_with_lookup_table( &decoders[context], &reader );
+        assert( 0 <= symbol ); // a context with no table?
+        assert( length < max_decompressed_size );
+        decompressed_text[length++] = symbol;
+        context = huffman_context( symbol, contexts );
+    };
+    assert( reader.position == digit_count );
+    return length;
+}
+
+/*
+Word-token mode.
+Nayuki's word-oriented Huffman (see the notes near the end of this file)
+codes each English *word* as a single symbol,
+and spells out the words that appear only once (hapax legomena)
+one letter at a time.
+compress_words() does the same for any block:
+it splits the block into tokens --
+runs of word bytes (letters, digits, '_', and all of UTF-8)
+and runs of everything else (spaces, punctuation, newlines),
+each at most WORD_MAX_LENGTH bytes --
+and looks each one up in a hash table of the block's distinct tokens.
+Tokens that repeat often enough to pay for their dictionary entry
+get a symbol of their own (WORD_FIRST_SYMBOL and up);
+every other token is spelled out with the byte symbols 0..255,
+so the byte symbols double as the escape mechanism
+and need no special escape symbol.
+One Huffman table covers bytes and words together.
+
+The dictionary is sent sorted, front-coded:
+for each word, the number of leading bytes it shares with the previous word,
+the number of bytes that follow, and those bytes.
+Symbol WORD_FIRST_SYMBOL is the first word in that order, and so on.
+
+The block is a single netstring:
+    "\nT" compressed_symbols ':' digit_count ':'
+    words ':' dictionary_bytes ':' dictionary
+    table_bytes ':' compact length table (symbols 0 .. MAX_LEAF_VALUE + words)
+    packed digits.
+FUTURE: Huffman-code the dictionary too,
+or (like the static tables) keep a built-in dictionary of common words.
+*/
+static inline bool
+is_word_byte( const unsigned char byte ){
+    return ((('a' <= byte) and (byte <= 'z')) or
+        (('A' <= byte) and (byte <= 'Z')) or
+        (('0' <= byte) and (byte <= '9')) or
+        ('_' == byte) or (128 <= byte));
+}
+
+// FNV-1a
+static inline unsigned int
+word_hash( const unsigned char * p, const int length ){
+    unsigned int h = 2166136261u;
+    for( int i=0; i<length; i++ ){
+        h = (h ^ p[i]) * 16777619u;
+    };
+    return h;
+}
+
+/*
+Find the entry for text[start .. start+length-1],
+adding a new entry if this is its first appearance.
+Only the first hash_mask+1 slots of the hash table are in use.
+Returns the entry index.
+*/
+static int
+find_or_add_word(
+    struct block_scratch * scratch,
+    const unsigned int hash_mask,
+    const unsigned char text[],
+    const int start,
+    const int length,
+    int * entries // in-out
+){
+    const unsigned char * p = &text[start];
+    unsigned int slot = word_hash( p, length ) & hash_mask;
+    for(;;){
+        const int e = scratch->word_slot[slot];
+        if( e < 0 ){
+            break;
+        };
+        struct word_entry * entry = &scratch->word_entries[e];
+        if( (length == entry->length) and
+            (0 == memcmp( &text[entry->start], p, length ))
+        ){
+            entry->count++;
+            return e;
+        };
+        slot = (slot + 1) & hash_mask;
+    };
+    const int e = (*entries)++;
+    assert( 2*(e + 1) <= (int)hash_mask + 1 ); // never more than half full
+    scratch->word_slot[slot] = e;
+    scratch->word_entries[e].start = start;
+    scratch->word_entries[e].length = length;
+    scratch->word_entries[e].count = 1;
+    scratch->word_entries[e].symbol = -1;
+    return e;
+}
+
+static int
+compare_word_savings( const void * a, const void * b ){
+    const struct word_key * x = a;
+    const struct word_key * y = b;
+    // most bytes saved first.
+    return (y->saving > x->saving) - (y->saving < x->saving);
+}
+
+static int
+compare_word_text( const void * a, const void * b ){
+    const struct word_key * x = a;
+    const struct word_key * y = b;
+    const int c = memcmp( x->text, y->text, imin( x->length, y->length ) );
+    return c ? c : (x->length - y->length);
+}
+
+/*
+Compress one block in word-token mode
+as a single "\nT" netstring,
+or as pass-through raw data if that's no smaller.
+Returns the number of bytes written.
+*/
+int
+compress_words(
+    struct block_scratch * scratch,
+    const int compressed_symbols,
+    const int original_length,
+    const char original_text[original_length],
+    const int compressed_size,
+    char compressed_text[compressed_size] // output
+){
+    const int n = compressed_symbols;
+    const unsigned char * t = (const unsigned char *)original_text;
+    struct word_entry * entries = scratch->word_entries;
+    // split into tokens, and count each distinct one.
+    // A block has at most one token per byte,
+    // so twice its length in slots keeps the hash table at most half full,
+    // and a short block doesn't pay to clear all WORD_HASH_SIZE slots.
+    int hash_size = 16;
+    while( hash_size < 2*original_length ){
+        hash_size *= 2;
+    };
+    assert( hash_size <= WORD_HASH_SIZE );
+    const unsigned int hash_mask = hash_size - 1;
+    for( int h=0; h<hash_size; h++ ){
+        scratch->word_slot[h] = -1;
+    };
+    int entry_count = 0;
+    int token_count = 0;
+    for( int i=0; i<original_length; ){
+        const bool word = is_word_byte( t[i] );
+        int length = 1;
+        while( (i + length < original_length) and (length < WORD_MAX_LENGTH) and
+            (word == is_word_byte( t[i + length] ))
+        ){
+            length++;
+        };
+        scratch->word_tokens[token_count++] =
+            find_or_add_word( scratch, hash_mask, t, i, length, &entry_count );
+        i += length;
+    };
+    // pick the dictionary: the tokens that save the most bytes,
+    // then sort them for front coding.
+    struct word_key * keys = scratch->word_keys;
+    int words = 0;
+    for( int e=0; e<entry_count; e++ ){
+        const int saving = (entries[e].count - 1) * entries[e].length;
+        if( (2 <= entries[e].length) and (WORD_MIN_SAVING <= saving) ){
+            keys[words].text = &t[ entries[e].start ];
+            keys[words].length = entries[e].length;
+            keys[words].saving = saving;
+            keys[words].entry = e;
+            words++;
+        };
+    };
+    if( WORD_DICTIONARY_SIZE < words ){
+        qsort( keys, words, sizeof( keys[0] ), compare_word_savings );
+        words = WORD_DICTIONARY_SIZE;
+    };
+    qsort( keys, words, sizeof( keys[0] ), compare_word_text );
+    unsigned char * dictionary = scratch->word_dictionary;
+    int dictionary_length = 0;
+    for( int k=0; k<words; k++ ){
+        entries[ keys[k].entry ].symbol = WORD_FIRST_SYMBOL + k;
+        int shared = 0;
+        if( 0 < k ){
+            while( (shared < keys[k].length) and (shared < keys[k-1].length) and
+                (keys[k].text[shared] == keys[k-1].text[shared])
+            ){
+                shared++;
+            };
+        };
+        dictionary[dictionary_length++] = shared;
+        dictionary[dictionary_length++] = keys[k].length - shared;
+        memcpy( &dictionary[dictionary_length], &keys[k].text[shared],
+            keys[k].length - shared );
+        dictionary_length += keys[k].length - shared;
+    };
+    // one table for bytes and words together.
+    const int max_symbol_value = MAX_LEAF_VALUE + words;
+    int * frequencies = scratch->word_frequencies;
+    int * lengths = scratch->word_lengths;
+    for( int i=0; i<=max_symbol_value; i++ ){
+        frequencies[i] = 0;
+    };
+    for( int k=0; k<token_count; k++ ){
+        const struct word_entry * entry = &entries[ scratch->word_tokens[k] ];
+        if( 0 <= entry->symbol ){
+            frequencies[ entry->symbol ]++;
+        }else{
+            for( int j=0; j<entry->length; j++ ){
+                frequencies[ t[entry->start + j] ]++;
+            };
+        };
+    };
+    // every length must fit in one nybble of the compact tables.
+    limited_huffman( &scratch->tree, max_symbol_value,
+        frequencies, n, MAX_CODE_LENGTH-1, lengths );
+    const int raw_size = raw_block_size( original_length );
+    if( 0 < original_length ){
+        const int * encode_lengths = scratch->word_encode_lengths;
+        const unsigned int * encode_values = scratch->word_encode_values;
+        convert_lengths_to_encode_table( max_symbol_value, lengths, n,
+            scratch->word_encode_lengths, scratch->word_encode_values );
+        int digit_count = 0;
+        for( int k=0; k<token_count; k++ ){
+            const struct word_entry * entry = &entries[ scratch->word_tokens[k] ];
+            if( 0 <= entry->symbol ){
+                digit_count += encode_lengths[ entry->symbol ];
+            }else{
+                for( int j=0; j<entry->length; j++ ){
+                    digit_count += encode_lengths[ t[entry->start + j] ];
+                };
+            };
+        };
+        const int digits_per_byte = digits_per_packed_byte( n );
+        const int data_bytes = (digit_count + digits_per_byte - 1) / digits_per_byte;
+        char * table = scratch->word_table;
+        const int table_length = encode_smallest_length_table( scratch,
+            max_symbol_value, lengths, sizeof( scratch->word_table ), table );
+        const int payload_length = 2 +
+            snprintf( NULL, 0, "%d:%d:%d:%d:", n, digit_count, words, dictionary_length ) +
+            dictionary_length +
+            snprintf( NULL, 0, "%d:", table_length ) + table_length + data_bytes;
+        const int words_size =
+            snprintf( NULL, 0, "%d:", payload_length ) + payload_length + 2;
+        printf("# word tokens: %d tokens, %d words in %d bytes, %d bytes; raw: %d bytes.\n",
+            token_count, words, dictionary_length, words_size, raw_size );
+        if( (words_size < raw_size) and (words_size < compressed_size) and
+            (payload_length <= 0x8000)
+        ){
+            char * d = compressed_text;
+            d += sprintf( d, "%d:\nT%d:%d:%d:%d:", // start of netstring
+                payload_length, n, digit_count, words, dictionary_length );
+            memcpy( d, dictionary, dictionary_length );
+            d += dictionary_length;
+            d += sprintf( d, "%d:", table_length );
+            memcpy( d, table, table_length );
+            d += table_length;
+            struct digit_writer writer;
+            start_digit_writer( &writer, n, true, data_bytes, d );
+            for( int k=0; k<token_count; k++ ){
+                const struct word_entry * entry = &entries[ scratch->word_tokens[k] ];
+                if( 0 <= entry->symbol ){
+                    write_digits( &writer, encode_values[ entry->symbol ],
+                        encode_lengths[ entry->symbol ] );
+                }else{
+                    for( int j=0; j<entry->length; j++ ){
+                        const unsigned char byte = t[entry->start + j];
+                        write_digits( &writer, encode_values[byte], encode_lengths[byte] );
+                    };
+                };
+            };
+            finish_digit_writer( &writer );
+            assert( digit_count == writer.digit_count );
+            assert( data_bytes == writer.length );
+            d += data_bytes;
+            d += sprintf( d, ",\n" ); // end of netstring
+            assert( words_size == (d - compressed_text) );
+            return words_size;
+        };
+    };
+    // not worth it (or an empty block):
+    // all-zero lengths make compress() pass the data through raw.
+    reset_block_scratch( scratch );
+    return compress( scratch, NO_STATIC_TABLE,
+        MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+        true, // packed digits
+        original_length, original_text,
+        compressed_size, compressed_text );
+}
+
+/*
+Read a front-coded "\nT" dictionary
+into scratch->dictionary_text[] and scratch->dictionary_length[].
+Returns the number of bytes read.
+*/
+static int
+decode_word_dictionary(
+    struct block_scratch * scratch,
+    const int words,
+    const int length,
+    const unsigned char data[length]
+){
+    int position = 0;
+    for( int k=0; k<words; k++ ){
+        assert( position + 2 <= length );
+        const int shared = data[position++];
+        const int suffix = data[position++];
+        assert( (0 == k) or (shared <= scratch->dictionary_length[k-1]) );
+        assert( (0 < shared + suffix) and (shared + suffix <= WORD_MAX_LENGTH) );
+        assert( position + suffix <= length );
+        if( shared ){
+            memcpy( scratch->dictionary_text[k], scratch->dictionary_text[k-1], shared );
+        };
+        memcpy( &scratch->dictionary_text[k][shared], &data[position], suffix );
+        scratch->dictionary_length[k] = shared + suffix;
+        position += suffix;
+    };
+    return position;
+}
+
+/*
+Decode digit_count digits of "\nT" data
+with the table already in scratch->decoder
+and the dictionary already in scratch->dictionary_text[].
+Returns the number of bytes written.
+*/
+static int
+decode_word_digits(
+    struct block_scratch * scratch,
+    const int words,
+    const int compressed_symbols,
+    const int digit_count,
+    const unsigned char digits[],
+    const int max_decompressed_size,
+    char decompressed_text[max_decompressed_size] // output
+){
+    const struct canonical_decoder * decoder = &scratch->decoder;
+    struct digit_reader reader;
+    start_digit_reader( &reader, compressed_symbols, true, digit_count, digits );
+    fill_lookahead_window( decoder, &reader );
+    int length = 0;
+    while( reader.position < digit_count ){
+        const int symbol = decode_symbol_with_lookup_table( decoder, &reader );
+        if( symbol < 256 ){
+            assert( length < max_decompressed_size );
+            decompressed_text[length++] = symbol;
+            continue;
+        };
+        const int k = symbol - WORD_FIRST_SYMBOL;
+        assert( (0 <= k) and (k < words) );
+        const int word_length = scratch->dictionary_length[k];
+        assert( length + word_length <= max_decompressed_size );
+        memcpy( &decompressed_text[length], scratch->dictionary_text[k], word_length );
+        length += word_length;
+    };
+    assert( reader.position == digit_count );
+    return length;
+}
+
+/*
+Table-based asymmetric numeral systems (tANS),
+as in Jarek Duda's ANS papers and Yann Collet's FSE,
+as an alternative entropy coder for a whole block.
+Huffman gives every symbol a whole number of digits,
+which wastes space whenever the probabilities aren't powers of 1/n --
+worst of all for a block dominated by one byte,
+where Huffman can't spend less than 1 digit per byte.
+tANS spends (very nearly) log2(1/p) bits per symbol.
+
+The same histogram() counts are normalized
+so they add up to a power of two, L = 2^table_log,
+with every byte that appears getting at least 1.
+Each byte s gets count[s] of the L states,
+spread around the table (the FSE spread).
+Decoding is a table lookup per symbol:
+    the state says the byte,
+    how many bits to read,
+    and the base of the next state.
+Encoding is a table lookup too,
+but runs from the last byte back to the first,
+so the bits of each step are saved and written out in reverse.
+
+tANS works in bits, so it's always binary,
+whatever radix the Huffman blocks around it use.
+The block is a single netstring:
+    "\nF" table_log ':' symbol_count ':' bit_count ':' packed bits,
+where the bits are
+    the normalized counts of bytes 0..255, each as Elias gamma(count + 1),
+    the final encoder state (table_log bits),
+    then the bits of every step.
+choose_entropy_coder() decides, per block,
+whether this or Huffman is smaller.
+*/
+
+/*
+Scale the counts in scratch->symbol_frequencies[0..255]
+to add up to exactly 1 << table_log,
+into scratch->tans_counts[].
+Returns the number of bytes actually used.
+*/
+static int
+normalize_tans_counts( struct block_scratch * scratch, const int table_log ){
+    const int * frequencies = scratch->symbol_frequencies;
+    int * counts = scratch->tans_counts;
+    const int table_size = 1 << table_log;
+    long long total = 0;
+    int used = 0;
+    for( int s=0; s<256; s++ ){
+        total += frequencies[s];
+        used += (0 < frequencies[s]);
+    };
+    assert( used <= table_size );
+    int sum = 0;
+    int largest = 0;
+    for( int s=0; s<256; s++ ){
+        counts[s] = 0;
+        if( frequencies[s] ){
+            counts[s] = imax( 1,
+                (int)((frequencies[s] * (long long)table_size + total / 2) / total) );
+            sum += counts[s];
+            if( counts[largest] < counts[s] ){
+                largest = s;
+            };
+        };
+    };
+    // rounding: give the difference to the most common byte,
+    // or take it from whichever bytes can best spare it.
+    if( sum < table_size ){
+        counts[largest] += table_size - sum;
+    };
+    while( table_size < sum ){
+        int spare = 0;
+        for( int s=0; s<256; s++ ){
+            if( counts[spare] < counts[s] ){
+                spare = s;
+            };
+        };
+        assert( 1 < counts[spare] );
+        counts[spare]--;
+        sum--;
+    };
+    return used;
+}
+
+/*
+Elias gamma code of value (1 or more):
+one 0 for each bit after the leading 1, then the value itself.
+*/
+static int
+write_gamma( struct digit_writer * writer, const int value ){
+    assert( 0 < value );
+    const int bits = log2i( value );
+    if( writer ){
+        write_bits( writer, 0, bits );
+        write_bits( writer, value, bits + 1 );
+    };
+    return 2*bits + 1;
+}
+
+static int
+read_gamma( struct digit_reader * reader ){
+    int bits = 0;
+    while( 0 == read_bits( reader, 1 ) ){
+        bits++;
+        assert( bits < 31 ); // corrupt data?
+    };
+    return (1 << bits) | read_bits( reader, bits );
+}
+
+// the normalized counts, or (with no writer) just how many bits they need
+static int
+write_tans_counts( const struct block_scratch * scratch, struct digit_writer * writer ){
+    int bits = 0;
+    for( int s=0; s<256; s++ ){
+        bits += write_gamma( writer, scratch->tans_counts[s] + 1 );
+    };
+    return bits;
+}
+
+/*
+Spread the normalized counts over the L states,
+and build both the decode table (one entry per state)
+and the encode tables (per byte, and one entry per state).
+*/
+static void
+build_tans_tables( struct block_scratch * scratch, const int table_log ){
+    const int table_size = 1 << table_log;
+    const int * counts = scratch->tans_counts;
+    unsigned char * spread = scratch->tans_spread;
+    // the FSE spread: an odd step visits every state exactly once,
+    // and scatters each byte's states around the table.
+    const int step = (table_size >> 1) + (table_size >> 3) + 3;
+    int position = 0;
+    for( int s=0; s<256; s++ ){
+        for( int i=0; i<counts[s]; i++ ){
+            spread[position] = s;
+            position = (position + step) & (table_size - 1);
+        };
+    };
+    assert( 0 == position );
+    int next[256];
+    int rank[256];
+    int cumulative = 0;
+    for( int s=0; s<256; s++ ){
+        next[s] = counts[s];
+        rank[s] = 0;
+        scratch->tans_cumulative[s] = cumulative;
+        cumulative += counts[s];
+        if( counts[s] ){
+            const int max_bits = table_log - log2i( counts[s] );
+            scratch->tans_max_bits[s] = max_bits;
+            scratch->tans_threshold[s] = counts[s] << max_bits;
+        };
+    };
+    for( int x=0; x<table_size; x++ ){
+        const int s = spread[x];
+        // decoding: state x is the rank-th state of byte s ...
+        const int y = next[s]++;
+        const int bits = table_log - log2i( y );
+        scratch->tans_symbol[x] = s;
+        scratch->tans_bits[x] = bits;
+        scratch->tans_base[x] = (y << bits) - table_size;
+        // ... so encoding s from a state that shifts down to y leads here.
+        scratch->tans_encode_state[ scratch->tans_cumulative[s] + rank[s]++ ] =
+            table_size + x;
+    };
+}
+
+/*
+Compress one block with tANS
+as a single "\nF" netstring,
+using the histogram already in scratch->symbol_frequencies,
+or as pass-through raw data if that's no smaller.
+Returns the number of bytes written.
+*/
+int
+compress_tans(
+    struct block_scratch * scratch,
+    const int table_log,
+    const int original_length,
+    const char original_text[original_length],
+    const int compressed_size,
+    char compressed_text[compressed_size] // output
+){
+    assert( (TANS_MIN_TABLE_LOG <= table_log) and (table_log <= TANS_MAX_TABLE_LOG) );
+    const unsigned char * t = (const unsigned char *)original_text;
+    const int table_size = 1 << table_log;
+    const int raw_size = raw_block_size( original_length );
+    if( 0 < original_length ){
+        normalize_tans_counts( scratch, table_log );
+        build_tans_tables( scratch, table_log );
+        // encode backwards, saving each step's bits.
+        int state = table_size;
+        int bit_count = write_tans_counts( scratch, NULL ) + table_log;
+        for( int i=original_length-1; 0<=i; i-- ){
+            const int s = t[i];
+            const int bits = scratch->tans_max_bits[s] -
+                (state < scratch->tans_threshold[s]);
+            scratch->tans_step_value[i] = state & ((1 << bits) - 1);
+            scratch->tans_step_bits[i] = bits;
+            bit_count += bits;
+            state = scratch->tans_encode_state[ scratch->tans_cumulative[s] +
+                (state >> bits) - scratch->tans_counts[s] ];
+        };
+        const int data_bytes = (bit_count + 7) / 8;
+        const int payload_length = 2 +
+            snprintf( NULL, 0, "%d:%d:%d:", table_log, original_length, bit_count ) +
+            data_bytes;
+        const int tans_size =
+            snprintf( NULL, 0, "%d:", payload_length ) + payload_length + 2;
+        printf("# tANS, L=%d: %d bits, %d bytes; raw: %d bytes.\n",
+            table_size, bit_count, tans_size, raw_size );
+        if( (tans_size < raw_size) and (tans_size < compressed_size) and
+            (payload_length <= 0x8000)
+        ){
+            char * d = compressed_text;
+            d += sprintf( d, "%d:\nF%d:%d:%d:", // start of netstring
+                payload_length, table_log, original_length, bit_count );
+            struct digit_writer writer;
+            start_digit_writer( &writer, 2, true, data_bytes, d );
+            write_tans_counts( scratch, &writer );
+            write_bits( &writer, state - table_size, table_log );
+            for( int i=0; i<original_length; i++ ){
+                write_bits( &writer, scratch->tans_step_value[i], scratch->tans_step_bits[i] );
+            };
+            finish_digit_writer( &writer );
+            assert( bit_count == writer.digit_count );
+            assert( data_bytes == writer.length );
+            d += data_bytes;
+            d += sprintf( d, ",\n" ); // end of netstring
+            assert( tans_size == (d - compressed_text) );
+            return tans_size;
+        };
+    };
+    // not worth it (or an empty block):
+    // all-zero lengths make compress() pass the data through raw.
+    reset_block_scratch( scratch );
+    return compress( scratch, NO_STATIC_TABLE,
+        MAX_LEAF_VALUE, scratch->canonical_lengths, 2,
+        true, // packed digits
+        original_length, original_text,
+        compressed_size, compressed_text );
+}
+
+/*
+Decode symbol_count bytes of "\nF" data.
+Returns the number of bytes written.
+*/
+static int
+decode_tans(
+    struct block_scratch * scratch,
+    const int table_log,
+    const int symbol_count,
+    const int bit_count,
+    const unsigned char bits[],
+    const int max_decompressed_size,
+    char decompressed_text[max_decompressed_size] // output
+){
+    assert( (TANS_MIN_TABLE_LOG <= table_log) and (table_log <= TANS_MAX_TABLE_LOG) );
+    assert( symbol_count <= max_decompressed_size );
+    struct digit_reader reader;
+    start_digit_reader( &reader, 2, true, bit_count, bits );
+    int sum = 0;
+    for( int s=0; s<256; s++ ){
+        scratch->tans_counts[s] = read_gamma( &reader ) - 1;
+        sum += scratch->tans_counts[s];
+    };
+    assert( (1 << table_log) == sum ); // corrupt data?
+    build_tans_tables( scratch, table_log );
+    int state = read_bits( &reader, table_log );
+    for( int i=0; i<symbol_count; i++ ){
+        decompressed_text[i] = scratch->tans_symbol[state];
+        state = scratch->tans_base[state] + read_bits( &reader, scratch->tans_bits[state] );
+    };
+    // back where the encoder started.
+    assert( 0 == state );
+    assert( reader.position == bit_count );
+    return symbol_count;
+}
+
+/*
+Per-block checksums.
+A "\nC" block carries the CRC32C (Castagnoli polynomial, as in iSCSI and ext4)
+of the decompressed text of every block since the previous "\nC" block
+(or since the start of the compressed text),
+and how many bytes that is:
+    <length>:\nC<covered_length>:<8 hex digits>,\n
+decompress() recomputes it over the bytes it just decoded,
+so corruption is caught without a copy of the original text.
+The checksum is optional:
+a stream with no "\nC" blocks decodes exactly as before.
+
+When built with SSE4.2 enabled (for example, -msse4.2 or -march=native),
+this uses the crc32 instruction, 8 bytes at a time;
+otherwise "slicing-by-8":
+8 table lookups per 8 bytes,
+independent of each other, rather than 8 dependent ones.
+*/
+#if defined( __SSE4_2__ )
+#include <nmmintrin.h> // for _mm_crc32_u64(), _mm_crc32_u8()
+#endif
+
+#define CRC32C_POLYNOMIAL (0x82F63B78) // reflected
+
+#if !defined( __SSE4_2__ )
+/*
+crc32c_table[k][b]: the CRC of byte b followed by k zero bytes.
+Row 0 is CRC32C_POLYNOMIAL applied bit by bit to each byte;
+row k is row k-1 run through row 0 once more
+(test_checksums() checks both).
+Compile-time data, so there's nothing to set up
+before the first checksum (and nothing for two threads to race on).
+*/
+static const uint32_t crc32c_table[8][256] = {
+    { // k = 0
+        0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+        0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+        0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+        0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+        0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+        0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+        0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+        0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+        0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+        0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+        0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+        0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+        0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+        0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+        0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+        0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+        0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+        0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+        0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+        0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+        0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+        0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+        0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+        0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+        0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+        0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+        0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+        0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+        0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+        0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+        0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+        0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+        0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+        0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+        0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+        0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+        0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+        0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+        0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+        0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+        0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+        0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+        0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+    },
+    { // k = 1
+        0x00000000, 0x13a29877, 0x274530ee, 0x34e7a899, 0x4e8a61dc, 0x5d28f9ab,
+        0x69cf5132, 0x7a6dc945, 0x9d14c3b8, 0x8eb65bcf, 0xba51f356, 0xa9f36b21,
+        0xd39ea264, 0xc03c3a13, 0xf4db928a, 0xe7790afd, 0x3fc5f181, 0x2c6769f6,
+        0x1880c16f, 0x0b225918, 0x714f905d, 0x62ed082a, 0x560aa0b3, 0x45a838c4,
+        0xa2d13239, 0xb173aa4e, 0x859402d7, 0x96369aa0, 0xec5b53e5, 0xfff9cb92,
+        0xcb1e630b, 0xd8bcfb7c, 0x7f8be302, 0x6c297b75, 0x58ced3ec, 0x4b6c4b9b,
+        0x310182de, 0x22a31aa9, 0x1644b230, 0x05e62a47, 0xe29f20ba, 0xf13db8cd,
+        0xc5da1054, 0xd6788823, 0xac154166, 0xbfb7d911, 0x8b507188, 0x98f2e9ff,
+        0x404e1283, 0x53ec8af4, 0x670b226d, 0x74a9ba1a, 0x0ec4735f, 0x1d66eb28,
+        0x298143b1, 0x3a23dbc6, 0xdd5ad13b, 0xcef8494c, 0xfa1fe1d5, 0xe9bd79a2,
+        0x93d0b0e7, 0x80722890, 0xb4958009, 0xa737187e, 0xff17c604, 0xecb55e73,
+        0xd852f6ea, 0xcbf06e9d, 0xb19da7d8, 0xa23f3faf, 0x96d89736, 0x857a0f41,
+        0x620305bc, 0x71a19dcb, 0x45463552, 0x56e4ad25, 0x2c896460, 0x3f2bfc17,
+        0x0bcc548e, 0x186eccf9, 0xc0d23785, 0xd370aff2, 0xe797076b, 0xf4359f1c,
+        0x8e585659, 0x9dface2e, 0xa91d66b7, 0xbabffec0, 0x5dc6f43d, 0x4e646c4a,
+        0x7a83c4d3, 0x69215ca4, 0x134c95e1, 0x00ee0d96, 0x3409a50f, 0x27ab3d78,
+        0x809c2506, 0x933ebd71, 0xa7d915e8, 0xb47b8d9f, 0xce1644da, 0xddb4dcad,
+        0xe9537434, 0xfaf1ec43, 0x1d88e6be, 0x0e2a7ec9, 0x3acdd650, 0x296f4e27,
+        0x53028762, 0x40a01f15, 0x7447b78c, 0x67e52ffb, 0xbf59d487, 0xacfb4cf0,
+        0x981ce469, 0x8bbe7c1e, 0xf1d3b55b, 0xe2712d2c, 0xd69685b5, 0xc5341dc2,
+        0x224d173f, 0x31ef8f48, 0x050827d1, 0x16aabfa6, 0x6cc776e3, 0x7f65ee94,
+        0x4b82460d, 0x5820de7a, 0xfbc3faf9, 0xe861628e, 0xdc86ca17, 0xcf245260,
+        0xb5499b25, 0xa6eb0352, 0x920cabcb, 0x81ae33bc, 0x66d73941, 0x7575a136,
+        0x419209af, 0x523091d8, 0x285d589d, 0x3bffc0ea, 0x0f186873, 0x1cbaf004,
+        0xc4060b78, 0xd7a4930f, 0xe3433b96, 0xf0e1a3e1, 0x8a8c6aa4, 0x992ef2d3,
+        0xadc95a4a, 0xbe6bc23d, 0x5912c8c0, 0x4ab050b7, 0x7e57f82e, 0x6df56059,
+        0x1798a91c, 0x043a316b, 0x30dd99f2, 0x237f0185, 0x844819fb, 0x97ea818c,
+        0xa30d2915, 0xb0afb162, 0xcac27827, 0xd960e050, 0xed8748c9, 0xfe25d0be,
+        0x195cda43, 0x0afe4234, 0x3e19eaad, 0x2dbb72da, 0x57d6bb9f, 0x447423e8,
+        0x70938b71, 0x63311306, 0xbb8de87a, 0xa82f700d, 0x9cc8d894, 0x8f6a40e3,
+        0xf50789a6, 0xe6a511d1, 0xd242b948, 0xc1e0213f, 0x26992bc2, 0x353bb3b5,
+        0x01dc1b2c, 0x127e835b, 0x68134a1e, 0x7bb1d269, 0x4f567af0, 0x5cf4e287,
+        0x04d43cfd, 0x1776a48a, 0x23910c13, 0x30339464, 0x4a5e5d21, 0x59fcc556,
+        0x6d1b6dcf, 0x7eb9f5b8, 0x99c0ff45, 0x8a626732, 0xbe85cfab, 0xad2757dc,
+        0xd74a9e99, 0xc4e806ee, 0xf00fae77, 0xe3ad3600, 0x3b11cd7c, 0x28b3550b,
+        0x1c54fd92, 0x0ff665e5, 0x759baca0, 0x663934d7, 0x52de9c4e, 0x417c0439,
+        0xa6050ec4, 0xb5a796b3, 0x81403e2a, 0x92e2a65d, 0xe88f6f18, 0xfb2df76f,
+        0xcfca5ff6, 0xdc68c781, 0x7b5fdfff, 0x68fd4788, 0x5c1aef11, 0x4fb87766,
+        0x35d5be23, 0x26772654, 0x12908ecd, 0x013216ba, 0xe64b1c47, 0xf5e98430,
+        0xc10e2ca9, 0xd2acb4de, 0xa8c17d9b, 0xbb63e5ec, 0x8f844d75, 0x9c26d502,
+        0x449a2e7e, 0x5738b609, 0x63df1e90, 0x707d86e7, 0x0a104fa2, 0x19b2d7d5,
+        0x2d557f4c, 0x3ef7e73b, 0xd98eedc6, 0xca2c75b1, 0xfecbdd28, 0xed69455f,
+        0x97048c1a, 0x84a6146d, 0xb041bcf4, 0xa3e32483,
+    },
+    { // k = 2
+        0x00000000, 0xa541927e, 0x4f6f520d, 0xea2ec073, 0x9edea41a, 0x3b9f3664,
+        0xd1b1f617, 0x74f06469, 0x38513ec5, 0x9d10acbb, 0x773e6cc8, 0xd27ffeb6,
+        0xa68f9adf, 0x03ce08a1, 0xe9e0c8d2, 0x4ca15aac, 0x70a27d8a, 0xd5e3eff4,
+        0x3fcd2f87, 0x9a8cbdf9, 0xee7cd990, 0x4b3d4bee, 0xa1138b9d, 0x045219e3,
+        0x48f3434f, 0xedb2d131, 0x079c1142, 0xa2dd833c, 0xd62de755, 0x736c752b,
+        0x9942b558, 0x3c032726, 0xe144fb14, 0x4405696a, 0xae2ba919, 0x0b6a3b67,
+        0x7f9a5f0e, 0xdadbcd70, 0x30f50d03, 0x95b49f7d, 0xd915c5d1, 0x7c5457af,
+        0x967a97dc, 0x333b05a2, 0x47cb61cb, 0xe28af3b5, 0x08a433c6, 0xade5a1b8,
+        0x91e6869e, 0x34a714e0, 0xde89d493, 0x7bc846ed, 0x0f382284, 0xaa79b0fa,
+        0x40577089, 0xe516e2f7, 0xa9b7b85b, 0x0cf62a25, 0xe6d8ea56, 0x43997828,
+        0x37691c41, 0x92288e3f, 0x78064e4c, 0xdd47dc32, 0xc76580d9, 0x622412a7,
+        0x880ad2d4, 0x2d4b40aa, 0x59bb24c3, 0xfcfab6bd, 0x16d476ce, 0xb395e4b0,
+        0xff34be1c, 0x5a752c62, 0xb05bec11, 0x151a7e6f, 0x61ea1a06, 0xc4ab8878,
+        0x2e85480b, 0x8bc4da75, 0xb7c7fd53, 0x12866f2d, 0xf8a8af5e, 0x5de93d20,
+        0x29195949, 0x8c58cb37, 0x66760b44, 0xc337993a, 0x8f96c396, 0x2ad751e8,
+        0xc0f9919b, 0x65b803e5, 0x1148678c, 0xb409f5f2, 0x5e273581, 0xfb66a7ff,
+        0x26217bcd, 0x8360e9b3, 0x694e29c0, 0xcc0fbbbe, 0xb8ffdfd7, 0x1dbe4da9,
+        0xf7908dda, 0x52d11fa4, 0x1e704508, 0xbb31d776, 0x511f1705, 0xf45e857b,
+        0x80aee112, 0x25ef736c, 0xcfc1b31f, 0x6a802161, 0x56830647, 0xf3c29439,
+        0x19ec544a, 0xbcadc634, 0xc85da25d, 0x6d1c3023, 0x8732f050, 0x2273622e,
+        0x6ed23882, 0xcb93aafc, 0x21bd6a8f, 0x84fcf8f1, 0xf00c9c98, 0x554d0ee6,
+        0xbf63ce95, 0x1a225ceb, 0x8b277743, 0x2e66e53d, 0xc448254e, 0x6109b730,
+        0x15f9d359, 0xb0b84127, 0x5a968154, 0xffd7132a, 0xb3764986, 0x1637dbf8,
+        0xfc191b8b, 0x595889f5, 0x2da8ed9c, 0x88e97fe2, 0x62c7bf91, 0xc7862def,
+        0xfb850ac9, 0x5ec498b7, 0xb4ea58c4, 0x11abcaba, 0x655baed3, 0xc01a3cad,
+        0x2a34fcde, 0x8f756ea0, 0xc3d4340c, 0x6695a672, 0x8cbb6601, 0x29faf47f,
+        0x5d0a9016, 0xf84b0268, 0x1265c21b, 0xb7245065, 0x6a638c57, 0xcf221e29,
+        0x250cde5a, 0x804d4c24, 0xf4bd284d, 0x51fcba33, 0xbbd27a40, 0x1e93e83e,
+        0x5232b292, 0xf77320ec, 0x1d5de09f, 0xb81c72e1, 0xccec1688, 0x69ad84f6,
+        0x83834485, 0x26c2d6fb, 0x1ac1f1dd, 0xbf8063a3, 0x55aea3d0, 0xf0ef31ae,
+        0x841f55c7, 0x215ec7b9, 0xcb7007ca, 0x6e3195b4, 0x2290cf18, 0x87d15d66,
+        0x6dff9d15, 0xc8be0f6b, 0xbc4e6b02, 0x190ff97c, 0xf321390f, 0x5660ab71,
+        0x4c42f79a, 0xe90365e4, 0x032da597, 0xa66c37e9, 0xd29c5380, 0x77ddc1fe,
+        0x9df3018d, 0x38b293f3, 0x7413c95f, 0xd1525b21, 0x3b7c9b52, 0x9e3d092c,
+        0xeacd6d45, 0x4f8cff3b, 0xa5a23f48, 0x00e3ad36, 0x3ce08a10, 0x99a1186e,
+        0x738fd81d, 0xd6ce4a63, 0xa23e2e0a, 0x077fbc74, 0xed517c07, 0x4810ee79,
+        0x04b1b4d5, 0xa1f026ab, 0x4bdee6d8, 0xee9f74a6, 0x9a6f10cf, 0x3f2e82b1,
+        0xd50042c2, 0x7041d0bc, 0xad060c8e, 0x08479ef0, 0xe2695e83, 0x4728ccfd,
+        0x33d8a894, 0x96993aea, 0x7cb7fa99, 0xd9f668e7, 0x9557324b, 0x3016a035,
+        0xda386046, 0x7f79f238, 0x0b899651, 0xaec8042f, 0x44e6c45c, 0xe1a75622,
+        0xdda47104, 0x78e5e37a, 0x92cb2309, 0x378ab177, 0x437ad51e, 0xe63b4760,
+        0x0c158713, 0xa954156d, 0xe5f54fc1, 0x40b4ddbf, 0xaa9a1dcc, 0x0fdb8fb2,
+        0x7b2bebdb, 0xde6a79a5, 0x3444b9d6, 0x91052ba8,
+    },
+    { // k = 3
+        0x00000000, 0xdd45aab8, 0xbf672381, 0x62228939, 0x7b2231f3, 0xa6679b4b,
+        0xc4451272, 0x1900b8ca, 0xf64463e6, 0x2b01c95e, 0x49234067, 0x9466eadf,
+        0x8d665215, 0x5023f8ad, 0x32017194, 0xef44db2c, 0xe964b13d, 0x34211b85,
+        0x560392bc, 0x8b463804, 0x924680ce, 0x4f032a76, 0x2d21a34f, 0xf06409f7,
+        0x1f20d2db, 0xc2657863, 0xa047f15a, 0x7d025be2, 0x6402e328, 0xb9474990,
+        0xdb65c0a9, 0x06206a11, 0xd725148b, 0x0a60be33, 0x6842370a, 0xb5079db2,
+        0xac072578, 0x71428fc0, 0x136006f9, 0xce25ac41, 0x2161776d, 0xfc24ddd5,
+        0x9e0654ec, 0x4343fe54, 0x5a43469e, 0x8706ec26, 0xe524651f, 0x3861cfa7,
+        0x3e41a5b6, 0xe3040f0e, 0x81268637, 0x5c632c8f, 0x45639445, 0x98263efd,
+        0xfa04b7c4, 0x27411d7c, 0xc805c650, 0x15406ce8, 0x7762e5d1, 0xaa274f69,
+        0xb327f7a3, 0x6e625d1b, 0x0c40d422, 0xd1057e9a, 0xaba65fe7, 0x76e3f55f,
+        0x14c17c66, 0xc984d6de, 0xd0846e14, 0x0dc1c4ac, 0x6fe34d95, 0xb2a6e72d,
+        0x5de23c01, 0x80a796b9, 0xe2851f80, 0x3fc0b538, 0x26c00df2, 0xfb85a74a,
+        0x99a72e73, 0x44e284cb, 0x42c2eeda, 0x9f874462, 0xfda5cd5b, 0x20e067e3,
+        0x39e0df29, 0xe4a57591, 0x8687fca8, 0x5bc25610, 0xb4868d3c, 0x69c32784,
+        0x0be1aebd, 0xd6a40405, 0xcfa4bccf, 0x12e11677, 0x70c39f4e, 0xad8635f6,
+        0x7c834b6c, 0xa1c6e1d4, 0xc3e468ed, 0x1ea1c255, 0x07a17a9f, 0xdae4d027,
+        0xb8c6591e, 0x6583f3a6, 0x8ac7288a, 0x57828232, 0x35a00b0b, 0xe8e5a1b3,
+        0xf1e51979, 0x2ca0b3c1, 0x4e823af8, 0x93c79040, 0x95e7fa51, 0x48a250e9,
+        0x2a80d9d0, 0xf7c57368, 0xeec5cba2, 0x3380611a, 0x51a2e823, 0x8ce7429b,
+        0x63a399b7, 0xbee6330f, 0xdcc4ba36, 0x0181108e, 0x1881a844, 0xc5c402fc,
+        0xa7e68bc5, 0x7aa3217d, 0x52a0c93f, 0x8fe56387, 0xedc7eabe, 0x30824006,
+        0x2982f8cc, 0xf4c75274, 0x96e5db4d, 0x4ba071f5, 0xa4e4aad9, 0x79a10061,
+        0x1b838958, 0xc6c623e0, 0xdfc69b2a, 0x02833192, 0x60a1b8ab, 0xbde41213,
+        0xbbc47802, 0x6681d2ba, 0x04a35b83, 0xd9e6f13b, 0xc0e649f1, 0x1da3e349,
+        0x7f816a70, 0xa2c4c0c8, 0x4d801be4, 0x90c5b15c, 0xf2e73865, 0x2fa292dd,
+        0x36a22a17, 0xebe780af, 0x89c50996, 0x5480a32e, 0x8585ddb4, 0x58c0770c,
+        0x3ae2fe35, 0xe7a7548d, 0xfea7ec47, 0x23e246ff, 0x41c0cfc6, 0x9c85657e,
+        0x73c1be52, 0xae8414ea, 0xcca69dd3, 0x11e3376b, 0x08e38fa1, 0xd5a62519,
+        0xb784ac20, 0x6ac10698, 0x6ce16c89, 0xb1a4c631, 0xd3864f08, 0x0ec3e5b0,
+        0x17c35d7a, 0xca86f7c2, 0xa8a47efb, 0x75e1d443, 0x9aa50f6f, 0x47e0a5d7,
+        0x25c22cee, 0xf8878656, 0xe1873e9c, 0x3cc29424, 0x5ee01d1d, 0x83a5b7a5,
+        0xf90696d8, 0x24433c60, 0x4661b559, 0x9b241fe1, 0x8224a72b, 0x5f610d93,
+        0x3d4384aa, 0xe0062e12, 0x0f42f53e, 0xd2075f86, 0xb025d6bf, 0x6d607c07,
+        0x7460c4cd, 0xa9256e75, 0xcb07e74c, 0x16424df4, 0x106227e5, 0xcd278d5d,
+        0xaf050464, 0x7240aedc, 0x6b401616, 0xb605bcae, 0xd4273597, 0x09629f2f,
+        0xe6264403, 0x3b63eebb, 0x59416782, 0x8404cd3a, 0x9d0475f0, 0x4041df48,
+        0x22635671, 0xff26fcc9, 0x2e238253, 0xf36628eb, 0x9144a1d2, 0x4c010b6a,
+        0x5501b3a0, 0x88441918, 0xea669021, 0x37233a99, 0xd867e1b5, 0x05224b0d,
+        0x6700c234, 0xba45688c, 0xa345d046, 0x7e007afe, 0x1c22f3c7, 0xc167597f,
+        0xc747336e, 0x1a0299d6, 0x782010ef, 0xa565ba57, 0xbc65029d, 0x6120a825,
+        0x0302211c, 0xde478ba4, 0x31035088, 0xec46fa30, 0x8e647309, 0x5321d9b1,
+        0x4a21617b, 0x9764cbc3, 0xf54642fa, 0x2803e842,
+    },
+    { // k = 4
+        0x00000000, 0x38116fac, 0x7022df58, 0x4833b0f4, 0xe045beb0, 0xd854d11c,
+        0x906761e8, 0xa8760e44, 0xc5670b91, 0xfd76643d, 0xb545d4c9, 0x8d54bb65,
+        0x2522b521, 0x1d33da8d, 0x55006a79, 0x6d1105d5, 0x8f2261d3, 0xb7330e7f,
+        0xff00be8b, 0xc711d127, 0x6f67df63, 0x5776b0cf, 0x1f45003b, 0x27546f97,
+        0x4a456a42, 0x725405ee, 0x3a67b51a, 0x0276dab6, 0xaa00d4f2, 0x9211bb5e,
+        0xda220baa, 0xe2336406, 0x1ba8b557, 0x23b9dafb, 0x6b8a6a0f, 0x539b05a3,
+        0xfbed0be7, 0xc3fc644b, 0x8bcfd4bf, 0xb3debb13, 0xdecfbec6, 0xe6ded16a,
+        0xaeed619e, 0x96fc0e32, 0x3e8a0076, 0x069b6fda, 0x4ea8df2e, 0x76b9b082,
+        0x948ad484, 0xac9bbb28, 0xe4a80bdc, 0xdcb96470, 0x74cf6a34, 0x4cde0598,
+        0x04edb56c, 0x3cfcdac0, 0x51eddf15, 0x69fcb0b9, 0x21cf004d, 0x19de6fe1,
+        0xb1a861a5, 0x89b90e09, 0xc18abefd, 0xf99bd151, 0x37516aae, 0x0f400502,
+        0x4773b5f6, 0x7f62da5a, 0xd714d41e, 0xef05bbb2, 0xa7360b46, 0x9f2764ea,
+        0xf236613f, 0xca270e93, 0x8214be67, 0xba05d1cb, 0x1273df8f, 0x2a62b023,
+        0x625100d7, 0x5a406f7b, 0xb8730b7d, 0x806264d1, 0xc851d425, 0xf040bb89,
+        0x5836b5cd, 0x6027da61, 0x28146a95, 0x10050539, 0x7d1400ec, 0x45056f40,
+        0x0d36dfb4, 0x3527b018, 0x9d51be5c, 0xa540d1f0, 0xed736104, 0xd5620ea8,
+        0x2cf9dff9, 0x14e8b055, 0x5cdb00a1, 0x64ca6f0d, 0xccbc6149, 0xf4ad0ee5,
+        0xbc9ebe11, 0x848fd1bd, 0xe99ed468, 0xd18fbbc4, 0x99bc0b30, 0xa1ad649c,
+        0x09db6ad8, 0x31ca0574, 0x79f9b580, 0x41e8da2c, 0xa3dbbe2a, 0x9bcad186,
+        0xd3f96172, 0xebe80ede, 0x439e009a, 0x7b8f6f36, 0x33bcdfc2, 0x0badb06e,
+        0x66bcb5bb, 0x5eadda17, 0x169e6ae3, 0x2e8f054f, 0x86f90b0b, 0xbee864a7,
+        0xf6dbd453, 0xcecabbff, 0x6ea2d55c, 0x56b3baf0, 0x1e800a04, 0x269165a8,
+        0x8ee76bec, 0xb6f60440, 0xfec5b4b4, 0xc6d4db18, 0xabc5decd, 0x93d4b161,
+        0xdbe70195, 0xe3f66e39, 0x4b80607d, 0x73910fd1, 0x3ba2bf25, 0x03b3d089,
+        0xe180b48f, 0xd991db23, 0x91a26bd7, 0xa9b3047b, 0x01c50a3f, 0x39d46593,
+        0x71e7d567, 0x49f6bacb, 0x24e7bf1e, 0x1cf6d0b2, 0x54c56046, 0x6cd40fea,
+        0xc4a201ae, 0xfcb36e02, 0xb480def6, 0x8c91b15a, 0x750a600b, 0x4d1b0fa7,
+        0x0528bf53, 0x3d39d0ff, 0x954fdebb, 0xad5eb117, 0xe56d01e3, 0xdd7c6e4f,
+        0xb06d6b9a, 0x887c0436, 0xc04fb4c2, 0xf85edb6e, 0x5028d52a, 0x6839ba86,
+        0x200a0a72, 0x181b65de, 0xfa2801d8, 0xc2396e74, 0x8a0ade80, 0xb21bb12c,
+        0x1a6dbf68, 0x227cd0c4, 0x6a4f6030, 0x525e0f9c, 0x3f4f0a49, 0x075e65e5,
+        0x4f6dd511, 0x777cbabd, 0xdf0ab4f9, 0xe71bdb55, 0xaf286ba1, 0x9739040d,
+        0x59f3bff2, 0x61e2d05e, 0x29d160aa, 0x11c00f06, 0xb9b60142, 0x81a76eee,
+        0xc994de1a, 0xf185b1b6, 0x9c94b463, 0xa485dbcf, 0xecb66b3b, 0xd4a70497,
+        0x7cd10ad3, 0x44c0657f, 0x0cf3d58b, 0x34e2ba27, 0xd6d1de21, 0xeec0b18d,
+        0xa6f30179, 0x9ee26ed5, 0x36946091, 0x0e850f3d, 0x46b6bfc9, 0x7ea7d065,
+        0x13b6d5b0, 0x2ba7ba1c, 0x63940ae8, 0x5b856544, 0xf3f36b00, 0xcbe204ac,
+        0x83d1b458, 0xbbc0dbf4, 0x425b0aa5, 0x7a4a6509, 0x3279d5fd, 0x0a68ba51,
+        0xa21eb415, 0x9a0fdbb9, 0xd23c6b4d, 0xea2d04e1, 0x873c0134, 0xbf2d6e98,
+        0xf71ede6c, 0xcf0fb1c0, 0x6779bf84, 0x5f68d028, 0x175b60dc, 0x2f4a0f70,
+        0xcd796b76, 0xf56804da, 0xbd5bb42e, 0x854adb82, 0x2d3cd5c6, 0x152dba6a,
+        0x5d1e0a9e, 0x650f6532, 0x081e60e7, 0x300f0f4b, 0x783cbfbf, 0x402dd013,
+        0xe85bde57, 0xd04ab1fb, 0x9879010f, 0xa0686ea3,
+    },
+    { // k = 5
+        0x00000000, 0xef306b19, 0xdb8ca0c3, 0x34bccbda, 0xb2f53777, 0x5dc55c6e,
+        0x697997b4, 0x8649fcad, 0x6006181f, 0x8f367306, 0xbb8ab8dc, 0x54bad3c5,
+        0xd2f32f68, 0x3dc34471, 0x097f8fab, 0xe64fe4b2, 0xc00c303e, 0x2f3c5b27,
+        0x1b8090fd, 0xf4b0fbe4, 0x72f90749, 0x9dc96c50, 0xa975a78a, 0x4645cc93,
+        0xa00a2821, 0x4f3a4338, 0x7b8688e2, 0x94b6e3fb, 0x12ff1f56, 0xfdcf744f,
+        0xc973bf95, 0x2643d48c, 0x85f4168d, 0x6ac47d94, 0x5e78b64e, 0xb148dd57,
+        0x370121fa, 0xd8314ae3, 0xec8d8139, 0x03bdea20, 0xe5f20e92, 0x0ac2658b,
+        0x3e7eae51, 0xd14ec548, 0x570739e5, 0xb83752fc, 0x8c8b9926, 0x63bbf23f,
+        0x45f826b3, 0xaac84daa, 0x9e748670, 0x7144ed69, 0xf70d11c4, 0x183d7add,
+        0x2c81b107, 0xc3b1da1e, 0x25fe3eac, 0xcace55b5, 0xfe729e6f, 0x1142f576,
+        0x970b09db, 0x783b62c2, 0x4c87a918, 0xa3b7c201, 0x0e045beb, 0xe13430f2,
+        0xd588fb28, 0x3ab89031, 0xbcf16c9c, 0x53c10785, 0x677dcc5f, 0x884da746,
+        0x6e0243f4, 0x813228ed, 0xb58ee337, 0x5abe882e, 0xdcf77483, 0x33c71f9a,
+        0x077bd440, 0xe84bbf59, 0xce086bd5, 0x213800cc, 0x1584cb16, 0xfab4a00f,
+        0x7cfd5ca2, 0x93cd37bb, 0xa771fc61, 0x48419778, 0xae0e73ca, 0x413e18d3,
+        0x7582d309, 0x9ab2b810, 0x1cfb44bd, 0xf3cb2fa4, 0xc777e47e, 0x28478f67,
+        0x8bf04d66, 0x64c0267f, 0x507ceda5, 0xbf4c86bc, 0x39057a11, 0xd6351108,
+        0xe289dad2, 0x0db9b1cb, 0xebf65579, 0x04c63e60, 0x307af5ba, 0xdf4a9ea3,
+        0x5903620e, 0xb6330917, 0x828fc2cd, 0x6dbfa9d4, 0x4bfc7d58, 0xa4cc1641,
+        0x9070dd9b, 0x7f40b682, 0xf9094a2f, 0x16392136, 0x2285eaec, 0xcdb581f5,
+        0x2bfa6547, 0xc4ca0e5e, 0xf076c584, 0x1f46ae9d, 0x990f5230, 0x763f3929,
+        0x4283f2f3, 0xadb399ea, 0x1c08b7d6, 0xf338dccf, 0xc7841715, 0x28b47c0c,
+        0xaefd80a1, 0x41cdebb8, 0x75712062, 0x9a414b7b, 0x7c0eafc9, 0x933ec4d0,
+        0xa7820f0a, 0x48b26413, 0xcefb98be, 0x21cbf3a7, 0x1577387d, 0xfa475364,
+        0xdc0487e8, 0x3334ecf1, 0x0788272b, 0xe8b84c32, 0x6ef1b09f, 0x81c1db86,
+        0xb57d105c, 0x5a4d7b45, 0xbc029ff7, 0x5332f4ee, 0x678e3f34, 0x88be542d,
+        0x0ef7a880, 0xe1c7c399, 0xd57b0843, 0x3a4b635a, 0x99fca15b, 0x76ccca42,
+        0x42700198, 0xad406a81, 0x2b09962c, 0xc439fd35, 0xf08536ef, 0x1fb55df6,
+        0xf9fab944, 0x16cad25d, 0x22761987, 0xcd46729e, 0x4b0f8e33, 0xa43fe52a,
+        0x90832ef0, 0x7fb345e9, 0x59f09165, 0xb6c0fa7c, 0x827c31a6, 0x6d4c5abf,
+        0xeb05a612, 0x0435cd0b, 0x308906d1, 0xdfb96dc8, 0x39f6897a, 0xd6c6e263,
+        0xe27a29b9, 0x0d4a42a0, 0x8b03be0d, 0x6433d514, 0x508f1ece, 0xbfbf75d7,
+        0x120cec3d, 0xfd3c8724, 0xc9804cfe, 0x26b027e7, 0xa0f9db4a, 0x4fc9b053,
+        0x7b757b89, 0x94451090, 0x720af422, 0x9d3a9f3b, 0xa98654e1, 0x46b63ff8,
+        0xc0ffc355, 0x2fcfa84c, 0x1b736396, 0xf443088f, 0xd200dc03, 0x3d30b71a,
+        0x098c7cc0, 0xe6bc17d9, 0x60f5eb74, 0x8fc5806d, 0xbb794bb7, 0x544920ae,
+        0xb206c41c, 0x5d36af05, 0x698a64df, 0x86ba0fc6, 0x00f3f36b, 0xefc39872,
+        0xdb7f53a8, 0x344f38b1, 0x97f8fab0, 0x78c891a9, 0x4c745a73, 0xa344316a,
+        0x250dcdc7, 0xca3da6de, 0xfe816d04, 0x11b1061d, 0xf7fee2af, 0x18ce89b6,
+        0x2c72426c, 0xc3422975, 0x450bd5d8, 0xaa3bbec1, 0x9e87751b, 0x71b71e02,
+        0x57f4ca8e, 0xb8c4a197, 0x8c786a4d, 0x63480154, 0xe501fdf9, 0x0a3196e0,
+        0x3e8d5d3a, 0xd1bd3623, 0x37f2d291, 0xd8c2b988, 0xec7e7252, 0x034e194b,
+        0x8507e5e6, 0x6a378eff, 0x5e8b4525, 0xb1bb2e3c,
+    },
+    { // k = 6
+        0x00000000, 0x68032cc8, 0xd0065990, 0xb8057558, 0xa5e0c5d1, 0xcde3e919,
+        0x75e69c41, 0x1de5b089, 0x4e2dfd53, 0x262ed19b, 0x9e2ba4c3, 0xf628880b,
+        0xebcd3882, 0x83ce144a, 0x3bcb6112, 0x53c84dda, 0x9c5bfaa6, 0xf458d66e,
+        0x4c5da336, 0x245e8ffe, 0x39bb3f77, 0x51b813bf, 0xe9bd66e7, 0x81be4a2f,
+        0xd27607f5, 0xba752b3d, 0x02705e65, 0x6a7372ad, 0x7796c224, 0x1f95eeec,
+        0xa7909bb4, 0xcf93b77c, 0x3d5b83bd, 0x5558af75, 0xed5dda2d, 0x855ef6e5,
+        0x98bb466c, 0xf0b86aa4, 0x48bd1ffc, 0x20be3334, 0x73767eee, 0x1b755226,
+        0xa370277e, 0xcb730bb6, 0xd696bb3f, 0xbe9597f7, 0x0690e2af, 0x6e93ce67,
+        0xa100791b, 0xc90355d3, 0x7106208b, 0x19050c43, 0x04e0bcca, 0x6ce39002,
+        0xd4e6e55a, 0xbce5c992, 0xef2d8448, 0x872ea880, 0x3f2bddd8, 0x5728f110,
+        0x4acd4199, 0x22ce6d51, 0x9acb1809, 0xf2c834c1, 0x7ab7077a, 0x12b42bb2,
+        0xaab15eea, 0xc2b27222, 0xdf57c2ab, 0xb754ee63, 0x0f519b3b, 0x6752b7f3,
+        0x349afa29, 0x5c99d6e1, 0xe49ca3b9, 0x8c9f8f71, 0x917a3ff8, 0xf9791330,
+        0x417c6668, 0x297f4aa0, 0xe6ecfddc, 0x8eefd114, 0x36eaa44c, 0x5ee98884,
+        0x430c380d, 0x2b0f14c5, 0x930a619d, 0xfb094d55, 0xa8c1008f, 0xc0c22c47,
+        0x78c7591f, 0x10c475d7, 0x0d21c55e, 0x6522e996, 0xdd279cce, 0xb524b006,
+        0x47ec84c7, 0x2fefa80f, 0x97eadd57, 0xffe9f19f, 0xe20c4116, 0x8a0f6dde,
+        0x320a1886, 0x5a09344e, 0x09c17994, 0x61c2555c, 0xd9c72004, 0xb1c40ccc,
+        0xac21bc45, 0xc422908d, 0x7c27e5d5, 0x1424c91d, 0xdbb77e61, 0xb3b452a9,
+        0x0bb127f1, 0x63b20b39, 0x7e57bbb0, 0x16549778, 0xae51e220, 0xc652cee8,
+        0x959a8332, 0xfd99affa, 0x459cdaa2, 0x2d9ff66a, 0x307a46e3, 0x58796a2b,
+        0xe07c1f73, 0x887f33bb, 0xf56e0ef4, 0x9d6d223c, 0x25685764, 0x4d6b7bac,
+        0x508ecb25, 0x388de7ed, 0x808892b5, 0xe88bbe7d, 0xbb43f3a7, 0xd340df6f,
+        0x6b45aa37, 0x034686ff, 0x1ea33676, 0x76a01abe, 0xcea56fe6, 0xa6a6432e,
+        0x6935f452, 0x0136d89a, 0xb933adc2, 0xd130810a, 0xccd53183, 0xa4d61d4b,
+        0x1cd36813, 0x74d044db, 0x27180901, 0x4f1b25c9, 0xf71e5091, 0x9f1d7c59,
+        0x82f8ccd0, 0xeafbe018, 0x52fe9540, 0x3afdb988, 0xc8358d49, 0xa036a181,
+        0x1833d4d9, 0x7030f811, 0x6dd54898, 0x05d66450, 0xbdd31108, 0xd5d03dc0,
+        0x8618701a, 0xee1b5cd2, 0x561e298a, 0x3e1d0542, 0x23f8b5cb, 0x4bfb9903,
+        0xf3feec5b, 0x9bfdc093, 0x546e77ef, 0x3c6d5b27, 0x84682e7f, 0xec6b02b7,
+        0xf18eb23e, 0x998d9ef6, 0x2188ebae, 0x498bc766, 0x1a438abc, 0x7240a674,
+        0xca45d32c, 0xa246ffe4, 0xbfa34f6d, 0xd7a063a5, 0x6fa516fd, 0x07a63a35,
+        0x8fd9098e, 0xe7da2546, 0x5fdf501e, 0x37dc7cd6, 0x2a39cc5f, 0x423ae097,
+        0xfa3f95cf, 0x923cb907, 0xc1f4f4dd, 0xa9f7d815, 0x11f2ad4d, 0x79f18185,
+        0x6414310c, 0x0c171dc4, 0xb412689c, 0xdc114454, 0x1382f328, 0x7b81dfe0,
+        0xc384aab8, 0xab878670, 0xb66236f9, 0xde611a31, 0x66646f69, 0x0e6743a1,
+        0x5daf0e7b, 0x35ac22b3, 0x8da957eb, 0xe5aa7b23, 0xf84fcbaa, 0x904ce762,
+        0x2849923a, 0x404abef2, 0xb2828a33, 0xda81a6fb, 0x6284d3a3, 0x0a87ff6b,
+        0x17624fe2, 0x7f61632a, 0xc7641672, 0xaf673aba, 0xfcaf7760, 0x94ac5ba8,
+        0x2ca92ef0, 0x44aa0238, 0x594fb2b1, 0x314c9e79, 0x8949eb21, 0xe14ac7e9,
+        0x2ed97095, 0x46da5c5d, 0xfedf2905, 0x96dc05cd, 0x8b39b544, 0xe33a998c,
+        0x5b3fecd4, 0x333cc01c, 0x60f48dc6, 0x08f7a10e, 0xb0f2d456, 0xd8f1f89e,
+        0xc5144817, 0xad1764df, 0x15121187, 0x7d113d4f,
+    },
+    { // k = 7
+        0x00000000, 0x493c7d27, 0x9278fa4e, 0xdb448769, 0x211d826d, 0x6821ff4a,
+        0xb3657823, 0xfa590504, 0x423b04da, 0x0b0779fd, 0xd043fe94, 0x997f83b3,
+        0x632686b7, 0x2a1afb90, 0xf15e7cf9, 0xb86201de, 0x847609b4, 0xcd4a7493,
+        0x160ef3fa, 0x5f328edd, 0xa56b8bd9, 0xec57f6fe, 0x37137197, 0x7e2f0cb0,
+        0xc64d0d6e, 0x8f717049, 0x5435f720, 0x1d098a07, 0xe7508f03, 0xae6cf224,
+        0x7528754d, 0x3c14086a, 0x0d006599, 0x443c18be, 0x9f789fd7, 0xd644e2f0,
+        0x2c1de7f4, 0x65219ad3, 0xbe651dba, 0xf759609d, 0x4f3b6143, 0x06071c64,
+        0xdd439b0d, 0x947fe62a, 0x6e26e32e, 0x271a9e09, 0xfc5e1960, 0xb5626447,
+        0x89766c2d, 0xc04a110a, 0x1b0e9663, 0x5232eb44, 0xa86bee40, 0xe1579367,
+        0x3a13140e, 0x732f6929, 0xcb4d68f7, 0x827115d0, 0x593592b9, 0x1009ef9e,
+        0xea50ea9a, 0xa36c97bd, 0x782810d4, 0x31146df3, 0x1a00cb32, 0x533cb615,
+        0x8878317c, 0xc1444c5b, 0x3b1d495f, 0x72213478, 0xa965b311, 0xe059ce36,
+        0x583bcfe8, 0x1107b2cf, 0xca4335a6, 0x837f4881, 0x79264d85, 0x301a30a2,
+        0xeb5eb7cb, 0xa262caec, 0x9e76c286, 0xd74abfa1, 0x0c0e38c8, 0x453245ef,
+        0xbf6b40eb, 0xf6573dcc, 0x2d13baa5, 0x642fc782, 0xdc4dc65c, 0x9571bb7b,
+        0x4e353c12, 0x07094135, 0xfd504431, 0xb46c3916, 0x6f28be7f, 0x2614c358,
+        0x1700aeab, 0x5e3cd38c, 0x857854e5, 0xcc4429c2, 0x361d2cc6, 0x7f2151e1,
+        0xa465d688, 0xed59abaf, 0x553baa71, 0x1c07d756, 0xc743503f, 0x8e7f2d18,
+        0x7426281c, 0x3d1a553b, 0xe65ed252, 0xaf62af75, 0x9376a71f, 0xda4ada38,
+        0x010e5d51, 0x48322076, 0xb26b2572, 0xfb575855, 0x2013df3c, 0x692fa21b,
+        0xd14da3c5, 0x9871dee2, 0x4335598b, 0x0a0924ac, 0xf05021a8, 0xb96c5c8f,
+        0x6228dbe6, 0x2b14a6c1, 0x34019664, 0x7d3deb43, 0xa6796c2a, 0xef45110d,
+        0x151c1409, 0x5c20692e, 0x8764ee47, 0xce589360, 0x763a92be, 0x3f06ef99,
+        0xe44268f0, 0xad7e15d7, 0x572710d3, 0x1e1b6df4, 0xc55fea9d, 0x8c6397ba,
+        0xb0779fd0, 0xf94be2f7, 0x220f659e, 0x6b3318b9, 0x916a1dbd, 0xd856609a,
+        0x0312e7f3, 0x4a2e9ad4, 0xf24c9b0a, 0xbb70e62d, 0x60346144, 0x29081c63,
+        0xd3511967, 0x9a6d6440, 0x4129e329, 0x08159e0e, 0x3901f3fd, 0x703d8eda,
+        0xab7909b3, 0xe2457494, 0x181c7190, 0x51200cb7, 0x8a648bde, 0xc358f6f9,
+        0x7b3af727, 0x32068a00, 0xe9420d69, 0xa07e704e, 0x5a27754a, 0x131b086d,
+        0xc85f8f04, 0x8163f223, 0xbd77fa49, 0xf44b876e, 0x2f0f0007, 0x66337d20,
+        0x9c6a7824, 0xd5560503, 0x0e12826a, 0x472eff4d, 0xff4cfe93, 0xb67083b4,
+        0x6d3404dd, 0x240879fa, 0xde517cfe, 0x976d01d9, 0x4c2986b0, 0x0515fb97,
+        0x2e015d56, 0x673d2071, 0xbc79a718, 0xf545da3f, 0x0f1cdf3b, 0x4620a21c,
+        0x9d642575, 0xd4585852, 0x6c3a598c, 0x250624ab, 0xfe42a3c2, 0xb77edee5,
+        0x4d27dbe1, 0x041ba6c6, 0xdf5f21af, 0x96635c88, 0xaa7754e2, 0xe34b29c5,
+        0x380faeac, 0x7133d38b, 0x8b6ad68f, 0xc256aba8, 0x19122cc1, 0x502e51e6,
+        0xe84c5038, 0xa1702d1f, 0x7a34aa76, 0x3308d751, 0xc951d255, 0x806daf72,
+        0x5b29281b, 0x1215553c, 0x230138cf, 0x6a3d45e8, 0xb179c281, 0xf845bfa6,
+        0x021cbaa2, 0x4b20c785, 0x906440ec, 0xd9583dcb, 0x613a3c15, 0x28064132,
+        0xf342c65b, 0xba7ebb7c, 0x4027be78, 0x091bc35f, 0xd25f4436, 0x9b633911,
+        0xa777317b, 0xee4b4c5c, 0x350fcb35, 0x7c33b612, 0x866ab316, 0xcf56ce31,
+        0x14124958, 0x5d2e347f, 0xe54c35a1, 0xac704886, 0x7734cfef, 0x3e08b2c8,
+        0xc451b7cc, 0x8d6dcaeb, 0x56294d82, 0x1f1530a5,
+    },
+};
+#endif
+
+static uint32_t
+crc32c_update( uint32_t crc, const int length, const unsigned char data[] ){
+    int i = 0;
+    crc = ~crc;
+#if defined( __SSE4_2__ )
+    uint64_t crc64 = crc;
+    for( ; i + 8 <= length; i += 8 ){
+        uint64_t word;
+        memcpy( &word, &data[i], 8 );
+        crc64 = _mm_crc32_u64( crc64, word );
+    };
+    crc = crc64;
+    for( ; i<length; i++ ){
+        crc = _mm_crc32_u8( crc, data[i] );
+    };
+#else
+    for( ; i + 8 <= length; i += 8 ){
+        const unsigned char * p = &data[i];
+        const uint32_t low = crc ^
+            ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+            (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc =
+            crc32c_table[7][ low & 0xff ] ^
+            crc32c_table[6][ (low >> 8) & 0xff ] ^
+            crc32c_table[5][ (low >> 16) & 0xff ] ^
+            crc32c_table[4][ low >> 24 ] ^
+            crc32c_table[3][ p[4] ] ^
+            crc32c_table[2][ p[5] ] ^
+            crc32c_table[1][ p[6] ] ^
+            crc32c_table[0][ p[7] ];
+    };
+    for( ; i<length; i++ ){
+        crc = (crc >> 8) ^ crc32c_table[0][ (crc ^ data[i]) & 0xff ];
+    };
+#endif
+    return ~crc;
+}
+
+static uint32_t
+crc32c( const int length, const char text[] ){
+    return crc32c_update( 0, length, (const unsigned char *)text );
+}
+
+/*
+Append a "\nC" block
+covering the given original text
+to the end of compressed_length bytes of compressed text.
+Returns the new compressed length.
+*/
+int
+append_checksum_block(
+    const int original_length,
+    const char original_text[],
+    const int compressed_length,
+    const int compressed_size,
+    char compressed_text[compressed_size] // in-out
+){
+    char payload[32];
+    const int payload_length = snprintf( payload, sizeof( payload ), "\nC%d:%08lx",
+        original_length, (unsigned long)crc32c( original_length, original_text ) );
+    const int block_length =
+        snprintf( NULL, 0, "%d:", payload_length ) + payload_length + 2;
+    assert( compressed_length + block_length < compressed_size );
+    char * d = &compressed_text[compressed_length];
+    d += sprintf( d, "%d:%s,\n", payload_length, payload );
+    assert( d == &compressed_text[compressed_length + block_length] );
+    return compressed_length + block_length;
+}
+
+static int
+get_compressed_block_length( const char * s ){
+    // Later this will be restricted more,
+    // but currently "%i"
+    // supports base-16 if blocks begin with "0x" or "0X",
+    // base-8 if it begins with 0,
+    // and base 10 otherwise.
+    int length = 0;
+    sscanf( s, "%i", &length );
+    assert( length <=  32768 );
+    assert( length <= 0x8000 );
+    assert( 0 <= length );
+    return length;
+}
+
+/*
+Given a block of compressed text
+(starting with a compact representation
+of the canonical list of lengths),
 recover the uncompressed text.
 
 For each block,
@@ -1844,6 +5741,8 @@ the header ends with a newline and the footer begins with a newline)
 * read Huffman table header, and
 decompress the following 8-bit binary Huffman-compressed data
 (which may include NULL bytes)
+* check a "\nC" checksum block against the text decoded so far
+(on a mismatch, decompress() returns -1)
 * A quasi-human-readable representation
 of compressed Huffman:
 (to use as examples in
@@ -1917,7 +5816,17 @@ begins with 2 bytes of type indicator:
 "\n\n": pass-through raw data
 "\n#": metadata string (currently only used for debugging)
 "\nX": Huffman table type 1 (human-readable)
+"\nW": Huffman table type 2 (compact: nybbles, run-length, or Huffman-coded lengths)
+"\nS": reference to a built-in static Huffman table
 "\nZ": Huffman-compressed data type 1 (human-readable)
+"\nY": Huffman-compressed data type 2 (packed digits)
+"\nQ": Huffman-compressed data type 3 (packed digits in interleaved streams)
+"\nA": adaptive Huffman-compressed data (needs no table)
+"\nL": LZ77 tokens (carries its own two tables)
+"\nK": Huffman data with a table per context (carries its own tables)
+"\nT": word tokens (carries its own dictionary and table)
+"\nF": tANS-compressed data (carries its own normalized counts)
+"\nC": CRC32C of the text decoded since the previous "\nC" block
 (Each block of huffman table *should*
 be immediately followed by Huffman-compressed data block.
 ).
@@ -2013,84 +5922,365 @@ Kraft inequality.
 */
 static int
 decompress(
-    const int max_compressed_size,
+    struct block_scratch * scratch,
+    const int compressed_length,
     const char compressed_text[],
     const int max_decompressed_size,
     char decompressed_text[] // output
     ){
 
-    const char * s = &compressed_text[0];
     char * d = &decompressed_text[0];
+    int decompressed_length = 0;
+    // the most-recently-defined Huffman table
+    struct canonical_decoder * decoder = &scratch->decoder;
+    bool have_table = false;
+    // where the text covered by the next "\nC" block starts.
+    int checksum_start = 0;
 
-    // FIXME:
-    // There seems to be a conflict between
-    // (a) we want to use standard C string-handling functions,
-    // the actual compressed data
-    // and the actual decompressed data
-    // *should*
-    // be far less than the buffer size,
-    // so it *should* be OK to slap a "\0"
-    // as the last byte of both
-    // so we can guarantee
-    // standard C string-handling functions
-    // which assume a "\0" byte,
-    // we don't read
-    // past the end of the buffer ...
-    // (b) but we *also* want to handle
-    // compressed text stored in ROM.
-    const int length = get_compressed_block_length( s );
-    // In a netstring, data is the *next* character
-    // after the first ":"
-    const char * colon_pos = strchr( s, ':' );
-    assert(colon_pos); // there *should* be a ":" character.
-    const int end_of_block_index = colon_pos - s + length + 1;
-    assert( end_of_block_index < max_compressed_size );
-    // netstrings *should* end with ',' after end of data.
-    assert( ',' == s[end_of_block_index] );
-    assert( '\n' == s[end_of_block_index + 1] );
-
-    // block type indicator
-    // in the next 2 bytes after the colon:
-    assert( '\n' == colon_pos[1] );
-    char block_type = colon_pos[2];
-    const char * data_start = colon_pos + 3;
-    /*
-"case blocks in switch statements should have curly braces."
---
-https://codingart.readthedocs.io/en/latest/c/Formatting.html
-
-"C Switch-case curly braces after every case"
-https://stackoverflow.com/questions/4241545/c-switch-case-curly-braces-after-every-case
+    int block_start = 0;
+    while( block_start < compressed_length ){
+        const char * s = &compressed_text[block_start];
 
-    */
-    switch( block_type ){
-    default: {
-        // unknown block type
-        assert(0);
-        }; break;
-    case '\n': { // pass-through raw data
-        printf("# raw data:\n");
-        assert( max_decompressed_size > length );
-        memcpy( d, data_start, length );
-        d[length+1] = '\0';
-        }; break;
-    case '#': { // metadata string
-        // perhaps we should just skip?
-        printf("# skipping metadata.\n");
-        }; break;
-    case 'X': { // human-readable Huffman table type 1
         // FIXME:
-        assert(0);
-        }; break;
-    case 'Z': { // human-readable Huffman data type 1
-        assert( max_decompressed_size >= 4000  );
-        // FIXME:
-        assert(0);
-        }; break;
+        // There seems to be a conflict between
+        // (a) we want to use standard C string-handling functions,
+        // the actual compressed data
+        // and the actual decompressed data
+        // *should*
+        // be far less than the buffer size,
+        // so it *should* be OK to slap a "\0"
+        // as the last byte of both
+        // so we can guarantee
+        // standard C string-handling functions
+        // which assume a "\0" byte,
+        // we don't read
+        // past the end of the buffer ...
+        // (b) but we *also* want to handle
+        // compressed text stored in ROM.
+        const int length = get_compressed_block_length( s );
+        // In a netstring, data is the *next* character
+        // after the first ":"
+        const char * colon_pos = memchr( s, ':', compressed_length - block_start );
+        assert(colon_pos); // there *should* be a ":" character.
+        const int end_of_block_index = colon_pos - s + length + 1;
+        assert( block_start + end_of_block_index + 1 < compressed_length );
+        // netstrings *should* end with ',' after end of data.
+        assert( ',' == s[end_of_block_index] );
+        assert( '\n' == s[end_of_block_index + 1] );
+
+        // block type indicator
+        // in the next 2 bytes after the colon:
+        assert( '\n' == colon_pos[1] );
+        char block_type = colon_pos[2];
+        const char * data_start = colon_pos + 3;
+        const int data_length = length - 2;
+        /*
+    "case blocks in switch statements should have curly braces."
+    --
+    https://codingart.readthedocs.io/en/latest/c/Formatting.html
 
-        }; // end switch().
+    "C Switch-case curly braces after every case"
+    https://stackoverflow.com/questions/4241545/c-switch-case-curly-braces-after-every-case
 
-    return length;
+        */
+        switch( block_type ){
+        default: {
+            // unknown block type
+            assert(0);
+            }; break;
+        case '\n': { // pass-through raw data
+            DEBUG_PRINTF("# raw data:\n");
+            assert( max_decompressed_size >= decompressed_length + data_length );
+            memcpy( d, data_start, data_length );
+            d += data_length;
+            decompressed_length += data_length;
+            }; break;
+        case '#': { // metadata string
+            // perhaps we should just skip?
+            printf("# skipping metadata.\n");
+            }; break;
+        case 'C': { // checksum of the text decoded so far
+            char * end = NULL;
+            const int covered_length = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const unsigned long crc = strtoul( end+1, &end, 16 );
+            assert( ',' == *end );
+            const int decoded_length = decompressed_length - checksum_start;
+            if( (covered_length != decoded_length) or
+                (crc != crc32c( decoded_length, &decompressed_text[checksum_start] )) ){
+                printf("Error: block checksum mismatch.\n");
+                return -1;
+            };
+            checksum_start = decompressed_length;
+            }; break;
+        case 'X': { // human-readable Huffman table type 1
+            char * end = NULL;
+            const int compressed_symbols = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const int max_symbol_value = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const char * lengths_start = end + 1;
+            assert( (max_symbol_value + 1) == (data_start + data_length - lengths_start) );
+            assert( max_symbol_value < MAX_DECODE_SYMBOLS );
+            int * canonical_lengths = scratch->decode_lengths;
+            for( int i=0; i<=max_symbol_value; i++ ){
+                const char * hex = strchr( "0123456789abcdef", lengths_start[i] );
+                assert( hex and *hex );
+                canonical_lengths[i] = hex - "0123456789abcdef";
+            };
+            printf("# read %d-ary Huffman table.\n", compressed_symbols);
+            convert_lengths_to_decode_table(
+                max_symbol_value,
+                canonical_lengths,
+                compressed_symbols,
+                decoder
+                );
+            have_table = true;
+            }; break;
+        case 'W': { // compact Huffman table type 2
+            char * end = NULL;
+            const int compressed_symbols = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const int max_symbol_value = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            assert( max_symbol_value < MAX_DECODE_SYMBOLS );
+            const char method = end[1];
+            assert( strchr( LENGTH_TABLE_METHODS, method ) );
+            const char * table = end + 2;
+            int * canonical_lengths = scratch->decode_lengths;
+            decode_length_table( scratch, method,
+                (data_start + data_length) - table, table,
+                max_symbol_value, canonical_lengths );
+            printf("# read compact (%c) %d-ary Huffman table.\n", method, compressed_symbols);
+            convert_lengths_to_decode_table(
+                max_symbol_value,
+                canonical_lengths,
+                compressed_symbols,
+                decoder
+                );
+            have_table = true;
+            }; break;
+        case 'S': { // built-in static Huffman table
+            char * end = NULL;
+            const int static_table = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const int compressed_symbols = strtol( end+1, &end, 10 );
+            assert( (data_start + data_length) == end );
+            assert( 0 <= static_table );
+            assert( static_table < STATIC_TABLE_COUNT );
+            prepare_static_tables( scratch, compressed_symbols );
+            assert( scratch->static_table_usable[static_table] );
+            printf("# using static %d-ary Huffman table %d (%s).\n",
+                compressed_symbols, static_table,
+                static_huffman_tables[static_table].name );
+            convert_lengths_to_decode_table(
+                MAX_LEAF_VALUE,
+                scratch->static_lengths[static_table],
+                compressed_symbols,
+                decoder
+                );
+            have_table = true;
+            }; break;
+        case 'A': { // adaptive Huffman data, with its own fresh tree
+            char * end = NULL;
+            const int compressed_symbols = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const int digit_count = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            struct adaptive_huffman * tree = &scratch->adaptive;
+            start_adaptive_huffman( tree, compressed_symbols );
+            struct digit_reader reader;
+            start_digit_reader( &reader, compressed_symbols, true,
+                digit_count, (const unsigned char *)(end + 1) );
+            while( reader.position < digit_count ){
+                assert( decompressed_length < max_decompressed_size );
+                *d++ = decode_adaptive_symbol( tree, &reader );
+                decompressed_length++;
+            };
+            assert( reader.position == digit_count );
+            }; break;
+        case 'L': { // LZ77 tokens, with their own two tables
+            char * end = NULL;
+            const int compressed_symbols = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const int digit_count = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const int literal_table_length = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const char * literal_table = end + 1;
+            const int distance_table_length =
+                strtol( literal_table + literal_table_length, &end, 10 );
+            assert( ':' == *end );
+            const char * distance_table = end + 1;
+            const char * digits = distance_table + distance_table_length;
+            assert( digits <= data_start + data_length );
+            int * literal_lengths = scratch->decode_lengths;
+            int distance_lengths[LZ_DISTANCE_SYMBOLS];
+            decode_length_table( scratch, literal_table[0],
+                literal_table_length - 1, literal_table + 1,
+                LZ_MAX_SYMBOL_VALUE, literal_lengths );
+            decode_length_table( scratch, distance_table[0],
+                distance_table_length - 1, distance_table + 1,
+                LZ_DISTANCE_SYMBOLS-1, distance_lengths );
+            printf("# read %d-ary LZ77 tables.\n", compressed_symbols);
+            convert_lengths_to_decode_table( LZ_MAX_SYMBOL_VALUE,
+                literal_lengths, compressed_symbols, decoder );
+            convert_lengths_to_decode_table( LZ_DISTANCE_SYMBOLS-1,
+                distance_lengths, compressed_symbols, &scratch->lz_distance_decoder );
+            // that replaced the most-recent byte table.
+            have_table = false;
+            const int n = decode_lz77_digits( scratch, compressed_symbols,
+                digit_count, (const unsigned char *)digits,
+                max_decompressed_size - decompressed_length, d );
+            d += n;
+            decompressed_length += n;
+            }; break;
+        case 'K': { // Huffman data with context-selected tables
+            char * end = NULL;
+            const int contexts = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            assert( 2 <= contexts );
+            assert( contexts <= MAX_CONTEXT_TABLES );
+            const int compressed_symbols = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const int digit_count = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const char * p = end + 1;
+            int * lengths = scratch->decode_lengths;
+            for( int k=0; k<contexts; k++ ){
+                const int table_length = strtol( p, &end, 10 );
+                assert( ':' == *end );
+                const char * table = end + 1;
+                decode_length_table( scratch, table[0],
+                    table_length - 1, table + 1, 255, lengths );
+                convert_lengths_to_decode_table( 255,
+                    lengths, compressed_symbols, &scratch->context_decoders[k] );
+                p = table + table_length;
+            };
+            assert( p <= data_start + data_length );
+            printf("# read %d %d-ary context tables.\n", contexts, compressed_symbols);
+            // that replaced the most-recent byte table.
+            have_table = false;
+            const int n = decode_context_digits( scratch, contexts, compressed_symbols,
+                digit_count, (const unsigned char *)p,
+                max_decompressed_size - decompressed_length, d );
+            d += n;
+            decompressed_length += n;
+            }; break;
+        case 'T': { // word tokens, with their own dictionary and table
+            char * end = NULL;
+            const int compressed_symbols = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const int digit_count = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const int words = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            assert( (0 <= words) and (words <= WORD_DICTIONARY_SIZE) );
+            const int dictionary_length = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const unsigned char * dictionary = (const unsigned char *)(end + 1);
+            const int dictionary_read = decode_word_dictionary( scratch,
+                words, dictionary_length, dictionary );
+            assert( dictionary_length == dictionary_read );
+            const int table_length =
+                strtol( (const char *)dictionary + dictionary_length, &end, 10 );
+            assert( ':' == *end );
+            const char * table = end + 1;
+            const char * digits = table + table_length;
+            assert( digits <= data_start + data_length );
+            const int max_symbol_value = MAX_LEAF_VALUE + words;
+            int * lengths = scratch->decode_lengths;
+            decode_length_table( scratch, table[0],
+                table_length - 1, table + 1, max_symbol_value, lengths );
+            printf("# read %d-ary word table, %d words.\n", compressed_symbols, words);
+            convert_lengths_to_decode_table( max_symbol_value,
+                lengths, compressed_symbols, decoder );
+            // that replaced the most-recent byte table.
+            have_table = false;
+            const int n = decode_word_digits( scratch, words, compressed_symbols,
+                digit_count, (const unsigned char *)digits,
+                max_decompressed_size - decompressed_length, d );
+            d += n;
+            decompressed_length += n;
+            }; break;
+        case 'F': { // tANS data, with its own normalized counts
+            char * end = NULL;
+            const int table_log = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            const int symbol_count = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const int bit_count = strtol( end+1, &end, 10 );
+            assert( ':' == *end );
+            const char * bits = end + 1;
+            assert( (bit_count + 7) / 8 == (data_start + data_length) - bits );
+            printf("# read tANS block, L=%d.\n", 1 << table_log);
+            const int n = decode_tans( scratch, table_log, symbol_count,
+                bit_count, (const unsigned char *)bits,
+                max_decompressed_size - decompressed_length, d );
+            d += n;
+            decompressed_length += n;
+            }; break;
+        case 'Q': { // packed Huffman data in interleaved streams
+            assert( have_table ); // data block without a table?
+            char * end = NULL;
+            const int symbol_count = strtol( data_start, &end, 10 );
+            assert( ':' == *end );
+            int digit_counts[HUFFMAN_STREAMS];
+            for( int k=0; k<HUFFMAN_STREAMS; k++ ){
+                digit_counts[k] = strtol( end+1, &end, 10 );
+                assert( ':' == *end );
+            };
+            // the digit counts give the start of each stream.
+            const int digits_per_byte = digits_per_packed_byte( decoder->compressed_symbols );
+            const unsigned char * streams[HUFFMAN_STREAMS];
+            const unsigned char * p = (const unsigned char *)(end + 1);
+            for( int k=0; k<HUFFMAN_STREAMS; k++ ){
+                streams[k] = p;
+                p += (digit_counts[k] + digits_per_byte - 1) / digits_per_byte;
+            };
+            assert( (const char *)p == data_start + data_length );
+            const int n = decode_interleaved_digits( decoder,
+                HUFFMAN_STREAMS, symbol_count, digit_counts, streams,
+                max_decompressed_size - decompressed_length, d );
+            d += n;
+            decompressed_length += n;
+            }; break;
+        case 'Z': // human-readable Huffman data type 1
+        case 'Y': { // packed Huffman data type 2
+            assert( have_table ); // data block without a table?
+            const bool packed_digits = ('Y' == block_type);
+            const char * digits = data_start;
+            int digit_count = data_length;
+            if( packed_digits ){
+                char * end = NULL;
+                digit_count = strtol( data_start, &end, 10 );
+                assert( ':' == *end );
+                digits = end + 1;
+            };
+            // the table only pays for itself when codes are several digits long;
+            // with 3-digit tables (radix 9 and up) most codes are 1 or 2 digits
+            // and reading them one at a time is as fast
+            // (see benchmark_canonical_decoders()).
+            const bool use_lookup_table = (decoder->lookup_digits > 3);
+            const int n = decode_digits_to_text(
+                decoder,
+                use_lookup_table,
+                packed_digits,
+                digit_count,
+                (const unsigned char *)digits,
+                max_decompressed_size - decompressed_length,
+                d
+                );
+            d += n;
+            decompressed_length += n;
+            }; break;
+
+            }; // end switch().
+
+        block_start += end_of_block_index + 2;
+    }; // end while().
+    assert( decompressed_length <= max_decompressed_size );
+    return decompressed_length;
 }
 
 /*
@@ -2440,19 +6630,6 @@ test_various_table_representations(
     return 0;
 }
 
-/*
-inspired by
-zbyszek
-https://stackoverflow.com/questions/994593/how-to-do-an-integer-log2-in-c/22418446#22418446
-*/
-static inline int
-log2i(int x) {
-    assert(x > 0);
-    // "...clz()" is for "int"
-    // "...clzl()" is for "long int".
-    return sizeof(int) * 8 - __builtin_clz(x) - 1;
-}
-
 /*
 inspired by
 https://stackoverflow.com/questions/3272424/compute-fast-log-base-2-ceiling
@@ -2505,78 +6682,455 @@ find_compressed_data_size(
     return data_size;
 }
 
-void
-next_block(void){
-    printf("# Starting next block...\n");
-    // FIXME: use a larger buffer,
-    // perhaps with calloc() or realloc() or both?
-    const int bufsize = 65000; // FIXME: const size_t bufsize = 65000;
-    char original_text[bufsize+1];
-    size_t used = load_more_text( stdin, bufsize, original_text );
-    // FUTURE: support arbitrary data, including '\0' character.
-    size_t original_length = strlen( original_text );
-    // FIXME: doesn't yet support reading '\0' bytes
-    assert( original_length == used );
+/*
+log2(x) in 1/256ths of a bit,
+good to about 0.01 bits,
+without needing libm.
+*/
+static int
+log2_q8( const unsigned int x ){
+    assert( 0 < x );
+    // round(256*log2(1 + i/16))
+    static const int fraction_q8[17] = {
+        0, 22, 44, 63, 82, 100, 118, 134,
+        150, 165, 179, 193, 207, 220, 232, 244, 256
+    };
+    const int whole = log2i( x );
+    // the 8 bits just below the leading 1
+    const unsigned int mantissa =
+        (whole >= 8) ? (x >> (whole - 8)) & 0xff : (x << (8 - whole)) & 0xff;
+    const int i = mantissa >> 4;
+    const int f = mantissa & 15;
+    return 256*whole +
+        fraction_q8[i] + ((fraction_q8[i+1] - fraction_q8[i]) * f) / 16;
+}
+
+/*
+A static table is used without building a fresh tree at all
+when its cost is within this many percent of
+the best a fresh table could *possibly* do
+(the framing of a fresh "\nW" header plus the entropy of the block;
+the compact length table itself isn't known until the tree is built).
+*/
+#define STATIC_TABLE_THRESHOLD_PERCENT (5)
+
+/*
+Given the histogram already in scratch->symbol_frequencies,
+fill in scratch->canonical_lengths
+and return the static table to use,
+or NO_STATIC_TABLE for a fresh table.
+Costs are in bytes of packed digits, including the table header.
+If allow_fresh is false (say, for tiny blocks
+where a fresh header can never pay for itself),
+only the static tables are considered,
+and canonical_lengths is left all-zero
+if none of them can encode this block.
+*/
+int
+choose_huffman_table(
+    struct block_scratch * scratch,
+    const int compressed_symbols,
+    const bool allow_fresh
+){
+    const int max_symbol_value = MAX_LEAF_VALUE;
+    const int * frequencies = scratch->symbol_frequencies;
+    prepare_static_tables( scratch, compressed_symbols );
+    const int digits_per_byte = digits_per_packed_byte( compressed_symbols );
+
+    int best_static = NO_STATIC_TABLE;
+    long long best_static_cost = LLONG_MAX;
+    for( int k=0; k<STATIC_TABLE_COUNT; k++ ){
+        if( !scratch->static_table_usable[k] ){
+            continue;
+        };
+        const int * lengths = scratch->static_lengths[k];
+        long long digits = 0;
+        bool usable = true;
+        for( int i=0; i<=max_symbol_value; i++ ){
+            if( frequencies[i] ){
+                usable = usable and (0 < lengths[i]);
+                digits += (long long)frequencies[i] * lengths[i];
+            };
+        };
+        const long long cost =
+            10 + (digits + digits_per_byte - 1) / digits_per_byte;
+        if( usable and (cost < best_static_cost) ){
+            best_static = k;
+            best_static_cost = cost;
+        };
+    };
+
+    // the same framing as the static tables, plus the method character
+    // and at least one byte of the compact "\nW" length table.
+    const int fresh_header_bound = 10 + 2;
+    bool build_fresh = allow_fresh;
+    if( build_fresh and (NO_STATIC_TABLE != best_static) ){
+        // entropy, in digits, as a lower bound on any fresh table.
+        int total = 0;
+        for( int i=0; i<=max_symbol_value; i++ ){
+            total += frequencies[i];
+        };
+        long long bits_q8 = 0;
+        for( int i=0; i<=max_symbol_value; i++ ){
+            if( frequencies[i] ){
+                bits_q8 += (long long)frequencies[i] *
+                    (log2_q8( total ) - log2_q8( frequencies[i] ));
+            };
+        };
+        const long long entropy_digits = bits_q8 / log2_q8( compressed_symbols );
+        const long long fresh_bound =
+            fresh_header_bound + entropy_digits / digits_per_byte;
+        if( 100 * best_static_cost <=
+            (100 + STATIC_TABLE_THRESHOLD_PERCENT) * fresh_bound ){
+            printf("# static table %d (%s): %lld bytes, fresh at least %lld; skipping the tree.\n",
+                best_static, static_huffman_tables[best_static].name,
+                best_static_cost, fresh_bound );
+            build_fresh = false;
+        };
+    };
+
+    int * canonical_lengths = scratch->canonical_lengths;
+    if( build_fresh ){
+        huffman(
+            &scratch->tree,
+            max_symbol_value, frequencies,
+            compressed_symbols,
+            canonical_lengths
+        );
+        long long digits = 0;
+        for( int i=0; i<=max_symbol_value; i++ ){
+            digits += (long long)frequencies[i] * canonical_lengths[i];
+        };
+        // the real compact header compress() will write,
+        // as in choose_entropy_coder().
+        char table[WORD_MAX_SYMBOL_VALUE+16];
+        const int fresh_header_cost = 10 + encode_smallest_length_table( scratch,
+            max_symbol_value, canonical_lengths, sizeof( table ), table );
+        const long long fresh_cost =
+            fresh_header_cost + (digits + digits_per_byte - 1) / digits_per_byte;
+        if( fresh_cost <= best_static_cost ){
+            return NO_STATIC_TABLE;
+        };
+    };
+    if( NO_STATIC_TABLE != best_static ){
+        memcpy( canonical_lengths, scratch->static_lengths[best_static],
+            sizeof( scratch->static_lengths[best_static] ) );
+    };
+    return best_static;
+}
+
+/*
+Per-block choice between Huffman and tANS (see compress_tans()):
+estimate both sizes, in bytes, headers included,
+from the histogram already in scratch->symbol_frequencies
+and the Huffman table choose_huffman_table() already picked.
+The tANS table is no bigger than the block needs
+(but big enough for every byte it uses).
+Returns the tANS table_log to use,
+or 0 to stay with Huffman.
+*/
+int
+choose_entropy_coder(
+    struct block_scratch * scratch,
+    const int compressed_symbols,
+    const int static_table,
+    const int original_length
+){
+    const int * frequencies = scratch->symbol_frequencies;
+    const int * lengths = scratch->canonical_lengths;
+    if( 0 == original_length ){
+        return 0;
+    };
+    const int digits_per_byte = digits_per_packed_byte( compressed_symbols );
+    long long digits = 0;
+    int used = 0;
+    for( int s=0; s<256; s++ ){
+        digits += (long long)frequencies[s] * lengths[s];
+        used += (0 < frequencies[s]);
+    };
+    int huffman_header = 10;
+    if( NO_STATIC_TABLE == static_table ){
+        char table[WORD_MAX_SYMBOL_VALUE+16];
+        huffman_header += encode_smallest_length_table( scratch,
+            MAX_LEAF_VALUE, lengths, sizeof( table ), table );
+    };
+    const long long huffman_cost =
+        huffman_header + (digits + digits_per_byte - 1) / digits_per_byte;
 
+    int table_log = imin( TANS_DEFAULT_TABLE_LOG,
+        imax( TANS_MIN_TABLE_LOG, log2i( original_length ) ) );
+    while( (1 << table_log) < used ){
+        table_log++;
+    };
+    normalize_tans_counts( scratch, table_log );
+    long long bits_q8 = 256LL * (write_tans_counts( scratch, NULL ) + table_log);
+    for( int s=0; s<256; s++ ){
+        if( frequencies[s] ){
+            bits_q8 += (long long)frequencies[s] *
+                (256*table_log - log2_q8( scratch->tans_counts[s] ));
+        };
+    };
+    const long long tans_cost = 16 + (bits_q8 / 256 + 7) / 8;
+    printf("# estimated %d-ary Huffman: %lld bytes; tANS, L=%d: %lld bytes.\n",
+        compressed_symbols, huffman_cost, 1 << table_log, tans_cost );
+    return (tans_cost < huffman_cost) ? table_log : 0;
+}
 
+/*
+Compress and decompress the next block of stdin,
+using (and re-using) the given scratch arena.
+Returns the number of bytes read,
+0 at the end of the input.
+*/
+int
+next_block( struct block_scratch * scratch ){
+    printf("# Starting next block...\n");
+    reset_block_scratch( scratch );
+    const int bufsize = BLOCK_SIZE; // FIXME: const size_t bufsize = BLOCK_SIZE;
+    char * original_text = scratch->original_text;
+    size_t used = load_more_text( stdin, bufsize, original_text );
+    if( (0 == used) or ((size_t)-1 == used) ){
+        return 0;
+    };
+    // binary-safe: '\0' is just another byte,
+    // so the block is exactly the bytes fread() returned.
+    const int original_length = used;
 
     // FIXME: support arbitrary number of symbols.
-    const int max_symbol_value = 258;
-    int symbol_frequencies[max_symbol_value+1];
+    const int max_symbol_value = MAX_LEAF_VALUE;
+    int * symbol_frequencies = scratch->symbol_frequencies;
     printf("# finding histogram.\n");
-    histogram( original_text, max_symbol_value, symbol_frequencies );
+    histogram( original_length, original_text, max_symbol_value, symbol_frequencies );
     assert( 0 == symbol_frequencies[258] );
     int compressed_symbols = 3; // 2 for binary, 3 for trinary, etc.
     // FUTURE: length-limited Huffman?
 
-    /*
-    int canonical_lengths[text_symbols];
-    */
     printf("# finding canonical lengths.\n");
-    int canonical_lengths[max_symbol_value+1];
-    for( int i=0; i<(max_symbol_value+1); i++){
-        canonical_lengths[i] = 0;
-    };
-    // int canonical_lengths[nonzero_text_symbols] = {};
-    huffman(
-        max_symbol_value, symbol_frequencies,
-        compressed_symbols,
-        canonical_lengths
-    );
+    // already zeroed by reset_block_scratch().
+    int * canonical_lengths = scratch->canonical_lengths;
+    const int static_table =
+        choose_huffman_table( scratch, compressed_symbols, true );
     printf("# now we have the canonical lengths ...\n");
     debug_print_table( max_symbol_value, canonical_lengths, compressed_symbols );
-    test_various_table_representations(
-        max_symbol_value,
-        symbol_frequencies,
-        canonical_lengths
-    );
+    if( NO_STATIC_TABLE == static_table ){
+        test_various_table_representations(
+            max_symbol_value,
+            symbol_frequencies,
+            canonical_lengths
+        );
+    };
+    const int tans_table_log = choose_entropy_coder(
+        scratch, compressed_symbols, static_table, original_length );
     printf("# compressing text.");
-    char compressed_text[bufsize+1];
-    compress(
+    // room for the netstring headers when falling back to raw data.
+    const int compressed_size = COMPRESSED_BLOCK_SIZE;
+    char * compressed_text = scratch->compressed_text;
+    const int block_length = tans_table_log ?
+    compress_tans(
+        scratch,
+        tans_table_log,
+        original_length,
+        original_text,
+        compressed_size,
+        compressed_text
+        ) :
+    compress_with_streams(
+        scratch,
+        static_table,
         max_symbol_value,
         canonical_lengths,
         compressed_symbols,
-        bufsize,
+        true, // packed digits
+        HUFFMAN_STREAMS,
         original_length,
         original_text,
+        compressed_size,
         compressed_text
         );
+    // so the decoder can check its own output.
+    const int compressed_length = append_checksum_block(
+        original_length, original_text,
+        block_length, compressed_size, compressed_text );
+    printf("# %d bytes compressed to %d bytes (%d bytes before the checksum block).\n",
+        original_length, compressed_length, block_length );
     printf("# decompressing text.");
-    char decompressed_text[bufsize+1];
-    size_t decompressed_length =
-    decompress( bufsize+1, compressed_text, bufsize+1, decompressed_text );
-    // FUTURE: fix so it correctly handles text with '\0' bytes.
-    size_t text_length = strlen( decompressed_text );
-    assert( text_length <= 0x8000 );
+    char * decompressed_text = scratch->decompressed_text;
+    const int decompressed_length =
+    decompress( scratch, compressed_length, compressed_text, bufsize, decompressed_text );
+    assert( decompressed_length <= 0x8000 );
     assert( original_length == decompressed_length );
-    assert( original_length == text_length );
     if( memcmp( original_text, decompressed_text, original_length ) ){
         printf("Error: decompressed text doesn't match original text.\n");
-        printf("[%s] original\n", original_text);
-        printf("[%s] decompressed\n", decompressed_text);
+        printf("[%.*s] original\n", original_length, original_text);
+        printf("[%.*s] decompressed\n", decompressed_length, decompressed_text);
     }else{
         printf("Successful test.\n");
     };
+    return used;
+}
+
+/*
+Bounded-latency mode,
+for log shippers, RPC streams, and other interactive streams
+where each message needs to be decodable
+soon after it is written.
+next_block() waits for a full BLOCK_SIZE buffer (or end-of-file);
+a latency_stream instead emits a complete block
+as soon as either deadline is reached:
+    flush_bytes: this many bytes are waiting, or
+    flush_seconds: the oldest waiting byte has waited this long,
+or whenever the caller calls flush_latency_stream().
+(A deadline <= 0 is never reached.)
+There's no background thread:
+the time deadline is only checked when the caller
+writes or calls poll_latency_stream(),
+typically once per trip around its event loop.
+Times are passed in by the caller (usually seconds_now()),
+which also lets tests run on a simulated clock.
+
+Every flushed block is complete by itself
+(its own Huffman table, or pass-through raw data),
+so the receiver can decode it immediately.
+Tiny blocks skip building a Huffman tree entirely
+and use a built-in static table (or pass-through raw data),
+since the "\nX" table alone is larger than a short message;
+compress() also falls back to raw data
+whenever the table plus data doesn't save any space.
+*/
+#define TINY_BLOCK_SIZE (128)
+
+struct latency_stream{
+    struct block_scratch * scratch; // pending text lives in scratch->original_text
+    int compressed_symbols; // 2 for binary, 3 for trinary, etc.
+    int flush_bytes;
+    double flush_seconds;
+    int pending_length;
+    double oldest_pending_time;
+    int blocks; // number of blocks emitted so far
+    // compressed blocks are appended here.
+    int out_size;
+    int out_length;
+    char * out;
+};
+
+double
+seconds_now(void){
+    struct timespec ts;
+    timespec_get( &ts, TIME_UTC );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void
+start_latency_stream(
+    struct latency_stream * stream,
+    struct block_scratch * scratch,
+    const int compressed_symbols,
+    const int flush_bytes,
+    const double flush_seconds,
+    const int out_size,
+    char out[out_size]
+){
+    assert( 2 <= compressed_symbols );
+    stream->scratch = scratch;
+    stream->compressed_symbols = compressed_symbols;
+    stream->flush_bytes = flush_bytes;
+    stream->flush_seconds = flush_seconds;
+    stream->pending_length = 0;
+    stream->oldest_pending_time = 0;
+    stream->blocks = 0;
+    stream->out_size = out_size;
+    stream->out_length = 0;
+    stream->out = out;
+}
+
+/*
+Emit everything written so far as one complete block.
+Returns the number of compressed bytes appended to stream->out
+(0 if nothing was waiting).
+*/
+int
+flush_latency_stream( struct latency_stream * stream ){
+    if( 0 == stream->pending_length ){
+        return 0;
+    };
+    struct block_scratch * scratch = stream->scratch;
+    const int max_symbol_value = MAX_LEAF_VALUE;
+    char * original_text = scratch->original_text;
+    const int original_length = stream->pending_length;
+    reset_block_scratch( scratch );
+    histogram( original_length, original_text, max_symbol_value, scratch->symbol_frequencies );
+    // Tiny blocks never build a fresh tree;
+    // if no static table fits either, all lengths stay 0,
+    // so compress() emits pass-through raw data.
+    const int static_table = choose_huffman_table( scratch,
+        stream->compressed_symbols, (TINY_BLOCK_SIZE <= original_length) );
+    const int compressed_length =
+    compress(
+        scratch,
+        static_table,
+        max_symbol_value,
+        scratch->canonical_lengths,
+        stream->compressed_symbols,
+        true, // packed digits
+        original_length,
+        original_text,
+        COMPRESSED_BLOCK_SIZE,
+        scratch->compressed_text
+        );
+    assert( stream->out_length + compressed_length <= stream->out_size );
+    memcpy( &stream->out[stream->out_length], scratch->compressed_text, compressed_length );
+    stream->out_length += compressed_length;
+    stream->pending_length = 0;
+    stream->blocks++;
+    return compressed_length;
+}
+
+/*
+Flush if the oldest waiting byte has reached the time deadline.
+Returns the number of compressed bytes appended.
+*/
+int
+poll_latency_stream( struct latency_stream * stream, const double now ){
+    if( (0 < stream->pending_length) and (0 < stream->flush_seconds) and
+        (stream->flush_seconds <= (now - stream->oldest_pending_time))
+    ){
+        return flush_latency_stream( stream );
+    };
+    return 0;
+}
+
+/*
+Append one message (any bytes, including '\0'),
+then flush if either deadline has been reached.
+Returns the number of compressed bytes appended.
+*/
+int
+write_latency_stream(
+    struct latency_stream * stream,
+    const int length,
+    const char text[length],
+    const double now
+){
+    int appended = 0;
+    int done = 0;
+    while( done < length ){
+        if( BLOCK_SIZE == stream->pending_length ){
+            appended += flush_latency_stream( stream );
+        };
+        if( 0 == stream->pending_length ){
+            stream->oldest_pending_time = now;
+        };
+        const int room = BLOCK_SIZE - stream->pending_length;
+        const int n = imin( room, length - done );
+        memcpy( &stream->scratch->original_text[stream->pending_length], &text[done], n );
+        stream->pending_length += n;
+        done += n;
+    };
+    if( (0 < stream->flush_bytes) and (stream->flush_bytes <= stream->pending_length) ){
+        appended += flush_latency_stream( stream );
+    };
+    appended += poll_latency_stream( stream, now );
+    return appended;
 }
 
 void test_setup_nodes(){
@@ -2603,7 +7157,7 @@ void test_setup_nodes(){
 }
 
 void
-test_next_block(void){
+test_next_block( struct block_scratch * scratch ){
     printf("# Starting next block...\n");
     // FIXME: use a larger buffer,
     // perhaps with calloc() or realloc() or both?
@@ -2646,23 +7200,105 @@ length 3:  G I L M N O R T W Z
 length 3:  _ k w x
 
 
-           0 1 2 3 4 5 6 7 8
-length 1:  e   a n s       space
-length 2:  - . 0 1 2 5 6 7 8
-length 2:  : A D E H _ b c d
-length 2:  f g h i l m o p r
-length 2:  t u v w x y
-length 3:  ' ( ) * , / 3 C F
-length 3:  G I L M N O R T W
-length 3:  Z k
-*/
+           0 1 2 3 4 5 6 7 8
+length 1:  e   a n s       space
+length 2:  - . 0 1 2 5 6 7 8
+length 2:  : A D E H _ b c d
+length 2:  f g h i l m o p r
+length 2:  t u v w x y
+length 3:  ' ( ) * , / 3 C F
+length 3:  G I L M N O R T W
+length 3:  Z k
+*/
+
+    // FIXME: support arbitrary number of symbols.
+    const int max_symbol_value = 258;
+    int symbol_frequencies[max_symbol_value+1];
+    symbol_frequencies[258] = 0xBEEF; // for debugging: canary sentinel to test zeroing.
+    printf("# finding histogram.\n");
+    histogram( original_length, original_text, max_symbol_value, symbol_frequencies );
+    assert( 0 == symbol_frequencies[258] );
+    int compressed_symbols = 3; // 2 for binary, 3 for trinary, etc.
+    assert(compressed_symbols);
+    // FUTURE: length-limited Huffman?
+
+    printf("# finding canonical lengths.\n");
+    int canonical_lengths[max_symbol_value+1];
+    for( int i=0; i<(max_symbol_value+1); i++){
+        canonical_lengths[i] = 0;
+    };
+    assert(0 == canonical_lengths[0]);
+    // int canonical_lengths[nonzero_text_symbols] = {};
+    huffman(
+        &scratch->tree,
+        max_symbol_value, symbol_frequencies,
+        compressed_symbols,
+        canonical_lengths
+    );
+    printf("# now we have the canonical lengths ...\n");
+    debug_print_table( max_symbol_value, canonical_lengths, compressed_symbols );
+    int compressed_data_size = 
+    find_compressed_data_size(
+        max_symbol_value,
+        symbol_frequencies,
+        canonical_lengths,
+        compressed_symbols
+        );
+    printf("# compressed_data_size, not including header: %i symbols\n",
+        compressed_data_size
+        );
+    test_various_table_representations(
+        max_symbol_value,
+        symbol_frequencies,
+        canonical_lengths
+    );
+    printf("# compressing text...\n");
+    char compressed_text[bufsize+1];
+    int compressed_length =
+    compress(
+        scratch,
+        NO_STATIC_TABLE,
+        max_symbol_value, canonical_lengths, compressed_symbols,
+        false, // printable digits
+        original_length,
+        original_text,
+        bufsize,
+        compressed_text
+    );
+    printf("# decompressing text.\n");
+    char decompressed_text[bufsize+1];
+    const size_t decompressed_length =
+        decompress( scratch, compressed_length, compressed_text, bufsize, decompressed_text );
+    assert( original_length == decompressed_length );
+    if( memcmp( original_text, decompressed_text, original_length ) ){
+        printf("Error: decompressed text doesn't match original text.\n");
+        printf("[%s] original\n", original_text);
+        printf("[%.*s] decompressed\n", (int)decompressed_length, decompressed_text);
+    }else{
+        printf("Successful test.\n");
+    }
+}
+
+
+void
+short_test_next_block( struct block_scratch * scratch ){
+    printf("# short_test_next_block ...\n");
+    // FIXME: use a larger buffer,
+    // perhaps with calloc() or realloc() or both?
+    const size_t bufsize = 65000;
+    char original_text[65000+1] =
+        ""
+"/* n_ary_huffman.c"
+"2021-10-25: started by David Cary"
+        "";
+    size_t original_length = strlen( original_text );
 
     // FIXME: support arbitrary number of symbols.
     const int max_symbol_value = 258;
     int symbol_frequencies[max_symbol_value+1];
     symbol_frequencies[258] = 0xBEEF; // for debugging: canary sentinel to test zeroing.
     printf("# finding histogram.\n");
-    histogram( original_text, max_symbol_value, symbol_frequencies );
+    histogram( original_length, original_text, max_symbol_value, symbol_frequencies );
     assert( 0 == symbol_frequencies[258] );
     int compressed_symbols = 3; // 2 for binary, 3 for trinary, etc.
     assert(compressed_symbols);
@@ -2676,6 +7312,7 @@ length 3:  Z k
     assert(0 == canonical_lengths[0]);
     // int canonical_lengths[nonzero_text_symbols] = {};
     huffman(
+        &scratch->tree,
         max_symbol_value, symbol_frequencies,
         compressed_symbols,
         canonical_lengths
@@ -2699,204 +7336,1626 @@ length 3:  Z k
     );
     printf("# compressing text...\n");
     char compressed_text[bufsize+1];
+    int compressed_length =
     compress(
+        scratch,
+        NO_STATIC_TABLE,
         max_symbol_value, canonical_lengths, compressed_symbols,
-        bufsize,
+        false, // printable digits
         original_length,
         original_text,
+        bufsize,
         compressed_text
     );
     printf("# decompressing text.\n");
     char decompressed_text[bufsize+1];
-    decompress( bufsize, compressed_text, bufsize, decompressed_text );
-    size_t decompressed_length = strlen( decompressed_text );
+    const size_t decompressed_length =
+        decompress( scratch, compressed_length, compressed_text, bufsize, decompressed_text );
     assert( original_length == decompressed_length );
     if( memcmp( original_text, decompressed_text, original_length ) ){
         printf("Error: decompressed text doesn't match original text.\n");
         printf("[%s] original\n", original_text);
-        printf("[%s] decompressed\n", decompressed_text);
+        printf("[%.*s] decompressed\n", (int)decompressed_length, decompressed_text);
     }else{
         printf("Successful test.\n");
     }
 }
 
+// return 1 (True) if the arrays are equal.
+bool
+arrays_equal(
+    int array_length,
+    int a[array_length],
+    int b[array_length]
+){
+    for(int i=0; i<array_length; i++){
+        bool same = (a[i] == b[i]);
+        if(!same){
+            printf(
+                "First difference: a[%i]=%i ; b[%i]=%i.\n", 
+                i, a[i], i, b[i]
+                );
+            return false;
+        };
+    };
+    return true;
+}
+
+void
+test_convert_lengths_to_encode_table(void){
+    int max_symbol_value = 20;
+    int encode_length_table[80] = {0};
+    unsigned int encode_value_table[80] = {0};
+    if(1){
+        /*
+        int length_table_length = NUM_ELEM( length_table );
+        */
+        int length_table[80] = {0, 0, 1, 1, 1};
+        convert_lengths_to_encode_table(
+            max_symbol_value,
+            length_table,
+            3, // trinary output
+            encode_length_table,
+            encode_value_table
+            );
+        assert( arrays_equal( (max_symbol_value+1), length_table, encode_length_table ) );
+        int expected_length_table[80] = {0, 0, 1, 1, 1};
+        int expected_value_table[80] = {0, 0, 0, 1, 2}; // trinary
+        assert( arrays_equal( 80, expected_value_table, (int *)encode_value_table ) );
+        assert( arrays_equal( 80, expected_length_table, encode_length_table ) );
+    };
+    if(1){
+        // test with 8 equal-frequency items,
+        // which (in trinary) should lead to all items of length 2
+        // (and 1 unused "dummy" codeword).
+        int length_table[80] = {0,0,
+            2, 2, 2, 2,
+            2, 2, 2, 2,
+        };
+        convert_lengths_to_encode_table(
+            max_symbol_value,
+            length_table,
+            3, // trinary output
+            encode_length_table,
+            encode_value_table
+            );
+        assert( arrays_equal( (max_symbol_value+1), length_table, encode_length_table ) );
+        unsigned int expected_value_table[80] = {0,0,
+            0, 1, 2, 3,
+            4, 5, 6, 7,
+        };
+        assert( arrays_equal( 80, (int *)expected_value_table, (int *)encode_value_table ) );
+    };
+    if(1){
+        // test with 9 equal-frequency items,
+        // which (in trinary) should lead to all items of length 2
+        // (and zero unused "dummy" codewords).
+        int length_table[80] = {0,0,
+            2, 2, 2, 2,
+            2, 2, 2, 2,
+            2,
+        };
+        convert_lengths_to_encode_table(
+            max_symbol_value,
+            length_table,
+            3, // trinary output
+            encode_length_table,
+            encode_value_table
+            );
+        assert( arrays_equal( (max_symbol_value+1), length_table, encode_length_table ) );
+        unsigned int expected_value_table[80] = {0,0,
+            0, 1, 2, 3,
+            4, 5, 6, 7,
+            8
+        };
+        assert( arrays_equal( 80, (int *)expected_value_table, (int *)encode_value_table ) );
+    };
+
+}
+
+/*
+Encode sample_text with the canonical code for each radix,
+then check that the table-driven decoder and
+the digit-at-a-time decoder both give back the original text,
+for both packed and printable digits.
+*/
+static const char decoder_sample_text[] =
+"Many Huffman data compression algorithms use "
+"2 output symbols (binary) and around 257 input symbols. "
+"DEFLATE has 288 symbols in its main Huffman tree: "
+"0..255: all possible literal bytes 0-255, "
+"256: end-of-block symbol, 257-285: match lengths. "
+"Z!? qxj ~{}|\t\n";
+
+/*
+The inputs the round-trip tests run through, numbered from -1:
+decoder_sample_text (input -1),
+the sample of each static table,
+some binary-looking data,
+a long run of one byte,
+and the empty block (input TEST_INPUTS-1).
+Writes input k into text[] and returns its length.
+*/
+#define TEST_INPUTS (STATIC_TABLE_COUNT + 3)
+static int
+make_test_input( const int k, const int size, char text[size] ){
+    int length = 0;
+    if( k < 0 ){
+        length = strlen( decoder_sample_text );
+        assert( length <= size );
+        memcpy( text, decoder_sample_text, length );
+    }else if( k < STATIC_TABLE_COUNT ){
+        length = strlen( static_huffman_tables[k].sample_text );
+        assert( length <= size );
+        memcpy( text, static_huffman_tables[k].sample_text, length );
+    }else if( STATIC_TABLE_COUNT == k ){
+        length = imin( 4096, size );
+        for( int i=0; i<length; i++ ){
+            text[i] = (i & 1) ? (char)(i * 37 / 2) : '\0';
+        };
+    }else if( STATIC_TABLE_COUNT + 1 == k ){
+        length = imin( 5000, size );
+        memset( text, 'a', length );
+    }else{
+        assert( TEST_INPUTS - 1 == k );
+    };
+    return length;
+}
+
+/*
+decoder_sample_text, repeated to fill length bytes,
+for the decoder benchmarks.
+*/
+static void
+make_repeated_sample( const int length, char text[length] ){
+    const int sample_length = strlen( decoder_sample_text );
+    for( int i=0; i<length; i++){
+        text[i] = decoder_sample_text[ i % sample_length ];
+    };
+}
+
+/*
+All the sample texts
+(decoder_sample_text and the sample of each static table)
+run together, as one corpus for the benchmarks.
+Returns its length.
+*/
+static int
+make_sample_corpus( const int size, char text[size] ){
+    int length = 0;
+    for( int k=-1; k<STATIC_TABLE_COUNT; k++ ){
+        const char * sample = (k < 0) ?
+            decoder_sample_text : static_huffman_tables[k].sample_text;
+        const int sample_length = strlen( sample );
+        assert( length + sample_length <= size );
+        memcpy( &text[length], sample, sample_length );
+        length += sample_length;
+    };
+    return length;
+}
+
+/*
+Leaves the matching decoder in scratch->decoder.
+*/
+static int
+encode_sample_for_decoder(
+    struct block_scratch * scratch,
+    const int compressed_symbols,
+    const bool packed_digits,
+    const int original_length,
+    const char original_text[original_length],
+    const int digits_size,
+    unsigned char digits[digits_size] // output
+){
+    const int max_symbol_value = MAX_LEAF_VALUE;
+    reset_block_scratch( scratch );
+    int * symbol_frequencies = scratch->symbol_frequencies;
+    histogram( original_length, original_text, max_symbol_value, symbol_frequencies );
+    int * canonical_lengths = scratch->canonical_lengths;
+    huffman( &scratch->tree, max_symbol_value, symbol_frequencies,
+        compressed_symbols, canonical_lengths );
+    int * encode_length_table = scratch->encode_length_table;
+    unsigned int * encode_value_table = scratch->encode_value_table;
+    convert_lengths_to_encode_table( max_symbol_value, canonical_lengths,
+        compressed_symbols, encode_length_table, encode_value_table );
+    convert_lengths_to_decode_table( max_symbol_value, canonical_lengths,
+        compressed_symbols, &scratch->decoder );
+    const int digit_count = count_code_digits( max_symbol_value,
+        encode_length_table, original_length, original_text );
+    represent_items_with_codes( max_symbol_value,
+        encode_length_table, encode_value_table,
+        compressed_symbols, packed_digits,
+        original_length, original_text,
+        0, digits_size, (char *)digits );
+    return digit_count;
+}
+
+void
+test_canonical_decoder( struct block_scratch * scratch ){
+    printf("# test_canonical_decoder ...\n");
+    const int original_length = strlen( decoder_sample_text );
+    const int radixes[] = {2, 3, 9, 10};
+    for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+        for( int packed=0; packed<2; packed++){
+            const int n = radixes[r];
+            const int digits_size = original_length * MAX_CODE_LENGTH;
+            unsigned char digits[digits_size];
+            const int digit_count = encode_sample_for_decoder(
+                scratch, n, packed, original_length, decoder_sample_text,
+                digits_size, digits );
+            const struct canonical_decoder * decoder = &scratch->decoder;
+            for( int use_table=0; use_table<2; use_table++){
+                char decompressed_text[original_length+1];
+                const int decompressed_length = decode_digits_to_text(
+                    decoder, use_table, packed, digit_count, digits,
+                    original_length, decompressed_text );
+                assert( original_length == decompressed_length );
+                assert( 0 == memcmp( decoder_sample_text,
+                    decompressed_text, original_length ) );
+            };
+            printf("# n=%d %s: %d digits, %d-digit lookup table ok.\n",
+                n, packed ? "packed" : "printable",
+                digit_count, decoder->lookup_digits );
+        };
+    };
+}
+
+/*
+Rough throughput of the two decoders,
+so we can see how much the multi-digit lookup table helps
+for each radix.
+*/
+void
+benchmark_canonical_decoders( struct block_scratch * scratch ){
+    printf("# benchmark_canonical_decoders ...\n");
+    const int original_length = 16000;
+    char original_text[original_length+1];
+    make_repeated_sample( original_length, original_text );
+    original_text[original_length] = '\0';
+    const int repeats = 20;
+    const int radixes[] = {2, 3, 9, 10};
+    for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+        for( int packed=0; packed<2; packed++){
+            const int n = radixes[r];
+            const int digits_size = original_length * MAX_CODE_LENGTH;
+            unsigned char digits[digits_size];
+            const int digit_count = encode_sample_for_decoder(
+                scratch, n, packed, original_length, original_text,
+                digits_size, digits );
+            const struct canonical_decoder * decoder = &scratch->decoder;
+            double mb_per_s[2] = {0};
+            for( int use_table=0; use_table<2; use_table++){
+                char decompressed_text[original_length+1];
+                const clock_t start = clock();
+                for( int i=0; i<repeats; i++){
+                    const int decompressed_length = decode_digits_to_text(
+                        decoder, use_table, packed, digit_count, digits,
+                        original_length, decompressed_text );
+                    assert( original_length == decompressed_length );
+                };
+                const double seconds =
+                    (double)(clock() - start) / CLOCKS_PER_SEC;
+                mb_per_s[use_table] = (seconds > 0) ?
+                    (double)original_length * repeats / seconds / 1e6 : 0;
+                assert( 0 == memcmp( original_text,
+                    decompressed_text, original_length ) );
+            };
+            printf("# n=%d %-9s one digit at a time: %7.1f MB/s;"
+                " %d-digit lookup table: %7.1f MB/s\n",
+                n, packed ? "packed" : "printable",
+                mb_per_s[0], decoder->lookup_digits, mb_per_s[1] );
+        };
+    };
+}
+
+static int
+compare_doubles( const void * a, const void * b ){
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+Simulate a log shipper writing one short message every millisecond
+(on a simulated clock, so the results don't depend on machine load),
+with various flush deadlines.
+The latency of each message is the simulated time it waited
+plus the real time spent compressing the block that carried it.
+Reports the compression ratio and the 99th-percentile latency,
+and checks the concatenated blocks decompress to the original messages.
+*/
+void
+benchmark_flush_intervals( struct block_scratch * scratch ){
+    printf("# benchmark_flush_intervals ...\n");
+    const int messages = 400;
+    const double interval = 0.001; // seconds between messages
+    const int sample_length = strlen( decoder_sample_text );
+    const struct { int bytes; double seconds; } deadlines[] = {
+        {1, 0}, // every message is its own block
+        {256, 0}, {1024, 0}, {4096, 0}, {16384, 0},
+        {0, 0.005}, {0, 0.050},
+    };
+    for( int c=0; c<(int)NUM_ELEM(deadlines); c++){
+        const int text_size = messages * 100;
+        char text[text_size+1];
+        int text_length = 0;
+        const int out_size = 2 * text_size;
+        char out[out_size];
+        struct latency_stream stream;
+        start_latency_stream( &stream, scratch, 3,
+            deadlines[c].bytes, deadlines[c].seconds, out_size, out );
+        double latency[messages];
+        int first_unflushed = 0;
+        for( int i=0; i<=messages; i++){
+            const double now = i * interval;
+            const int blocks_before = stream.blocks;
+            const double start = seconds_now();
+            if( i < messages ){
+                char message[100];
+                const int offset = (i * 37) % sample_length;
+                const int length = snprintf( message, sizeof( message ),
+                    "%d %.*s\n", i, 20 + (i * 13) % 60, &decoder_sample_text[offset] );
+                assert( length < (int)sizeof( message ) );
+                memcpy( &text[text_length], message, length );
+                text_length += length;
+                poll_latency_stream( &stream, now );
+                if( stream.blocks != blocks_before ){
+                    // flushed everything before this message.
+                    const double finished = now + (seconds_now() - start);
+                    for( ; first_unflushed < i; first_unflushed++){
+                        latency[first_unflushed] = finished - first_unflushed * interval;
+                    };
+                };
+                write_latency_stream( &stream, length, message, now );
+            }else{
+                // end of the stream: explicit flush.
+                flush_latency_stream( &stream );
+            };
+            if( stream.blocks != blocks_before ){
+                const double finished = now + (seconds_now() - start);
+                const int last = imin( i, messages - 1 );
+                for( ; first_unflushed <= last; first_unflushed++){
+                    latency[first_unflushed] = finished - first_unflushed * interval;
+                };
+            };
+        };
+        assert( messages == first_unflushed );
+        char decompressed_text[text_size+1];
+        const int decompressed_length =
+            decompress( scratch, stream.out_length, out, text_size+1, decompressed_text );
+        assert( text_length == decompressed_length );
+        assert( 0 == memcmp( text, decompressed_text, text_length ) );
+        qsort( latency, messages, sizeof( latency[0] ), compare_doubles );
+        printf("# flush at %5d bytes / %5.3f s: %3d blocks, ratio %5.3f, p99 latency %8.3f ms\n",
+            deadlines[c].bytes, deadlines[c].seconds, stream.blocks,
+            (double)stream.out_length / text_length,
+            1000 * latency[ (99 * (messages - 1)) / 100 ] );
+    };
+}
+
+/*
+Among the static tables, each built-in table should be chosen
+for (a copy of) its own sample,
+and the "\nS" block should round-trip.
+A fresh table should win whenever it is smaller, header included.
+*/
+void
+test_static_tables( struct block_scratch * scratch ){
+    printf("# test_static_tables ...\n");
+    // the length tables are part of the "\nS" format:
+    // any change to them breaks old compressed files.
+    assert( 0xfd537a68 == crc32c(
+        sizeof( static_code_lengths ), (const char *)static_code_lengths ) );
+    for( int r=0; r<STATIC_TABLE_RADIXES; r++){
+        const int n = static_table_radixes[r];
+        prepare_static_tables( scratch, n );
+        for( int k=0; k<STATIC_TABLE_COUNT; k++ ){
+            // Kraft: a complete prefix code, with a code for every byte.
+            const int * lengths = scratch->static_lengths[k];
+            const int max_length = array_max( 256, lengths );
+            long long kraft = 0;
+            long long full = 1;
+            for( int j=0; j<max_length; j++ ){
+                full *= n;
+            };
+            for( int i=0; i<256; i++ ){
+                assert( 0 < lengths[i] );
+                long long weight = 1;
+                for( int j=lengths[i]; j<max_length; j++ ){
+                    weight *= n;
+                };
+                kraft += weight;
+            };
+            assert( kraft <= full );
+        };
+    };
+    // no length tables for this radix: never use a static table.
+    prepare_static_tables( scratch, 5 );
+    for( int k=0; k<STATIC_TABLE_COUNT; k++ ){
+        assert( !scratch->static_table_usable[k] );
+    };
+    const int radixes[] = {2, 3, 9, 10};
+    for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+        const int n = radixes[r];
+        for( int k=0; k<STATIC_TABLE_COUNT; k++ ){
+            const char * original_text = static_huffman_tables[k].sample_text;
+            const int original_length = strlen( original_text );
+            reset_block_scratch( scratch );
+            histogram( original_length, original_text, MAX_LEAF_VALUE, scratch->symbol_frequencies );
+            // (a fresh table, with its compact header, can beat even that,
+            // since the static tables spend code space on every byte.)
+            const int static_table = choose_huffman_table( scratch, n, false );
+            assert( k == static_table );
+            const int compressed_size = 2 * original_length + 100;
+            char compressed_text[compressed_size];
+            const int compressed_length = compress(
+                scratch, static_table,
+                MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+                true, // packed digits
+                original_length, original_text,
+                compressed_size, compressed_text );
+            assert( 'S' == compressed_text[ strcspn( compressed_text, ":" ) + 2 ] );
+            char decompressed_text[original_length+1];
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                original_length+1, decompressed_text );
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# n=%d static table %d (%s): %d bytes compressed to %d bytes.\n",
+                n, k, static_huffman_tables[k].name,
+                original_length, compressed_length );
+        };
+    };
+
+    // A block with a skewed alphabet:
+    // a fresh table plus its compact "\nW" header
+    // is smaller than the best static table
+    // (though not once a 275-byte "\nX" header is charged to it).
+    const char * pangram = "the quick brown fox jumps over the lazy dog while seven tall men sing ";
+    const int pangram_length = strlen( pangram );
+    const int original_length = 800;
+    char original_text[original_length];
+    for( int i=0; i<original_length; i++ ){
+        original_text[i] = pangram[ i % pangram_length ];
+    };
+    const int compressed_size = 2 * original_length + 300;
+    char compressed_text[compressed_size];
+    int compressed_length[2]; // fresh, static
+    for( int fresh=1; fresh>=0; fresh-- ){
+        reset_block_scratch( scratch );
+        histogram( original_length, original_text, MAX_LEAF_VALUE, scratch->symbol_frequencies );
+        const int table = choose_huffman_table( scratch, 3, fresh );
+        assert( fresh == (NO_STATIC_TABLE == table) );
+        compressed_length[!fresh] = compress(
+            scratch, table,
+            MAX_LEAF_VALUE, scratch->canonical_lengths, 3,
+            true, // packed digits
+            original_length, original_text,
+            compressed_size, compressed_text );
+    };
+    printf("# fresh table: %d bytes; best static table: %d bytes.\n",
+        compressed_length[0], compressed_length[1] );
+    assert( compressed_length[0] < compressed_length[1] );
+    assert( compressed_length[1] < compressed_length[0] + 16 + MAX_LEAF_VALUE + 1 );
+}
+
+/*
+Check the sibling property (and the bookkeeping)
+of an adaptive Huffman tree.
+*/
+static void
+check_adaptive_huffman( const struct adaptive_huffman * tree ){
+    for( int slot=0; slot<tree->nodes; slot++ ){
+        if( 0 < slot ){
+            assert( tree->weight[slot-1] >= tree->weight[slot] );
+            assert( tree->weight[ tree->parent[slot] ] > tree->weight[slot] );
+        };
+        if( 0 <= tree->first_child[slot] ){
+            assert( tree->child_count[slot] <= tree->compressed_symbols );
+            int sum = 0;
+            for( int c=0; c<tree->child_count[slot]; c++ ){
+                const int child = tree->first_child[slot] + c;
+                assert( slot == tree->parent[child] );
+                sum += tree->weight[child];
+            };
+            assert( sum == tree->weight[slot] );
+        }else if( ADAPTIVE_NYT == tree->symbol[slot] ){
+            assert( slot == tree->nyt );
+            assert( 1 == tree->weight[slot] );
+        }else{
+            assert( slot == tree->leaf_slot[ tree->symbol[slot] ] );
+        };
+    };
+}
+
+void
+test_adaptive_huffman( struct block_scratch * scratch ){
+    printf("# test_adaptive_huffman ...\n");
+    const int radixes[] = {2, 3, 4, 9, 10};
+    for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+        const int n = radixes[r];
+        for( int k=-1; k<STATIC_TABLE_COUNT; k++ ){
+            const char * original_text = (k < 0) ?
+                decoder_sample_text : static_huffman_tables[k].sample_text;
+            const int original_length = strlen( original_text );
+            // encode one symbol at a time, checking the tree as we go.
+            struct adaptive_huffman * tree = &scratch->adaptive;
+            start_adaptive_huffman( tree, n );
+            const int digits_size = original_length * 16;
+            char digits[digits_size];
+            struct digit_writer writer;
+            start_digit_writer( &writer, n, false, digits_size, digits );
+            for( int i=0; i<original_length; i++ ){
+                encode_adaptive_symbol( tree, &writer, original_text[i] );
+                check_adaptive_huffman( tree );
+            };
+            // round-trip a whole "\nA" block.
+            const int compressed_size = 2 * original_length + 100;
+            char compressed_text[compressed_size];
+            const int compressed_length = compress_adaptive( scratch, n,
+                original_length, original_text,
+                compressed_size, compressed_text );
+            char decompressed_text[original_length+1];
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                original_length+1, decompressed_text );
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# n=%d adaptive: %d bytes compressed to %d bytes (%d printable digits).\n",
+                n, original_length, compressed_length, writer.digit_count );
+        };
+    };
+}
+
+/*
+Adaptive mode against the block modes
+(fresh "\nX" table, and the static-table chooser)
+for messages of various sizes:
+compression ratio,
+throughput (compress + decompress),
+and the latency to compress one message.
+The debug output of huffman() is turned off while timing.
+*/
+void
+benchmark_adaptive_huffman( struct block_scratch * scratch ){
+    printf("# benchmark_adaptive_huffman ...\n");
+    const int n = 3;
+    const int sizes[] = {32, 128, 512, 2048, 8192, 32000};
+    const int sample_length = strlen( decoder_sample_text );
+    static char original_text[BLOCK_SIZE+1];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE+1];
+    const char * mode_names[3] = {"adaptive", "fresh table", "chooser"};
+    // build the static tables now, not inside the first timed message.
+    prepare_static_tables( scratch, n );
+    for( int z=0; z<(int)NUM_ELEM(sizes); z++){
+        const int original_length = sizes[z];
+        for( int i=0; i<original_length; i++ ){
+            original_text[i] = decoder_sample_text[ (i * 7 + i / sample_length) % sample_length ];
+        };
+        for( int mode=0; mode<3; mode++ ){
+            const int repeats = 20;
+            int compressed_length = 0;
+            double compress_seconds = 0;
+            double decompress_seconds = 0;
+            huffman_debug_output = false;
+            for( int rep=0; rep<repeats; rep++ ){
+                double start = seconds_now();
+                if( 0 == mode ){
+                    compressed_length = compress_adaptive( scratch, n,
+                        original_length, original_text,
+                        COMPRESSED_BLOCK_SIZE, compressed_text );
+                }else{
+                    reset_block_scratch( scratch );
+                    histogram( original_length, original_text, MAX_LEAF_VALUE, scratch->symbol_frequencies );
+                    int static_table = NO_STATIC_TABLE;
+                    if( 1 == mode ){
+                        huffman( &scratch->tree, MAX_LEAF_VALUE,
+                            scratch->symbol_frequencies, n,
+                            scratch->canonical_lengths );
+                    }else{
+                        static_table = choose_huffman_table( scratch, n, true );
+                    };
+                    compressed_length = compress( scratch, static_table,
+                        MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+                        true, // packed digits
+                        original_length, original_text,
+                        COMPRESSED_BLOCK_SIZE, compressed_text );
+                };
+                compress_seconds += seconds_now() - start;
+                start = seconds_now();
+                const int decompressed_length = decompress( scratch,
+                    compressed_length, compressed_text,
+                    BLOCK_SIZE+1, decompressed_text );
+                decompress_seconds += seconds_now() - start;
+                assert( original_length == decompressed_length );
+                assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            };
+            huffman_debug_output = true;
+            printf("# %5d bytes, %-11s: ratio %5.3f, %6.2f MB/s compress, %6.2f MB/s decompress,"
+                " %9.1f us per message\n",
+                original_length, mode_names[mode],
+                (double)compressed_length / original_length,
+                original_length * repeats / compress_seconds / 1e6,
+                original_length * repeats / decompress_seconds / 1e6,
+                1e6 * compress_seconds / repeats );
+        };
+    };
+}
+
+/*
+Round-trip every compact length-table method ("\nW" blocks)
+on the tables of a few sample texts,
+and compare their header sizes against the hex "\nX" table
+(one byte per symbol).
+The debug output of huffman() is turned off while timing.
+The 'H' method builds its code-length code once, outside the timed loop
+(its cost is printed on its own as "build"),
+so its encode time is that of the bits alone, as for 'N' and 'R'.
+*/
+void
+test_length_table_codecs( struct block_scratch * scratch ){
+    printf("# test_length_table_codecs ...\n");
+    const int radixes[] = {2, 3, 10};
+    const int repeats = 100;
+    for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+        const int n = radixes[r];
+        for( int k=-1; k<STATIC_TABLE_COUNT; k++ ){
+            const char * original_text = (k < 0) ?
+                decoder_sample_text : static_huffman_tables[k].sample_text;
+            reset_block_scratch( scratch );
+            histogram( strlen( original_text ), original_text, MAX_LEAF_VALUE, scratch->symbol_frequencies );
+            huffman( &scratch->tree, MAX_LEAF_VALUE,
+                scratch->symbol_frequencies, n, scratch->canonical_lengths );
+            int lengths[MAX_LEAF_VALUE+1];
+            memcpy( lengths, scratch->canonical_lengths, sizeof( lengths ) );
+            huffman_debug_output = false;
+            struct length_table_code code;
+            double start = seconds_now();
+            build_length_table_code( scratch, MAX_LEAF_VALUE, lengths, &code );
+            const double build_seconds = seconds_now() - start;
+            for( int m=0; m<(int)strlen( LENGTH_TABLE_METHODS ); m++ ){
+                const char method = LENGTH_TABLE_METHODS[m];
+                char table[MAX_LEAF_VALUE+16];
+                int table_length = 0;
+                start = seconds_now();
+                for( int rep=0; rep<repeats; rep++ ){
+                    table_length = ('H' == method) ?
+                        write_length_table_code( &code, sizeof( table ), table ) :
+                        encode_length_table( scratch, method,
+                            MAX_LEAF_VALUE, lengths, sizeof( table ), table );
+                };
+                const double encode_seconds = seconds_now() - start;
+                int decoded[MAX_LEAF_VALUE+1];
+                start = seconds_now();
+                for( int rep=0; rep<repeats; rep++ ){
+                    decode_length_table( scratch, method, table_length, table,
+                        MAX_LEAF_VALUE, decoded );
+                };
+                const double decode_seconds = seconds_now() - start;
+                assert( arrays_equal( MAX_LEAF_VALUE+1, lengths, decoded ) );
+                huffman_debug_output = true;
+                printf("# n=%d table %d method %c: %3d bytes (hex table: %d bytes),"
+                    " %8.2f us encode, %6.2f us parse",
+                    n, k, method, table_length, MAX_LEAF_VALUE+1,
+                    1e6 * encode_seconds / repeats,
+                    1e6 * decode_seconds / repeats );
+                if( 'H' == method ){
+                    printf(", %8.2f us build", 1e6 * build_seconds );
+                };
+                printf("\n");
+                huffman_debug_output = false;
+            };
+            huffman_debug_output = true;
+            char smallest[MAX_LEAF_VALUE+16];
+            const int smallest_length = encode_smallest_length_table( scratch,
+                MAX_LEAF_VALUE, lengths, sizeof( smallest ), smallest );
+            int decoded[MAX_LEAF_VALUE+1];
+            decode_length_table( scratch, smallest[0], smallest_length - 1, smallest + 1,
+                MAX_LEAF_VALUE, decoded );
+            assert( arrays_equal( MAX_LEAF_VALUE+1, lengths, decoded ) );
+        };
+    };
+    // a sparse table exercises the long zero runs and the repeat code.
+    int lengths[MAX_LEAF_VALUE+1] = {0};
+    for( int i='a'; i<='z'; i++ ){
+        lengths[i] = 5;
+    };
+    lengths[' '] = 2;
+    lengths[MAX_LEAF_VALUE] = 9;
+    for( int m=0; m<(int)strlen( LENGTH_TABLE_METHODS ); m++ ){
+        const char method = LENGTH_TABLE_METHODS[m];
+        char table[MAX_LEAF_VALUE+16];
+        const int table_length = encode_length_table( scratch, method,
+            MAX_LEAF_VALUE, lengths, sizeof( table ), table );
+        int decoded[MAX_LEAF_VALUE+1];
+        decode_length_table( scratch, method, table_length, table,
+            MAX_LEAF_VALUE, decoded );
+        assert( arrays_equal( MAX_LEAF_VALUE+1, lengths, decoded ) );
+        printf("# sparse table method %c: %d bytes.\n", method, table_length );
+    };
+    printf("Successful test.\n");
+}
+
+/*
+Binary payloads:
+'\0' is a normal symbol (here the most common one),
+and every other byte value appears at least once.
+Round-trip through a fresh table (packed and printable),
+adaptive mode, and the static-table chooser.
+*/
+void
+test_binary_data( struct block_scratch * scratch ){
+    printf("# test_binary_data ...\n");
+    const int original_length = 4096;
+    static char original_text[4096];
+    for( int i=0; i<original_length; i++ ){
+        original_text[i] = (i & 1) ? (char)(i * 37 / 2) : '\0';
+    };
+    const int compressed_size = 2 * original_length + 100;
+    static char compressed_text[2 * 4096 + 100];
+    static char decompressed_text[4096];
+    const int radixes[] = {2, 3, 10};
+    for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+        const int n = radixes[r];
+        for( int mode=0; mode<4; mode++ ){
+            int compressed_length = 0;
+            if( 2 == mode ){
+                compressed_length = compress_adaptive( scratch, n,
+                    original_length, original_text,
+                    compressed_size, compressed_text );
+            }else{
+                reset_block_scratch( scratch );
+                histogram( original_length, original_text,
+                    MAX_LEAF_VALUE, scratch->symbol_frequencies );
+                assert( original_length / 2 <= scratch->symbol_frequencies[0] );
+                int static_table = NO_STATIC_TABLE;
+                if( 3 == mode ){
+                    static_table = choose_huffman_table( scratch, n, false );
+                }else{
+                    huffman( &scratch->tree, MAX_LEAF_VALUE,
+                        scratch->symbol_frequencies, n,
+                        scratch->canonical_lengths );
+                };
+                compressed_length = compress( scratch, static_table,
+                    MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+                    (1 != mode), // mode 1: printable digits
+                    original_length, original_text,
+                    compressed_size, compressed_text );
+            };
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                original_length, decompressed_text );
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# n=%d mode %d: %d binary bytes compressed to %d bytes.\n",
+                n, mode, original_length, compressed_length );
+        };
+    };
+    printf("Successful test.\n");
+}
+
+/*
+Round-trip the LZ77 front end at a few effort levels
+on the sample texts,
+binary data,
+a long run of one byte (matches overlapping their own output),
+and an empty block.
+*/
+void
+test_lz77( struct block_scratch * scratch ){
+    printf("# test_lz77 ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const int radixes[] = {2, 3, 10};
+    const int levels[] = {0, 1, LZ_DEFAULT_LEVEL, 9, LZ_LEVELS-1};
+    for( int k=-1; k<TEST_INPUTS; k++ ){
+        const int original_length = make_test_input( k, BLOCK_SIZE, original_text );
+        for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+            for( int v=0; v<(int)NUM_ELEM(levels); v++){
+                const int compressed_length = compress_lz77( scratch,
+                    levels[v], radixes[r], original_length, original_text,
+                    COMPRESSED_BLOCK_SIZE, compressed_text );
+                const int decompressed_length = decompress( scratch,
+                    compressed_length, compressed_text,
+                    BLOCK_SIZE, decompressed_text );
+                assert( original_length == decompressed_length );
+                assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+                printf("# input %d, n=%d, level %d: %d bytes compressed to %d bytes.\n",
+                    k, radixes[r], levels[v], original_length, compressed_length );
+            };
+        };
+    };
+    printf("Successful test.\n");
+}
+
+/*
+A block of made-up server log lines:
+the kind of repetitive text
+LZ77 finds far more in than order-0 Huffman does.
+*/
+static int
+make_sample_log( const int size, char text[size] ){
+    int length = 0;
+    for( int line=0; ; line++ ){
+        char buffer[200];
+        const int n = snprintf( buffer, sizeof( buffer ),
+            "2026-10-18 12:%02d:%02d %s request id=%d path=/api/v1/items/%d status=%d bytes=%d\n",
+            (line / 60) % 60, line % 60,
+            (line % 17) ? "INFO" : "WARN",
+            100000 + line * 7, (line * 31) % 1000,
+            (line % 23) ? 200 : 404, 512 + (line * 97) % 4096 );
+        if( size < length + n ){
+            return length;
+        };
+        memcpy( &text[length], buffer, n );
+        length += n;
+    };
+}
 
+/*
+Compression ratio and throughput at every LZ77 effort level
+(greedy and optimal parsing),
+against order-0 Huffman of the same block (a fresh "\nW" table),
+on the sample texts (all run together) and on a block of log lines.
+The debug output of huffman() is turned off while timing.
+*/
 void
-short_test_next_block(void){
-    printf("# short_test_next_block ...\n");
-    // FIXME: use a larger buffer,
-    // perhaps with calloc() or realloc() or both?
-    const size_t bufsize = 65000;
-    char original_text[65000+1] =
-        ""
-"/* n_ary_huffman.c"
-"2021-10-25: started by David Cary"
-        "";
-    size_t original_length = strlen( original_text );
+benchmark_lz77_levels( struct block_scratch * scratch ){
+    printf("# benchmark_lz77_levels ...\n");
+    const int n = 3;
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const char * corpus_names[2] = {"samples", "log lines"};
+    for( int corpus=0; corpus<2; corpus++ ){
+        int original_length = 0;
+        if( 0 == corpus ){
+            original_length = make_sample_corpus( BLOCK_SIZE, original_text );
+        }else{
+            original_length = make_sample_log( BLOCK_SIZE, original_text );
+        };
+        reset_block_scratch( scratch );
+        histogram( original_length, original_text,
+            MAX_LEAF_VALUE, scratch->symbol_frequencies );
+        huffman( &scratch->tree, MAX_LEAF_VALUE,
+            scratch->symbol_frequencies, n, scratch->canonical_lengths );
+        const int order0_length = compress( scratch, NO_STATIC_TABLE,
+            MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+            true, // packed digits
+            original_length, original_text,
+            COMPRESSED_BLOCK_SIZE, compressed_text );
+        printf("# %s, %d bytes, order-0 Huffman: ratio %5.3f\n",
+            corpus_names[corpus], original_length,
+            (double)order0_length / original_length );
+        for( int level=0; level<LZ_LEVELS; level++ ){
+            huffman_debug_output = false;
+            double start = seconds_now();
+            const int compressed_length = compress_lz77( scratch,
+                level, n, original_length, original_text,
+                COMPRESSED_BLOCK_SIZE, compressed_text );
+            const double compress_seconds = seconds_now() - start;
+            start = seconds_now();
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                BLOCK_SIZE, decompressed_text );
+            const double decompress_seconds = seconds_now() - start;
+            huffman_debug_output = true;
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# %s, LZ77 level %2d (%s): ratio %5.3f, %6.2f MB/s compress, %6.2f MB/s decompress\n",
+                corpus_names[corpus], level,
+                lz_levels[level].optimal ? "optimal" : "greedy ",
+                (double)compressed_length / original_length,
+                original_length / compress_seconds / 1e6,
+                original_length / decompress_seconds / 1e6 );
+        };
+    };
+}
 
-    // FIXME: support arbitrary number of symbols.
-    const int max_symbol_value = 258;
-    int symbol_frequencies[max_symbol_value+1];
-    symbol_frequencies[258] = 0xBEEF; // for debugging: canary sentinel to test zeroing.
-    printf("# finding histogram.\n");
-    histogram( original_text, max_symbol_value, symbol_frequencies );
-    assert( 0 == symbol_frequencies[258] );
-    int compressed_symbols = 3; // 2 for binary, 3 for trinary, etc.
-    assert(compressed_symbols);
-    // FUTURE: length-limited Huffman?
+/*
+Round-trip the context-selected tables
+for several numbers of tables (including ones that aren't a power of 2)
+and several radixes,
+on the sample texts, binary data, a run of one byte, and an empty block.
+*/
+void
+test_context_tables( struct block_scratch * scratch ){
+    printf("# test_context_tables ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const int radixes[] = {2, 3, 10};
+    const int table_counts[] = {2, 3, 8, MAX_CONTEXT_TABLES};
+    for( int k=-1; k<TEST_INPUTS; k++ ){
+        const int original_length = make_test_input( k, BLOCK_SIZE, original_text );
+        for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+            for( int v=0; v<(int)NUM_ELEM(table_counts); v++){
+                const int compressed_length = compress_contexts( scratch,
+                    table_counts[v], radixes[r], original_length, original_text,
+                    COMPRESSED_BLOCK_SIZE, compressed_text );
+                const int decompressed_length = decompress( scratch,
+                    compressed_length, compressed_text,
+                    BLOCK_SIZE, decompressed_text );
+                assert( original_length == decompressed_length );
+                assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+                printf("# input %d, n=%d, %d tables: %d bytes compressed to %d bytes.\n",
+                    k, radixes[r], table_counts[v], original_length, compressed_length );
+            };
+        };
+    };
+    printf("Successful test.\n");
+}
 
-    printf("# finding canonical lengths.\n");
-    int canonical_lengths[max_symbol_value+1];
-    for( int i=0; i<(max_symbol_value+1); i++){
-        canonical_lengths[i] = 0;
+/*
+Compression ratio against the number of context tables,
+from one table (plain "\nW" order-0 Huffman) up to MAX_CONTEXT_TABLES,
+on this file's sample texts (all run together)
+and on a block of log lines.
+More tables fit the data better
+but cost more table bytes.
+*/
+void
+benchmark_context_tables( struct block_scratch * scratch ){
+    printf("# benchmark_context_tables ...\n");
+    const int n = 3;
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const char * corpus_names[2] = {"samples", "log lines"};
+    const int table_counts[] = {2, 3, 4, 6, 8, 12, 16, 24, MAX_CONTEXT_TABLES};
+    for( int corpus=0; corpus<2; corpus++ ){
+        int original_length = 0;
+        if( 0 == corpus ){
+            original_length = make_sample_corpus( BLOCK_SIZE, original_text );
+        }else{
+            original_length = make_sample_log( BLOCK_SIZE, original_text );
+        };
+        reset_block_scratch( scratch );
+        histogram( original_length, original_text,
+            MAX_LEAF_VALUE, scratch->symbol_frequencies );
+        huffman( &scratch->tree, MAX_LEAF_VALUE,
+            scratch->symbol_frequencies, n, scratch->canonical_lengths );
+        const int order0_length = compress( scratch, NO_STATIC_TABLE,
+            MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+            true, // packed digits
+            original_length, original_text,
+            COMPRESSED_BLOCK_SIZE, compressed_text );
+        printf("# %s, %d bytes,  1 table:  ratio %5.3f\n",
+            corpus_names[corpus], original_length,
+            (double)order0_length / original_length );
+        for( int v=0; v<(int)NUM_ELEM(table_counts); v++){
+            const int compressed_length = compress_contexts( scratch,
+                table_counts[v], n, original_length, original_text,
+                COMPRESSED_BLOCK_SIZE, compressed_text );
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                BLOCK_SIZE, decompressed_text );
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# %s, %d bytes, %2d tables: ratio %5.3f\n",
+                corpus_names[corpus], original_length, table_counts[v],
+                (double)compressed_length / original_length );
+        };
     };
-    assert(0 == canonical_lengths[0]);
-    // int canonical_lengths[nonzero_text_symbols] = {};
-    huffman(
-        max_symbol_value, symbol_frequencies,
-        compressed_symbols,
-        canonical_lengths
-    );
-    printf("# now we have the canonical lengths ...\n");
-    debug_print_table( max_symbol_value, canonical_lengths, compressed_symbols );
-    assert(0);
-    int compressed_data_size = 
-    find_compressed_data_size(
-        max_symbol_value,
-        symbol_frequencies,
-        canonical_lengths,
-        compressed_symbols
-        );
-    printf("# compressed_data_size, not including header: %i symbols\n",
-        compressed_data_size
-        );
-    test_various_table_representations(
-        max_symbol_value,
-        symbol_frequencies,
-        canonical_lengths
-    );
-    printf("# compressing text...\n");
-    char compressed_text[bufsize+1];
-    compress(
-        max_symbol_value, canonical_lengths, compressed_symbols,
-        bufsize,
-        original_length,
-        original_text,
-        compressed_text
-    );
-    printf("# decompressing text.\n");
-    char decompressed_text[bufsize+1];
-    decompress( bufsize, compressed_text, bufsize, decompressed_text );
-    size_t decompressed_length = strlen( decompressed_text );
-    assert( original_length == decompressed_length );
-    if( memcmp( original_text, decompressed_text, original_length ) ){
-        printf("Error: decompressed text doesn't match original text.\n");
-        printf("[%s] original\n", original_text);
-        printf("[%s] decompressed\n", decompressed_text);
-    }else{
-        printf("Successful test.\n");
-    }
 }
 
-// return 1 (True) if the arrays are equal.
-bool
-arrays_equal(
-    int array_length,
-    int a[array_length],
-    int b[array_length]
-){
-    for(int i=0; i<array_length; i++){
-        bool same = (a[i] == b[i]);
-        if(!same){
-            printf(
-                "First difference: a[%i]=%i ; b[%i]=%i.\n", 
-                i, a[i], i, b[i]
-                );
-            return false;
+/*
+Round-trip the word-token mode in several radixes
+on the sample texts, binary data, a run of one byte,
+a block of log lines, and an empty block.
+*/
+void
+test_word_tokens( struct block_scratch * scratch ){
+    printf("# test_word_tokens ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const int radixes[] = {2, 3, 10};
+    for( int k=-1; k<=TEST_INPUTS; k++ ){
+        // and one more: a block of log lines.
+        const int original_length = (TEST_INPUTS == k) ?
+            make_sample_log( BLOCK_SIZE, original_text ) :
+            make_test_input( k, BLOCK_SIZE, original_text );
+        for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+            const int compressed_length = compress_words( scratch,
+                radixes[r], original_length, original_text,
+                COMPRESSED_BLOCK_SIZE, compressed_text );
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                BLOCK_SIZE, decompressed_text );
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# input %d, n=%d, word tokens: %d bytes compressed to %d bytes.\n",
+                k, radixes[r], original_length, compressed_length );
         };
     };
-    return true;
+    printf("Successful test.\n");
 }
 
+/*
+Word tokens against order-0 byte Huffman (a fresh "\nW" table),
+ratio and compression throughput,
+on the sample texts (all run together),
+and on a block of log lines.
+The debug output of huffman() is turned off while timing.
+*/
 void
-test_convert_lengths_to_encode_table(void){
-    int max_symbol_value = 20;
-    int encode_length_table[80] = {0};
-    unsigned int encode_value_table[80] = {0};
-    if(1){
-        /*
-        int length_table_length = NUM_ELEM( length_table );
-        */
-        int length_table[80] = {0, 0, 1, 1, 1};
-        convert_lengths_to_encode_table(
-            max_symbol_value,
-            length_table,
-            3, // trinary output
-            encode_length_table,
-            encode_value_table
-            );
-        assert( arrays_equal( (max_symbol_value+1), length_table, encode_length_table ) );
-        int expected_length_table[80] = {0, 0, 1, 1, 1};
-        int expected_value_table[80] = {0, 0, 0, 1, 2}; // trinary
-        assert( arrays_equal( 80, expected_value_table, (int *)encode_value_table ) );
-        assert( arrays_equal( 80, expected_length_table, encode_length_table ) );
+benchmark_word_tokens( struct block_scratch * scratch ){
+    printf("# benchmark_word_tokens ...\n");
+    const int n = 2;
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const char * corpus_names[2] = {"samples", "log lines"};
+    for( int corpus=0; corpus<2; corpus++ ){
+        int original_length = 0;
+        if( 0 == corpus ){
+            original_length = make_sample_corpus( BLOCK_SIZE, original_text );
+        }else{
+            original_length = make_sample_log( BLOCK_SIZE, original_text );
+        };
+        huffman_debug_output = false;
+        double start = seconds_now();
+        reset_block_scratch( scratch );
+        histogram( original_length, original_text,
+            MAX_LEAF_VALUE, scratch->symbol_frequencies );
+        huffman( &scratch->tree, MAX_LEAF_VALUE,
+            scratch->symbol_frequencies, n, scratch->canonical_lengths );
+        const int byte_length = compress( scratch, NO_STATIC_TABLE,
+            MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+            true, // packed digits
+            original_length, original_text,
+            COMPRESSED_BLOCK_SIZE, compressed_text );
+        const double byte_seconds = seconds_now() - start;
+        start = seconds_now();
+        const int word_length = compress_words( scratch,
+            n, original_length, original_text,
+            COMPRESSED_BLOCK_SIZE, compressed_text );
+        const double word_seconds = seconds_now() - start;
+        huffman_debug_output = true;
+        const int decompressed_length = decompress( scratch,
+            word_length, compressed_text, BLOCK_SIZE, decompressed_text );
+        assert( original_length == decompressed_length );
+        assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+        printf("# %s, %d bytes, bytes: ratio %5.3f, %6.2f MB/s compress\n",
+            corpus_names[corpus], original_length,
+            (double)byte_length / original_length,
+            original_length / byte_seconds / 1e6 );
+        printf("# %s, %d bytes, words: ratio %5.3f, %6.2f MB/s compress\n",
+            corpus_names[corpus], original_length,
+            (double)word_length / original_length,
+            original_length / word_seconds / 1e6 );
     };
-    if(1){
-        // test with 8 equal-frequency items,
-        // which (in trinary) should lead to all items of length 2
-        // (and 1 unused "dummy" codeword).
-        int length_table[80] = {0,0,
-            2, 2, 2, 2,
-            2, 2, 2, 2,
+}
+
+/*
+A block dominated by one byte
+(85% 'a', 10% 'b', 4% 'c', 1% 'd', from a fixed pseudo-random sequence):
+the case where whole-digit Huffman codes waste the most.
+*/
+static int
+make_skewed_text( const int size, char text[size] ){
+    unsigned int seed = 12345;
+    for( int i=0; i<size; i++ ){
+        seed = seed * 1103515245u + 12345u;
+        const int r = (seed >> 16) % 100;
+        text[i] = (r < 85) ? 'a' : (r < 95) ? 'b' : (r < 99) ? 'c' : 'd';
+    };
+    return size;
+}
+
+/*
+Round-trip tANS at several table sizes
+on the sample texts, binary data, a run of one byte,
+a skewed block, and an empty block.
+*/
+void
+test_tans( struct block_scratch * scratch ){
+    printf("# test_tans ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const int table_logs[] = {8, TANS_DEFAULT_TABLE_LOG, TANS_MAX_TABLE_LOG};
+    for( int k=-1; k<=TEST_INPUTS; k++ ){
+        // and one more: skewed text.
+        const int original_length = (TEST_INPUTS == k) ?
+            make_skewed_text( BLOCK_SIZE, original_text ) :
+            make_test_input( k, BLOCK_SIZE, original_text );
+        for( int v=0; v<(int)NUM_ELEM(table_logs); v++){
+            reset_block_scratch( scratch );
+            histogram( original_length, original_text,
+                MAX_LEAF_VALUE, scratch->symbol_frequencies );
+            const int compressed_length = compress_tans( scratch,
+                table_logs[v], original_length, original_text,
+                COMPRESSED_BLOCK_SIZE, compressed_text );
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                BLOCK_SIZE, decompressed_text );
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# input %d, tANS L=%d: %d bytes compressed to %d bytes.\n",
+                k, 1 << table_logs[v], original_length, compressed_length );
         };
-        convert_lengths_to_encode_table(
-            max_symbol_value,
-            length_table,
-            3, // trinary output
-            encode_length_table,
-            encode_value_table
-            );
-        assert( arrays_equal( (max_symbol_value+1), length_table, encode_length_table ) );
-        unsigned int expected_value_table[80] = {0,0,
-            0, 1, 2, 3,
-            4, 5, 6, 7,
+    };
+    printf("Successful test.\n");
+}
+
+/*
+Binary and trinary Huffman against tANS,
+size and compression throughput,
+and what choose_entropy_coder() picks,
+on the sample texts (all run together), a block of log lines,
+and a skewed block.
+The debug output of huffman() is turned off while timing.
+*/
+void
+benchmark_entropy_coders( struct block_scratch * scratch ){
+    printf("# benchmark_entropy_coders ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const char * corpus_names[3] = {"samples", "log lines", "skewed"};
+    for( int corpus=0; corpus<3; corpus++ ){
+        int original_length = 0;
+        if( 0 == corpus ){
+            original_length = make_sample_corpus( BLOCK_SIZE, original_text );
+        }else if( 1 == corpus ){
+            original_length = make_sample_log( BLOCK_SIZE, original_text );
+        }else{
+            original_length = make_skewed_text( BLOCK_SIZE, original_text );
         };
-        assert( arrays_equal( 80, (int *)expected_value_table, (int *)encode_value_table ) );
+        for( int n=2; n<=3; n++ ){
+            huffman_debug_output = false;
+            double start = seconds_now();
+            reset_block_scratch( scratch );
+            histogram( original_length, original_text,
+                MAX_LEAF_VALUE, scratch->symbol_frequencies );
+            huffman( &scratch->tree, MAX_LEAF_VALUE,
+                scratch->symbol_frequencies, n, scratch->canonical_lengths );
+            const int huffman_length = compress( scratch, NO_STATIC_TABLE,
+                MAX_LEAF_VALUE, scratch->canonical_lengths, n,
+                true, // packed digits
+                original_length, original_text,
+                COMPRESSED_BLOCK_SIZE, compressed_text );
+            const double huffman_seconds = seconds_now() - start;
+            huffman_debug_output = true;
+            printf("# %s, %d bytes, %d-ary Huffman: ratio %5.3f, %6.2f MB/s compress\n",
+                corpus_names[corpus], original_length, n,
+                (double)huffman_length / original_length,
+                original_length / huffman_seconds / 1e6 );
+        };
+        // the histogram and trinary lengths are still in scratch.
+        const int chosen = choose_entropy_coder( scratch, 3, NO_STATIC_TABLE, original_length );
+        const double start = seconds_now();
+        const int tans_length = compress_tans( scratch, TANS_DEFAULT_TABLE_LOG,
+            original_length, original_text,
+            COMPRESSED_BLOCK_SIZE, compressed_text );
+        const double tans_seconds = seconds_now() - start;
+        const int decompressed_length = decompress( scratch,
+            tans_length, compressed_text, BLOCK_SIZE, decompressed_text );
+        assert( original_length == decompressed_length );
+        assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+        printf("# %s, %d bytes, tANS L=%d: ratio %5.3f, %6.2f MB/s compress; chooser picks %s\n",
+            corpus_names[corpus], original_length, 1 << TANS_DEFAULT_TABLE_LOG,
+            (double)tans_length / original_length,
+            original_length / tans_seconds / 1e6,
+            chosen ? "tANS" : "Huffman" );
     };
-    if(1){
-        // test with 9 equal-frequency items,
-        // which (in trinary) should lead to all items of length 2
-        // (and zero unused "dummy" codewords).
-        int length_table[80] = {0,0,
-            2, 2, 2, 2,
-            2, 2, 2, 2,
-            2,
+}
+
+/*
+Round-trip the interleaved "\nQ" layout in several radixes
+on the sample texts, binary data, a skewed block,
+and blocks too short to fill every stream.
+*/
+void
+test_interleaved_streams( struct block_scratch * scratch ){
+    printf("# test_interleaved_streams ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const int radixes[] = {2, 3, 10};
+    // and some lengths that aren't a multiple of the number of streams:
+    // skewed text, fewer symbols than streams, and one more.
+    const int short_lengths[] = {1, 2, 5};
+    for( int k=-1; k<TEST_INPUTS + 1 + (int)NUM_ELEM(short_lengths); k++ ){
+        int original_length = 0;
+        if( k < TEST_INPUTS ){
+            original_length = make_test_input( k, BLOCK_SIZE, original_text );
+        }else if( TEST_INPUTS == k ){
+            original_length = make_skewed_text( BLOCK_SIZE - 1, original_text );
+        }else{
+            original_length = short_lengths[ k - TEST_INPUTS - 1 ];
+            memcpy( original_text, "abcab", original_length );
         };
-        convert_lengths_to_encode_table(
-            max_symbol_value,
-            length_table,
-            3, // trinary output
-            encode_length_table,
-            encode_value_table
-            );
-        assert( arrays_equal( (max_symbol_value+1), length_table, encode_length_table ) );
-        unsigned int expected_value_table[80] = {0,0,
-            0, 1, 2, 3,
-            4, 5, 6, 7,
-            8
+        for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+            reset_block_scratch( scratch );
+            histogram( original_length, original_text,
+                MAX_LEAF_VALUE, scratch->symbol_frequencies );
+            huffman( &scratch->tree, MAX_LEAF_VALUE,
+                scratch->symbol_frequencies, radixes[r], scratch->canonical_lengths );
+            const int compressed_length = compress_with_streams( scratch,
+                NO_STATIC_TABLE, MAX_LEAF_VALUE, scratch->canonical_lengths, radixes[r],
+                true, HUFFMAN_STREAMS,
+                original_length, original_text,
+                COMPRESSED_BLOCK_SIZE, compressed_text );
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                BLOCK_SIZE, decompressed_text );
+            assert( original_length == decompressed_length );
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+            printf("# input %d, n=%d, %d streams: %d bytes compressed to %d bytes.\n",
+                k, radixes[r], HUFFMAN_STREAMS, original_length, compressed_length );
         };
-        assert( arrays_equal( 80, (int *)expected_value_table, (int *)encode_value_table ) );
     };
+    printf("Successful test.\n");
+}
+
+/*
+Decode throughput of one stream against HUFFMAN_STREAMS interleaved streams
+of the same text with the same table, for each radix.
+The middle column runs the stream reader on a single stream,
+to separate what the reader itself gains
+from what interleaving gains.
+*/
+void
+benchmark_interleaved_streams( struct block_scratch * scratch ){
+    printf("# benchmark_interleaved_streams ...\n");
+    const int original_length = 16000;
+    static char original_text[16000];
+    static char decompressed_text[16000];
+    static unsigned char digits[16000 * MAX_CODE_LENGTH];
+    static unsigned char stream_data[HUFFMAN_STREAMS][16000 * MAX_CODE_LENGTH / HUFFMAN_STREAMS];
+    make_repeated_sample( original_length, original_text );
+    const int repeats = 20;
+    const int radixes[] = {2, 3, 9, 10};
+    for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+        const int n = radixes[r];
+        // leaves the tables in scratch.
+        const int digit_count = encode_sample_for_decoder(
+            scratch, n, true, original_length, original_text,
+            sizeof( digits ), digits );
+        const struct canonical_decoder * decoder = &scratch->decoder;
+        int digit_counts[HUFFMAN_STREAMS];
+        const unsigned char * streams[HUFFMAN_STREAMS];
+        for( int k=0; k<HUFFMAN_STREAMS; k++ ){
+            struct digit_writer writer;
+            start_digit_writer( &writer, n, true,
+                sizeof( stream_data[k] ), (char *)stream_data[k] );
+            for( int i=k; i<original_length; i+=HUFFMAN_STREAMS ){
+                const unsigned char byte = original_text[i];
+                write_digits( &writer, scratch->encode_value_table[byte],
+                    scratch->encode_length_table[byte] );
+            };
+            finish_digit_writer( &writer );
+            digit_counts[k] = writer.digit_count;
+            streams[k] = stream_data[k];
+        };
+        // the plain single-stream decoder,
+        // the stream reader on one stream (all the digits, in order),
+        // and the stream reader on HUFFMAN_STREAMS interleaved streams.
+        const unsigned char * one_stream[1] = { digits };
+        double mb_per_s[3] = {0};
+        for( int mode=0; mode<3; mode++){
+            const clock_t start = clock();
+            for( int i=0; i<repeats; i++){
+                const int decompressed_length =
+                    (0 == mode) ?
+                    decode_digits_to_text( decoder, true, true, digit_count, digits,
+                        original_length, decompressed_text ) :
+                    (1 == mode) ?
+                    decode_interleaved_digits( decoder, 1, original_length,
+                        &digit_count, one_stream, original_length, decompressed_text ) :
+                    decode_interleaved_digits( decoder, HUFFMAN_STREAMS, original_length,
+                        digit_counts, streams, original_length, decompressed_text );
+                assert( original_length == decompressed_length );
+            };
+            const double seconds =
+                (double)(clock() - start) / CLOCKS_PER_SEC;
+            mb_per_s[mode] = (seconds > 0) ?
+                (double)original_length * repeats / seconds / 1e6 : 0;
+            assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+        };
+        printf("# n=%d one stream: %7.1f MB/s; stream reader: %7.1f MB/s; %d streams: %7.1f MB/s\n",
+            n, mb_per_s[0], mb_per_s[1], HUFFMAN_STREAMS, mb_per_s[2] );
+    };
+}
+
+/*
+CRC32C against the standard check value,
+in pieces against all at once,
+then round-trip blocks with "\nC" blocks appended
+on the sample texts, binary data, a run of one byte, and an empty block,
+two checked blocks back to back,
+and make sure a damaged block, or a wrong length, is caught.
+*/
+void
+test_checksums( struct block_scratch * scratch ){
+    printf("# test_checksums ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+#if !defined( __SSE4_2__ )
+    for( int b=0; b<256; b++ ){
+        uint32_t c = b;
+        for( int bit=0; bit<8; bit++ ){
+            c = (c >> 1) ^ ((c & 1) ? CRC32C_POLYNOMIAL : 0);
+        };
+        assert( c == crc32c_table[0][b] );
+        for( int k=1; k<8; k++ ){
+            const uint32_t previous = crc32c_table[k-1][b];
+            assert( crc32c_table[k][b] ==
+                ((previous >> 8) ^ crc32c_table[0][ previous & 0xff ]) );
+        };
+    };
+#endif
+    assert( 0xE3069283 == crc32c( 9, "123456789" ) );
+    assert( 0 == crc32c( 0, "" ) );
+    const int sample_length = strlen( decoder_sample_text );
+    for( int split=0; split<=sample_length; split += 7 ){
+        const uint32_t first = crc32c( split, decoder_sample_text );
+        assert( crc32c( sample_length, decoder_sample_text ) ==
+            crc32c_update( first, sample_length - split,
+                (const unsigned char *)&decoder_sample_text[split] ) );
+    };
+    for( int k=-1; k<TEST_INPUTS; k++ ){
+        const int original_length = make_test_input( k, BLOCK_SIZE, original_text );
+        reset_block_scratch( scratch );
+        histogram( original_length, original_text,
+            MAX_LEAF_VALUE, scratch->symbol_frequencies );
+        huffman( &scratch->tree, MAX_LEAF_VALUE,
+            scratch->symbol_frequencies, 3, scratch->canonical_lengths );
+        int compressed_length = compress_with_streams( scratch,
+            NO_STATIC_TABLE, MAX_LEAF_VALUE, scratch->canonical_lengths, 3,
+            true, HUFFMAN_STREAMS,
+            original_length, original_text,
+            COMPRESSED_BLOCK_SIZE, compressed_text );
+        compressed_length = append_checksum_block( original_length, original_text,
+            compressed_length, COMPRESSED_BLOCK_SIZE, compressed_text );
+        const int decompressed_length = decompress( scratch,
+            compressed_length, compressed_text,
+            BLOCK_SIZE, decompressed_text );
+        assert( original_length == decompressed_length );
+        assert( 0 == memcmp( original_text, decompressed_text, original_length ) );
+    };
+
+    // two checked blocks: each "\nC" covers only its own block.
+    const int half = sample_length / 2;
+    int compressed_length = 0;
+    for( int part=0; part<2; part++ ){
+        const char * text = &decoder_sample_text[ part * half ];
+        const int length = part ? sample_length - half : half;
+        // pass-through raw data, so any damage decodes without complaint.
+        compressed_length += sprintf( &compressed_text[compressed_length],
+            "%d:\n\n%.*s,\n", length + 2, length, text );
+        compressed_length = append_checksum_block( length, text,
+            compressed_length, COMPRESSED_BLOCK_SIZE, compressed_text );
+    };
+    assert( sample_length == decompress( scratch,
+        compressed_length, compressed_text, BLOCK_SIZE, decompressed_text ) );
+    assert( 0 == memcmp( decoder_sample_text, decompressed_text, sample_length ) );
+
+    // damage one byte of the second raw block.
+    char * damaged = strstr( compressed_text, "\nC" );
+    assert( damaged );
+    damaged = strstr( damaged, ":\n\n" ) + 3 + 5;
+    *damaged ^= 0x20;
+    assert( -1 == decompress( scratch,
+        compressed_length, compressed_text, BLOCK_SIZE, decompressed_text ) );
+    *damaged ^= 0x20;
+
+    // a block that decodes to the wrong length.
+    char * covered = strstr( compressed_text, "\nC" ) + 2;
+    assert( '0' < *covered );
+    (*covered)--;
+    assert( -1 == decompress( scratch,
+        compressed_length, compressed_text, BLOCK_SIZE, decompressed_text ) );
+    (*covered)++;
+    printf("Successful test.\n");
+}
+
+/*
+Throughput of crc32c() against decompress(),
+to show what checking every block costs,
+on the sample texts (all run together) and a block of log lines.
+*/
+void
+benchmark_checksums( struct block_scratch * scratch ){
+    printf("# benchmark_checksums ...\n");
+    static char original_text[BLOCK_SIZE];
+    static char compressed_text[COMPRESSED_BLOCK_SIZE];
+    static char decompressed_text[BLOCK_SIZE];
+    const char * corpus_names[2] = {"samples", "log lines"};
+    const int repeats = 20;
+    for( int corpus=0; corpus<2; corpus++ ){
+        int original_length = 0;
+        if( 0 == corpus ){
+            original_length = make_sample_corpus( BLOCK_SIZE, original_text );
+        }else{
+            original_length = make_sample_log( BLOCK_SIZE, original_text );
+        };
+        reset_block_scratch( scratch );
+        histogram( original_length, original_text,
+            MAX_LEAF_VALUE, scratch->symbol_frequencies );
+        huffman( &scratch->tree, MAX_LEAF_VALUE,
+            scratch->symbol_frequencies, 3, scratch->canonical_lengths );
+        const int compressed_length = compress_with_streams( scratch,
+            NO_STATIC_TABLE, MAX_LEAF_VALUE, scratch->canonical_lengths, 3,
+            true, HUFFMAN_STREAMS,
+            original_length, original_text,
+            COMPRESSED_BLOCK_SIZE, compressed_text );
+        double start = seconds_now();
+        for( int i=0; i<repeats; i++ ){
+            const int decompressed_length = decompress( scratch,
+                compressed_length, compressed_text,
+                BLOCK_SIZE, decompressed_text );
+            assert( original_length == decompressed_length );
+        };
+        const double decompress_seconds = seconds_now() - start;
+        start = seconds_now();
+        uint32_t crc = 0;
+        for( int i=0; i<repeats; i++ ){
+            crc ^= crc32c( original_length, original_text );
+        };
+        const double crc_seconds = seconds_now() - start;
+        assert( 0 == crc ); // an even number of repeats
+        printf("# %s, %d bytes: decompress %7.2f MB/s, CRC32C %8.2f MB/s (%s), checking adds %4.1f%%\n",
+            corpus_names[corpus], original_length,
+            (double)original_length * repeats / decompress_seconds / 1e6,
+            (double)original_length * repeats / crc_seconds / 1e6,
+#if defined( __SSE4_2__ )
+            "SSE4.2",
+#else
+            "slicing-by-8",
+#endif
+            100 * crc_seconds / decompress_seconds );
+    };
+}
+
+/*
+The example in the comment before print_counts():
+frequencies 1, 1, 2, 2 give a binary tree of depth 2,
+and (merging the deepest node first) a tree of depth 3
+with exactly the same total length.
+*/
+void
+test_minimum_depth_ties( struct block_scratch * scratch ){
+    printf("# test_minimum_depth_ties ...\n");
+    int frequencies[MAX_LEAF_VALUE+1] = {0};
+    int lengths[MAX_LEAF_VALUE+1] = {0};
+    frequencies['a'] = 1;
+    frequencies['b'] = 1;
+    frequencies['c'] = 2;
+    frequencies['d'] = 2;
+    huffman( &scratch->tree, MAX_LEAF_VALUE, frequencies, 2, lengths );
+    for( int c='a'; c<='d'; c++ ){
+        assert( 2 == lengths[c] );
+    };
+    scratch->tree.ties = DEEPER_FIRST;
+    huffman( &scratch->tree, MAX_LEAF_VALUE, frequencies, 2, lengths );
+    scratch->tree.ties = SHALLOWER_FIRST;
+    assert( 3 == array_max( MAX_LEAF_VALUE+1, lengths ) );
+    assert( 1*3 + 1*3 + 2*2 + 2*1 == lengths['a'] + lengths['b'] + 2*lengths['c'] + 2*lengths['d'] );
+    // trinary: 1, 1, 1, 3, 3 -- the first merge (3) ties two leaves.
+    frequencies['a'] = 1;
+    frequencies['b'] = 1;
+    frequencies['c'] = 1;
+    frequencies['d'] = 3;
+    frequencies['e'] = 3;
+    huffman( &scratch->tree, MAX_LEAF_VALUE, frequencies, 3, lengths );
+    assert( 2 == array_max( MAX_LEAF_VALUE+1, lengths ) );
+    printf("Successful test.\n");
+}
 
+/*
+How breaking ties in count
+changes the longest code
+and the share of the text that decodes in one table lookup
+(a code no longer than the widest lookup table
+convert_lengths_to_decode_table() would build),
+merging the deepest, the oldest, or the shallowest node first,
+for each radix,
+on the sample texts (all run together), a block of log lines,
+a skewed block, and a block where every byte occurs
+1, 2, 3, or 4 times (so nearly every merge is a tie).
+*/
+void
+benchmark_tie_breaking( struct block_scratch * scratch ){
+    printf("# benchmark_tie_breaking ...\n");
+    static char original_text[BLOCK_SIZE];
+    const char * corpus_names[4] = {"samples", "log lines", "skewed", "ties"};
+    const int radixes[] = {2, 3, 4, 10};
+    const enum tie_break rules[3] = {DEEPER_FIRST, OLDEST_FIRST, SHALLOWER_FIRST};
+    for( int corpus=0; corpus<4; corpus++ ){
+        int original_length = 0;
+        if( 0 == corpus ){
+            original_length = make_sample_corpus( BLOCK_SIZE, original_text );
+        }else if( 1 == corpus ){
+            original_length = make_sample_log( BLOCK_SIZE, original_text );
+        }else if( 2 == corpus ){
+            original_length = make_skewed_text( BLOCK_SIZE, original_text );
+        }else{
+            for( int c=0; c<256; c++ ){
+                for( int i=0; i<=c%4; i++ ){
+                    original_text[original_length++] = c;
+                };
+            };
+        };
+        histogram( original_length, original_text,
+            MAX_LEAF_VALUE, scratch->symbol_frequencies );
+        for( int r=0; r<(int)NUM_ELEM(radixes); r++){
+            const int n = radixes[r];
+            int lookup_digits = 0;
+            for( int entries=n; entries<=MAX_LOOKUP_ENTRIES; entries *= n ){
+                lookup_digits++;
+            };
+            int longest[3] = {0};
+            long long total_digits[3] = {0};
+            double one_lookup[3] = {0};
+            for( int rule=0; rule<3; rule++ ){
+                scratch->tree.ties = rules[rule];
+                huffman( &scratch->tree, MAX_LEAF_VALUE,
+                    scratch->symbol_frequencies, n, scratch->canonical_lengths );
+                longest[rule] = array_max( MAX_LEAF_VALUE+1, scratch->canonical_lengths );
+                long long within_reach = 0;
+                for( int s=0; s<256; s++ ){
+                    const int length = scratch->canonical_lengths[s];
+                    total_digits[rule] += (long long)scratch->symbol_frequencies[s] * length;
+                    if( length <= lookup_digits ){
+                        within_reach += scratch->symbol_frequencies[s];
+                    };
+                };
+                one_lookup[rule] = (double)within_reach / original_length;
+            };
+            scratch->tree.ties = SHALLOWER_FIRST;
+            // every rule gives an optimal code.
+            assert( total_digits[0] == total_digits[1] );
+            assert( total_digits[1] == total_digits[2] );
+            printf("# %s, n=%d, deepest/oldest/shallowest first: "
+                "longest code %d/%d/%d digits; "
+                "one lookup (%d digits) %6.2f%%/%6.2f%%/%6.2f%% of symbols\n",
+                corpus_names[corpus], n,
+                longest[0], longest[1], longest[2], lookup_digits,
+                100 * one_lookup[0], 100 * one_lookup[1], 100 * one_lookup[2] );
+        };
+    };
 }
 
 void run_tests(void){
-    short_test_next_block();
+    // one scratch arena, reused by every test and every block.
+    struct block_scratch * scratch = new_block_scratch();
+    short_test_next_block( scratch );
     test_convert_lengths_to_encode_table();
     test_summarize_tree_with_lengths();
     test_setup_nodes();
-    test_next_block();
-    next_block();
+    test_canonical_decoder( scratch );
+    benchmark_canonical_decoders( scratch );
+    test_static_tables( scratch );
+    test_length_table_codecs( scratch );
+    test_binary_data( scratch );
+    test_lz77( scratch );
+    benchmark_lz77_levels( scratch );
+    test_context_tables( scratch );
+    benchmark_context_tables( scratch );
+    test_word_tokens( scratch );
+    benchmark_word_tokens( scratch );
+    test_tans( scratch );
+    benchmark_entropy_coders( scratch );
+    test_interleaved_streams( scratch );
+    benchmark_interleaved_streams( scratch );
+    test_checksums( scratch );
+    benchmark_checksums( scratch );
+    test_minimum_depth_ties( scratch );
+    benchmark_tie_breaking( scratch );
+    test_adaptive_huffman( scratch );
+    benchmark_adaptive_huffman( scratch );
+    benchmark_flush_intervals( scratch );
+    test_next_block( scratch );
+    while( next_block( scratch ) ){
+    };
+    free_block_scratch( scratch );
 }
 
 int main(void){
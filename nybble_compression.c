@@ -508,22 +508,57 @@ so we only have room for a few contexts, perhaps
 * the remaining bytes (symbols; tab, newline, other control characters)
 If our microcontroller has *very* little RAM,
 perhaps we allow this to be scalable to 2 or even only 1 context.
+(context_of_byte[] can put any bytes in any bin:
+see initialize_context_classes().)
 
 */
 #define COMPILE_TIME_ASSERT(pred) switch(0){case 0:case pred:;}
 
 #define letters_per_context (8)
 #define num_contexts (16)
-int byte_to_context( char byte ){
-    // "clever" code that assumes num_contexts is a power of 2.
-    int context = (byte>>3) bitand (num_contexts-1);
-    assert( context < num_contexts );
-    assert( 0 <= context );
-    return (context);
+
+/*
+The context of each possible previous byte.
+Picking a few bits out of the byte
+puts unrelated bytes in the same context
+(' ' with '!' ... "'"; 'a' ... 'g' with 'A' ... 'G'),
+so the compressor and the decompressor both look it up in this table,
+filled in with one of these layouts.
+The compressor writes which one into the header
+(see compress_bytestring()),
+and fills in the table from that;
+the decompressor fills it in from the header it reads.
+*/
+enum context_classes {
+    HIGH_BIT_CONTEXT_CLASSES = 0, // (byte >> 3) bitand 0xf
+    FIVE_CONTEXT_CLASSES = 1, // space, vowels, consonants, numbers, everything else
+};
+#define context_class_layouts (2)
+static unsigned char context_of_byte[256];
+
+void
+initialize_context_classes( int layout ){
+    assert( 0 <= layout );
+    assert( layout < context_class_layouts );
+    int byte = 0;
+    for( byte=0; byte<256; byte++ ){
+        int context = (byte >> 3) bitand (num_contexts-1);
+        if( FIVE_CONTEXT_CLASSES == layout ){
+            bool vowel = (0 != byte) and strchr( "aeiouAEIOU", byte );
+            bool number = isdigit( byte ) or ((0 != byte) and strchr( ".+-", byte ));
+            context = (' ' == byte) ? 0 :
+                vowel ? 1 :
+                isalpha( byte ) ? 2 :
+                number ? 3 : 4;
+        };
+        assert( context < num_contexts );
+        assert( 0 <= context );
+        context_of_byte[byte] = context;
+    };
 }
-char context_to_byte( int context ){
-    char byte = (context << 3);
-    return (byte);
+
+int byte_to_context( char byte ){
+    return context_of_byte[ (unsigned char)byte ];
 }
 /*
 If I used
@@ -699,17 +734,17 @@ debug_print_dictionary_contents(
     int context = 0;
     for( context=0; context<num_contexts; context++ ){
         int index = 0;
-        // picking only some bits
-        // as the context means that
-        // we don't know exactly the full byte context ...
-        // so print one letter that
-        // maps to this context.
-        // (probably the lowercase letters and space
-        // are more likely ...)
-        char lo_char = context_to_byte( context );
-        char hi_char = context_to_byte( context+1 ) - 1;
-        lo_char = isprint(lo_char) ? lo_char: '?';
-        hi_char = isprint(hi_char) ? hi_char: '?';
+        // many bytes map to each context,
+        // so print the first and last printable ones.
+        char lo_char = '?';
+        char hi_char = '?';
+        int byte = 0;
+        for( byte=0; byte<256; byte++ ){
+            if( (context == context_of_byte[byte]) and isprint( byte ) ){
+                lo_char = ('?' == lo_char) ? byte : lo_char;
+                hi_char = byte;
+            };
+        };
         printf( "%c..%c: ", lo_char, hi_char );
         for( index=0; index<letters_per_context; index++ ){
             printf( "%c", context_table.letter[context][index] );
@@ -728,6 +763,14 @@ Something like
    'Hello,': 'Hello,'
    '\x80': ' w'
 
+*/
+/*
+Format (NYBBLES):
+NYBBLES,
+the context class layout as a digit ('0' + layout,
+so the compressed text never has a 0x00 byte),
+the first byte unchanged,
+then the nybbles.
 */
 #define NYBBLES (0xAF) /* arbitrarily chosen */
 #define LITERAL (' ')  /* arbitrarily chosen */
@@ -742,6 +785,14 @@ decompress_bytestring(
     printf( "compressed_length: %zi.\n", compressed_length );
     int compression_type = (unsigned char)(source[0]);
     if( NYBBLES == compression_type ){
+        source++;
+        int layout = source[0] - '0';
+        if( (layout < 0) or (context_class_layouts <= layout) ){
+            printf("unknown context class layout?\n");
+            *dest_original = '\0';
+            return;
+        };
+        initialize_context_classes( layout );
         source++;
         context_table_type context_table;
         initialize_dictionary( &context_table );
@@ -888,12 +939,14 @@ void
 compress_bytestring(
     const char * source_original,
     char * dest_original,
-    bool modify
+    bool modify,
+    int layout
 ){
     const char * source = source_original;
     char * dest = dest_original;
     int compression_type = NYBBLES;
 
+    initialize_context_classes( layout );
     context_table_type context_table;
     initialize_dictionary( &context_table );
     printf("dictionary after first initialization:\n");
@@ -901,6 +954,7 @@ compress_bytestring(
     printf("compressing ...\n");
 
     *dest++ = compression_type;
+    *dest++ = '0' + layout;
     // first byte copied unchanged, in order to provide context
     *dest++ = *source++;
     printf( "%c%c;", source[-1], dest[-1] );
@@ -1131,9 +1185,17 @@ debug_print_nybbles( const char * source, int nybbles ){
     putchar( ')' );
 }
 
+void
+nybble_compress_with_context_classes(
+    const char * source_original, char * dest_original, int layout
+){
+    compress_bytestring( source_original, dest_original, true, layout );
+}
+
 void
 nybble_compress( const char * source_original, char * dest_original ){
-    compress_bytestring( source_original, dest_original, true );
+    nybble_compress_with_context_classes(
+        source_original, dest_original, HIGH_BIT_CONTEXT_CLASSES );
 }
 
 int main( void ){
@@ -1157,7 +1219,7 @@ int main( void ){
     printf("testing with [%s].\n", text );
 
     printf("quick test with compress_bytestring ...\n");
-    compress_bytestring( text, compressed_text, false );
+    compress_bytestring( text, compressed_text, false, HIGH_BIT_CONTEXT_CLASSES );
     print_as_c_string( compressed_text, strlen(compressed_text) );
     assert( strlen( compressed_text ) <= 70 );
     decompress_bytestring( compressed_text, decompressed_text, false );
@@ -1213,6 +1275,24 @@ int main( void ){
     }else{
         printf("Successful test.\n");
     };
+
+    printf("testing the five context classes ...\n");
+    size_t high_bit_length = strlen( compressed_text );
+    nybble_compress_with_context_classes( text, compressed_text, FIVE_CONTEXT_CLASSES );
+    // the decompressor gets the layout from the header,
+    // whatever the table was left holding.
+    initialize_context_classes( HIGH_BIT_CONTEXT_CLASSES );
+    nybble_decompress( compressed_text, decompressed_text );
+    printf("high-bit contexts: %zi bytes; five context classes: %zi bytes.\n",
+        high_bit_length, strlen( compressed_text ) );
+    if( memcmp( text, decompressed_text, text_length ) ){
+        printf("Error: decompressed text doesn't match original text.\n");
+        printf("[%s] original\n", text);
+        printf("[%s] decompressed\n", decompressed_text);
+        assert(0);
+    }else{
+        printf("Successful test.\n");
+    };
     printf("Done testing nybble_compression.");
 
     return 0;
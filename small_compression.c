@@ -25,18 +25,32 @@ consider using
 https://en.wikipedia.org/wiki/C_data_types#Fixed-width_integer_types
 */
 
+// for mmap() and friends (see load_dictionary_snapshot())
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h> // for malloc()
 #include <string.h>
 #include <stdbool.h> // for bool, true, false
+#include <stddef.h> // for offsetof()
 #include <iso646.h> // for bitand, bitor, not, xor, etc.
 #include <assert.h> // for assert()
 #include <ctype.h> // for isprint()
+#include <limits.h> // for UCHAR_MAX
+#include <time.h> // for clock()
+#include <math.h> // for log2()
+#include <fcntl.h> // for open()
+#include <sys/mman.h> // for mmap()
+#include <sys/stat.h> // for fstat()
+#include <unistd.h> // for close()
 
 enum algorithm {
     LITERAL = ' ',
     ISPRINT_IS_ALWAYS_LITERAL = 0x1f,
     COMPRESSED_TEXT_IS_PRINTABLE = '_',
     EIGHT_BIT_PRUNED = 8,
+    VARIABLE_WIDTH_PRUNED = 9,
+    PRETRAINED_VARIABLE_WIDTH = 10,
 };
 
 
@@ -66,6 +80,9 @@ so we only have room for a few contexts, perhaps
 * the remaining bytes (symbols; tab, newline, other control characters)
 If our microcontroller has *very* little RAM,
 perhaps we allow this to be scalable to 2 or even only 1 context.
+(The VARIABLE_WIDTH_PRUNED format does,
+with a table of which bytes go in which bin:
+see Context_layout_type.)
 
 */
 #define COMPILE_TIME_ASSERT(pred) switch(0){case 0:case pred:;}
@@ -93,6 +110,8 @@ http://c-faq.com/ansi/constasconst.html
 word_indexes = 256 lets each word be represented by a byte.
 FUTURE: experiment with word_indexes = 0x1000
 so each word can be represented by 12 bits, like GIF-variant LZW.
+(The byte-oriented dictionary does this:
+see VARIABLE_WIDTH_PRUNED and max_index_bits.)
 FUTURE: experiment with starting out with short 8-bit indexes
 and gradually expanding as necessary, like GIF-variant LZW.
 FUTURE:
@@ -104,6 +123,7 @@ that contains all the words in the dictionary,
 and this structure
 points to the first byte (nybble?)
 of that word in the buffer and its length.
+(Word_buffer_type, below, is that buffer.)
 ...
 Traditional LZW only makes words by adding letters to the end of the word,
 and the second-simplest form of pruning only deletes letters
@@ -116,25 +136,59 @@ A few pruning strategies:
 * after we use up the last index in some context,
 clear and re-initialize *just that context*
 (all other contexts continue filling up right where they left off)
+(RESET_PRUNING does this.)
 * after we use up the last index in some context,
 prune *all* the leaf words in that context to open up at least one empty slot,
 then start filling up the empty slots again.
+(LEAF_PRUNING does this,
+pruning only the leaf words that haven't been used since the last time,
+if there are any.)
 * Dictionary always full:
 use some cache algorithm -- perhaps the clock algorithm --
 to empty up one leaf word as needed.
+(choose_dictionary_slot() and choose_table_slot() do this;
+for the byte-oriented dictionary it's CLOCK_PRUNING.)
+The VARIABLE_WIDTH_PRUNED format lets the compressor pick one of these,
+or ADAPTIVE_PRUNING, which moves each context on to the next one
+whenever that context's hit rate drops.
 
 */
 typedef struct Word_in_byte_dictionary_type {
     int prefix_word_index;
     char last_letter;
-    bool leaf;
+    char first_letter; // so we never walk the chain just to find it
+    int length; // in bytes, so we can expand the word back to front
+    bool leaf; // no other word is built on this one
     bool recently_used;
-    // only used for debug performance monitoring
+    int children; // how many words are built on this one
+    // since the last time this context was pruned (see mark_word_used())
     int times_used_directly;
-    int times_used_indirectly;
+    int times_used_indirectly; // words built on this one were used
 } Word_in_byte_dictionary_type;
 
-#define dictionary_indexes (0x7f)
+/*
+In the EIGHT_BIT_PRUNED format every compressed index is one byte,
+so each context has only 0x7f words.
+In the VARIABLE_WIDTH_PRUNED format
+each context's dictionary keeps growing,
+and the indexes in that context grow one bit wider
+each time the dictionary doubles (like GIF-variant LZW),
+up to max_index_bits bits
+(or less, if the compressor asks for less).
+Every dictionary has room for that many words,
+the EIGHT_BIT_PRUNED format simply never uses most of them.
+*/
+#ifndef max_index_bits
+#define max_index_bits (12)
+#endif
+#define eight_bit_dictionary_indexes (0x7f)
+#define dictionary_indexes ((1 << max_index_bits) - 0x80)
+
+/*
+No word in the dictionary is longer than this
+(plus the one letter a word may add to it).
+*/
+#define max_word_length (0x7f)
 
 /*
 FUTURE:
@@ -168,29 +222,64 @@ with this pragma:
 */
 #pragma GCC diagnostic warning "-Wtype-limits"
 
+/*
+Put a slot in the state it starts out in:
+slots 0 ... 0x7e hold the two-byte words " \x01" ... " \x7f";
+the slots past those are empty.
+*/
+void
+initialize_dictionary_word(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context, int index
+){
+    // pure byte-oriented -- big-endian or little-endian is irrelevant.
+    // apparently we never use these escape codes when
+    // the plain text is normal 7-bit ASCII text.
+    #define escape_code(x) ( 0x1f == ((x) bitor 0xf) )
+    dictionary[context][index].prefix_word_index = ' ';
+    char letter = index bitand 0x7f;
+    if( 0 == letter ){ letter = 'x'; }; // TODO: remove after debugging.
+    assert( letter < 0x80 );
+    assert( 0 < letter );
+    dictionary[context][index].last_letter = letter;
+    dictionary[context][index].first_letter = ' ';
+    // the words past the 8-bit ones don't exist yet.
+    dictionary[context][index].length =
+        (index < eight_bit_dictionary_indexes) ? 2 : 0;
+    dictionary[context][index].leaf = true;
+    dictionary[context][index].recently_used = false;
+    dictionary[context][index].children = 0;
+    dictionary[context][index].times_used_directly = 0;
+    dictionary[context][index].times_used_indirectly = 0;
+}
+
+/*
+Give one context the words it starts with.
+Only the first eight_bit_dictionary_indexes slots:
+the rest are never looked at
+until choose_dictionary_slot() hands them out
+(and initializes them),
+so starting a context doesn't cost
+anything like dictionary_indexes slots' worth of time.
+*/
+void
+initialize_context_dictionary(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context
+){
+    int index=0;
+    for( index=0; index<eight_bit_dictionary_indexes; index++ ){
+        initialize_dictionary_word( dictionary, context, index );
+    };
+}
+
 void initialize_dictionary(
     Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
     int next_word_index[num_contexts]
 ){
     int context=0;
     for( context=0; context<num_contexts; context++ ){
-        int index=0;
-        for( index=0; index<dictionary_indexes; index++ ){
-            // pure byte-oriented -- big-endian or little-endian is irrelevant.
-            // apparently we never use these escape codes when
-            // the plain text is normal 7-bit ASCII text.
-            #define escape_code(x) ( 0x1f == ((x) bitor 0xf) )
-            dictionary[context][index].prefix_word_index = ' ';
-            char letter = index;
-            if( 0 == letter ){ letter = 'x'; }; // TODO: remove after debugging.
-            assert( letter < 0x80 );
-            assert( 0 < letter );
-            dictionary[context][index].last_letter = letter;
-            dictionary[context][index].leaf = true;
-            dictionary[context][index].recently_used = false;
-            dictionary[context][index].times_used_directly = 0;
-            dictionary[context][index].times_used_indirectly = 0;
-        };
+        initialize_context_dictionary( dictionary, context );
         next_word_index[ context ] = 0;
     };
 }
@@ -274,48 +363,43 @@ void print_as_c_string( const char * s, int length ){
     printf( " /* %i bytes. */\n", length );
 }
 
-// returns the number of bytes written to dest.
+/*
+returns the number of bytes written to dest.
+Every word knows its own length,
+so we write it directly into dest from the last byte back to the first,
+with no recursion and no temporary reversed copy.
+*/
 int decompress_byte_index(
     Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
     const int context, int index, char * dest
 ){
-    char reversed_word[128];
-    int i=0;
     assert( 0x00 != index );
-
-    while( index bitand 0x80 ){
-        int prefix_index = dictionary[context][index - 0x80].prefix_word_index;
-        if( 0x80 <= prefix_index ){
-            assert( !dictionary[context][prefix_index-0x80].leaf );
-        };
-        char letter = dictionary[context][index - 0x80].last_letter;
+    if( index < 0x80 ){
+        // a literal byte represents itself.
+        *dest = index;
+        return 1;
+    };
+    const int bytes_written = dictionary[context][index - 0x80].length;
+    assert( bytes_written <= max_word_length + 1 );
+    int i = bytes_written;
+    while( 0x80 <= index ){
+        const Word_in_byte_dictionary_type * word = &dictionary[context][index - 0x80];
+        char letter = word->last_letter;
         assert( letter < 0x80 );
         if( letter <= 0 ){
             printf("context: 0x%x, index: 0x%x", context, index);
             printf("letter: 0x%x\n", letter);
         };
         assert( 0 < letter );
-        reversed_word[i++] = letter;
-        index = prefix_index;
-    };
-    assert( !(index bitand 0x80) );
-    reversed_word[i++] = index;
-    // This if() supports hi-bit-set and 0x00 bytes in the plaintext.
-    // It may not be necessary if those bytes never occur in the plaintext.
-    if( 0x00 == index ){
-        printf( "test: special case: dictionary chain ends with 0x00.\n" );
-        i--;
-    };
-    const int bytes_written = i;
-    while( i ){
-        char letter = reversed_word[--i];
-        // FIXME: remove this assert when plaintext includes hi-bit-set bytes.
-        assert( letter < 0x80 );
-        assert( 0 < letter );
-        *dest = letter;
-        dest++;
+        dest[--i] = letter;
+        index = word->prefix_word_index;
+        if( 0x80 <= index ){
+            assert( !dictionary[context][index-0x80].leaf );
+        };
     };
-
+    assert( 1 == i );
+    assert( 0 < index );
+    dest[0] = index;
     return bytes_written;
 }
 
@@ -367,304 +451,2168 @@ debug_print_dictionary_contents(
     int context = 0;
     for( context=0; context<num_contexts; context++ ){
         int index = 0;
-        for( index=0x80; index<(0x80+dictionary_indexes); index++ ){
+        for( index=0x80; index<(0x80+eight_bit_dictionary_indexes); index++ ){
             debug_print_dictionary_entry( dictionary, context, index );
         };
     };
 }
 
 void
-increment_dictionary_index( int context, int next_word_index[num_contexts] ){
-    // FIXME: loop until we hit a leaf node.
+increment_dictionary_index( int context, int next_word_index[num_contexts], int slots ){
     int i = next_word_index[context] + 1;
-    if( dictionary_indexes <= i ){
+    if( slots <= i ){
         i = 0;
     };
     next_word_index[context] = i;
 }
+
+/*
+The VARIABLE_WIDTH_PRUNED format lets the compressor pick
+what each context does once it has used up its last index
+(the pruning strategies listed above Word_in_byte_dictionary_type).
+Whatever the policy,
+a context fills its empty slots first,
+then grows (one new slot per new word) until it has "slots" words,
+and only then prunes.
+*/
+enum pruning_policy {
+    CLOCK_PRUNING = 0, // always full: replace one leaf word at a time
+    LEAF_PRUNING = 1, // empty the leaf words that haven't been used, then fill those
+    RESET_PRUNING = 2, // start the context over with its first 0x7f words
+    ADAPTIVE_PRUNING = 3, // move on to the next policy whenever the hit rate drops
+};
+#define pruning_policies (4)
+
+/*
+ADAPTIVE_PRUNING measures each context's hit rate
+(how many bytes each index stands for)
+over this many indexes at a time.
+*/
+#define pruning_window (256)
+
+typedef struct Context_pruning_type {
+    int policy; // never ADAPTIVE_PRUNING; see "adaptive".
+    bool adaptive;
+    int words; // slots 0 ... words-1 have been handed out
+    int empty; // how many of those are empty again
+    int prunings; // how many times this context has been pruned or reset
+    int indexes; // in the current window
+    int bytes; // that those indexes stood for
+    int previous_rate; // 16 * bytes per index in the previous window
+} Context_pruning_type;
+
+void
+initialize_context_pruning( Context_pruning_type * pruning, int policy ){
+    assert( 0 <= policy );
+    assert( policy < pruning_policies );
+    pruning->adaptive = (ADAPTIVE_PRUNING == policy);
+    pruning->policy = pruning->adaptive ? CLOCK_PRUNING : policy;
+    pruning->words = eight_bit_dictionary_indexes;
+    pruning->empty = 0;
+    pruning->prunings = 0;
+    pruning->indexes = 0;
+    pruning->bytes = 0;
+    pruning->previous_rate = 0;
+}
+
+/*
+Both the compressor and the decompressor call this
+after every index,
+so ADAPTIVE_PRUNING changes policy at exactly the same index on both sides.
+*/
+void
+note_index( Context_pruning_type * pruning, int bytes ){
+    pruning->indexes++;
+    pruning->bytes += bytes;
+    if( pruning->indexes < pruning_window ){
+        return;
+    };
+    int rate = 16 * pruning->bytes / pruning->indexes;
+    // dropped by more than an eighth: whatever we're doing isn't working.
+    if( pruning->adaptive and (8 * rate < 7 * pruning->previous_rate) ){
+        pruning->policy = (CLOCK_PRUNING == pruning->policy) ? LEAF_PRUNING :
+            (LEAF_PRUNING == pruning->policy) ? RESET_PRUNING : CLOCK_PRUNING;
+    };
+    pruning->previous_rate = rate;
+    pruning->indexes = 0;
+    pruning->bytes = 0;
+}
+
+// Take a leaf word out of the dictionary, leaving its slot empty.
+void
+empty_dictionary_word(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context, int slot
+){
+    Word_in_byte_dictionary_type * word = &dictionary[context][slot];
+    assert( word->leaf );
+    assert( 0 < word->length );
+    int prefix_index = word->prefix_word_index;
+    if( prefix_index >= 0x80 ){
+        Word_in_byte_dictionary_type * prefix = &dictionary[context][prefix_index - 0x80];
+        assert( 0 < prefix->children );
+        prefix->children--;
+        prefix->leaf = (0 == prefix->children);
+    };
+    word->prefix_word_index = ' ';
+    word->first_letter = ' ';
+    word->length = 0;
+    word->recently_used = false;
+}
+
+/*
+Empty every leaf word in the first "words" slots of the context
+that hasn't been used since the last pruning
+and whose prefix has no other words built on it that have been used
+(a leaf on a branch the text keeps following
+is likely to be needed soon)
+-- or, if that spares every leaf word, every leaf word --
+except the word the new word will be built on.
+Emptying a word may turn its prefix into a leaf,
+but that prefix waits for the next pruning.
+Returns how many slots it emptied.
+*/
+int
+prune_leaf_words(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int words, int context, int prefix_index
+){
+    int leaves[dictionary_indexes];
+    int count = 0;
+    int pass = 0;
+    for( pass=0; (pass < 2) and (0 == count); pass++ ){
+        int slot = 0;
+        for( slot=0; slot<words; slot++ ){
+            Word_in_byte_dictionary_type * word = &dictionary[context][slot];
+            int prefix = word->prefix_word_index;
+            bool hot_branch = (0x80 <= prefix) and
+                (0 < dictionary[context][prefix - 0x80].times_used_indirectly);
+            if( word->leaf and (0 < word->length) and
+                (prefix_index != slot + 0x80) and
+                (((0 == word->times_used_directly) and !hot_branch) or (1 == pass))
+            ){
+                leaves[count++] = slot;
+            };
+        };
+    };
+    int i = 0;
+    for( i=0; i<count; i++ ){
+        empty_dictionary_word( dictionary, context, leaves[i] );
+    };
+    int slot = 0;
+    for( slot=0; slot<words; slot++ ){
+        dictionary[context][slot].times_used_directly = 0;
+        dictionary[context][slot].times_used_indirectly = 0;
+    };
+    return count;
+}
+
+/*
+Pick the slot for the next new word in this context.
+When the context has no empty slot
+(and cannot grow),
+this is the clock (second-chance) algorithm:
+next_word_index[context] is the clock hand.
+Only leaf words (no other word is built on them) are replaced,
+so replacing a word never changes what any other word means,
+and the prefix chains never loop back on themselves.
+The word the new word is built on is never replaced, either.
+A leaf word that has been used since the hand last passed it
+(see mark_word_used())
+loses its recently_used bit and is passed over this time;
+so the hand goes around at most twice.
+Only the first "slots" slots are used
+(eight_bit_dictionary_indexes for the EIGHT_BIT_PRUNED format).
+
+With pruning (the VARIABLE_WIDTH_PRUNED format),
+empty slots are filled first,
+then new slots are handed out in order,
+and each time the hand comes back around to slot 0
+LEAF_PRUNING empties the unused leaf words (and fills those instead)
+and RESET_PRUNING starts the context over.
+Without pruning (NULL), the context is always full.
+
+Returns the slot (0 ... slots-1),
+or -1 if the new word would be too long
+or there is no slot to put it in.
+The compressor and the decompressor make exactly the same choices.
+*/
+int
+choose_dictionary_slot(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int next_word_index[num_contexts], int slots,
+    Context_pruning_type * pruning,
+    int context, int prefix_index, int prefix_length
+){
+    assert( slots <= dictionary_indexes );
+    if( max_word_length <= prefix_length ){
+        return -1;
+    };
+    int tries = 0;
+    for( tries=0; tries<2*slots+2; tries++ ){
+        if( pruning and (0 < pruning->empty) ){
+            int start = next_word_index[context];
+            int i = 0;
+            for( i=0; i<pruning->words; i++ ){
+                int slot = (start + i) % pruning->words;
+                if( 0 == dictionary[context][slot].length ){
+                    pruning->empty--;
+                    next_word_index[context] = slot + 1;
+                    return slot;
+                };
+            };
+            assert( false ); // "empty" is out of step with the dictionary
+        };
+        if( pruning and (pruning->words < slots) ){
+            initialize_dictionary_word( dictionary, context, pruning->words );
+            next_word_index[context] = pruning->words + 1;
+            return pruning->words++;
+        };
+        if( slots <= next_word_index[context] ){
+            next_word_index[context] = 0;
+            if( pruning and (LEAF_PRUNING == pruning->policy) ){
+                pruning->prunings++;
+                pruning->empty += prune_leaf_words(
+                    dictionary, pruning->words, context, prefix_index );
+                continue;
+            };
+            if( pruning and (RESET_PRUNING == pruning->policy) ){
+                pruning->prunings++;
+                initialize_context_dictionary( dictionary, context );
+                pruning->words = eight_bit_dictionary_indexes;
+                pruning->empty = 0;
+                if( 0x80 <= prefix_index ){
+                    // the word the new word would be built on is gone.
+                    return -1;
+                };
+                continue;
+            };
+        };
+        int slot = next_word_index[context]++;
+        Word_in_byte_dictionary_type * word = &dictionary[context][slot];
+        if( !word->leaf or (prefix_index == slot + 0x80) ){
+            continue;
+        };
+        if( word->recently_used ){
+            // second chance
+            word->recently_used = false;
+            continue;
+        };
+        return slot;
+    };
+    return -1;
+}
+
+/*
+The compressor and the decompressor
+both call this for every index in the compressed text,
+right after choosing the slot for the word before it,
+so they both give the same words a second chance
+(and LEAF_PRUNING spares the same words).
+*/
+void
+mark_word_used(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context, int index
+){
+    if( 0x80 <= index ){
+        Word_in_byte_dictionary_type * word = &dictionary[context][index - 0x80];
+        word->recently_used = true;
+        word->times_used_directly++;
+        if( 0x80 <= word->prefix_word_index ){
+            dictionary[context][word->prefix_word_index - 0x80].times_used_indirectly++;
+        };
+    };
+}
+
+/*
+Replace the word in the given slot
+with the word prefix_index + letter,
+keeping track of which words are leaves.
+*/
+void
+store_dictionary_word(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context, int slot, int prefix_index, int letter
+){
+    Word_in_byte_dictionary_type * word = &dictionary[context][slot];
+    assert( word->leaf );
+    int old_prefix_index = word->prefix_word_index;
+    if( old_prefix_index >= 0x80 ){
+        Word_in_byte_dictionary_type * old_prefix = &dictionary[context][old_prefix_index - 0x80];
+        assert( 0 < old_prefix->children );
+        old_prefix->children--;
+        old_prefix->leaf = (0 == old_prefix->children);
+    };
+    word->prefix_word_index = prefix_index;
+    word->last_letter = letter;
+    word->recently_used = false;
+    if( prefix_index >= 0x80 ){
+        Word_in_byte_dictionary_type * prefix = &dictionary[context][prefix_index - 0x80];
+        word->first_letter = prefix->first_letter;
+        word->length = prefix->length + 1;
+        prefix->children++;
+        prefix->leaf = false;
+    }else{
+        word->first_letter = prefix_index;
+        word->length = 2;
+    };
+}
+
+// a literal byte is its own first byte.
+int
+first_byte_of_word(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context, int index
+){
+    if( 0x80 <= index ){
+        return (unsigned char)dictionary[context][index - 0x80].first_letter;
+    };
+    return index;
+}
+
+/*
+The last letter of the new word going into slot tochange:
+the first byte of the next word.
+*/
+int
+first_byte_of_new_word(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context, int tochange, int index, int next_context, int next_index
+){
+    int first_byte_of_next_word = 0xff;
+    bool special_case = (tochange + 0x80 == next_index) and (context == next_context);
+    if( !special_case ){
+        // normal case
+        first_byte_of_next_word = first_byte_of_word( dictionary, next_context, next_index );
+    }else{
+        // handle the "special case" LZW exception,
+        // as mentioned by
+        // http://michael.dipperstein.com/lzw/#example3
+        // https://www.cs.duke.edu/csed/curious/compression/lzw.html#decompression
+        // https://en.wikipedia.org/wiki/Lempel%E2%80%93Ziv%E2%80%93Welch#Decoding_2
+        // http://www.perlmonks.org/?node_id=270016
+        // http://stackoverflow.com/questions/10450395/lzw-decompression-algorithm
+        // etc.
+        // The next word is the very word we are adding now,
+        // so its first byte is the first byte of *this* word.
+        first_byte_of_next_word = first_byte_of_word( dictionary, context, index );
+    };
+    assert( first_byte_of_next_word < 0x80 );
+    return first_byte_of_next_word;
+}
+
+/*
+compress_bytestring() and the decompress_bytestring() decoders
+print what they are doing as they go,
+unless this is turned off (see benchmark_byte_decoders()).
+*/
+static bool bytestring_debug_output = true;
+
 /*
 Given the context and index of 2 consecutive indexes
-in the compressed text.
+in the compressed text
+(and how many bytes the first one decompressed to),
+add the word they imply to the dictionary:
+the first word, plus the first byte of the second word,
+in the context the first word was looked up in.
+We assume that the compressor
+*would* have used *that* word if it had been available,
+so clearly that word is *not* already in the dictionary.
+Returns the slot the new word went into,
+or -1 if there was no room for it.
+*/
+int
+update_dictionary(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int next_word_index[num_contexts],
+    int context, int index, int length, int next_context, int next_index
+){
+    int tochange = choose_dictionary_slot(
+        dictionary, next_word_index, eight_bit_dictionary_indexes, NULL,
+        context, index, length );
+    if( tochange < 0 ){
+        if( bytestring_debug_output ){
+            printf("(no room for a new word)\n");
+        };
+        return -1;
+    };
+    if( bytestring_debug_output and
+        (tochange + 0x80 == next_index) and (context == next_context)
+    ){
+        printf("(... handling LZW special case ...)\n");
+    };
+    unsigned char first_byte_of_next_word = first_byte_of_new_word(
+        dictionary, context, tochange, index, next_context, next_index );
+    if( bytestring_debug_output ){
+        printf("context: %c, index: 0x%x, last_letter: %c.\n", (char)('@'+context), index, first_byte_of_next_word);
+    };
+    store_dictionary_word( dictionary, context, tochange, index, first_byte_of_next_word );
+    return tochange;
+}
+
+/*
+Word buffer:
+the "store the words more directly" alternative
+from the FUTURE note above Word_in_byte_dictionary_type.
+All the words of one context live end to end in one buffer;
+each slot only remembers where its word starts and how long it is,
+so expanding a word is a single memcpy()
+rather than a walk down its prefix chain.
+Words that share letters may share them in the buffer:
+a word built by adding a letter to the end of the word
+that ends where the buffer's used space ends
+(or a letter to the front of the word
+that starts where the used space starts)
+costs only that one letter.
+Pruning a letter from either end of a word costs nothing at all.
+Space no word uses any more is reclaimed
+only when the buffer runs out of room
+(see word_buffer_compact()).
+The letters are bytes for the byte-oriented dictionary,
+and one nybble per byte for the nybble-oriented table.
+A slot with start -1 has no word in the buffer
+(perhaps because the buffer had no room for it);
+the decoders then fall back to the prefix chain,
+so the buffer never changes what the compressed text means.
+Once the clock starts replacing words,
+the live words of a context (most of them not sharing letters)
+fill more than 512 bytes,
+and a buffer that small compacts on almost every new word
+(see benchmark_byte_decoders()).
+*/
+#define word_buffer_size (2048)
+#define word_buffer_slots (word_indexes)
+
+typedef struct Word_buffer_type {
+    char letters[word_buffer_size];
+    // letters[first ... used-1] hold words; the space on either side is free.
+    short first;
+    short used;
+    short start[word_buffer_slots]; // -1: this slot's word isn't in the buffer
+    unsigned char length[word_buffer_slots];
+} Word_buffer_type;
+
+void
+initialize_word_buffer( Word_buffer_type words[num_contexts] ){
+    int context = 0;
+    for( context=0; context<num_contexts; context++ ){
+        // leave some room in front for prepending.
+        words[context].first = word_buffer_size / 4;
+        words[context].used = word_buffer_size / 4;
+        int slot = 0;
+        for( slot=0; slot<word_buffer_slots; slot++ ){
+            words[context].start[slot] = -1;
+            words[context].length[slot] = 0;
+        };
+    };
+}
+
+// returns the letters of the word, or NULL if it isn't in the buffer.
+const char *
+word_buffer_letters( const Word_buffer_type * words, int slot ){
+    assert( ((unsigned)slot) < word_buffer_slots );
+    if( words->start[slot] < 0 ){
+        return NULL;
+    };
+    return &words->letters[ words->start[slot] ];
+}
+
+void
+word_buffer_forget( Word_buffer_type * words, int slot ){
+    assert( ((unsigned)slot) < word_buffer_slots );
+    words->start[slot] = -1;
+    words->length[slot] = 0;
+}
+
+/*
+Squeeze out the letters no word uses any more,
+keeping letters that several words share shared.
+Afterwards
+a quarter of the free space is in front of the words,
+the rest after them.
+*/
+void
+word_buffer_compact( Word_buffer_type * words ){
+    // the words that are in the buffer, in order of where they start.
+    unsigned char order[word_buffer_slots];
+    int live = 0;
+    int slot = 0;
+    for( slot=0; slot<word_buffer_slots; slot++ ){
+        if( words->start[slot] < 0 ){
+            continue;
+        };
+        int i = live++;
+        while( (0 < i) and (words->start[ order[i-1] ] > words->start[slot]) ){
+            order[i] = order[i-1];
+            i--;
+        };
+        order[i] = slot;
+    };
+    char packed[word_buffer_size];
+    int packed_length = 0;
+    int old_end = -1; // end of the run of overlapping words so far
+    int run_start = 0; // where that run started, before and after packing
+    int packed_run_start = 0;
+    int i = 0;
+    for( i=0; i<live; i++ ){
+        slot = order[i];
+        int start = words->start[slot];
+        int end = start + words->length[slot];
+        if( old_end <= start ){
+            // nothing shared with the previous words
+            run_start = start;
+            packed_run_start = packed_length;
+            old_end = start;
+        };
+        if( old_end < end ){
+            memcpy( &packed[packed_length], &words->letters[old_end], end - old_end );
+            packed_length += end - old_end;
+            old_end = end;
+        };
+        words->start[slot] = packed_run_start + (start - run_start);
+    };
+    int first = (word_buffer_size - packed_length) / 4;
+    memcpy( &words->letters[first], packed, packed_length );
+    for( i=0; i<live; i++ ){
+        words->start[ order[i] ] += first;
+    };
+    words->first = first;
+    words->used = first + packed_length;
+}
+
+/*
+Put a copy of the given letters in the buffer as the word in slot.
+Returns false (and forgets the slot's word)
+if even after compacting there isn't room.
+*/
+bool
+word_buffer_store( Word_buffer_type * words, int slot, const char * letters, int length ){
+    word_buffer_forget( words, slot );
+    if( (UCHAR_MAX < length) or (word_buffer_size < length) ){
+        return false;
+    };
+    if( word_buffer_size < words->used + length ){
+        word_buffer_compact( words );
+        if( word_buffer_size < words->used + length ){
+            return false;
+        };
+    };
+    memcpy( &words->letters[ words->used ], letters, length );
+    words->start[slot] = words->used;
+    words->length[slot] = length;
+    words->used += length;
+    return true;
+}
+
+/*
+The word in slot becomes the word in prefix_slot
+with one more letter on the end
+(slot and prefix_slot may be the same slot).
+*/
+bool
+word_buffer_append( Word_buffer_type * words, int slot, int prefix_slot, char letter ){
+    const char * prefix = word_buffer_letters( words, prefix_slot );
+    int length = words->length[prefix_slot];
+    if( NULL == prefix ){
+        word_buffer_forget( words, slot );
+        return false;
+    };
+    if( (words->start[prefix_slot] + length == words->used) and
+        (words->used < word_buffer_size) and (length < UCHAR_MAX)
+    ){
+        // The prefix is the last thing in the buffer:
+        // just add the letter after it.
+        int start = words->start[prefix_slot];
+        words->letters[ words->used++ ] = letter;
+        words->start[slot] = start;
+        words->length[slot] = length + 1;
+        return true;
+    };
+    char word[UCHAR_MAX + 1];
+    memcpy( word, prefix, length );
+    word[length] = letter;
+    return word_buffer_store( words, slot, word, length + 1 );
+}
+
+/*
+The word in slot becomes one letter
+followed by the word in suffix_slot
+(slot and suffix_slot may be the same slot).
+*/
+bool
+word_buffer_prepend( Word_buffer_type * words, int slot, char letter, int suffix_slot ){
+    const char * suffix = word_buffer_letters( words, suffix_slot );
+    int length = words->length[suffix_slot];
+    if( NULL == suffix ){
+        word_buffer_forget( words, slot );
+        return false;
+    };
+    if( (words->start[suffix_slot] == words->first) and
+        (0 < words->first) and (length < UCHAR_MAX)
+    ){
+        // The suffix is the first thing in the buffer:
+        // just add the letter before it.
+        words->letters[ --words->first ] = letter;
+        words->start[slot] = words->first;
+        words->length[slot] = length + 1;
+        return true;
+    };
+    char word[UCHAR_MAX + 1];
+    word[0] = letter;
+    memcpy( &word[1], suffix, length );
+    return word_buffer_store( words, slot, word, length + 1 );
+}
+
+// Drop the first letter of the word in slot.
+void
+word_buffer_prune_front( Word_buffer_type * words, int slot ){
+    assert( 0 <= words->start[slot] );
+    assert( 0 < words->length[slot] );
+    words->start[slot]++;
+    words->length[slot]--;
+}
+
+// Drop the last letter of the word in slot.
+void
+word_buffer_prune_back( Word_buffer_type * words, int slot ){
+    assert( 0 <= words->start[slot] );
+    assert( 0 < words->length[slot] );
+    words->length[slot]--;
+}
+
+/*
+Start the word buffer out with
+exactly the words initialize_dictionary() starts with.
+*/
+void
+initialize_word_buffer_from_dictionary(
+    Word_buffer_type words[num_contexts],
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes]
+){
+    initialize_word_buffer( words );
+    int context = 0;
+    for( context=0; context<num_contexts; context++ ){
+        int slot = 0;
+        for( slot=0; slot<eight_bit_dictionary_indexes; slot++ ){
+            char word[max_word_length + 1];
+            int bytes = decompress_byte_index( dictionary, context, slot + 0x80, word );
+            bool stored = word_buffer_store( &words[context], slot, word, bytes );
+            assert( stored );
+        };
+    };
+}
+
+/*
+Decode one index using the word buffer if the word is there,
+falling back to the prefix chain if it isn't.
+*/
+int
+decompress_byte_index_from_word_buffer(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    Word_buffer_type words[num_contexts],
+    const int context, int index, char * dest
+){
+    if( index bitand 0x80 ){
+        const char * word = word_buffer_letters( &words[context], index - 0x80 );
+        if( word ){
+            int bytes = words[context].length[index - 0x80];
+            memcpy( dest, word, bytes );
+            return bytes;
+        };
+    };
+    return decompress_byte_index( dictionary, context, index, dest );
+}
+
+/*
+Keep the word buffer in step with the dictionary:
+the new word in slot is the previous word
+(which the decoder has just written out,
+at previous_text)
+plus one more letter.
+*/
+void
+update_word_buffer(
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    Word_buffer_type words[num_contexts],
+    int context, int slot,
+    int previous_index, const char * previous_text, int previous_length
+){
+    Word_buffer_type * buffer = &words[context];
+    char letter = dictionary[context][slot].last_letter;
+    if( (previous_index bitand 0x80) and
+        word_buffer_letters( buffer, previous_index - 0x80 )
+    ){
+        word_buffer_append( buffer, slot, previous_index - 0x80, letter );
+    }else if( word_buffer_store( buffer, slot, previous_text, previous_length ) ){
+        word_buffer_append( buffer, slot, slot, letter );
+    };
+}
+
+/*
+exhaustively commented version:
+While decompressing, print
+compressed byte on the left, the "word" of decompressed text decoded from it on the right.
+(Optional: bundle up consecutive literals all on one line, rather than one per line).
+Something like
+
+   'Hello,': 'Hello,'
+   '\x80': ' w'
+
+*/
+/*
+If words is NULL, words are expanded by walking the dictionary's prefix chains;
+otherwise they are copied out of the word buffer.
+Either way the decompressed text is the same.
+*/
+void decompress_bytestring_using(
+    const char * source, char * dest_original,
+    Word_buffer_type words[num_contexts]
+){
+    char * dest = dest_original;
+    size_t compressed_length = strlen( source );
+    if( bytestring_debug_output ){
+        printf( "compressed_length: %zi.\n", compressed_length );
+    };
+    int compression_type = *source++;
+    if( EIGHT_BIT_PRUNED == compression_type ){
+        int next_word_index[num_contexts] = {0};
+        static Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes];
+        initialize_dictionary( dictionary, next_word_index );
+        if( words ){
+            initialize_word_buffer_from_dictionary( words, dictionary );
+        };
+        if( bytestring_debug_output ){
+            printf("dictionary after first initialization:\n");
+            debug_print_dictionary_contents(dictionary);
+        };
+        // first byte copied unchanged, in order to provide context
+        int previous_index = (unsigned char)source[0];
+        int previous_length = 1;
+        if( bytestring_debug_output ){
+            printf( "'%c': (%c)", source[0], source[0] );
+        };
+        *dest++ = *source++;
+        // as if the text started after a space.
+        int previous_context = byte_to_context( ' ' );
+        while( *source ){
+            int index = (unsigned char)*source++;
+            // context is the most recent byte
+            int context = byte_to_context( (unsigned char)dest[-1] );
+            /* Add a word to the dictionary:
+               the previous word,
+               and the first byte of the next word.
+               Add entry just before decompressing it,
+               to handle the LZW special case.
+            */
+            int tochange = update_dictionary( dictionary, next_word_index,
+                previous_context, previous_index, previous_length, context, index );
+            int bytes = 0;
+            if( words ){
+                if( 0 <= tochange ){
+                    update_word_buffer( dictionary, words, previous_context, tochange,
+                        previous_index, dest - previous_length, previous_length );
+                };
+                bytes = decompress_byte_index_from_word_buffer(
+                    dictionary, words, context, index, dest );
+            }else{
+                bytes = decompress_byte_index( dictionary, context, index, dest );
+            };
+            mark_word_used( dictionary, context, index );
+            if( bytestring_debug_output ){
+                print_as_c_literal( source - 1, 1 );
+                printf(": ");
+                print_as_c_literal(dest, bytes);
+                putchar('\n');
+            };
+            assert( 1 <= bytes );
+            
+            dest += bytes;
+            previous_context = context;
+            previous_index = index;
+            previous_length = bytes;
+        };
+        if( bytestring_debug_output ){
+            debug_print_dictionary_contents(dictionary);
+        };
+    }else if( LITERAL == compression_type ){
+        while( *source ){ // assume null-terminated string -- is this wise?
+            *dest++ = *source++;
+        };
+    }else{
+        printf("invalid compressed data");
+    };
+    *dest = '\0'; // null termination.
+    size_t decompressed_length = strlen( dest_original ); // assume null-terminated -- wise?
+    if( bytestring_debug_output ){
+        printf( "decompressed_length: %zi.\n", decompressed_length );
+    };
+}
+
+void decompress_bytestring( const char * source, char * dest_original ){
+    decompress_bytestring_using( source, dest_original, NULL );
+}
+
+void decompress_bytestring_from_word_buffer( const char * source, char * dest_original ){
+    Word_buffer_type words[num_contexts];
+    decompress_bytestring_using( source, dest_original, words );
+}
+
+/*
+Compact trie:
+the compressor's view of the dictionary.
+Given the index of some word (a prefix)
+and the next letter (a byte, or a nybble),
+find the index of the longer word, if the dictionary has one.
+
+Originally this was a dense table,
+compression_table[num_contexts][word_indexes][0x80]
+(an int for every possible prefix and every possible letter,
+4 MiB for the byte-oriented dictionary,
+512 KiB for the nybble-oriented one,
+zeroed on every call,
+almost all of it zero).
+Instead each word knows its prefix and its last letter,
+and a small open-addressing hash table
+(linear probing, never more than half full)
+finds the word for a given prefix and letter
+in O(1) expected time,
+no matter how many words share that prefix.
+Index 0 is never a word,
+so 0 means "empty" / "no such word" / "not in the trie".
+
+The words of the nybble dictionary and of EIGHT_BIT_PRUNED
+all have 8-bit indexes,
+so their tries (Narrow_trie_type) have room for 0x100 words:
+1.75 KiB per context.
+Only VARIABLE_WIDTH_PRUNED needs room
+for max_index_bits-bit word indexes (Wide_trie_type):
+28 KiB per context with 12-bit indexes.
+The trie functions work on either,
+through a Trie_type that points at one of them.
+*/
+#define narrow_trie_words (0x100)
+typedef struct Narrow_trie_type {
+    unsigned short prefix[narrow_trie_words];
+    unsigned char letter[narrow_trie_words];
+    unsigned short word_at[2 * narrow_trie_words]; // the hash table
+} Narrow_trie_type;
+
+#define wide_trie_words (1 << max_index_bits)
+typedef struct Wide_trie_type {
+    unsigned short prefix[wide_trie_words];
+    unsigned char letter[wide_trie_words];
+    unsigned short word_at[2 * wide_trie_words]; // the hash table
+} Wide_trie_type;
+
+typedef struct Trie_type {
+    int hash_bits; // room for 1 << (hash_bits - 1) words
+    int hash_mask; // (1 << hash_bits) - 1
+    unsigned short * prefix;
+    unsigned char * letter;
+    unsigned short * word_at;
+} Trie_type;
+
+// point trie[0] ... trie[contexts-1] at storage[0] ... storage[contexts-1].
+void
+use_narrow_tries( Trie_type trie[], Narrow_trie_type storage[], int contexts ){
+    int context = 0;
+    for( context=0; context<contexts; context++ ){
+        // 9 bits: 2 * narrow_trie_words hash slots.
+        Trie_type view = { 9, (1 << 9) - 1, storage[context].prefix,
+            storage[context].letter, storage[context].word_at };
+        trie[context] = view;
+    };
+}
+
+void
+use_wide_tries( Trie_type trie[], Wide_trie_type storage[], int contexts ){
+    int context = 0;
+    for( context=0; context<contexts; context++ ){
+        Trie_type view = { max_index_bits + 1, (1 << (max_index_bits + 1)) - 1,
+            storage[context].prefix,
+            storage[context].letter, storage[context].word_at };
+        trie[context] = view;
+    };
+}
+
+int
+trie_words( const Trie_type * trie ){
+    return 1 << (trie->hash_bits - 1);
+}
+
+// empty the trie.
+void
+clear_trie( Trie_type * trie ){
+    int words = trie_words( trie );
+    memset( trie->prefix, 0, words * sizeof( trie->prefix[0] ) );
+    memset( trie->letter, 0, words * sizeof( trie->letter[0] ) );
+    memset( trie->word_at, 0, 2 * words * sizeof( trie->word_at[0] ) );
+}
+
+void
+initialize_trie( Trie_type trie[num_contexts] ){
+    int context = 0;
+    for( context=0; context<num_contexts; context++ ){
+        clear_trie( &trie[context] );
+    };
+}
+
+int
+trie_hash( const Trie_type * trie, int prefix, int letter ){
+    // Fibonacci hashing of the (prefix, letter) pair.
+    unsigned long key = ((unsigned long)prefix << 8) bitor (unsigned)letter;
+    unsigned long hash = (key * 2654435761UL) bitand 0xffffffffUL;
+    return hash >> (32 - trie->hash_bits);
+}
+
+// returns the index of the word prefix+letter, or 0 if there is none.
+int
+trie_child( const Trie_type * trie, int prefix, int letter ){
+    assert( ((unsigned)prefix) < (unsigned)trie_words( trie ) );
+    int slot = trie_hash( trie, prefix, letter );
+    int word = trie->word_at[slot];
+    while( word and
+        ((trie->prefix[word] != prefix) or (trie->letter[word] != letter))
+    ){
+        slot = (slot + 1) bitand trie->hash_mask;
+        word = trie->word_at[slot];
+    };
+    return word;
+}
+
+// take the word out of the trie, if it is in there.
+void
+trie_remove( Trie_type * trie, int word ){
+    assert( 0 < word );
+    assert( word < trie_words( trie ) );
+    if( 0 == trie->prefix[word] ){
+        return;
+    };
+    int slot = trie_hash( trie, trie->prefix[word], trie->letter[word] );
+    while( trie->word_at[slot] != word ){
+        assert( trie->word_at[slot] ); // every word is in the table
+        slot = (slot + 1) bitand trie->hash_mask;
+    };
+    trie->prefix[word] = 0;
+    // close the gap, so later lookups don't stop short of a word.
+    int hole = slot;
+    for(;;){
+        trie->word_at[hole] = 0;
+        int next = hole;
+        int moved = 0;
+        do{
+            next = (next + 1) bitand trie->hash_mask;
+            moved = trie->word_at[next];
+            if( 0 == moved ){
+                return;
+            };
+            int home = trie_hash( trie, trie->prefix[moved], trie->letter[moved] );
+            // can "moved" go in the hole
+            // (is the hole between its home and where it is now)?
+            bool fits = (hole <= next) ?
+                ((home <= hole) or (next < home)) :
+                ((home <= hole) and (next < home));
+            if( fits ){
+                break;
+            };
+        }while( true );
+        trie->word_at[hole] = moved;
+        hole = next;
+    };
+}
+
+/*
+Make word (re-)represent prefix+letter,
+forgetting whatever word represented before
+and whatever word used to represent prefix+letter.
+*/
+void
+trie_add( Trie_type * trie, int prefix, int letter, int word ){
+    assert( 0 < prefix );
+    assert( prefix < trie_words( trie ) );
+    trie_remove( trie, word );
+    int old_word = trie_child( trie, prefix, letter );
+    if( old_word ){
+        trie_remove( trie, old_word );
+    };
+    trie->prefix[word] = prefix;
+    trie->letter[word] = letter;
+    int slot = trie_hash( trie, prefix, letter );
+    while( trie->word_at[slot] ){
+        slot = (slot + 1) bitand trie->hash_mask;
+    };
+    trie->word_at[slot] = word;
+}
+
+/*
+Greedy longest match:
+starting from the literal first byte,
+follow the trie one byte at a time
+for as long as the dictionary has the longer word.
+Writes the index of the longest word found to *index;
+returns the number of bytes that word represents.
+*/
+int
+compress_byte_index(
+    Trie_type trie[num_contexts],
+    int context, const char * source, int * index
+){
+    unsigned char byte = source[0];
+    /*
+    FIXME:
+    remove this assert when compressing hi-bit-set bytes.
+    */
+    assert( byte < 0x80 );
+    assert( 0 != byte );
+    int selected_index = byte;
+    int bytes_eaten = 1;
+    for(;;){
+        byte = source[bytes_eaten];
+        if( 0 == byte ){
+            break;
+        };
+        int next_index = trie_child( &trie[context], selected_index, byte );
+        if( 0 == next_index ){
+            break;
+        };
+        assert( 0x80 <= next_index );
+        selected_index = next_index;
+        bytes_eaten++;
+    };
+    assert( 0 != selected_index );
+    *index = selected_index;
+    if( 0x80 <= selected_index ){
+        assert( 1 < bytes_eaten );
+    }else{
+        assert( 1 == bytes_eaten );
+    };
+    return bytes_eaten;
+}
+
+/*
+The compressor's trie starts out with
+exactly the words initialize_dictionary() starts with.
+*/
+void
+initialize_compression_dictionary(
+    Trie_type trie[num_contexts],
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes]
+){
+    initialize_trie( trie );
+    int context = 0;
+    for(; context<num_contexts; context++){
+        int slot = 0;
+        for(; slot<eight_bit_dictionary_indexes; slot++){
+            Word_in_byte_dictionary_type word = dictionary[context][slot];
+            trie_add( &trie[context],
+                word.prefix_word_index, word.last_letter, slot + 0x80 );
+        };
+    };
+}
+
+/*
+Pruning or resetting a context empties many slots at once;
+rather than take those words out of the trie one at a time,
+start that context's trie over with the words that are left.
+*/
+void
+rebuild_context_trie(
+    Trie_type * trie,
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int context, int words
+){
+    clear_trie( trie );
+    int slot = 0;
+    for( slot=0; slot<words; slot++ ){
+        Word_in_byte_dictionary_type word = dictionary[context][slot];
+        if( 0 < word.length ){
+            trie_add( trie, word.prefix_word_index, word.last_letter, slot + 0x80 );
+        };
+    };
+}
+
+/*
+Add the same word update_dictionary() adds while decompressing:
+the previous word plus the first byte of this one,
+in the previous word's context.
+Adding it *before* searching
+lets this word use it,
+which is the LZW special case.
+pruning is NULL for the EIGHT_BIT_PRUNED format.
+Returns the slot the word went into, or -1.
+*/
+int
+add_compression_word(
+    Trie_type trie[num_contexts],
+    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
+    int next_word_index[num_contexts], int slots,
+    Context_pruning_type pruning[num_contexts],
+    int previous_context, int previous_index, int previous_length,
+    unsigned char first_byte
+){
+    Context_pruning_type * context_pruning =
+        pruning ? &pruning[previous_context] : NULL;
+    int prunings = pruning ? context_pruning->prunings : 0;
+    int tochange = choose_dictionary_slot(
+        dictionary, next_word_index, slots, context_pruning,
+        previous_context, previous_index, previous_length );
+    if( pruning and (prunings != context_pruning->prunings) ){
+        rebuild_context_trie( &trie[previous_context],
+            dictionary, previous_context, context_pruning->words );
+    };
+    if( 0 <= tochange ){
+        store_dictionary_word( dictionary,
+            previous_context, tochange, previous_index, first_byte );
+        trie_add( &trie[previous_context],
+            previous_index, first_byte, tochange + 0x80 );
+    };
+    return tochange;
+}
+
+void compress_bytestring( const char * source_original, char * dest_original){
+    const char * source = source_original;
+    char * dest = dest_original;
+    int compression_type = EIGHT_BIT_PRUNED;
+
+    static Narrow_trie_type narrow_trie[num_contexts];
+    Trie_type trie[num_contexts];
+    use_narrow_tries( trie, narrow_trie, num_contexts );
+    /*
+    FIXME: compress_byte_index() assumes that
+    the plaintext contains only 7-bit characters.
+    */
+
+    // the decompressor's dictionary, kept in sync
+    // so we replace the same words it does.
+    int next_word_index[num_contexts] = {0};
+    static Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes];
+    initialize_dictionary(dictionary, next_word_index);
+    initialize_compression_dictionary( trie, dictionary );
+    if( bytestring_debug_output ){
+        printf("dictionary after first initialization:\n");
+        debug_print_dictionary_contents(dictionary);
+        printf("compressing ...\n");
+    };
+
+    *dest++ = compression_type;
+    source = source_original;
+    // first byte copied unchanged, in order to provide context
+    int previous_index = (unsigned char)source[0];
+    int previous_length = 1;
+    *dest++ = *source++;
+    // as if the text started after a space.
+    int previous_context = byte_to_context( ' ' );
+    while( *source ){ // assume null-terminated string -- is this wise?
+        int context = byte_to_context( source[-1] );
+        add_compression_word( trie, dictionary,
+            next_word_index, eight_bit_dictionary_indexes, NULL,
+            previous_context, previous_index, previous_length, source[0] );
+        int index = 0;
+        int bytes = compress_byte_index(
+            trie,
+            context, source, &index
+            );
+        mark_word_used( dictionary, context, index );
+
+        // each compressed index uses 1 byte
+        assert( index < 0x100 );
+        *dest++ = index;
+
+        if( bytestring_debug_output ){
+            print_as_c_literal( source, bytes );
+        };
+        assert( 1 <= bytes );
+        source += bytes;
+        previous_context = context;
+        previous_index = index;
+        previous_length = bytes;
+    };
+    *dest = '\0'; // null termination.
+    if( bytestring_debug_output ){
+        printf("table after some compression:\n");
+        debug_print_dictionary_contents(dictionary);
+    };
+
+    size_t source_length = strlen( source_original );
+    if( bytestring_debug_output ){
+        printf( "source_length: %zi.\n", source_length );
+    };
+    size_t compressed_length = strlen( dest_original ); // assume null-terminated -- wise?
+
+    if( compressed_length >= source_length ){
+        compression_type = LITERAL;
+    };
+
+    if( LITERAL == compression_type ){
+        if( bytestring_debug_output ){
+            printf("incompressible section; copying as literals.");
+        };
+        source = source_original;
+        dest = dest_original;
+        *dest++ = compression_type;
+        while( *source ){ // assume null-terminated string -- is this wise?
+            *dest++ = *source++;
+        };
+        *dest = '\0'; // null termination.
+    };
+}
+
+/*
+Variable-width indexes (the VARIABLE_WIDTH_PRUNED format):
+the same per-context dictionaries as EIGHT_BIT_PRUNED,
+except that each context's dictionary keeps growing
+(up to (1 << index_bits_cap) - 0x80 words)
+before it starts pruning (see enum pruning_policy),
+so each index takes as many bits as its context currently needs:
+8 bits while the context has only its first 0x7f words,
+9 bits once it has more than that,
+and so on up to index_bits_cap bits.
+The compressor and the decompressor
+always know how many words each context has,
+so they always agree on how wide the next index is.
+
+Format:
+VARIABLE_WIDTH_PRUNED,
+index_bits_cap (8 ... max_index_bits),
+the pruning policy (CLOCK_PRUNING ... ADAPTIVE_PRUNING),
+the context layout (see Context_layout_type)
+(followed by the number of contexts minus one and the 256-byte table,
+for CUSTOM_CONTEXTS),
+the first byte of the text, unchanged,
+then the indexes,
+packed least-significant bit first.
+With index_bits_cap 8, CLOCK_PRUNING and LOW_5_BIT_CONTEXTS,
+everything after the header is byte-for-byte
+the same as the EIGHT_BIT_PRUNED format.
+*/
+typedef struct Bit_writer_type {
+    char * dest;
+    unsigned long pending; // bits not yet written to dest
+    int pending_bits;
+} Bit_writer_type;
+
+void
+put_bits( Bit_writer_type * writer, int value, int bits ){
+    assert( 0 <= value );
+    assert( value < (1 << bits) );
+    writer->pending |= (unsigned long)value << writer->pending_bits;
+    writer->pending_bits += bits;
+    while( 8 <= writer->pending_bits ){
+        *writer->dest++ = writer->pending bitand 0xff;
+        writer->pending >>= 8;
+        writer->pending_bits -= 8;
+    };
+}
+
+void
+flush_bits( Bit_writer_type * writer ){
+    if( writer->pending_bits ){
+        *writer->dest++ = writer->pending bitand 0xff;
+    };
+    writer->pending = 0;
+    writer->pending_bits = 0;
+}
+
+typedef struct Bit_reader_type {
+    const char * source;
+    const char * end;
+    unsigned long pending;
+    int pending_bits;
+} Bit_reader_type;
+
+/*
+Returns false if there are fewer than "bits" bits left;
+the padding at the end of the last byte
+is always shorter than the narrowest index.
+*/
+bool
+get_bits( Bit_reader_type * reader, int bits, int * value ){
+    while( reader->pending_bits < bits ){
+        if( reader->source == reader->end ){
+            return false;
+        };
+        reader->pending |= (unsigned long)(unsigned char)*reader->source++
+            << reader->pending_bits;
+        reader->pending_bits += 8;
+    };
+    *value = reader->pending bitand ((1UL << bits) - 1);
+    reader->pending >>= bits;
+    reader->pending_bits -= bits;
+    return true;
+}
+
+int
+variable_width_slots( int index_bits_cap ){
+    assert( 8 <= index_bits_cap );
+    assert( index_bits_cap <= max_index_bits );
+    if( 8 == index_bits_cap ){
+        // 8-bit indexes never use 0xff, just like EIGHT_BIT_PRUNED.
+        return eight_bit_dictionary_indexes;
+    };
+    return (1 << index_bits_cap) - 0x80;
+}
+
+/*
+How many bits the next index in this context needs:
+enough for every slot the context has handed out so far
+(counting the one the decompressor has picked for the next word
+but not filled in yet).
+*/
+int
+index_bits_in_context( Context_pruning_type pruning[num_contexts], int context ){
+    int words = pruning[context].words;
+    assert( eight_bit_dictionary_indexes <= words );
+    int bits = 8;
+    while( (1 << bits) < 0x80 + words ){
+        bits++;
+    };
+    return bits;
+}
+
+/*
+The VARIABLE_WIDTH_PRUNED format can use
+anything from 1 to 256 contexts
+(the built-in layouts have 1, 2, 5, 16, 32 -- num_contexts, the default -- or 256),
+up to the max_contexts this build has room for,
+depending on how much RAM we have
+(about 110 KiB per context with 12-bit indexes,
+plus 28 KiB per context for the compressor's trie).
+A 256-entry table gives the context ("class") for each previous byte.
+Taking the low bits of the byte, like byte_to_context(),
+puts unrelated bytes in the same context
+('e' with 'E', 'u', '%' and '5');
+grouping bytes that tend to be followed by the same words
+gets more out of the same RAM.
+The compressor and the decompressor use the same table:
+one of the layouts below (the header says which),
+or any other table (trained on some corpus, perhaps:
+see train_context_layout()),
+which then goes in the header.
+*/
+typedef struct Context_layout_type {
+    int id; // goes in the header
+    int classes; // 1 to 256
+    unsigned char class_of[256];
+} Context_layout_type;
+
+enum context_layout {
+    ONE_CONTEXT = 0,
+    LETTER_CONTEXTS = 1, // after a letter, or after anything else
+    FIVE_CLASS_CONTEXTS = 2, // the bins suggested above num_contexts
+    LOW_4_BIT_CONTEXTS = 3, // byte bitand 0xf
+    HIGH_BIT_CONTEXTS = 4, // (byte >> 3) bitand 0xf, as in nybble_compression.c
+    SIXTEEN_CLASS_CONTEXTS = 5,
+    LOW_5_BIT_CONTEXTS = 6, // byte_to_context()
+    THIRTY_TWO_CLASS_CONTEXTS = 7,
+    WHOLE_BYTE_CONTEXTS = 8,
+    CUSTOM_CONTEXTS = 0xff, // the table follows the header
+};
+#define context_layouts (9)
+
+// like strchr(), except that 0 is never in the set.
+bool
+byte_in_set( unsigned char byte, const char * set ){
+    return (0 != byte) and strchr( set, byte );
+}
+
+int
+context_class_of( int layout, unsigned char byte ){
+    bool vowel = byte_in_set( byte, "aeiouAEIOU" );
+    bool number = isdigit( byte ) or byte_in_set( byte, ".+-" );
+    const char * lowercase = "abcdefghiklmnoprstuwy";
+    switch( layout ){
+    case ONE_CONTEXT:
+        return 0;
+    case LETTER_CONTEXTS:
+        return isalpha( byte ) ? 1 : 0;
+    case FIVE_CLASS_CONTEXTS:
+        return (' ' == byte) ? 0 :
+            vowel ? 1 :
+            isalpha( byte ) ? 2 :
+            number ? 3 : 4;
+    case LOW_4_BIT_CONTEXTS:
+        return byte bitand 0xf;
+    case HIGH_BIT_CONTEXTS:
+        return (byte >> 3) bitand 0xf;
+    case SIXTEEN_CLASS_CONTEXTS:
+        return (' ' == byte) ? 0 :
+            byte_in_set( byte, ".!?" ) ? 2 :
+            ispunct( byte ) ? 3 :
+            isdigit( byte ) ? 4 :
+            isupper( byte ) ? 5 :
+            ('e' == byte) ? 6 :
+            ('a' == byte) ? 7 :
+            byte_in_set( byte, "iou" ) ? 8 :
+            ('s' == byte) ? 9 :
+            ('t' == byte) ? 10 :
+            ('n' == byte) ? 11 :
+            byte_in_set( byte, "rl" ) ? 12 :
+            byte_in_set( byte, "dh" ) ? 13 :
+            byte_in_set( byte, "yw" ) ? 14 :
+            islower( byte ) ? 15 : 1; // 1: newline, tab, everything else
+    case LOW_5_BIT_CONTEXTS:
+        return byte bitand 0x1f;
+    case THIRTY_TWO_CLASS_CONTEXTS:
+        return (' ' == byte) ? 0 :
+            ('\n' == byte) ? 1 :
+            byte_in_set( byte, ".!?" ) ? 3 :
+            (',' == byte) ? 4 :
+            byte_in_set( byte, "'\"" ) ? 5 :
+            ispunct( byte ) ? 6 :
+            isdigit( byte ) ? 7 :
+            (isupper( byte ) and vowel) ? 8 :
+            isupper( byte ) ? 9 :
+            byte_in_set( byte, lowercase ) ? 10 + (strchr( lowercase, byte ) - lowercase) :
+            islower( byte ) ? 31 : 2; // 2: tab, everything else
+    case WHOLE_BYTE_CONTEXTS:
+        return byte;
+    };
+    assert( false );
+    return 0;
+}
+
+void
+initialize_context_layout( Context_layout_type * layout, int id ){
+    assert( 0 <= id );
+    assert( id < context_layouts );
+    layout->id = id;
+    layout->classes = 0;
+    int byte = 0;
+    for( byte=0; byte<256; byte++ ){
+        int c = context_class_of( id, byte );
+        layout->class_of[byte] = c;
+        if( layout->classes <= c ){
+            layout->classes = c + 1;
+        };
+    };
+}
+
+const Context_layout_type *
+context_layout( int id ){
+    static Context_layout_type layouts[context_layouts];
+    static bool initialized = false;
+    if( !initialized ){
+        int i = 0;
+        for( i=0; i<context_layouts; i++ ){
+            initialize_context_layout( &layouts[i], i );
+        };
+        initialized = true;
+    };
+    assert( 0 <= id );
+    assert( id < context_layouts );
+    return &layouts[id];
+}
+
+/*
+How many bits it takes to write down
+which byte follows each of these bytes,
+given only the counts of which bytes followed them:
+sum over next bytes c of n[c] * log2( total / n[c] ).
+*/
+double
+following_bits( const long following[256] ){
+    long total = 0;
+    int c = 0;
+    for( c=0; c<256; c++ ){
+        total += following[c];
+    };
+    double bits = 0;
+    for( c=0; c<256; c++ ){
+        if( following[c] ){
+            bits += following[c] * log2( (double)total / following[c] );
+        };
+    };
+    return bits;
+}
+
+/*
+Train a CUSTOM_CONTEXTS layout on a corpus:
+start with every byte in a class of its own,
+and keep merging the two classes whose merger costs the fewest bits
+(counting the bytes that follow each class as above)
+until there are only "classes" classes left.
+Bytes that never occur in the corpus cost nothing,
+so they all end up in some class or other.
+This is too slow to do for every text,
+so it is meant to be done offline,
+with the result shipped in the compressed text.
+*/
+void
+train_context_layout(
+    Context_layout_type * layout, int classes, const char * corpus, long length
+){
+    assert( 1 <= classes );
+    assert( classes <= 256 );
+    static long following[256][256]; // per class: how often each byte followed it
+    memset( following, 0, sizeof( following ) );
+    long i = 0;
+    for( i=1; i<length; i++ ){
+        following[(unsigned char)corpus[i-1]][(unsigned char)corpus[i]]++;
+    };
+    int cluster[256]; // each byte's class, numbered by one of its bytes
+    double bits[256];
+    bool alive[256];
+    int c = 0;
+    for( c=0; c<256; c++ ){
+        cluster[c] = c;
+        bits[c] = following_bits( following[c] );
+        alive[c] = true;
+    };
+    int live = 256;
+    // bytes that never occur cost nothing anywhere: put them all in one class first.
+    int unseen = -1;
+    for( c=0; c<256; c++ ){
+        long total = 0;
+        int next = 0;
+        for( next=0; next<256; next++ ){
+            total += following[c][next];
+        };
+        if( (0 == total) and (unseen < 0) ){
+            unseen = c;
+        }else if( (0 == total) and (classes < live) ){
+            cluster[c] = unseen;
+            alive[c] = false;
+            live--;
+        };
+    };
+    long merged[256];
+    while( classes < live ){
+        int best_a = -1;
+        int best_b = -1;
+        double best_cost = 0;
+        int a = 0;
+        for( a=0; a<256; a++ ){
+            int b = 0;
+            for( b=a+1; alive[a] and (b<256); b++ ){
+                if( !alive[b] ){
+                    continue;
+                };
+                for( c=0; c<256; c++ ){
+                    merged[c] = following[a][c] + following[b][c];
+                };
+                double cost = following_bits( merged ) - bits[a] - bits[b];
+                if( (best_a < 0) or (cost < best_cost) ){
+                    best_a = a;
+                    best_b = b;
+                    best_cost = cost;
+                };
+            };
+        };
+        for( c=0; c<256; c++ ){
+            following[best_a][c] += following[best_b][c];
+            if( best_b == cluster[c] ){
+                cluster[c] = best_a;
+            };
+        };
+        bits[best_a] = following_bits( following[best_a] );
+        alive[best_b] = false;
+        live--;
+    };
+    // number the classes 0, 1, 2, ...
+    int number[256];
+    int next = 0;
+    for( c=0; c<256; c++ ){
+        number[c] = alive[c] ? next++ : -1;
+    };
+    for( c=0; c<256; c++ ){
+        layout->class_of[c] = number[ cluster[c] ];
+    };
+    layout->id = CUSTOM_CONTEXTS;
+    layout->classes = classes;
+}
+
+/*
+The compressor and the decompressor
+work with any number of contexts from 1 to max_contexts;
+the context of each byte is a single lookup in class_of[],
+and the number of contexts only matters
+when the dictionaries are started.
+They share the same (static) dictionaries,
+big enough for the most contexts,
+since only one of them runs at a time.
+Both take the text after the header
+(see compress_bytestring_variable_width()).
+Each context costs about 140 KiB of RAM,
+so max_contexts is set when building,
+to num_contexts unless the build says otherwise
+(see the Makefile);
+a message with more contexts than that is refused.
+(The tests in main() want at least num_contexts.)
+*/
+#ifndef max_contexts
+#define max_contexts (num_contexts)
+#endif
+#if (max_contexts < 1) or (256 < max_contexts)
+#error "max_contexts must be from 1 to 256."
+#endif
+static Word_in_byte_dictionary_type variable_width_dictionary[max_contexts][dictionary_indexes];
+static Wide_trie_type variable_width_wide_trie[max_contexts];
+static Trie_type variable_width_trie[max_contexts]; // see use_wide_tries()
+static Context_pruning_type variable_width_pruning[max_contexts];
+static int variable_width_next_word_index[max_contexts];
+
+/*
+Every message compressed from scratch
+starts out with only the 0x7f two-byte words in each context,
+so short messages never get past the warm-up.
+A dictionary snapshot is the whole state of the codec
+(every context's words, clock hand and pruning state,
+and the compressor's tries)
+after compressing some typical text,
+written to a file exactly as it is in RAM,
+so loading it is just mmap() -- no parsing --
+and starting a message from it is just a few memcpy()s
+for each context the message uses.
+
+Format (PRETRAINED_VARIABLE_WIDTH):
+PRETRAINED_VARIABLE_WIDTH,
+the snapshot id,
+then exactly what follows the VARIABLE_WIDTH_PRUNED header,
+with the index width cap, the pruning policy and the context layout
+all coming from the snapshot.
+
+A snapshot file only works with the same build that wrote it
+(same max_index_bits, same struct layouts);
+load_dictionary_snapshot() rejects any other.
 */
-void
-update_dictionary(
-    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes],
-    int context, int index, int next_context, int next_index, int tochange
-){
+typedef struct Dictionary_snapshot_type {
+    char magic[8];
+    int id;
+    int index_bits_limit; // max_index_bits
+    int word_size; // sizeof( Word_in_byte_dictionary_type )
+    int pruning_size; // sizeof( Context_pruning_type )
+    int trie_size; // sizeof( Wide_trie_type )
+    int index_bits_cap;
+    int policy;
+    Context_layout_type layout;
+    long length; // of the whole file
     /*
-    int tochange = next_word_index[context];
+    followed by, for each of the layout.classes contexts,
+    int next_word_index[];
+    Context_pruning_type pruning[];
+    Word_in_byte_dictionary_type dictionary[][dictionary_indexes];
+    Wide_trie_type trie[];
     */
-    unsigned char first_byte_of_next_word = 0xff;
+} Dictionary_snapshot_type;
+#define snapshot_magic ("SCDSNAP")
 
-    bool special_case = (tochange == next_index) and (context = next_context);
-    if( !special_case ){
-        // normal case
+const int *
+snapshot_next_word_index( const Dictionary_snapshot_type * snapshot ){
+    return (const int *)&snapshot[1];
+}
 
-    // FIXME: we also do this in decompress_byte_index;
-    // it would be better to do this only once, either here or there.
-    while( next_index bitand 0x80 ){
-        assert( next_index >= 0x80 );
-        assert( next_index < 0xff );
-        int prefix_index = dictionary[next_context][next_index - 0x80].prefix_word_index;
-        next_index = prefix_index;
-    };
-    assert( !(next_index bitand 0x80) );
-    first_byte_of_next_word = next_index;
+const Context_pruning_type *
+snapshot_pruning( const Dictionary_snapshot_type * snapshot ){
+    return (const Context_pruning_type *)
+        &snapshot_next_word_index( snapshot )[ snapshot->layout.classes ];
+}
 
-    }else{
-        // handle the "special case" LZW exception,
-        // as mentioned by
-        // http://michael.dipperstein.com/lzw/#example3
-        // https://www.cs.duke.edu/csed/curious/compression/lzw.html#decompression
-        // https://en.wikipedia.org/wiki/Lempel%E2%80%93Ziv%E2%80%93Welch#Decoding_2
-        // http://www.perlmonks.org/?node_id=270016
-        // http://stackoverflow.com/questions/10450395/lzw-decompression-algorithm
-        // etc.
-        // DAV:
-        // are there any other special cases in this
-        // 
-        printf("(... handling LZW special case ...)\n");
+const Word_in_byte_dictionary_type (*
+snapshot_dictionary( const Dictionary_snapshot_type * snapshot ) )[dictionary_indexes]{
+    return (const Word_in_byte_dictionary_type (*)[dictionary_indexes])
+        &snapshot_pruning( snapshot )[ snapshot->layout.classes ];
+}
 
-        assert(0); // unimplemented
+const Wide_trie_type *
+snapshot_trie( const Dictionary_snapshot_type * snapshot ){
+    return (const Wide_trie_type *)
+        &snapshot_dictionary( snapshot )[ snapshot->layout.classes ];
+}
 
-    };
+long
+snapshot_length( int contexts ){
+    return sizeof( Dictionary_snapshot_type ) + contexts * (
+        sizeof( int ) + sizeof( Context_pruning_type ) +
+        dictionary_indexes * sizeof( Word_in_byte_dictionary_type ) +
+        sizeof( Wide_trie_type ) );
+}
 
-    assert( first_byte_of_next_word < 0x80 );
+/*
+A short message only ever looks at a few of the contexts,
+so each context is started
+(from scratch, or copied out of the snapshot:
+its words, clock hand and pruning state, and the compressor's trie)
+only when the codec first looks at it;
+copying every context of a 32-context snapshot
+costs far more than compressing a 100-byte record.
+Every context a message looks at is the context of some byte of it
+(or of the space before it),
+and no context's words refer to another context's.
+*/
+static bool variable_width_started[max_contexts];
+static Trie_type * variable_width_started_trie; // NULL for the decompressor
+static int variable_width_started_policy;
+static const Dictionary_snapshot_type * variable_width_started_snapshot;
+
+void
+start_variable_width_context( int context ){
+    variable_width_started[context] = true;
+    Trie_type * trie = variable_width_started_trie;
+    const Dictionary_snapshot_type * snapshot = variable_width_started_snapshot;
+    if( snapshot ){
+        variable_width_next_word_index[context] =
+            snapshot_next_word_index( snapshot )[context];
+        variable_width_pruning[context] = snapshot_pruning( snapshot )[context];
+        // the slots past "words" are never looked at.
+        memcpy( variable_width_dictionary[context],
+            snapshot_dictionary( snapshot )[context],
+            variable_width_pruning[context].words
+                * sizeof( Word_in_byte_dictionary_type ) );
+        if( trie ){
+            const Wide_trie_type * from = &snapshot_trie( snapshot )[context];
+            memcpy( trie[context].prefix, from->prefix, sizeof( from->prefix ) );
+            memcpy( trie[context].letter, from->letter, sizeof( from->letter ) );
+            memcpy( trie[context].word_at, from->word_at, sizeof( from->word_at ) );
+        };
+        return;
+    };
+    initialize_context_dictionary( variable_width_dictionary, context );
+    variable_width_next_word_index[context] = 0;
+    initialize_context_pruning( &variable_width_pruning[context],
+        variable_width_started_policy );
+    if( trie ){
+        rebuild_context_trie( &trie[context],
+            variable_width_dictionary, context, eight_bit_dictionary_indexes );
+    };
+}
 
-    printf("context: %c, index: 0x%x, last_letter: %c.\n", (char)('@'+context), index, first_byte_of_next_word);
-    dictionary[context][tochange].prefix_word_index = index;
-    dictionary[context][tochange].last_letter = first_byte_of_next_word;
-    if( index >= 0x80 ){
-        dictionary[context][index - 0x80].leaf = false;
+// call before the codec looks at the context.
+void
+use_variable_width_context( int context ){
+    if( !variable_width_started[context] ){
+        start_variable_width_context( context );
     };
 }
 
 /*
-exhaustively commented version:
-While decompressing, print
-compressed byte on the left, the "word" of decompressed text decoded from it on the right.
-(Optional: bundle up consecutive literals all on one line, rather than one per line).
-Something like
+Get ready to start the shared dictionaries
+(and, for the compressor, the tries)
+either from scratch or from a snapshot,
+one context at a time (see use_variable_width_context()).
+*/
+void
+start_variable_width_codec(
+    Trie_type trie[max_contexts], int policy, int contexts,
+    const Dictionary_snapshot_type * snapshot
+){
+    assert( !snapshot or (contexts == snapshot->layout.classes) );
+    memset( variable_width_started, 0, contexts * sizeof( bool ) );
+    variable_width_started_trie = trie;
+    variable_width_started_policy = policy;
+    variable_width_started_snapshot = snapshot;
+}
 
-   'Hello,': 'Hello,'
-   '\x80': ' w'
+int
+compress_variable_width(
+    const char * source, char * dest_original, int index_bits_cap, int policy,
+    int contexts, const unsigned char class_of[256],
+    const Dictionary_snapshot_type * snapshot
+){
+    char * dest = dest_original;
+    int slots = variable_width_slots( index_bits_cap );
+    Trie_type * trie = variable_width_trie;
+    use_wide_tries( trie, variable_width_wide_trie, contexts );
+    int * next_word_index = variable_width_next_word_index;
+    Word_in_byte_dictionary_type (* dictionary)[dictionary_indexes] =
+        variable_width_dictionary;
+    Context_pruning_type * pruning = variable_width_pruning;
+    start_variable_width_codec( trie, policy, contexts, snapshot );
+    if( 0 == *source ){
+        return 0;
+    };
+    // first byte copied unchanged, in order to provide context
+    int previous_index = (unsigned char)source[0];
+    int previous_length = 1;
+    *dest++ = *source++;
+    // as if the text started after a space.
+    int previous_context = class_of[' '];
+    use_variable_width_context( previous_context );
+    Bit_writer_type writer = { dest, 0, 0 };
+    while( *source ){
+        int context = class_of[ (unsigned char)source[-1] ];
+        use_variable_width_context( context );
+        add_compression_word( trie, dictionary, next_word_index, slots, pruning,
+            previous_context, previous_index, previous_length, source[0] );
+        int index = 0;
+        int bytes = compress_byte_index( trie, context, source, &index );
+        mark_word_used( dictionary, context, index );
+        note_index( &pruning[context], bytes );
+        int bits = index_bits_in_context( pruning, context );
+        put_bits( &writer, index, bits );
+        source += bytes;
+        previous_context = context;
+        previous_index = index;
+        previous_length = bytes;
+    };
+    flush_bits( &writer );
+    return writer.dest - dest_original;
+}
 
-*/
-void decompress_bytestring( const char * source, char * dest_original ){
+int
+decompress_variable_width(
+    const char * source, const char * end, char * dest_original,
+    int index_bits_cap, int policy,
+    int contexts, const unsigned char class_of[256],
+    const Dictionary_snapshot_type * snapshot
+){
     char * dest = dest_original;
-    size_t compressed_length = strlen( source );
-    printf( "compressed_length: %zi.\n", compressed_length );
-    int compression_type = *source++;
-    if( EIGHT_BIT_PRUNED == compression_type ){
-        int next_word_index[num_contexts] = {0};
-        Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes] = {0};
-        initialize_dictionary( dictionary, next_word_index );
-        printf("dictionary after first initialization:\n");
-        debug_print_dictionary_contents(dictionary);
-        // first byte copied unchanged, in order to provide context
-        int previous_index = (unsigned char)source[0];
-        printf( "'%c': (%c)", source[0], source[0] );
-        *dest++ = *source++;
-        int previous_context = ' ';
-        while( *source ){
-            int index = (unsigned char)*source++;
-            // context is the most recent byte
-            int context = byte_to_context( (unsigned char)dest[-1] );
-            /* Add a word to the dictionary:
-               the previous word,
-               and the first byte of the next word.
-               We assume that the compressor
-               *would* have used *that* word if it had been available,
-               so clearly that word is *not* already in the dictionary.
-            */
-            int tochange = next_word_index[context];
-            update_dictionary(dictionary, previous_context, previous_index, context, index, tochange);
-            increment_dictionary_index( context, next_word_index );
-            int bytes = decompress_byte_index( dictionary, context, index, dest );
-            print_as_c_literal( source, 1 );
-            printf(": ");
-            print_as_c_literal(dest, bytes);
-            putchar('\n');
-            assert( 1 <= bytes );
-            
-            dest += bytes;
-            previous_context = context;
-            previous_index = index;
+    int slots = variable_width_slots( index_bits_cap );
+    int * next_word_index = variable_width_next_word_index;
+    Word_in_byte_dictionary_type (* dictionary)[dictionary_indexes] =
+        variable_width_dictionary;
+    Context_pruning_type * pruning = variable_width_pruning;
+    start_variable_width_codec( NULL, policy, contexts, snapshot );
+    if( end <= source ){
+        return 0;
+    };
+    int previous_index = (unsigned char)source[0];
+    int previous_length = 1;
+    *dest++ = *source++;
+    int previous_context = class_of[' '];
+    use_variable_width_context( previous_context );
+    Bit_reader_type reader = { source, end, 0, 0 };
+    for(;;){
+        int context = class_of[ (unsigned char)dest[-1] ];
+        use_variable_width_context( context );
+        // pick the slot for the new word before reading the index,
+        // since the new word may make this index 1 bit wider.
+        int tochange = choose_dictionary_slot(
+            dictionary, next_word_index, slots, &pruning[previous_context],
+            previous_context, previous_index, previous_length );
+        int bits = index_bits_in_context( pruning, context );
+        int index = 0;
+        if( !get_bits( &reader, bits, &index ) ){
+            break;
         };
-        debug_print_dictionary_contents(dictionary);
-    }else if( LITERAL == compression_type ){
-        while( *source ){ // assume null-terminated string -- is this wise?
-            *dest++ = *source++;
+        if( (0 == index) or
+            ((0x80 <= index) and (pruning[context].words <= index - 0x80)) or
+            ((0x80 <= index) and (0 == dictionary[context][index - 0x80].length) and
+                ((index != tochange + 0x80) or (context != previous_context)))
+        ){
+            printf("Error: index 0x%x is not in the dictionary.\n", index);
+            return -1;
         };
-    }else{
-        printf("invalid compressed data");
+        if( 0 <= tochange ){
+            int letter = first_byte_of_new_word( dictionary,
+                previous_context, tochange, previous_index, context, index );
+            store_dictionary_word( dictionary,
+                previous_context, tochange, previous_index, letter );
+        };
+        int bytes = decompress_byte_index( dictionary, context, index, dest );
+        mark_word_used( dictionary, context, index );
+        note_index( &pruning[context], bytes );
+        dest += bytes;
+        previous_context = context;
+        previous_index = index;
+        previous_length = bytes;
     };
-    *dest = '\0'; // null termination.
-    size_t decompressed_length = strlen( dest_original ); // assume null-terminated -- wise?
-    printf( "decompressed_length: %zi.\n", decompressed_length );
+    return dest - dest_original;
+}
+
+// false if the codec has no room for that many contexts.
+bool
+variable_width_contexts_ok( int contexts ){
+    return (1 <= contexts) and (contexts <= max_contexts);
 }
 
+/*
+Returns the length of the compressed text
+(which may contain 0x00 bytes),
+or -1 if the layout has too many (or no) contexts.
+dest needs room for 5 + (strlen(source) * index_bits_cap + 7) / 8 bytes
+(and another 257 for a CUSTOM_CONTEXTS layout).
+*/
 int
-compress_byte_index(
-    int compression_table[num_contexts][word_indexes][0x80],
-    int next_word_index[num_contexts],
-    int context, const char * source, char * dest
+compress_bytestring_variable_width(
+    const char * source, char * dest,
+    int index_bits_cap, int policy, const Context_layout_type * layout
 ){
-    // FIXME: perhaps print a debug message in the "LZW special case".
-    int byte_offset = 0;
-    // normal compression
-    int bytes_eaten = 0;
-    int selected_index = 0;
-    int next_index = source[0];
-    assert( next_index < 0x80 );
-    // FIXME: implement
-    selected_index = next_index;
-    bytes_eaten = 1;
-    // quick test, using a hard-wired dictionary
-    if( (' ' == source[0]) and islower(source[1]) ){
-        selected_index = 0x80 + source[1];
-        bytes_eaten = 2;
+    int contexts = layout->classes;
+    if( !variable_width_contexts_ok( contexts ) ){
+        printf("Error: no codec for %i contexts.\n", contexts);
+        return -1;
     };
-    unsigned char byte = source[byte_offset];
-    /*
-    bytes_eaten = 0;
-    unsigned char byte = 0xff;
+    int header = 0;
+    dest[header++] = VARIABLE_WIDTH_PRUNED;
+    dest[header++] = index_bits_cap;
+    dest[header++] = policy;
+    dest[header++] = layout->id;
+    if( CUSTOM_CONTEXTS == layout->id ){
+        dest[header++] = contexts - 1;
+        memcpy( &dest[header], layout->class_of, 256 );
+        header += 256;
+    };
+    return header + compress_variable_width( source, &dest[header],
+        index_bits_cap, policy, contexts, layout->class_of, NULL );
+}
 
-    // search through the tree
-    do{
-        byte = source[byte_offset];
-        / *
-        FIXME:
-        remove this assert when compressing hi-bit-set bytes.
-        * /
-        assert( byte < 0x80 );
-        selected_index = next_index;
-        next_index = compression_table[context][selected_index][byte];
-        assert( (0 == next_index) or (0x80 bitand next_index) );
-        byte_offset++;
-        bytes_eaten++;
-    }while( next_index );
-    // add a new leaf to the tree
-    assert( 0 == next_index );
-    */
-    assert( byte < 0x80 );
-    /*
-    assert( 0 == compression_table[context][selected_index][byte] );
-    */
-    compression_table[context][selected_index][byte] = next_word_index[context] + 0x80;
+/*
+The snapshots load_dictionary_snapshot() has mapped in, by id.
+*/
+#define max_snapshots (256)
+static const Dictionary_snapshot_type * loaded_snapshots[max_snapshots];
 
-    assert( 0 != selected_index );
-    *dest = selected_index;
-    if( dest[0] bitand 0x80 ){
-        assert( 1 < bytes_eaten );
-    }else{
-        assert( 1 == bytes_eaten );
+/*
+Compress some typical text,
+then write the state the codec ends up in to a snapshot file.
+Returns false if the file can't be written.
+*/
+bool
+save_dictionary_snapshot(
+    const char * filename, int id, const char * corpus,
+    int index_bits_cap, int policy, const Context_layout_type * layout
+){
+    assert( 0 <= id );
+    assert( id < max_snapshots );
+    int contexts = layout->classes;
+    char * scratch = malloc( 1 + (strlen( corpus ) * index_bits_cap + 7) / 8 );
+    if( !variable_width_contexts_ok( contexts ) or !scratch ){
+        free( scratch );
+        return false;
     };
-    increment_dictionary_index( context, next_word_index );
-    return bytes_eaten;
+    compress_variable_width( corpus, scratch,
+        index_bits_cap, policy, contexts, layout->class_of, NULL );
+    free( scratch );
+    // contexts the corpus never used still go in the snapshot.
+    int context = 0;
+    for( context=0; context<contexts; context++ ){
+        use_variable_width_context( context );
+    };
+
+    Dictionary_snapshot_type snapshot;
+    memset( &snapshot, 0, sizeof( snapshot ) );
+    strcpy( snapshot.magic, snapshot_magic );
+    snapshot.id = id;
+    snapshot.index_bits_limit = max_index_bits;
+    snapshot.word_size = sizeof( Word_in_byte_dictionary_type );
+    snapshot.pruning_size = sizeof( Context_pruning_type );
+    snapshot.trie_size = sizeof( Wide_trie_type );
+    snapshot.index_bits_cap = index_bits_cap;
+    snapshot.policy = policy;
+    snapshot.layout = *layout;
+    snapshot.length = snapshot_length( contexts );
+    FILE * file = fopen( filename, "wb" );
+    if( !file ){
+        return false;
+    };
+    bool ok =
+        (1 == fwrite( &snapshot, sizeof( snapshot ), 1, file )) and
+        (contexts == (int)fwrite( variable_width_next_word_index,
+            sizeof( int ), contexts, file )) and
+        (contexts == (int)fwrite( variable_width_pruning,
+            sizeof( Context_pruning_type ), contexts, file )) and
+        (contexts == (int)fwrite( variable_width_dictionary,
+            sizeof( variable_width_dictionary[0] ), contexts, file )) and
+        (contexts == (int)fwrite( variable_width_wide_trie,
+            sizeof( Wide_trie_type ), contexts, file ));
+    ok = (0 == fclose( file )) and ok;
+    return ok;
 }
 
 void
-initialize_compression_dictionary(
-    int compression_table[num_contexts][word_indexes][0x80]
-){
-    /* optional special case: spaces */
+unload_dictionary_snapshot( int id ){
+    assert( 0 <= id );
+    assert( id < max_snapshots );
+    const Dictionary_snapshot_type * snapshot = loaded_snapshots[id];
+    if( snapshot ){
+        munmap( (void *)snapshot, snapshot->length );
+        loaded_snapshots[id] = NULL;
+    };
+}
+
+/*
+Map a snapshot file into memory, read-only,
+and make it available (by its id) to the compressor and the decompressor,
+replacing any snapshot already loaded with that id.
+Returns the id, or -1 if the file isn't a snapshot from this build.
+*/
+/*
+The codec trusts the state it starts from,
+so a snapshot (of the right length) is checked
+the way decompress_bytestring_variable_width() checks a custom layout:
+every byte's class is one of the layout's classes,
+and each context's clock hand and pruning state
+are ones the codec could have left behind.
+*/
+bool
+snapshot_contexts_ok( const Dictionary_snapshot_type * snapshot ){
+    const Context_layout_type * layout = &snapshot->layout;
+    int byte = 0;
+    for( byte=0; byte<256; byte++ ){
+        if( layout->classes <= layout->class_of[byte] ){
+            return false;
+        };
+    };
+    int slots = variable_width_slots( snapshot->index_bits_cap );
+    bool adaptive = (ADAPTIVE_PRUNING == snapshot->policy);
     int context = 0;
-    for(; context<num_contexts; context++){
-        int lowercase_letter = 'a';
-        for(; lowercase_letter <= 'z'; lowercase_letter++){
-            compression_table[context][lowercase_letter][' '] = lowercase_letter+0x80;
+    for( context=0; context<layout->classes; context++ ){
+        int next_word_index = snapshot_next_word_index( snapshot )[context];
+        const Context_pruning_type * pruning = &snapshot_pruning( snapshot )[context];
+        // a bool holding anything but 0 or 1 can't even be read safely.
+        unsigned char adaptive_byte = 0;
+        memcpy( &adaptive_byte, &pruning->adaptive, 1 );
+        bool ok =
+            (0 <= next_word_index) and (next_word_index <= slots) and
+            (adaptive_byte == (adaptive ? 1 : 0)) and
+            (adaptive ? (ADAPTIVE_PRUNING != pruning->policy) :
+                (snapshot->policy == pruning->policy)) and
+            (0 <= pruning->policy) and (pruning->policy < pruning_policies) and
+            (eight_bit_dictionary_indexes <= pruning->words) and
+            (pruning->words <= slots) and
+            (0 <= pruning->empty) and (pruning->empty <= pruning->words) and
+            (0 <= pruning->prunings) and
+            (0 <= pruning->indexes) and (pruning->indexes < pruning_window) and
+            (0 <= pruning->bytes) and
+            (pruning->bytes <= pruning->indexes * max_word_length) and
+            (0 <= pruning->previous_rate) and
+            (pruning->previous_rate <= 16 * max_word_length);
+        if( !ok ){
+            return false;
         };
     };
-    /* end option */
+    return true;
 }
 
-void compress_bytestring( const char * source_original, char * dest_original){
-    const char * source = source_original;
-    char * dest = dest_original;
-    int compression_type = EIGHT_BIT_PRUNED;
-
-    int compression_table[num_contexts][word_indexes][0x80] = {0};
-    /*
-    FIXME: the 0x80 assumes that
-    the plaintext contains only printable characters.
-    Extend to allow all possible bytes in the uncompressed text,
-    by either
-    (a) bumping from 0x80 to 0x100, or
-    (b) reducing from (0x80) to (0x10 * 2), with a two-level nybble lookup
-    (c) some other reduced-memory variant
-    */
-
-    initialize_compression_dictionary( compression_table );
-
-    int next_word_index[num_contexts] = {0};
-    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes] = {0};
-    initialize_dictionary(dictionary, next_word_index);
-    printf("dictionary after first initialization:\n");
-    debug_print_dictionary_contents(dictionary);
-    printf("compressing ...\n");
-
-    *dest++ = compression_type;
-    source = source_original;
-    // first byte copied unchanged, in order to provide context
-    *dest++ = *source++;
-    // int previous_context = 0;
-    while( *source ){ // assume null-terminated string -- is this wise?
-        int context = byte_to_context( source[-1] );
-        int bytes = compress_byte_index(
-            compression_table,
-            next_word_index,
-            context, source, dest
-            );
+int
+load_dictionary_snapshot( const char * filename ){
+    int fd = open( filename, O_RDONLY );
+    if( fd < 0 ){
+        return -1;
+    };
+    struct stat status;
+    if( (0 != fstat( fd, &status )) or
+        (status.st_size < (off_t)sizeof( Dictionary_snapshot_type ))
+    ){
+        close( fd );
+        return -1;
+    };
+    void * mapped = mmap( NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( MAP_FAILED == mapped ){
+        return -1;
+    };
+    const Dictionary_snapshot_type * snapshot = mapped;
+    int contexts = snapshot->layout.classes;
+    bool ok =
+        (0 == memcmp( snapshot->magic, snapshot_magic, sizeof( snapshot_magic ) )) and
+        (0 <= snapshot->id) and (snapshot->id < max_snapshots) and
+        (max_index_bits == snapshot->index_bits_limit) and
+        ((int)sizeof( Word_in_byte_dictionary_type ) == snapshot->word_size) and
+        ((int)sizeof( Context_pruning_type ) == snapshot->pruning_size) and
+        ((int)sizeof( Wide_trie_type ) == snapshot->trie_size) and
+        (8 <= snapshot->index_bits_cap) and
+        (snapshot->index_bits_cap <= max_index_bits) and
+        (0 <= snapshot->policy) and (snapshot->policy < pruning_policies) and
+        variable_width_contexts_ok( contexts ) and
+        (snapshot_length( contexts ) == snapshot->length) and
+        (status.st_size == snapshot->length) and
+        snapshot_contexts_ok( snapshot );
+    if( !ok ){
+        munmap( mapped, status.st_size );
+        return -1;
+    };
+    unload_dictionary_snapshot( snapshot->id );
+    loaded_snapshots[snapshot->id] = snapshot;
+    return snapshot->id;
+}
 
-        /*
-        FIXME:
-        maintain a dictionary synchronized with the decompressor,
-        or find some other way to prune and re-use dictionary indexes
-        in a compatible way.
-        int tochange = next_word_index[context];
-        update_dictionary(previous_context, previous_index, context, index, tochange);
-        increment_dictionary_index( context );
-        */
-        // each compressed index uses 1 byte
-        assert( 256 >= word_indexes );
-        dest++;
+/*
+Like compress_bytestring_variable_width(),
+except that every context starts out with the words in the snapshot
+(loaded with load_dictionary_snapshot()).
+Returns the length of the compressed text,
+or -1 if no snapshot with that id is loaded.
+dest needs room for 2 + (strlen(source) * index_bits_cap + 7) / 8 bytes.
+*/
+int
+compress_bytestring_with_snapshot( const char * source, char * dest, int id ){
+    const Dictionary_snapshot_type * snapshot =
+        ((0 <= id) and (id < max_snapshots)) ? loaded_snapshots[id] : NULL;
+    if( !snapshot ){
+        printf("Error: dictionary snapshot %i is not loaded.\n", id);
+        return -1;
+    };
+    dest[0] = PRETRAINED_VARIABLE_WIDTH;
+    dest[1] = id;
+    return 2 + compress_variable_width( source, &dest[2],
+        snapshot->index_bits_cap, snapshot->policy,
+        snapshot->layout.classes, snapshot->layout.class_of, snapshot );
+}
 
-        print_as_c_literal( source, bytes );
-        assert( 1 <= bytes );
-        if( dest[-1] bitand 0x80 ){
-            assert( 1 < bytes );
-        }else{
-            assert( 1 == bytes );
+/*
+Decompresses both VARIABLE_WIDTH_PRUNED
+and PRETRAINED_VARIABLE_WIDTH compressed text.
+Returns the length of the decompressed text
+(and null-terminates it),
+or -1 if the compressed text is invalid
+(or names a snapshot that isn't loaded).
+*/
+int
+decompress_bytestring_variable_width(
+    const char * source, int compressed_length, char * dest
+){
+    const char * end = source + compressed_length;
+    if( (2 <= compressed_length) and (PRETRAINED_VARIABLE_WIDTH == source[0]) ){
+        int id = (unsigned char)source[1];
+        const Dictionary_snapshot_type * snapshot = loaded_snapshots[id];
+        if( !snapshot ){
+            printf("Error: dictionary snapshot %i is not loaded.\n", id);
+            return -1;
         };
-        source += bytes;
-        // previous_context = context;
+        int length = decompress_variable_width( &source[2], end, dest,
+            snapshot->index_bits_cap, snapshot->policy,
+            snapshot->layout.classes, snapshot->layout.class_of, snapshot );
+        if( 0 <= length ){
+            dest[length] = '\0'; // null termination.
+        };
+        return length;
     };
-    *dest = '\0'; // null termination.
-    printf("table after some compression:\n");
-    debug_print_dictionary_contents(dictionary);
-
-    size_t source_length = strlen( source_original );
-    printf( "source_length: %zi.\n", source_length );
-    size_t compressed_length = strlen( dest_original ); // assume null-terminated -- wise?
-
-    if( compressed_length >= source_length ){
-        compression_type = LITERAL;
+    if( (compressed_length < 4) or (VARIABLE_WIDTH_PRUNED != source[0]) ){
+        return -1;
     };
-
-    if( LITERAL == compression_type ){
-        printf("incompressible section; copying as literals.");
-        source = source_original;
-        dest = dest_original;
-        *dest++ = compression_type;
-        while( *source ){ // assume null-terminated string -- is this wise?
-            *dest++ = *source++;
+    int index_bits_cap = source[1];
+    if( (index_bits_cap < 8) or (max_index_bits < index_bits_cap) ){
+        printf("Error: unsupported index width %i.\n", index_bits_cap);
+        return -1;
+    };
+    int policy = source[2];
+    if( (policy < 0) or (pruning_policies <= policy) ){
+        printf("Error: unsupported pruning policy %i.\n", policy);
+        return -1;
+    };
+    int id = (unsigned char)source[3];
+    source += 4;
+    Context_layout_type custom_layout;
+    const Context_layout_type * layout = NULL;
+    if( id < context_layouts ){
+        layout = context_layout( id );
+    }else if( (CUSTOM_CONTEXTS == id) and (257 <= end - source) ){
+        custom_layout.id = id;
+        custom_layout.classes = (unsigned char)source[0] + 1;
+        memcpy( custom_layout.class_of, &source[1], 256 );
+        source += 257;
+        int byte = 0;
+        for( byte=0; byte<256; byte++ ){
+            if( custom_layout.classes <= custom_layout.class_of[byte] ){
+                printf("Error: context %i out of range.\n", custom_layout.class_of[byte]);
+                return -1;
+            };
         };
-        *dest = '\0'; // null termination.
+        layout = &custom_layout;
+    }else{
+        printf("Error: unsupported context layout %i.\n", id);
+        return -1;
     };
+    int length = decompress_variable_width( source, end, dest,
+        index_bits_cap, policy, layout->classes, layout->class_of, NULL );
+    if( 0 <= length ){
+        dest[length] = '\0'; // null termination.
+    };
+    return length;
 }
 
-
 int
 test_compress_byte_index(
     int next_word_index[num_contexts],
@@ -681,7 +2629,7 @@ test_compress_byte_index(
         bytes_eaten = 2;
     };
     *dest = selected_index;
-    increment_dictionary_index( context, next_word_index );
+    increment_dictionary_index( context, next_word_index, eight_bit_dictionary_indexes );
     return bytes_eaten;
 }
 
@@ -693,7 +2641,7 @@ void test_compress_bytestring( const char * source_original, char * dest_origina
     printf("quick test, using a hard-wired dictionary.\n");
 
     int next_word_index[num_contexts] = {0};
-    Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes] = {0};
+    static Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes];
     initialize_dictionary( dictionary, next_word_index );
     printf("dictionary after first initialization:\n");
     /*
@@ -758,25 +2706,17 @@ void test_compress_bytestring( const char * source_original, char * dest_origina
 typedef struct Word_in_nybble_table_type {
     int prefix_word_index;
     char last_letter;
-    int next_index; // only temporarily used inside decompress_index
-    bool leaf;
+    char first_letter; // first nybble of the word
+    int length; // in nybbles
+    bool leaf; // no other word is built on this one
     bool recently_used;
+    int children; // how many words are built on this one
     /*
     // only used for debug performance monitoring
     int times_used_directly;
     int times_used_indirectly;
     */
 } Word_in_nybble_table_type;
-/*
-FIXME:
-move next_index
-into a temporary array inside decompress_index?
-It only needs to be as long as the longest word ...
-so with a 128-entry table, max 128 indexes,
-and we only need it briefly ...
-and perhaps if we somehow guarantee that the longest wordlength
-is, say, 32 indexes, it really only needs to be 32 indexes long.
-*/
 
 Word_in_nybble_table_type table[num_contexts][word_indexes] = {0};
 
@@ -807,7 +2747,9 @@ void initialize_table( int next_word_index[num_contexts] ){
             table[context][index].prefix_word_index = nybble2index(first_nybble);
             assert( ((unsigned)second_nybble) < 0x10 );
             table[context][index].last_letter = second_nybble;
-            table[context][index].next_index = 0;
+            table[context][index].first_letter = first_nybble;
+            table[context][index].length = 2;
+            table[context][index].children = 0;
             table[context][index].leaf = true;
             if( is_literal_index( index ) ){
                 // the literal nybbles
@@ -1214,54 +3156,45 @@ write_nybble( int nybble, char * dest, bool nybble_offset ){
     };
 }
 
-/*
-returns the number of nybbles written to dest.
-*/
-int decompress_index( int context, int index, char * dest, bool nybble_offset ){
-#undef arbitrary
-#define arbitrary 1
-#if arbitrary
-    // special case for literals
+// a literal index is its own first (and only) nybble.
+int
+first_nybble_of_word( int context, int index ){
     if( is_literal_index( index ) ){
-        int nybble = index2nybble( index );
-        assert( ((unsigned)nybble) < 0x10 );
-        write_nybble( nybble, dest, nybble_offset );
-        int nybble_count = 1;
-        return nybble_count;
-    }else{
-        // this index represents a "word",
-        // a string of nybbles in the dictionary.
-        int previous_index = table[context][index].prefix_word_index;
-        int nybble_count = decompress_index( context, previous_index, dest, nybble_offset );
-        dest += (nybble_count >> 1);
-        nybble_offset ^= (nybble_count bitand 1);
-        int nybble = table[context][index].last_letter;
-        assert( ((unsigned)nybble) < 0x10 );
-        write_nybble( nybble, dest, nybble_offset );
-        return 1+nybble_count;
+        return index2nybble( index );
     };
-#else
-    assert( 0 == table[context][index].next_index );
-    while( !is_literal_index( index ) ){
-        int prefix_index = table[context][index].prefix_word_index;
-        table[context][prefix_index].next_index = index;
-        index = prefix_index;
+    return table[context][index].first_letter;
+}
+
+int
+nybble_length_of_word( int context, int index ){
+    if( is_literal_index( index ) ){
+        return 1;
     };
-    assert( is_literal_index( index ) );
-    while( table[index].next_index ){
+    return table[context][index].length;
+}
+
+/*
+returns the number of nybbles written to dest.
+Every word knows its own length,
+so we write it directly into dest from the last nybble back to the first,
+following the prefix chain,
+with no recursion.
+*/
+int decompress_index( int context, int index, char * dest, bool nybble_offset ){
+    const int nybble_count = nybble_length_of_word( context, index );
+    // position (in nybbles, counting from dest) of the nybble to write next.
+    int position = nybble_offset + nybble_count;
+    while( !is_literal_index( index ) ){
         int nybble = table[context][index].last_letter;
         assert( ((unsigned)nybble) < 0x10 );
-        write_nybble( nybble, dest, nybble_offset );
-        int next_index = table[context][index].next_index;
-        table[context][index].next_index = 0;
-        index = next_index;
-        if(nybble_offset){ dest++ };
-        nybble_offset ^= 1;
-    };
-    int nybble = table[context][index].last_letter;
-    assert( ((unsigned)nybble) < 0x10 );
-    write_nybble( nybble, dest, nybble_offset );
-#endif
+        position--;
+        write_nybble( nybble, dest + (position >> 1), position bitand 1 );
+        index = table[context][index].prefix_word_index;
+    };
+    position--;
+    assert( position == nybble_offset );
+    write_nybble( index2nybble( index ), dest + (position >> 1), position bitand 1 );
+    return nybble_count;
 }
 
 bool
@@ -1316,7 +3249,6 @@ debug_print_table_contents(){
                     print_as_c_literal( dest, (nybbles+1)/2 );
                     putchar(']');
                     Word_in_nybble_table_type word = table[context][index];
-                    assert( 0 == word.next_index );
                     if( word.recently_used ){ printf( "(recent)" ); };
                     int prefix_index = word.prefix_word_index;
                     assert( 0 == table[context][prefix_index].leaf );
@@ -1332,57 +3264,68 @@ increment_table_index( int context, int next_word_index[num_contexts]  ){
     /*
     Normally this is simply
         next_word_index[context]++;
-    except for:
-    * wrap-around
-    * only prune leaves.
+    except for wrap-around.
     */
-    bool leaf = true;
     int next_index = next_word_index[context];
-    do{
-        next_index++;
-        #define wraptype only_hi_bit_set
-        #if only_hi_bit_set == wraptype
-            if( 0x100 <= next_index ){
-                // wrap around from compressed index "0xff" to "0x80".
-                next_index = 0x80;
-            };
-        #elif every_byte_but_null == wraptype
-            if( 0x100 <= next_index ){
-                // wrap around, skipping NULL
-                next_index = 1;
-            };
-            // skip over the isliteral() nybbles
-            if( (0x10 <= next_index) and (next_index <= 0x1f) ){
-                next_index = 0x20;
-            };
-        #elif only_c_source_characters
-            if( 0x7f <= next_index ){
-                // wrap around, skipping NULL
-                next_index = 0x20;
-            };
-            // FIXME: skip over the isliteral() nybbles
-        #else
-            #error "no wrap type set. Sorry."
-        #endif
-        /* FIXME:
-        only prune leaves.
-        If this current index is *not* a leaf,
-        try the next one.
-        FIXME:
-        how to avoid infinite loop here?
-        leaf = table[context][next_index].leaf;
-        */
-    }while(!leaf);
-    if( ! table[context][next_index].leaf ){
-        printf( "context %x, index %x, is not a leaf.\n", context, next_index );
-    };
-    /*
-    assert( table[context][next_index].leaf );
-    */
-
+    next_index++;
+    #define wraptype only_hi_bit_set
+    #if only_hi_bit_set == wraptype
+        if( 0x100 <= next_index ){
+            // wrap around from compressed index "0xff" to "0x80".
+            next_index = 0x80;
+        };
+    #elif every_byte_but_null == wraptype
+        if( 0x100 <= next_index ){
+            // wrap around, skipping NULL
+            next_index = 1;
+        };
+        // skip over the isliteral() nybbles
+        if( (0x10 <= next_index) and (next_index <= 0x1f) ){
+            next_index = 0x20;
+        };
+    #elif only_c_source_characters
+        if( 0x7f <= next_index ){
+            // wrap around, skipping NULL
+            next_index = 0x20;
+        };
+        // FIXME: skip over the isliteral() nybbles
+    #else
+        #error "no wrap type set. Sorry."
+    #endif
     next_word_index[context] = next_index;
 }
 
+/*
+The same clock (second-chance) replacement
+as choose_dictionary_slot(),
+for the nybble-oriented table:
+next_word_index[context] is the clock hand,
+only leaf words are replaced
+(never the prefix of the new word),
+and a recently used leaf is passed over once.
+Returns the index to replace,
+or -1 if no word can be replaced.
+*/
+int
+choose_table_slot( int context, int next_word_index[num_contexts], int prefix_index ){
+    int tries = 0;
+    for( tries=0; tries<2*word_indexes; tries++ ){
+        int index = next_word_index[context];
+        increment_table_index( context, next_word_index );
+        Word_in_nybble_table_type * word = &table[context][index];
+        if( !word->leaf or (index == prefix_index) ){
+            continue;
+        };
+        if( word->recently_used ){
+            // second chance
+            word->recently_used = false;
+            continue;
+        };
+        return index;
+    };
+    return -1;
+}
+
 /*
 Given the context and index of 2 consecutive indexes
 in the compressed text.
@@ -1393,16 +3336,10 @@ update_table(int context, int index, int next_context, int next_index, int tocha
     int tochange = next_word_index[context];
     */
 
-    if( tochange != next_index ){
+    char first_nybble_of_next_word = 0;
+    if( (tochange != next_index) or (context != next_context) ){
         // normal case
-
-    // FIXME: we also do this in decompress_index;
-    // it would be better to do this only once, either here or there.
-    while( !is_literal_index( next_index ) ){
-        int prefix_index = table[next_context][next_index].prefix_word_index;
-        next_index = prefix_index;
-    };
-
+        first_nybble_of_next_word = first_nybble_of_word( next_context, next_index );
     }else{
         // handle the "special case" LZW exception,
         // as mentioned by
@@ -1412,24 +3349,104 @@ update_table(int context, int index, int next_context, int next_index, int tocha
         // http://www.perlmonks.org/?node_id=270016
         // http://stackoverflow.com/questions/10450395/lzw-decompression-algorithm
         // etc.
-        // DAV:
-        // are there any other special cases in this
-        // 
+        // The next word is the very word we are adding now,
+        // so its first nybble is the first nybble of *this* word.
         printf("(... handling LZW special case ...)");
-
-
+        first_nybble_of_next_word = first_nybble_of_word( context, index );
     };
-    assert( is_literal_index( next_index ) );
-    char first_nybble_of_next_word = index2nybble(next_index);
     assert( ( ((unsigned)first_nybble_of_next_word) < 0x10 ) );
 
-    table[context][tochange].prefix_word_index = index;
-    table[context][tochange].last_letter = first_nybble_of_next_word;
-    table[context][index].leaf = false;
+    Word_in_nybble_table_type * word = &table[context][tochange];
+    assert( word->leaf );
+    int old_prefix_index = word->prefix_word_index;
+    if( !is_literal_index( old_prefix_index ) ){
+        Word_in_nybble_table_type * old_prefix = &table[context][old_prefix_index];
+        assert( 0 < old_prefix->children );
+        old_prefix->children--;
+        old_prefix->leaf = (0 == old_prefix->children);
+    };
+    word->prefix_word_index = index;
+    word->last_letter = first_nybble_of_next_word;
+    word->first_letter = first_nybble_of_word( context, index );
+    word->length = nybble_length_of_word( context, index ) + 1;
+    word->recently_used = false;
+    if( !is_literal_index( index ) ){
+        table[context][index].children++;
+        table[context][index].leaf = false;
+    };
 
 }
 
-void decompress( const char * source, char * dest_original ){
+/*
+The nybble-oriented table can use the same word buffer,
+one nybble per letter.
+It starts out empty
+(the 2-nybble initial words are decoded from the table),
+and each new word is the previous word plus one more nybble.
+*/
+void
+update_nybble_word_buffer(
+    Word_buffer_type words[num_contexts],
+    int context, int slot, int prefix_index
+){
+    Word_buffer_type * buffer = &words[context];
+    char nybble = table[context][slot].last_letter;
+    if( is_literal_index( prefix_index ) ){
+        char prefix = index2nybble( prefix_index );
+        if( word_buffer_store( buffer, slot, &prefix, 1 ) ){
+            word_buffer_append( buffer, slot, slot, nybble );
+        };
+    }else if( word_buffer_letters( buffer, prefix_index ) ){
+        word_buffer_append( buffer, slot, prefix_index, nybble );
+    }else{
+        int length = nybble_length_of_word( context, slot );
+        if( UCHAR_MAX < length ){
+            word_buffer_forget( buffer, slot );
+            return;
+        };
+        // walk the prefix chain once, back to front.
+        char word[UCHAR_MAX];
+        int index = slot;
+        int i = length;
+        while( !is_literal_index( index ) ){
+            word[--i] = table[context][index].last_letter;
+            index = table[context][index].prefix_word_index;
+        };
+        word[--i] = index2nybble( index );
+        assert( 0 == i );
+        word_buffer_store( buffer, slot, word, length );
+    };
+}
+
+int
+decompress_index_from_word_buffer(
+    Word_buffer_type words[num_contexts],
+    int context, int index, char * dest, bool nybble_offset
+){
+    if( !is_literal_index( index ) ){
+        const char * word = word_buffer_letters( &words[context], index );
+        if( word ){
+            int nybbles = words[context].length[index];
+            int i = 0;
+            for( i=0; i<nybbles; i++ ){
+                write_nybble( word[i], dest, nybble_offset );
+                if( nybble_offset ){ dest++; };
+                nybble_offset ^= 1;
+            };
+            return nybbles;
+        };
+    };
+    return decompress_index( context, index, dest, nybble_offset );
+}
+
+/*
+If words is NULL, words are expanded by walking the table's prefix chains;
+otherwise they are copied out of the word buffer.
+*/
+void decompress_using(
+    const char * source, char * dest_original,
+    Word_buffer_type words[num_contexts]
+){
     char * dest = dest_original;
     size_t compressed_length = strlen( source );
     printf( "compressed_length: %zi.\n", compressed_length );
@@ -1438,13 +3455,17 @@ void decompress( const char * source, char * dest_original ){
         /* FIXME: */
         int next_word_index[num_contexts] = {0};
         initialize_table( next_word_index );
+        if( words ){
+            initialize_word_buffer( words );
+        };
         bool nybble_offset = 0;
-        int previous_index = source[0];
+        int previous_index = (unsigned char)source[0];
         // first byte copied unchanged, in order to provide context
         *dest++ = *source++;
-        int previous_context = ' ';
+        // as if the text started after a space.
+        int previous_context = byte_to_context( ' ' );
         while( *source ){
-            int index = *source++;
+            int index = (unsigned char)*source++;
             // should context be the most recent complete aligned byte,
             // or the most recent (possibly unaligned) 2 nybbles?
             int context = byte_to_context( dest[-1] );
@@ -1457,10 +3478,22 @@ void decompress( const char * source, char * dest_original ){
                Add entry just before decompressing it,
                to handle the LZW special case.
             */
-            int tochange = next_word_index[context];
-            update_table(previous_context, previous_index, context, index, tochange);
-            increment_table_index( context, next_word_index );
-            int nybbles = decompress_index( context, index, dest, nybble_offset );
+            int tochange = choose_table_slot(
+                previous_context, next_word_index, previous_index );
+            if( 0 <= tochange ){
+                update_table(previous_context, previous_index, context, index, tochange);
+            };
+            int nybbles = 0;
+            if( words ){
+                if( 0 <= tochange ){
+                    update_nybble_word_buffer( words, previous_context, tochange, previous_index );
+                };
+                nybbles = decompress_index_from_word_buffer(
+                    words, context, index, dest, nybble_offset );
+            }else{
+                nybbles = decompress_index( context, index, dest, nybble_offset );
+            };
+            table[context][index].recently_used = true;
             assert( 1 <= nybbles );
 
             
@@ -1482,53 +3515,53 @@ void decompress( const char * source, char * dest_original ){
     printf( "decompressed_length: %zi.\n", decompressed_length );
 }
 
+void decompress( const char * source, char * dest_original ){
+    decompress_using( source, dest_original, NULL );
+}
+
+void decompress_from_word_buffer( const char * source, char * dest_original ){
+    Word_buffer_type words[num_contexts];
+    decompress_using( source, dest_original, words );
+}
+
 
 /*
-compression table:
+compression trie (see Trie_type):
 for every possible current_index,
 (i.e., some prefix string)
-a list:
-For each of 16 possible next-nybbles,
+and each of 16 possible next-nybbles,
 if that longer string exists in the dictionary,
-the table indicates what index 
+the trie gives what index
 (i.e., some slightly longer string)
 represents that longer string.
-Currently we're reserving 0x00
-to indicate "that longer string does not yet exist in the dictionary".
+0x00 indicates "that longer string does not yet exist in the dictionary".
 FUTURE:
 Consider using a completely out-of-band indicator
 or some other reserved index, perhaps a "literal" index.
-The compression_table[]
-needs to be synchronized to the decompression table[].
+The compression trie
+needs to be synchronized to the decompression table[]:
+this mirrors initialize_table(),
+where every index other than the literal nybbles
+is the 2-nybble word
+(literal first nybble, then second nybble).
 */
 void initialize_compression_table(
-    int compression_table[num_contexts][word_indexes][16]
+    Trie_type trie[num_contexts]
 ){
+    initialize_trie( trie );
     int context=0;
     for( context=0; context<num_contexts; context++ ){
-        // initialize all the indexes,
-        // even if we have more than 256 of them.
-        int index=0;
-        for( index=0; index<word_indexes; index++ ){
-/* FIXME:
-#if only_high_bit_set_is_word
-            int value = index | 0x80;
-#else
-*/
-            // is it better to go big-endian or little-endian?
-            #if little_endian
-            int second_nybble = (index >> 4) bitand 0x0f;
-            #else
-            int second_nybble = (index) bitand 0x0f;
-            #endif
-            int nybble = 0;
-            for( nybble = 0; nybble<16; nybble++ ){
-                if( is_literal_index( index ) ){
-                    compression_table[context][index][nybble] = nybble2index(second_nybble);
-                }else{
-                    compression_table[context][index][nybble] = 0;
-                };
+        // index 0x00 stays out of the trie:
+        // it never appears in the compressed text.
+        int index=1;
+        for( index=1; index<word_indexes; index++ ){
+            if( is_literal_index( index ) ){
+                continue;
             };
+            int prefix_index = table[context][index].prefix_word_index;
+            int nybble = table[context][index].last_letter;
+            assert( is_literal_index( prefix_index ) );
+            trie_add( &trie[context], prefix_index, nybble, index );
         };
     };
 }
@@ -1552,7 +3585,7 @@ int get_nybble( const char * source, bool nybble_offset ){
 
 int
 compress_index(
-    int compression_table[num_contexts][word_indexes][16],
+    Trie_type trie[num_contexts],
     int next_word_index[num_contexts],
     int context, const char * source, char * dest, bool original_nybble_offset
 ){
@@ -1566,7 +3599,7 @@ compress_index(
         nybbles_eaten++;
         int nybble = get_nybble( source + (nybble_offset >> 1), nybble_offset bitand 1 );
         selected_index = next_index;
-        next_index = compression_table[context][selected_index][nybble];
+        next_index = trie_child( &trie[context], selected_index, index2nybble( nybble ) );
     }while( next_index );
     *dest = selected_index;
     increment_table_index( context, next_word_index );
@@ -1590,10 +3623,14 @@ void compress( const char * source_original, char * dest_original ){
     char * dest = dest_original;
     int compression_type = EIGHT_BIT_PRUNED;
 
-    int compression_table[num_contexts][word_indexes][16] = {0};
+    // 56 KiB, rather than the 512 KiB of the old dense table.
+    static Narrow_trie_type narrow_trie[num_contexts];
+    Trie_type trie[num_contexts];
+    use_narrow_tries( trie, narrow_trie, num_contexts );
 
     int next_word_index[num_contexts] = {0};
     initialize_table( next_word_index );
+    initialize_compression_table( trie );
     printf("table after first initialization:\n");
     debug_print_table_contents();
     printf("compressing ...\n");
@@ -1608,7 +3645,7 @@ void compress( const char * source_original, char * dest_original ){
         while( *source ){ // assume null-terminated string -- is this wise?
             int context = byte_to_context( dest[-1] );
             int nybbles = compress_index(
-                compression_table,
+                trie,
                 next_word_index,
                 context, source, dest, nybble_offset
                 );
@@ -1653,7 +3690,7 @@ mock test used as a quick test of the decoder
 */
 int
 test_byte_compress_index(
-    // int compression_table[num_contexts][word_indexes][16],
+    // Trie_type trie[num_contexts],
     int next_word_index[num_contexts],
     int context, const char * source, char * dest
     // , bool original_nybble_offset
@@ -1669,7 +3706,7 @@ test_byte_compress( const char * source_original, char * dest_original ){
     char * dest = dest_original;
     int compression_type = EIGHT_BIT_PRUNED;
 
-    // int compression_table[num_contexts][word_indexes][16] = {0};
+    // Trie_type trie[num_contexts];
 
     int next_word_index[num_contexts] = {0};
     initialize_table( next_word_index );
@@ -1687,7 +3724,7 @@ test_byte_compress( const char * source_original, char * dest_original ){
         while( *source ){ // assume null-terminated string -- is this wise?
             int context = byte_to_context( dest[-1] );
             int nybbles = test_byte_compress_index(
-                // compression_table,
+                // trie,
                 next_word_index,
                 context, source, dest
                 // , nybble_offset
@@ -1768,6 +3805,774 @@ void test_nybble_compress( const char * source_original, char * dest_original ){
     *dest = '\0'; // null termination.
 }
 
+void
+test_word_buffer( void ){
+    printf("testing the word buffer ...\n");
+    Word_buffer_type words[num_contexts];
+    initialize_word_buffer( words );
+    Word_buffer_type * buffer = &words[0];
+    bool stored = word_buffer_store( buffer, 1, "bcd", 3 );
+    assert( stored );
+    int used = buffer->used;
+    // "bcde" shares "bcd" with word 1
+    word_buffer_append( buffer, 2, 1, 'e' );
+    assert( used + 1 == buffer->used );
+    assert( buffer->start[1] == buffer->start[2] );
+    // "abcde" shares "bcde" with word 2
+    word_buffer_prepend( buffer, 3, 'a', 2 );
+    assert( buffer->start[3] + 1 == buffer->start[2] );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 3 ), "abcde", 5 ) );
+    word_buffer_prune_front( buffer, 3 );
+    word_buffer_prune_back( buffer, 3 );
+    assert( 3 == buffer->length[3] );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 3 ), "bcd", 3 ) );
+    // word 1 isn't the last thing in the buffer any more, so this copies.
+    stored = word_buffer_store( buffer, 4, "xyz", 3 );
+    assert( stored );
+    word_buffer_append( buffer, 5, 1, 'q' );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 5 ), "bcdq", 4 ) );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 2 ), "bcde", 4 ) );
+    // fill the buffer with garbage until it has to compact itself.
+    int i = 0;
+    for( i=0; i<1000; i++ ){
+        word_buffer_append( buffer, 6, 4, 'z' );
+    };
+    assert( 0 == memcmp( word_buffer_letters( buffer, 1 ), "bcd", 3 ) );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 2 ), "bcde", 4 ) );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 3 ), "bcd", 3 ) );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 4 ), "xyz", 3 ) );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 5 ), "bcdq", 4 ) );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 6 ), "xyzz", 4 ) );
+    // shared letters stay shared:
+    // "bcde", "xyz", "bcdq", "xyzz".
+    word_buffer_compact( buffer );
+    assert( buffer->start[1] == buffer->start[2] );
+    assert( 15 == buffer->used - buffer->first );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 3 ), "bcd", 3 ) );
+    assert( 0 == memcmp( word_buffer_letters( buffer, 6 ), "xyzz", 4 ) );
+    printf("Successful test.\n");
+}
+
+/*
+Decode speed and RAM of the word buffer
+against the prefix chains it stands in for.
+The dictionaries are filled with chains of 16 words,
+each word 1 letter longer than the last,
+as LZW builds them from repetitive text.
+Only the word expansion is timed here;
+see benchmark_byte_decoders() for the whole decoders.
+*/
+void
+benchmark_word_buffer( void ){
+    printf("benchmarking the word buffer ...\n");
+    const int repeats = 2000;
+    int next_word_index[num_contexts] = {0};
+    static Word_in_byte_dictionary_type dictionary[num_contexts][dictionary_indexes];
+    static Word_buffer_type words[num_contexts];
+    initialize_dictionary( dictionary, next_word_index );
+    initialize_word_buffer_from_dictionary( words, dictionary );
+    int context = 0;
+    for( context=0; context<num_contexts; context++ ){
+        int slot = 0;
+        for( slot=0; slot<eight_bit_dictionary_indexes; slot++ ){
+            int prefix_index = (slot % 16) ? (0x80 + slot - 1) : ('a' + context % 26);
+            int letter = 'a' + (slot * 7) % 26;
+            store_dictionary_word( dictionary, context, slot, prefix_index, letter );
+            char prefix_text[2] = { prefix_index, 0 };
+            update_word_buffer( dictionary, words, context, slot,
+                prefix_index, prefix_text, 1 );
+        };
+    };
+    char word[max_word_length + 1];
+    char buffered_word[max_word_length + 1];
+    long bytes = 0;
+    clock_t start = clock();
+    int i = 0;
+    for( i=0; i<repeats; i++ ){
+        for( context=0; context<num_contexts; context++ ){
+            int slot = 0;
+            for( slot=0; slot<eight_bit_dictionary_indexes; slot++ ){
+                bytes += decompress_byte_index( dictionary, context, 0x80 + slot, word );
+            };
+        };
+    };
+    double chain_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    long buffered_bytes = 0;
+    start = clock();
+    for( i=0; i<repeats; i++ ){
+        for( context=0; context<num_contexts; context++ ){
+            int slot = 0;
+            for( slot=0; slot<eight_bit_dictionary_indexes; slot++ ){
+                buffered_bytes += decompress_byte_index_from_word_buffer(
+                    dictionary, words, context, 0x80 + slot, buffered_word );
+            };
+        };
+    };
+    double buffer_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    assert( bytes == buffered_bytes );
+    int letters_used = 0;
+    for( context=0; context<num_contexts; context++ ){
+        int slot = 0;
+        for( slot=0; slot<eight_bit_dictionary_indexes; slot++ ){
+            int bytes = decompress_byte_index( dictionary, context, 0x80 + slot, word );
+            assert( bytes == words[context].length[slot] );
+            assert( 0 == memcmp( word, word_buffer_letters( &words[context], slot ), bytes ) );
+        };
+        letters_used += words[context].used - words[context].first;
+    };
+    printf("bytes: prefix chain %7.1f MB/s, word buffer %7.1f MB/s"
+        " (%.1f bytes per word).\n",
+        bytes / chain_seconds / 1e6, bytes / buffer_seconds / 1e6,
+        (double)bytes / repeats / num_contexts / eight_bit_dictionary_indexes );
+    printf("bytes: prefix chain dictionary %zu bytes;"
+        " word buffer %zu more bytes (%d letters in use).\n",
+        sizeof( dictionary ), sizeof( words ), letters_used );
+
+    // the same for the nybble table, one nybble per letter.
+    initialize_table( next_word_index );
+    initialize_word_buffer( words );
+    for( context=0; context<num_contexts; context++ ){
+        int slot = 0;
+        for( slot=0x80; slot<word_indexes; slot++ ){
+            int prefix_index = (slot % 16) ? (slot - 1) : ('a' + context % 26);
+            int nybble = (slot * 7) % 16;
+            update_table( context, prefix_index, context, nybble2index( nybble ), slot );
+            update_nybble_word_buffer( words, context, slot, prefix_index );
+        };
+    };
+    long nybbles = 0;
+    start = clock();
+    for( i=0; i<repeats; i++ ){
+        for( context=0; context<num_contexts; context++ ){
+            int slot = 0;
+            for( slot=0x80; slot<word_indexes; slot++ ){
+                nybbles += decompress_index( context, slot, word, 0 );
+            };
+        };
+    };
+    chain_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    long buffered_nybbles = 0;
+    start = clock();
+    for( i=0; i<repeats; i++ ){
+        for( context=0; context<num_contexts; context++ ){
+            int slot = 0;
+            for( slot=0x80; slot<word_indexes; slot++ ){
+                buffered_nybbles += decompress_index_from_word_buffer(
+                    words, context, slot, buffered_word, 0 );
+            };
+        };
+    };
+    buffer_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    assert( nybbles == buffered_nybbles );
+    letters_used = 0;
+    for( context=0; context<num_contexts; context++ ){
+        int slot = 0;
+        for( slot=0x80; slot<word_indexes; slot++ ){
+            int length = decompress_index( context, slot, word, 0 );
+            decompress_index_from_word_buffer( words, context, slot, buffered_word, 0 );
+            assert( 0 == memcmp( word, buffered_word, length / 2 ) );
+        };
+        letters_used += words[context].used - words[context].first;
+    };
+    printf("nybbles: prefix chain %7.1f MB/s, word buffer %7.1f MB/s"
+        " (%.1f nybbles per word).\n",
+        nybbles / 2 / chain_seconds / 1e6, nybbles / 2 / buffer_seconds / 1e6,
+        (double)nybbles / repeats / num_contexts / (word_indexes - 0x80) );
+    printf("nybbles: prefix chain table %zu bytes;"
+        " word buffer %zu more bytes (%d letters in use).\n",
+        sizeof( table ), sizeof( words ), letters_used );
+    // leave the table the way the decoder expects to find it.
+    initialize_table( next_word_index );
+}
+
+/*
+Text long enough to make the decoders' word buffers compact themselves.
+*/
+void
+test_word_buffer_decoders( void ){
+    static char text[4000];
+    static char compressed_text[4000];
+    static char decompressed_text[4000];
+    static char buffered_text[4000];
+    const char * phrases[] = {
+        "the quick brown fox ", "jumps over ", "the lazy dog; ",
+        "a lazy fox jumps over the quick dog. ", "Banana banana. ",
+    };
+    int length = 0;
+    int i = 0;
+    for( i=0; length<3500; i++ ){
+        const char * phrase = phrases[ (i * i + i / 3) % 5 ];
+        strcpy( &text[length], phrase );
+        length += strlen( phrase );
+    };
+    compress_bytestring( text, compressed_text );
+    decompress_bytestring( compressed_text, decompressed_text );
+    decompress_bytestring_from_word_buffer( compressed_text, buffered_text );
+    if( strcmp( text, decompressed_text ) or strcmp( text, buffered_text ) ){
+        printf("Error: decompressed text doesn't match original text.\n");
+    }else{
+        printf("Successful test.\n");
+    };
+}
+
+/*
+Pseudo-English text for the larger tests and benchmarks:
+a few thousand made-up words,
+the k-th most common one about 1/k as common as the most common one
+(roughly like real text),
+in sentences of 4 to 15 words.
+Only 7-bit printable bytes, spaces, and newlines.
+*/
+#define sample_vocabulary (4000)
+unsigned long
+sample_random( unsigned long * state ){
+    *state = (*state * 1103515245UL + 12345UL) bitand 0x7fffffffUL;
+    return *state >> 8;
+}
+
+void
+make_sample_text( char * text, long length, unsigned long seed ){
+    static char words[sample_vocabulary][16];
+    static double cumulative[sample_vocabulary];
+    const char * onsets[] = {
+        "", "b", "c", "d", "f", "g", "h", "l", "m", "n",
+        "p", "r", "s", "t", "w", "th", "st", "ch", "br", "pr",
+    };
+    const char * vowels[] = { "a", "e", "i", "o", "u", "ea", "ou", "ai" };
+    const char * codas[] = { "", "", "n", "r", "s", "t", "nd", "ng", "st", "ll" };
+    unsigned long state = 20150524;
+    double total = 0;
+    int k = 0;
+    for( k=0; k<sample_vocabulary; k++ ){
+        words[k][0] = '\0';
+        int syllables = 1 + sample_random( &state ) % 3;
+        int i = 0;
+        for( i=0; i<syllables; i++ ){
+            strcat( words[k], onsets[ sample_random( &state ) % 20 ] );
+            strcat( words[k], vowels[ sample_random( &state ) % 8 ] );
+            strcat( words[k], codas[ sample_random( &state ) % 10 ] );
+        };
+        total += 1.0 / (k + 1);
+        cumulative[k] = total;
+    };
+    state = seed;
+    long i = 0;
+    while( i < length ){
+        int sentence_words = 4 + sample_random( &state ) % 12;
+        int w = 0;
+        for( w=0; (w < sentence_words) and (i < length); w++ ){
+            double u = total * (sample_random( &state ) % 1000000) / 1000000.0;
+            int low = 0;
+            int high = sample_vocabulary - 1;
+            while( low < high ){
+                int middle = (low + high) / 2;
+                if( cumulative[middle] < u ){
+                    low = middle + 1;
+                }else{
+                    high = middle;
+                };
+            };
+            const char * word = words[low];
+            int j = 0;
+            for( j=0; word[j] and (i < length); j++ ){
+                char c = word[j];
+                if( (0 == w) and (0 == j) ){
+                    c = toupper( c );
+                };
+                text[i++] = c;
+            };
+            if( (w + 1 == sentence_words) and (i < length) ){
+                text[i++] = '.';
+            }else if( (0 == sample_random( &state ) % 9) and (i < length) ){
+                text[i++] = ',';
+            };
+            if( i < length ){
+                text[i++] = ((w + 1 == sentence_words) and
+                    (0 == sample_random( &state ) % 5)) ? '\n' : ' ';
+            };
+        };
+    };
+    text[length] = '\0';
+}
+
+void
+test_variable_width( void ){
+    printf("testing compress_bytestring_variable_width ...\n");
+    static char text[40001];
+    static char compressed_text[60010];
+    static char eight_bit_text[60010];
+    static char decompressed_text[40001];
+    const char * short_texts[] = {
+        "Hello, world. This is a test. This is only a test. "
+        "Banana banana banana banana. ",
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        "abababababababababababababababababababababababab",
+    };
+    bool ok = true;
+    // with 8-bit indexes, the indexes are exactly the EIGHT_BIT_PRUNED bytes.
+    int t = 0;
+    for( t=0; t<3; t++ ){
+        const char * short_text = short_texts[t];
+        compress_bytestring( short_text, eight_bit_text );
+        int length = compress_bytestring_variable_width(
+            short_text, compressed_text, 8, CLOCK_PRUNING, context_layout( LOW_5_BIT_CONTEXTS ) );
+        assert( EIGHT_BIT_PRUNED == eight_bit_text[0] );
+        assert( (int)strlen( eight_bit_text ) + 3 == length );
+        ok = ok and (0 == memcmp( &eight_bit_text[1], &compressed_text[4], length - 4 ));
+    };
+    make_sample_text( text, 40000, 1 );
+    int sizes[max_index_bits + 1] = {0};
+    int bits = 8;
+    for( bits=8; bits<=max_index_bits; bits++ ){
+        sizes[bits] = compress_bytestring_variable_width(
+            text, compressed_text, bits, CLOCK_PRUNING, context_layout( LOW_5_BIT_CONTEXTS ) );
+        int length = decompress_bytestring_variable_width(
+            compressed_text, sizes[bits], decompressed_text );
+        printf("%i-bit indexes: %i bytes to %i bytes.\n", bits, 40000, sizes[bits] );
+        ok = ok and (40000 == length) and (0 == strcmp( text, decompressed_text ));
+    };
+    // every pruning policy, pruning early and often.
+    int policy = 0;
+    for( policy=0; policy<pruning_policies; policy++ ){
+        for( bits=8; bits<=9; bits++ ){
+            int size = compress_bytestring_variable_width(
+                text, compressed_text, bits, policy, context_layout( LOW_5_BIT_CONTEXTS ) );
+            int length = decompress_bytestring_variable_width(
+                compressed_text, size, decompressed_text );
+            printf("%i-bit indexes, pruning policy %i: %i bytes to %i bytes.\n",
+                bits, policy, 40000, size );
+            ok = ok and (40000 == length) and (0 == strcmp( text, decompressed_text ));
+        };
+    };
+    // more words per context is better, at least on this much text.
+    ok = ok and (sizes[max_index_bits] < sizes[8]);
+    // an index that isn't in the dictionary yet.
+    sizes[max_index_bits] = compress_bytestring_variable_width(
+        text, compressed_text, max_index_bits, CLOCK_PRUNING, context_layout( LOW_5_BIT_CONTEXTS ) );
+    compressed_text[5] = (char)0xff;
+    ok = ok and (-1 == decompress_bytestring_variable_width(
+        compressed_text, sizes[max_index_bits], decompressed_text ));
+    // every context layout, and one trained on the text itself.
+    ok = ok and (byte_to_context( 'q' ) ==
+        context_layout( LOW_5_BIT_CONTEXTS )->class_of['q']);
+    Context_layout_type trained;
+    train_context_layout( &trained, 5, text, 40000 );
+    int id = 0;
+    for( id=0; id<=context_layouts; id++ ){
+        const Context_layout_type * layout =
+            (id < context_layouts) ? context_layout( id ) : &trained;
+        bits = (id < context_layouts) ? max_index_bits : 8;
+        int size = compress_bytestring_variable_width(
+            text, compressed_text, bits, ADAPTIVE_PRUNING, layout );
+        if( max_contexts < layout->classes ){
+            // too many for this build.
+            ok = ok and (-1 == size);
+            continue;
+        };
+        int length = decompress_bytestring_variable_width(
+            compressed_text, size, decompressed_text );
+        printf("context layout %i (%i contexts): %i bytes to %i bytes.\n",
+            layout->id, layout->classes, 40000, size );
+        ok = ok and (40000 == length) and (0 == strcmp( text, decompressed_text ));
+    };
+    // any number of contexts works, not just the built-in ones ...
+    train_context_layout( &trained, 3, text, 40000 );
+    int size = compress_bytestring_variable_width(
+        text, compressed_text, 8, CLOCK_PRUNING, &trained );
+    ok = ok and (40000 == decompress_bytestring_variable_width(
+        compressed_text, size, decompressed_text ));
+    ok = ok and (0 == strcmp( text, decompressed_text ));
+    // ... up to max_contexts.
+    trained.classes = max_contexts + 1;
+    ok = ok and (-1 == compress_bytestring_variable_width(
+        text, compressed_text, 8, CLOCK_PRUNING, &trained ));
+    if( ok ){
+        printf("Successful test.\n");
+    }else{
+        printf("Error: variable-width indexes don't round-trip.\n");
+    };
+}
+
+/*
+Compression ratio of the variable-width indexes,
+capped at each width from 8 (the EIGHT_BIT_PRUNED dictionary) up,
+on pseudo-English text from 1 MB up to largest_benchmark_megabytes.
+*/
+#ifndef largest_benchmark_megabytes
+#define largest_benchmark_megabytes (1)
+#endif
+void
+benchmark_variable_width( void ){
+    printf("benchmarking variable-width indexes ...\n");
+    long megabytes = 1;
+    for( megabytes=1; megabytes<=largest_benchmark_megabytes; megabytes *= 10 ){
+        long length = megabytes * 1000000;
+        char * text = malloc( length + 1 );
+        char * compressed_text = malloc( 5 + (length * max_index_bits + 7) / 8 );
+        char * decompressed_text = malloc( length + 1 );
+        assert( text and compressed_text and decompressed_text );
+        make_sample_text( text, length, megabytes );
+        double eight_bit_ratio = 0;
+        int bits = 8;
+        for( bits=8; bits<=max_index_bits; bits++ ){
+            clock_t start = clock();
+            int compressed_length = compress_bytestring_variable_width(
+                text, compressed_text, bits, CLOCK_PRUNING, context_layout( LOW_5_BIT_CONTEXTS ) );
+            double compress_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+            start = clock();
+            int decompressed_length = decompress_bytestring_variable_width(
+                compressed_text, compressed_length, decompressed_text );
+            double decompress_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+            assert( length == decompressed_length );
+            assert( 0 == memcmp( text, decompressed_text, length ) );
+            double ratio = (double)compressed_length / length;
+            if( 8 == bits ){
+                eight_bit_ratio = ratio;
+            };
+            printf("%4li MB, %2i-bit cap: ratio %5.3f (%+5.1f%% vs 8-bit),"
+                " %6.1f MB/s compress, %6.1f MB/s decompress.\n",
+                megabytes, bits, ratio, 100 * (ratio / eight_bit_ratio - 1),
+                megabytes / compress_seconds, megabytes / decompress_seconds );
+        };
+        free( text );
+        free( compressed_text );
+        free( decompressed_text );
+    };
+}
+
+/*
+Compression ratio of each pruning policy
+on 1 MB of the pseudo-English text,
+and on 1 MB of text whose vocabulary drifts:
+every 100 KB the lowercase letters get a different Caesar shift,
+so the words the dictionaries have learned suddenly stop being useful.
+*/
+void
+benchmark_pruning( void ){
+    printf("benchmarking pruning policies ...\n");
+    const char * policy_names[pruning_policies] = { "clock", "leaf", "reset", "adaptive" };
+    long length = 1000000;
+    char * text = malloc( length + 1 );
+    char * compressed_text = malloc( 5 + (length * max_index_bits + 7) / 8 );
+    char * decompressed_text = malloc( length + 1 );
+    assert( text and compressed_text and decompressed_text );
+    int drifting = 0;
+    for( drifting=0; drifting<2; drifting++ ){
+        make_sample_text( text, length, 1 );
+        long i = 0;
+        for( i=0; drifting and (i < length); i++ ){
+            int shift = 7 * (i / 100000) % 26;
+            if( islower( text[i] ) ){
+                text[i] = 'a' + (text[i] - 'a' + shift) % 26;
+            };
+        };
+        int bits = 8;
+        for( bits=8; bits<=max_index_bits; bits+=max_index_bits-8 ){
+            int policy = 0;
+            for( policy=0; policy<pruning_policies; policy++ ){
+                int compressed_length = compress_bytestring_variable_width(
+                    text, compressed_text, bits, policy, context_layout( LOW_5_BIT_CONTEXTS ) );
+                int decompressed_length = decompress_bytestring_variable_width(
+                    compressed_text, compressed_length, decompressed_text );
+                assert( length == decompressed_length );
+                assert( 0 == memcmp( text, decompressed_text, length ) );
+                printf("%s text, %2i-bit cap, %-8s pruning: ratio %5.3f.\n",
+                    drifting ? "drifting  " : "stationary", bits,
+                    policy_names[policy], (double)compressed_length / length );
+            };
+        };
+    };
+    free( text );
+    free( compressed_text );
+    free( decompressed_text );
+}
+
+/*
+The whole EIGHT_BIT_PRUNED decoder,
+walking the prefix chains
+or copying out of the word buffer
+(keeping it up to date, and falling back to the chains),
+on 100 KB of the pseudo-English text,
+with their running commentary turned off.
+On real text the words are short (about 3 bytes)
+and few of them share letters in the buffer,
+so keeping the buffer up to date
+costs more than walking the chains saves;
+decompress_bytestring() walks the chains.
+*/
+void
+benchmark_byte_decoders( void ){
+    printf("benchmarking the byte decoders ...\n");
+    const int repeats = 20;
+    long length = 100000;
+    static char text[100001];
+    static char compressed_text[100003];
+    static char decompressed_text[100001];
+    static char buffered_text[100001];
+    make_sample_text( text, length, 1 );
+    bytestring_debug_output = false;
+    compress_bytestring( text, compressed_text );
+    clock_t start = clock();
+    int i = 0;
+    for( i=0; i<repeats; i++ ){
+        decompress_bytestring( compressed_text, decompressed_text );
+    };
+    double chain_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for( i=0; i<repeats; i++ ){
+        decompress_bytestring_from_word_buffer( compressed_text, buffered_text );
+    };
+    double buffer_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    bytestring_debug_output = true;
+    assert( 0 == strcmp( text, decompressed_text ) );
+    assert( 0 == strcmp( text, buffered_text ) );
+    printf("bytes: ratio %5.3f, decompress_bytestring() %6.1f MB/s,"
+        " decompress_bytestring_from_word_buffer() %6.1f MB/s.\n",
+        (double)strlen( compressed_text ) / length,
+        length * repeats / chain_seconds / 1e6,
+        length * repeats / buffer_seconds / 1e6 );
+}
+
+/*
+Compression ratio and speed of each context layout,
+at 8-bit and max_index_bits-bit caps,
+on 1 MB of the pseudo-English text,
+grouped by number of contexts (so by RAM):
+the bitmask layouts, the hand-made classes,
+and classes trained on a different 1 MB of the same kind of text.
+*/
+void
+benchmark_contexts( void ){
+    printf("benchmarking context layouts ...\n");
+    long length = 1000000;
+    char * text = malloc( length + 1 );
+    char * compressed_text = malloc( 262 + (length * max_index_bits + 7) / 8 );
+    char * decompressed_text = malloc( length + 1 );
+    assert( text and compressed_text and decompressed_text );
+    static Context_layout_type trained[3];
+    make_sample_text( text, length, 2 );
+    train_context_layout( &trained[0], 5, text, length );
+    train_context_layout( &trained[1], 16, text, length );
+    train_context_layout( &trained[2], 32, text, length );
+    const Context_layout_type * layouts[] = {
+        context_layout( ONE_CONTEXT ),
+        context_layout( LETTER_CONTEXTS ),
+        context_layout( FIVE_CLASS_CONTEXTS ), &trained[0],
+        context_layout( LOW_4_BIT_CONTEXTS ),
+        context_layout( HIGH_BIT_CONTEXTS ),
+        context_layout( SIXTEEN_CLASS_CONTEXTS ), &trained[1],
+        context_layout( LOW_5_BIT_CONTEXTS ),
+        context_layout( THIRTY_TWO_CLASS_CONTEXTS ), &trained[2],
+        context_layout( WHOLE_BYTE_CONTEXTS ),
+    };
+    const char * names[] = {
+        "one context", "letters", "five classes", "trained",
+        "low 4 bits", "high bits", "16 classes", "trained",
+        "low 5 bits", "32 classes", "trained",
+        "whole byte",
+    };
+    make_sample_text( text, length, 1 );
+    int l = 0;
+    for( l=0; l<(int)(sizeof( layouts ) / sizeof( layouts[0] )); l++ ){
+        if( max_contexts < layouts[l]->classes ){
+            printf("%3i contexts, %-12s needs a build with max_contexts %i or more.\n",
+                layouts[l]->classes, names[l], layouts[l]->classes );
+            continue;
+        };
+        int bits = 8;
+        for( bits=8; bits<=max_index_bits; bits+=max_index_bits-8 ){
+            clock_t start = clock();
+            int compressed_length = compress_bytestring_variable_width(
+                text, compressed_text, bits, CLOCK_PRUNING, layouts[l] );
+            double compress_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+            start = clock();
+            int decompressed_length = decompress_bytestring_variable_width(
+                compressed_text, compressed_length, decompressed_text );
+            double decompress_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+            assert( length == decompressed_length );
+            assert( 0 == memcmp( text, decompressed_text, length ) );
+            printf("%3i contexts, %-12s %2i-bit cap: ratio %5.3f,"
+                " %6.1f MB/s compress, %6.1f MB/s decompress.\n",
+                layouts[l]->classes, names[l], bits, (double)compressed_length / length,
+                1 / compress_seconds, 1 / decompress_seconds );
+        };
+    };
+    free( text );
+    free( compressed_text );
+    free( decompressed_text );
+}
+
+/*
+Compress and decompress a record with and without the snapshot,
+adding the compressed lengths to *fresh and *pretrained
+and the time each round trip took to seconds[0] and seconds[1].
+*/
+bool
+round_trip_record(
+    const char * record, int id, long * fresh, long * pretrained, double seconds[2]
+){
+    static char compressed_text[20000];
+    static char decompressed_text[10001];
+    int length = strlen( record );
+    assert( length <= 10000 );
+    clock_t start = clock();
+    int fresh_length = compress_bytestring_variable_width(
+        record, compressed_text, max_index_bits, CLOCK_PRUNING,
+        context_layout( LOW_5_BIT_CONTEXTS ) );
+    bool ok = (length == decompress_bytestring_variable_width(
+        compressed_text, fresh_length, decompressed_text ));
+    ok = ok and (0 == strcmp( record, decompressed_text ));
+    clock_t middle = clock();
+    int pretrained_length = compress_bytestring_with_snapshot(
+        record, compressed_text, id );
+    ok = ok and (length == decompress_bytestring_variable_width(
+        compressed_text, pretrained_length, decompressed_text ));
+    ok = ok and (0 == strcmp( record, decompressed_text ));
+    seconds[0] += (double)(middle - start) / CLOCKS_PER_SEC;
+    seconds[1] += (double)(clock() - middle) / CLOCKS_PER_SEC;
+    *fresh += fresh_length;
+    *pretrained += pretrained_length;
+    return ok;
+}
+
+#define snapshot_filename ("junk_dictionary_snapshot")
+
+/*
+Overwrite an int of the snapshot file at offset,
+try to load it,
+and put the old value back.
+*/
+bool
+corrupted_snapshot_loads( long offset, int value ){
+    FILE * file = fopen( snapshot_filename, "r+b" );
+    assert( file );
+    int old_value = 0;
+    bool ok =
+        (0 == fseek( file, offset, SEEK_SET )) and
+        (1 == fread( &old_value, sizeof( old_value ), 1, file )) and
+        (0 == fseek( file, offset, SEEK_SET )) and
+        (1 == fwrite( &value, sizeof( value ), 1, file ));
+    ok = (0 == fclose( file )) and ok;
+    assert( ok );
+    int id = load_dictionary_snapshot( snapshot_filename );
+    if( 0 <= id ){
+        unload_dictionary_snapshot( id );
+    };
+    file = fopen( snapshot_filename, "r+b" );
+    assert( file );
+    ok =
+        (0 == fseek( file, offset, SEEK_SET )) and
+        (1 == fwrite( &old_value, sizeof( old_value ), 1, file ));
+    ok = (0 == fclose( file )) and ok;
+    assert( ok );
+    return 0 <= id;
+}
+
+void
+test_dictionary_snapshot( void ){
+    printf("testing dictionary snapshots ...\n");
+    static char corpus[200001];
+    static char text[20001];
+    make_sample_text( corpus, 200000, 2 );
+    make_sample_text( text, 20000, 1 );
+    bool ok = save_dictionary_snapshot( snapshot_filename, 7, corpus,
+        max_index_bits, CLOCK_PRUNING, context_layout( LOW_5_BIT_CONTEXTS ) );
+    ok = ok and (7 == load_dictionary_snapshot( snapshot_filename ));
+    long fresh = 0;
+    long pretrained = 0;
+    double seconds[2] = {0, 0};
+    int i = 0;
+    for( i=0; i<100; i++ ){
+        char record[201];
+        memcpy( record, &text[200 * i], 200 );
+        record[200] = '\0';
+        ok = ok and round_trip_record( record, 7, &fresh, &pretrained, seconds );
+    };
+    printf("100 records of 200 bytes: %li bytes from scratch, %li bytes pretrained.\n",
+        fresh, pretrained );
+    ok = ok and (pretrained < fresh / 2);
+    char compressed_text[100];
+    ok = ok and (-1 == compress_bytestring_with_snapshot( "Hello.", compressed_text, 8 ));
+    int length = compress_bytestring_with_snapshot( "Hello.", compressed_text, 7 );
+    unload_dictionary_snapshot( 7 );
+    char decompressed_text[100];
+    ok = ok and (-1 == decompress_bytestring_variable_width(
+        compressed_text, length, decompressed_text ));
+    ok = ok and (-1 == load_dictionary_snapshot( "no such snapshot" ));
+    // a byte in a class the layout doesn't have,
+    // or a context with more words than the index width allows.
+    long class_of = offsetof( Dictionary_snapshot_type, layout.class_of );
+    long pruning = sizeof( Dictionary_snapshot_type ) + num_contexts * sizeof( int );
+    long words = pruning + offsetof( Context_pruning_type, words );
+    long hand = sizeof( Dictionary_snapshot_type );
+    ok = ok and corrupted_snapshot_loads( class_of, 0 );
+    ok = ok and !corrupted_snapshot_loads( class_of, -1 );
+    ok = ok and !corrupted_snapshot_loads( words, dictionary_indexes + 1 );
+    ok = ok and !corrupted_snapshot_loads( hand, -1 );
+    remove( snapshot_filename );
+    if( ok ){
+        printf("Successful test.\n");
+    }else{
+        printf("Error: dictionary snapshots don't work.\n");
+    };
+}
+
+/*
+Compression ratio of short records
+compressed from scratch and from a snapshot
+(trained on a different 1 MB of the same kind of text),
+compared to the last 100 KB of one long 1 MB stream,
+and how fast each kind of record makes the round trip
+(compressed and decompressed),
+counting the time it takes to start the codec for every record.
+*/
+void
+benchmark_dictionary_snapshot( void ){
+    printf("benchmarking dictionary snapshots ...\n");
+    long length = 1000000;
+    char * text = malloc( length + 1 );
+    char * compressed_text = malloc( 5 + (length * max_index_bits + 7) / 8 );
+    assert( text and compressed_text );
+    make_sample_text( text, length, 2 );
+    bool saved = save_dictionary_snapshot( snapshot_filename, 1, text,
+        max_index_bits, CLOCK_PRUNING, context_layout( LOW_5_BIT_CONTEXTS ) );
+    int id = load_dictionary_snapshot( snapshot_filename );
+    assert( saved and (1 == id) );
+    remove( snapshot_filename ); // the mapping stays valid.
+    make_sample_text( text, length, 1 );
+    int record_length = 100;
+    for( record_length=100; record_length<=10000; record_length *= 10 ){
+        char * record = malloc( record_length + 1 );
+        assert( record );
+        long fresh = 0;
+        long pretrained = 0;
+        double seconds[2] = {0, 0};
+        long offset = 0;
+        for( offset=0; offset+record_length<=length; offset+=record_length ){
+            memcpy( record, &text[offset], record_length );
+            record[record_length] = '\0';
+            bool ok = round_trip_record( record, id, &fresh, &pretrained, seconds );
+            assert( ok );
+        };
+        printf("%5i-byte records: ratio %5.3f from scratch, %5.3f pretrained.\n",
+            record_length, (double)fresh / length, (double)pretrained / length );
+        printf("%5i-byte records: round trip %6.2f MB/s from scratch,"
+            " %6.2f MB/s pretrained.\n", record_length,
+            length / seconds[0] / 1e6, length / seconds[1] / 1e6 );
+        free( record );
+    };
+    const Context_layout_type * layout = context_layout( LOW_5_BIT_CONTEXTS );
+    int whole = compress_bytestring_variable_width(
+        text, compressed_text, max_index_bits, CLOCK_PRUNING, layout );
+    text[length - 100000] = '\0';
+    int head = compress_bytestring_variable_width(
+        text, compressed_text, max_index_bits, CLOCK_PRUNING, layout );
+    printf("last 100 KB of a 1 MB stream: ratio %5.3f.\n", (whole - head) / 100000.0 );
+    unload_dictionary_snapshot( id );
+    free( text );
+    free( compressed_text );
+}
+
 int main( void ){
     char compressed_text[1000] = " Hello, world.";
     printf( "%s", compressed_text );
@@ -1809,7 +4614,11 @@ int main( void ){
     printf("testing decompress_bytestring ...\n");
     decompress_bytestring( compressed_text, decompressed_text );
     printf("decompressed: [%s]\n", decompressed_text);
-    if( memcmp( text, decompressed_text, text_length ) ){
+    char buffered_text[100];
+    decompress_bytestring_from_word_buffer( compressed_text, buffered_text );
+    if( memcmp( text, decompressed_text, text_length ) or
+        memcmp( text, buffered_text, text_length )
+    ){
         printf("Error: decompressed text doesn't match original text.\n");
         printf("[%s] original\n", text);
         printf("[%s] decompressed\n", decompressed_text);
@@ -1817,6 +4626,35 @@ int main( void ){
         printf("Successful test.\n");
     };
 
+    /*
+    Runs of a repeated letter or pair
+    make the compressor use a word
+    in the same step that adds it to the dictionary
+    (the LZW special case).
+    */
+    const char * special_cases[] = {
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        "abababababababababababababababababababababababab",
+        "The rain in Spain stays mainly in the plain; the rain in Spain. ",
+    };
+    int special_case = 0;
+    for(; special_case<3; special_case++){
+        const char * special_text = special_cases[special_case];
+        int special_length = strlen( special_text );
+        printf("testing compress_bytestring on [%s] ...\n", special_text);
+        compress_bytestring( special_text, compressed_text );
+        print_as_c_string( compressed_text, strlen(compressed_text) );
+        assert( (int)strlen( compressed_text ) < special_length );
+        decompress_bytestring( compressed_text, decompressed_text );
+        if( strcmp( special_text, decompressed_text ) ){
+            printf("Error: decompressed text doesn't match original text.\n");
+            printf("[%s] original\n", special_text);
+            printf("[%s] decompressed\n", decompressed_text);
+        }else{
+            printf("Successful test.\n");
+        };
+    };
+
 // FIXME: do exhaustive test of both bytestring and nybblestring compression.
 
     test_nybble_compress( text, compressed_text );
@@ -1862,7 +4700,10 @@ int main( void ){
     print_as_c_string( compressed_text, strlen(compressed_text) );
     decompress( compressed_text, decompressed_text );
     printf("decompressed: [%s]\n", decompressed_text);
-    if( memcmp( text, decompressed_text, text_length ) ){
+    decompress_from_word_buffer( compressed_text, buffered_text );
+    if( memcmp( text, decompressed_text, text_length ) or
+        memcmp( text, buffered_text, text_length )
+    ){
         printf("Error: decompressed text doesn't match original text.\n");
         printf("[%s] original\n", text);
         printf("[%s] decompressed\n", decompressed_text);
@@ -1872,6 +4713,17 @@ int main( void ){
 
 
 
+    test_word_buffer();
+    test_word_buffer_decoders();
+    benchmark_word_buffer();
+    benchmark_byte_decoders();
+    test_variable_width();
+    benchmark_variable_width();
+    benchmark_pruning();
+    benchmark_contexts();
+    test_dictionary_snapshot();
+    benchmark_dictionary_snapshot();
+
     return 0;
 }
 